@@ -1,6 +1,7 @@
 #pragma once
 #include "types.h"
 #include "cave_math.h"
+#include "governor.h"
 
 enum key_t {
   KEY_A = 0,
@@ -198,5 +199,10 @@ typedef struct app_t {
   mouse_t mouse;
   f32 render_scale;
   bool show_frame_times;
+
+  // Time the last finished frame took, GPU time on macOS and CPU render time
+  // on Linux. Zero until there is one.
+  f32 frame_ms;
+  resolution_governor_t governor;
 } app_t;
 
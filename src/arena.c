@@ -0,0 +1,143 @@
+#include <sys/mman.h>
+#include "arena.h"
+
+//
+// Memory arenas.
+// Growable arenas reserve their whole range up front with PROT_NONE and make
+// it readable and writable ARENA_COMMIT_SIZE at a time, so pointers stay put
+// as they grow and the range costs nothing until it's touched.
+//
+
+static _Thread_local memory_arena_t scratch_arenas[SCRATCH_ARENA_COUNT];
+static atomic_size_t scratch_high_water;
+
+static inline usize arena_align_up(usize value, usize alignment) {
+  return (value + alignment-1) & ~(alignment-1);
+}
+
+// A growable arena of up to reserve bytes.
+static bool 
+init_virtual_arena(memory_arena_t* arena, usize reserve) {
+  *arena = (memory_arena_t){0};
+  reserve = arena_align_up(reserve, ARENA_COMMIT_SIZE);
+  void* base = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    printf("ERROR: failed to reserve %zu bytes for an arena\n", reserve);
+    return false;
+  }
+  arena->base = (u8*)base;
+  arena->reserved = reserve;
+  return true;
+}
+
+static void 
+free_arena(memory_arena_t* arena) {
+  if (arena->reserved) {
+    munmap(arena->base, arena->reserved);
+  }
+  *arena = (memory_arena_t){0};
+}
+
+static void 
+reset_arena(memory_arena_t* arena) {
+  arena->used = 0;
+}
+
+// Hands the committed pages past max(used, keep) back to the OS.
+static void 
+trim_arena(memory_arena_t* arena, usize keep) {
+  if (!arena->reserved) {
+    return;
+  }
+  usize size = arena_align_up(arena->used > keep ? arena->used : keep, ARENA_COMMIT_SIZE);
+  if (size < arena->size) {
+    madvise(arena->base + size, arena->size - size, MADV_DONTNEED);
+    mprotect(arena->base + size, arena->size - size, PROT_NONE);
+    arena->size = size;
+  }
+}
+
+static bool 
+arena_commit(memory_arena_t* arena, usize size) {
+  size = arena_align_up(size, ARENA_COMMIT_SIZE);
+  if (!arena->reserved || size > arena->reserved) {
+    return false;
+  }
+  if (mprotect(arena->base + arena->size, size - arena->size, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+  arena->size = size;
+  return true;
+}
+
+// alignment must be a power of two. NULL past the reserve, or on an arena
+// with none.
+static void* 
+push_size_aligned(memory_arena_t* arena, usize size, usize alignment) {
+  usize start = arena_align_up((usize)arena->base + arena->used, alignment) - (usize)arena->base;
+  usize end = start + size;
+  if (end > arena->size && !arena_commit(arena, end)) {
+    printf("ERROR: arena out of memory, %zu of %zu bytes used, %zu more asked for\n",
+      arena->used, arena->reserved ? arena->reserved : arena->size, size);
+    return NULL;
+  }
+
+  arena->used = end;
+  if (end > arena->high_water) {
+    arena->high_water = end;
+  }
+  return arena->base + start;
+}
+
+static arena_temp_t 
+begin_temp(memory_arena_t* arena) {
+  return (arena_temp_t){arena, arena->used};
+}
+
+static void 
+end_temp(arena_temp_t temp) {
+  temp.arena->used = temp.used;
+}
+
+//
+// Scratch
+//
+
+// A temp on one of the calling thread's scratch arenas, whichever isn't
+// conflict. Pass the arena the caller is building its result in, when that
+// may itself be scratch, so the two never alias.
+static arena_temp_t 
+begin_scratch(const memory_arena_t* conflict) {
+  memory_arena_t* arena = &scratch_arenas[0];
+  if (arena == conflict) {
+    arena = &scratch_arenas[1];
+  }
+  if (!arena->reserved && !init_virtual_arena(arena, SCRATCH_ARENA_RESERVE)) {
+    // Pushes fail on the empty arena instead.
+    *arena = (memory_arena_t){0};
+  }
+  return begin_temp(arena);
+}
+
+static void 
+end_scratch(arena_temp_t temp) {
+  usize high_water = atomic_load_explicit(&scratch_high_water, memory_order_relaxed);
+  while (temp.arena->high_water > high_water &&
+      !atomic_compare_exchange_weak_explicit(&scratch_high_water, &high_water, temp.arena->high_water, memory_order_relaxed, memory_order_relaxed)) {
+  }
+  end_temp(temp);
+}
+
+// Releases the calling thread's scratch arenas, before it exits.
+static void 
+free_scratch_arenas(void) {
+  for (int i=0; i < SCRATCH_ARENA_COUNT; i++) {
+    free_arena(&scratch_arenas[i]);
+  }
+}
+
+// Most any thread's scratch arena has held at once.
+static usize 
+scratch_arena_high_water(void) {
+  return atomic_load_explicit(&scratch_high_water, memory_order_relaxed);
+}
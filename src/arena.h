@@ -0,0 +1,36 @@
+#pragma once
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "types.h"
+
+#define kilobytes(value) ((value)*1024LL)
+#define megabytes(value) (kilobytes(value)*1024LL)
+#define gigabytes(value) (megabytes(value)*1024LL)
+
+// Growable arenas commit their reserve this much at a time.
+#define ARENA_COMMIT_SIZE kilobytes(64)
+
+// Per thread, so a function can build its result in one while working in the
+// other. Only address space until something is pushed.
+#define SCRATCH_ARENA_COUNT 2
+#define SCRATCH_ARENA_RESERVE gigabytes(1)
+
+// Bump allocator over address space it reserved itself and commits as it
+// fills up. Memory that was used before isn't cleared.
+typedef struct memory_arena_t {
+  u8* base;
+  usize size;       // usable bytes, the committed part of a reserve
+  usize reserved;   // 0 if the reserve failed, every push fails
+  usize used;
+  usize high_water; // most ever used
+} memory_arena_t;
+
+// Everything pushed after begin_temp is freed by end_temp. Temps on the same
+// arena have to end in the reverse order they began.
+typedef struct arena_temp_t {
+  memory_arena_t* arena;
+  usize used;
+} arena_temp_t;
+
+#define push_struct(arena, type) ((type*)push_size_aligned((arena), sizeof(type), alignof(type)))
+#define push_array(arena, type, count) ((type*)push_size_aligned((arena), sizeof(type)*(usize)(count), alignof(type)))
@@ -0,0 +1,186 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "asset_io.h"
+
+//
+// File loading.
+// Files are mapped read only instead of read into the heap, so loading costs
+// one syscall whatever the size, and pages come in on first touch straight
+// from the page cache. Prefetching asks the kernel to start reading ahead,
+// and the I/O thread can do the whole map and fault in off the caller's
+// thread, calling back once the data is resident.
+//
+
+static void asset_read_ahead(int fd, usize size) {
+#if defined(__APPLE__)
+  struct radvisory ra = {0, size < INT32_MAX ? (int)size : INT32_MAX};
+  fcntl(fd, F_RDADVISE, &ra);
+#else
+  posix_fadvise(fd, 0, (off_t)size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+// Empty files map to a view with no data.
+static bool map_asset(const char* path, u32 flags, asset_view_t* view) {
+  *view = (asset_view_t){0};
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    printf("ERROR: Cannot map %s, it isn't a regular file.\n", path);
+    close(fd);
+    return false;
+  }
+  usize size = (usize)st.st_size;
+  if (size == 0) {
+    close(fd);
+    return true;
+  }
+
+  if (flags & (ASSET_MAP_PREFETCH | ASSET_MAP_POPULATE)) {
+    asset_read_ahead(fd, size);
+  }
+  int map_flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+  if (flags & ASSET_MAP_POPULATE) {
+    map_flags |= MAP_POPULATE;
+  }
+#endif
+  void* data = mmap(NULL, size, PROT_READ, map_flags, fd, 0);
+  // The mapping keeps the file alive.
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("ERROR: Cannot map %s: %s.\n", path, strerror(errno));
+    return false;
+  }
+
+  if (flags & ASSET_MAP_SEQUENTIAL) {
+    madvise(data, size, MADV_SEQUENTIAL);
+  } else if (flags & ASSET_MAP_RANDOM) {
+    madvise(data, size, MADV_RANDOM);
+  }
+  if (flags & ASSET_MAP_PREFETCH) {
+    madvise(data, size, MADV_WILLNEED);
+  }
+#if !defined(MAP_POPULATE)
+  if (flags & ASSET_MAP_POPULATE) {
+    long page = sysconf(_SC_PAGESIZE);
+    volatile const u8* bytes = (const u8*)data;
+    for (usize i=0; i < size; i += (usize)page) (void)bytes[i];
+  }
+#endif
+  view->data = (const u8*)data;
+  view->size = size;
+  return true;
+}
+
+static void unmap_asset(asset_view_t* view) {
+  if (view->data) {
+    munmap((void*)view->data, view->size);
+  }
+  *view = (asset_view_t){0};
+}
+
+//
+// I/O thread
+//
+
+static void* asset_io_thread_main(void* data) {
+  asset_io_t* io = (asset_io_t*)data;
+  pthread_mutex_lock(&io->lock);
+  for (;;) {
+    while (!io->first && !io->quit) {
+      pthread_cond_wait(&io->wake, &io->lock);
+    }
+    if (!io->first) {
+      break;
+    }
+    asset_request_t* request = io->first;
+    io->first = request->next;
+    if (!io->first) {
+      io->last = NULL;
+    }
+    pthread_mutex_unlock(&io->lock);
+
+    u64 start = profiler_ticks_ns();
+    request->ok = map_asset(request->path, request->flags, &request->view);
+    request->ms = (f64)(profiler_ticks_ns() - start) / 1e6;
+    if (request->done) {
+      request->done(request);
+    }
+
+    pthread_mutex_lock(&io->lock);
+    atomic_store_explicit(&request->finished, true, memory_order_release);
+    pthread_cond_broadcast(&io->finished);
+  }
+  pthread_mutex_unlock(&io->lock);
+  return NULL;
+}
+
+static bool init_asset_io(asset_io_t* io) {
+  memset(io, 0, sizeof(*io));
+  pthread_mutex_init(&io->lock, NULL);
+  pthread_cond_init(&io->wake, NULL);
+  pthread_cond_init(&io->finished, NULL);
+  if (pthread_create(&io->thread, NULL, asset_io_thread_main, io) != 0) {
+    printf("ERROR: Cannot start the asset I/O thread.\n");
+    return false;
+  }
+  io->running = true;
+  return true;
+}
+
+// Finishes the requests already submitted first.
+static void shutdown_asset_io(asset_io_t* io) {
+  if (io->running) {
+    pthread_mutex_lock(&io->lock);
+    io->quit = true;
+    pthread_cond_broadcast(&io->wake);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread, NULL);
+  }
+  pthread_cond_destroy(&io->finished);
+  pthread_cond_destroy(&io->wake);
+  pthread_mutex_destroy(&io->lock);
+  memset(io, 0, sizeof(*io));
+}
+
+// Requests run in the order they're submitted. The view is the caller's to
+// unmap once the request is finished.
+static void submit_asset_request(asset_io_t* io, asset_request_t* request) {
+  request->view = (asset_view_t){0};
+  request->ok = false;
+  request->next = NULL;
+  atomic_store_explicit(&request->finished, false, memory_order_relaxed);
+
+  pthread_mutex_lock(&io->lock);
+  if (io->last) {
+    io->last->next = request;
+  } else {
+    io->first = request;
+  }
+  io->last = request;
+  pthread_cond_signal(&io->wake);
+  pthread_mutex_unlock(&io->lock);
+}
+
+static bool asset_request_finished(const asset_request_t* request) {
+  return atomic_load_explicit(&request->finished, memory_order_acquire);
+}
+
+// Returns request->ok.
+static bool wait_asset_request(asset_io_t* io, asset_request_t* request) {
+  if (!asset_request_finished(request)) {
+    pthread_mutex_lock(&io->lock);
+    while (!asset_request_finished(request)) {
+      pthread_cond_wait(&io->finished, &io->lock);
+    }
+    pthread_mutex_unlock(&io->lock);
+  }
+  return request->ok;
+}
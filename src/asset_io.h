@@ -0,0 +1,49 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+
+// How a mapping is going to be read, see map_asset.
+#define ASSET_MAP_SEQUENTIAL 0x1 // read front to back, read ahead aggressively
+#define ASSET_MAP_RANDOM     0x2 // jumped around in, don't read ahead
+#define ASSET_MAP_PREFETCH   0x4 // start reading the whole file in now
+#define ASSET_MAP_POPULATE   0x8 // fault the whole file in before returning
+
+// A read only, zero-copy view of a whole file. data stays valid until
+// unmap_asset, and nothing may write through it.
+typedef struct asset_view_t {
+  const u8* data;
+  usize size;
+} asset_view_t;
+
+typedef struct asset_request_t asset_request_t;
+typedef void asset_request_done_func_t(asset_request_t* request);
+
+// Filled in by the caller, which owns it until it's finished.
+struct asset_request_t {
+  const char* path;
+  u32 flags;
+  asset_request_done_func_t* done; // optional, called on the I/O thread
+  void* user;
+
+  // Set by the I/O thread before done is called.
+  asset_view_t view;
+  bool ok;
+  f64 ms;
+  atomic_bool finished;
+  asset_request_t* next;
+};
+
+// One thread that maps requested files and faults them in, so the first
+// touch on the calling side doesn't wait on the disk.
+typedef struct asset_io_t {
+  pthread_t thread;
+  bool running;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t finished;
+  asset_request_t* first;
+  asset_request_t* last;
+  bool quit;
+} asset_io_t;
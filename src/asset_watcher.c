@@ -0,0 +1,228 @@
+#include "asset_watcher.h"
+
+//
+// Asset hot reloading for Linux.
+// A watcher thread blocks on inotify and queues the assets whose files were
+// written. A loader thread loads them off the frame and leaves the result in
+// the asset's ready slot, and the frame loop swaps it in at a frame boundary
+// with take_reloaded_asset, one atomic exchange. Directories are watched
+// rather than files, so editors that save by renaming over the file work.
+//
+
+static bool
+asset_queue_push(asset_queue_t* q, u32 item) {
+  u32 head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  u32 tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head - tail >= ASSET_QUEUE_CAPACITY) {
+    return false;
+  }
+  q->items[head & (ASSET_QUEUE_CAPACITY-1)] = item;
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return true;
+}
+
+static bool
+asset_queue_pop(asset_queue_t* q, u32* item) {
+  u32 tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  u32 head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (tail == head) {
+    return false;
+  }
+  *item = q->items[tail & (ASSET_QUEUE_CAPACITY-1)];
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+static bool
+init_asset_watcher(asset_watcher_t* w) {
+  memset(w, 0, sizeof(*w));
+  w->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (w->inotify_fd < 0) {
+    printf("ERROR: inotify_init1 failed: %s.\n", strerror(errno));
+    return false;
+  }
+  w->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (w->wake_fd < 0) {
+    printf("ERROR: eventfd failed: %s.\n", strerror(errno));
+    close(w->inotify_fd);
+    return false;
+  }
+  pthread_mutex_init(&w->load_lock, NULL);
+  pthread_cond_init(&w->load_wake, NULL);
+  return true;
+}
+
+// Call before start_asset_watcher. Returns the asset's index, or -1.
+static int
+watch_asset(asset_watcher_t* w, asset_type_t type, const char* path, asset_load_func_t* load, asset_free_func_t* free_asset) {
+  if (w->asset_count == ASSET_WATCH_MAX || strlen(path) >= ASSET_PATH_MAX) {
+    printf("ERROR: Cannot watch %s.\n", path);
+    return -1;
+  }
+  watched_asset_t* a = &w->assets[w->asset_count];
+  snprintf(a->path, sizeof(a->path), "%s", path);
+
+  char dir[ASSET_PATH_MAX];
+  char* slash = strrchr(a->path, '/');
+  if (slash) {
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - a->path) + 1, a->path);
+    a->name = slash + 1;
+  } else {
+    snprintf(dir, sizeof(dir), ".");
+    a->name = a->path;
+  }
+  a->wd = inotify_add_watch(w->inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (a->wd < 0) {
+    printf("ERROR: Cannot watch %s: %s.\n", dir, strerror(errno));
+    return -1;
+  }
+  a->type = type;
+  a->load = load;
+  a->free = free_asset;
+  return w->asset_count++;
+}
+
+static void
+asset_watcher_queue(asset_watcher_t* w, int index) {
+  watched_asset_t* a = &w->assets[index];
+  // A save is often several events, one reload covers them all.
+  if (atomic_exchange_explicit(&a->queued, true, memory_order_acq_rel)) {
+    return;
+  }
+  asset_queue_push(&w->queue, (u32)index);
+  pthread_mutex_lock(&w->load_lock);
+  pthread_cond_signal(&w->load_wake);
+  pthread_mutex_unlock(&w->load_lock);
+}
+
+static void*
+asset_watch_thread_main(void* data) {
+  asset_watcher_t* w = (asset_watcher_t*)data;
+  alignas(struct inotify_event) char buffer[4096];
+  struct pollfd fds[2] = {
+    {w->inotify_fd, POLLIN, 0},
+    {w->wake_fd, POLLIN, 0},
+  };
+
+  while (!atomic_load_explicit(&w->quit, memory_order_acquire)) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    ssize_t size;
+    while ((size = read(w->inotify_fd, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + size;) {
+        const struct inotify_event* e = (const struct inotify_event*)p;
+        for (int i=0; i < w->asset_count && e->len; i++) {
+          if (w->assets[i].wd == e->wd && strcmp(w->assets[i].name, e->name) == 0) {
+            asset_watcher_queue(w, i);
+          }
+        }
+        p += sizeof(struct inotify_event) + e->len;
+      }
+    }
+  }
+  return NULL;
+}
+
+static void*
+asset_load_thread_main(void* data) {
+  asset_watcher_t* w = (asset_watcher_t*)data;
+  for (;;) {
+    u32 index;
+    if (!asset_queue_pop(&w->queue, &index)) {
+      pthread_mutex_lock(&w->load_lock);
+      while (!atomic_load_explicit(&w->quit, memory_order_acquire) &&
+             atomic_load_explicit(&w->queue.head, memory_order_acquire) == atomic_load_explicit(&w->queue.tail, memory_order_relaxed)) {
+        pthread_cond_wait(&w->load_wake, &w->load_lock);
+      }
+      pthread_mutex_unlock(&w->load_lock);
+      if (atomic_load_explicit(&w->quit, memory_order_acquire)) {
+        break;
+      }
+      continue;
+    }
+
+    watched_asset_t* a = &w->assets[index];
+    // Cleared first, so a save that lands mid load queues another one.
+    atomic_store_explicit(&a->queued, false, memory_order_release);
+    void* asset = a->load(a->path);
+    if (!asset) {
+      atomic_fetch_add_explicit(&a->failures, 1, memory_order_relaxed);
+      printf("%s: %s didn't load, keeping the old one\n", asset_type_names[a->type], a->path);
+      continue;
+    }
+    void* stale = atomic_exchange_explicit(&a->ready, asset, memory_order_acq_rel);
+    if (stale) {
+      a->free(stale);
+    }
+    atomic_fetch_add_explicit(&a->reloads, 1, memory_order_relaxed);
+  }
+  free_scratch_arenas();
+  return NULL;
+}
+
+static void
+stop_asset_threads(asset_watcher_t* w) {
+  atomic_store_explicit(&w->quit, true, memory_order_release);
+  u64 one = 1;
+  if (write(w->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+    printf("ERROR: Cannot wake the asset watcher.\n");
+  }
+  pthread_mutex_lock(&w->load_lock);
+  pthread_cond_broadcast(&w->load_wake);
+  pthread_mutex_unlock(&w->load_lock);
+}
+
+static bool
+start_asset_watcher(asset_watcher_t* w) {
+  if (pthread_create(&w->watch_thread, NULL, asset_watch_thread_main, w) != 0) {
+    printf("ERROR: Cannot start the asset watcher.\n");
+    return false;
+  }
+  if (pthread_create(&w->load_thread, NULL, asset_load_thread_main, w) != 0) {
+    printf("ERROR: Cannot start the asset loader.\n");
+    stop_asset_threads(w);
+    pthread_join(w->watch_thread, NULL);
+    return false;
+  }
+  w->running = true;
+  return true;
+}
+
+// Frame boundary. The asset loaded since the last call, or NULL. The caller
+// owns it from here and frees whatever it replaces.
+static void*
+take_reloaded_asset(asset_watcher_t* w, int index) {
+  if (index < 0) {
+    return NULL;
+  }
+  watched_asset_t* a = &w->assets[index];
+  if (!atomic_load_explicit(&a->ready, memory_order_relaxed)) {
+    return NULL;
+  }
+  return atomic_exchange_explicit(&a->ready, NULL, memory_order_acquire);
+}
+
+static void
+shutdown_asset_watcher(asset_watcher_t* w) {
+  if (w->running) {
+    stop_asset_threads(w);
+    pthread_join(w->watch_thread, NULL);
+    pthread_join(w->load_thread, NULL);
+  }
+  for (int i=0; i < w->asset_count; i++) {
+    void* ready = atomic_exchange(&w->assets[i].ready, NULL);
+    if (ready) {
+      w->assets[i].free(ready);
+    }
+  }
+  pthread_cond_destroy(&w->load_wake);
+  pthread_mutex_destroy(&w->load_lock);
+  close(w->wake_fd);
+  close(w->inotify_fd);
+  memset(w, 0, sizeof(*w));
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "types.h"
+
+#define ASSET_WATCH_MAX 16
+// Must be a power of two. Every asset is queued at most once at a time, so
+// this only has to beat ASSET_WATCH_MAX.
+#define ASSET_QUEUE_CAPACITY 32
+#define ASSET_PATH_MAX 512
+
+typedef enum asset_type_t {
+  ASSET_SCENE,
+  ASSET_SDF_PROGRAM,
+  ASSET_SHADER_LIBRARY,
+  ASSET_TYPE_COUNT
+} asset_type_t;
+
+static const char* asset_type_names[ASSET_TYPE_COUNT] = {
+  "scene",
+  "sdf program",
+  "shader library",
+};
+
+// Runs on the loader thread. Returns the new asset, or NULL if the file
+// doesn't load, in which case the old one stays.
+typedef void* asset_load_func_t(const char* path);
+typedef void asset_free_func_t(void* asset);
+
+typedef struct watched_asset_t {
+  asset_type_t type;
+  char path[ASSET_PATH_MAX];
+  const char* name; // the file name part of path
+  int wd;
+  asset_load_func_t* load;
+  asset_free_func_t* free;
+
+  atomic_bool queued;
+  // Loaded and waiting to be taken at a frame boundary.
+  _Atomic(void*) ready;
+  atomic_uint reloads;
+  atomic_uint failures;
+} watched_asset_t;
+
+// Single producer, single consumer ring of asset indices, from the watcher
+// thread to the loader thread.
+typedef struct asset_queue_t {
+  alignas(64) atomic_uint head;
+  alignas(64) atomic_uint tail;
+  u32 items[ASSET_QUEUE_CAPACITY];
+} asset_queue_t;
+
+// Nothing here blocks or makes a syscall on the frame's side, the frame loop
+// only ever calls take_reloaded_asset.
+typedef struct asset_watcher_t {
+  int inotify_fd;
+  int wake_fd; // an eventfd, written to stop the watcher thread
+  pthread_t watch_thread;
+  pthread_t load_thread;
+  bool running;
+
+  watched_asset_t assets[ASSET_WATCH_MAX];
+  int asset_count;
+
+  asset_queue_t queue;
+  atomic_bool quit;
+  pthread_mutex_t load_lock; // only for the loader to sleep on
+  pthread_cond_t load_wake;
+} asset_watcher_t;
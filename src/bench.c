@@ -0,0 +1,784 @@
+#include "bench.h"
+
+//
+// Render benchmark suite, see bench.h.
+// Renders every CPU pipeline and scene at every size along the same camera
+// path, with its own app, world and renderer so nothing carries over between
+// cases. Results go to stdout and optionally to JSON lines that a later run
+// can be compared against.
+//
+
+typedef enum bench_sphere_scene_t {
+  BENCH_SPHERES_DEFAULT,
+  BENCH_SPHERES_1K,
+  BENCH_SPHERES_COUNT,
+} bench_sphere_scene_t;
+
+static const char* bench_sphere_scene_names[BENCH_SPHERES_COUNT] = {
+  "default",
+  "spheres_1k",
+};
+
+static bool parse_bench_sizes(const char* text, bench_config_t* config) {
+  config->size_count = 0;
+  while (*text) {
+    bench_size_t size;
+    int used = 0;
+    if (config->size_count == BENCH_MAX_SIZES ||
+        sscanf(text, "%dx%d%n", &size.width, &size.height, &used) != 2 ||
+        size.width < 1 || size.height < 1) {
+      return false;
+    }
+    config->sizes[config->size_count++] = size;
+    text += used;
+    if (*text == ',') text++;
+  }
+  return config->size_count > 0;
+}
+
+static void bench_default_config(bench_config_t* config) {
+  memset(config, 0, sizeof(*config));
+  config->frames = 8;
+  config->sizes[0] = (bench_size_t){320, 180};
+  config->sizes[1] = (bench_size_t){640, 360};
+  config->size_count = 2;
+}
+
+static bench_result_t run_bench_case(const bench_config_t* config, cpu_renderer_t* renderer, const char* scene_name, int sdf_preset, bench_size_t size) {
+  app_t bench_app = {0};
+  world_t bench_world = {0};
+  fs_params_t params = {0};
+  v2 window = V2(size.width, size.height);
+  bench_app.window.size_in_pixels = window;
+  bench_app.window.size_in_points = window;
+  bench_app.display.size_in_pixels = window;
+  bench_app.display.size_in_points = window;
+  bench_app.render_scale = 1.0f;
+  init_world(&bench_app, &bench_world);
+  if (sdf_preset >= 0) {
+    bench_world.sdf_scene = sdf_preset;
+  }
+
+  input_log_t path = {0};
+  if (config->path) {
+    begin_input_replay(&path, config->path);
+  }
+
+  render_target_t target = {0};
+  target.width = size.width;
+  target.height = size.height;
+  target.stride = size.width;
+  target.pixels = aligned_alloc(64, aligned_size(sizeof(u32) * size.width * size.height));
+
+  bench_result_t result = {0};
+  result.pipeline = render_pipeline_names[renderer->pipeline];
+  result.scene = scene_name;
+  result.width = size.width;
+  result.height = size.height;
+  result.min_ms = INFINITY;
+
+  render_stats_t total = {0};
+  for (u32 frame=0; frame < BENCH_WARMUP_FRAMES + config->frames; frame++) {
+    if (path.file) {
+      if (!replay_input_frame(&path, &bench_app)) break;
+    } else {
+      update_button(&bench_app.keys[KEY_RIGHT], true);
+      bench_app.clocks.delta_secs = BENCH_ORBIT_DT;
+    }
+    bench_app.clocks.frame_count++;
+
+    update_and_render(&bench_app, &bench_world, &params.debug_params);
+    update_render_camera(&bench_world.camera, aspect2(window), &params.camera);
+    params.frame_count = bench_app.clocks.frame_count;
+    params.viewport_size.x = window.x;
+    params.viewport_size.y = window.y;
+
+    render_stats_t stats = cpu_render_frame(renderer, target, &params);
+    for (int i=0; i < NUMBER_OF_KEYS; i++) {
+      reset_button(&bench_app.keys[i]);
+    }
+    if (frame < BENCH_WARMUP_FRAMES) continue;
+
+    f64 ms = (f64)stats.elapsed_ns / 1e6;
+    if (ms < result.min_ms) result.min_ms = ms;
+    total.rays += stats.rays;
+    total.bvh_steps += stats.bvh_steps;
+    total.sphere_tests += stats.sphere_tests;
+    total.march_steps += stats.march_steps;
+    total.scene_evals += stats.scene_evals;
+    total.pixels += stats.pixels;
+    total.elapsed_ns += stats.elapsed_ns;
+    result.frames++;
+  }
+  end_input_log(&path);
+  free(target.pixels);
+
+  if (result.frames) {
+    f64 secs = (f64)total.elapsed_ns / 1e9;
+    result.ms_per_frame = secs * 1000.0 / (f64)result.frames;
+    result.mrays_per_sec = (f64)total.rays / secs / 1e6;
+    result.steps_per_pixel = (f64)total.march_steps / (f64)total.pixels;
+    result.evals_per_pixel = (f64)total.scene_evals / (f64)total.pixels;
+    result.nodes_per_ray = total.rays ? (f64)total.bvh_steps / (f64)total.rays : 0;
+    result.spheres_per_ray = total.rays ? (f64)total.sphere_tests / (f64)total.rays : 0;
+  } else {
+    result.min_ms = 0;
+  }
+  return result;
+}
+
+static void write_bench_result(FILE* f, const bench_result_t* r, int threads, int lanes) {
+  fprintf(f, "{\"pipeline\":\"%s\",\"scene\":\"%s\",\"width\":%d,\"height\":%d,\"threads\":%d,\"simd\":%d,\"frames\":%u,"
+    "\"ms_per_frame\":%0.4f,\"min_ms\":%0.4f,\"mrays_per_sec\":%0.4f,\"march_steps_per_pixel\":%0.4f,"
+    "\"scene_evals_per_pixel\":%0.4f,\"bvh_nodes_per_ray\":%0.4f,\"spheres_per_ray\":%0.4f}\n",
+    r->pipeline, r->scene, r->width, r->height, threads, lanes, r->frames,
+    r->ms_per_frame, r->min_ms, r->mrays_per_sec, r->steps_per_pixel,
+    r->evals_per_pixel, r->nodes_per_ray, r->spheres_per_ray);
+}
+
+// Just enough JSON to read back what write_bench_result wrote.
+static bool bench_json_string(const char* line, const char* key, char* out, int size) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+  const char* p = strstr(line, pattern);
+  if (!p) return false;
+  p += strlen(pattern);
+  int n = 0;
+  while (*p && *p != '"' && n < size-1) out[n++] = *p++;
+  out[n] = 0;
+  return true;
+}
+
+static f64 bench_json_number(const char* line, const char* key) {
+  char pattern[64];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* p = strstr(line, pattern);
+  return p ? strtod(p + strlen(pattern), NULL) : NAN;
+}
+
+// ms/frame of the same case in an earlier run, NAN if it isn't there.
+static f64 find_bench_baseline(FILE* baseline, const bench_result_t* r) {
+  char line[1024];
+  rewind(baseline);
+  while (fgets(line, sizeof(line), baseline)) {
+    char pipeline[64], scene[64];
+    if (bench_json_string(line, "pipeline", pipeline, sizeof(pipeline)) &&
+        bench_json_string(line, "scene", scene, sizeof(scene)) &&
+        strcmp(pipeline, r->pipeline) == 0 && strcmp(scene, r->scene) == 0 &&
+        (int)bench_json_number(line, "width") == r->width &&
+        (int)bench_json_number(line, "height") == r->height) {
+      return bench_json_number(line, "ms_per_frame");
+    }
+  }
+  return NAN;
+}
+
+static bool run_benchmarks(const bench_config_t* config) {
+  FILE* out = NULL;
+  FILE* baseline = NULL;
+  if (config->output_path && !(out = fopen(config->output_path, "w"))) {
+    printf("ERROR: Cannot open file %s.\n", config->output_path);
+    return false;
+  }
+  if (config->baseline_path && !(baseline = fopen(config->baseline_path, "r"))) {
+    printf("ERROR: Cannot open file %s.\n", config->baseline_path);
+    if (out) fclose(out);
+    return false;
+  }
+
+  job_system_t bench_jobs;
+  init_job_system(&bench_jobs, config->thread_count);
+
+  sphere_scene_t spheres[BENCH_SPHERES_COUNT] = {0};
+  init_default_scene(&spheres[BENCH_SPHERES_DEFAULT], SPHERE_LANES);
+  generate_sphere_scene(&spheres[BENCH_SPHERES_1K], 1000, 1, SPHERE_LANES);
+
+  sdf_graph_t graph;
+  sdf_program_t programs[SDF_PRESET_COUNT];
+  for (int i=0; i < SDF_PRESET_COUNT; i++) {
+    sdf_build_preset(&graph, (sdf_preset_t)i);
+    compile_sdf_graph(&graph, &programs[i]);
+  }
+
+  printf("bench: %d threads, %u frames per case along %s\n",
+    bench_jobs.thread_count, config->frames, config->path ? config->path : "the built in orbit");
+  printf("  %-12s %-13s %-9s %9s %9s %9s %9s %9s %9s %9s\n",
+    "pipeline", "scene", "size", "ms/frame", "min ms", "Mrays/s", "steps/px", "evals/px", "nodes/ray", "baseline");
+
+  for (int p=0; p < RENDER_PIPELINE_COUNT; p++) {
+    int scene_count = p == RENDER_PIPELINE_RAY_MARCHER ? SDF_PRESET_COUNT : BENCH_SPHERES_COUNT;
+    for (int s=0; s < scene_count; s++) {
+      for (int z=0; z < config->size_count; z++) {
+        cpu_renderer_t r;
+        init_cpu_renderer(&r, &bench_jobs);
+        r.pipeline = (render_pipeline_t)p;
+        if (config->scalar) r.use_packets = false;
+
+        bench_result_t result;
+        if (p == RENDER_PIPELINE_RAY_MARCHER) {
+          r.sdf_program = &programs[s];
+          result = run_bench_case(config, &r, sdf_preset_names[s], s, config->sizes[z]);
+        } else {
+          r.scene = &spheres[s];
+          result = run_bench_case(config, &r, bench_sphere_scene_names[s], -1, config->sizes[z]);
+        }
+        int lanes = p != RENDER_PIPELINE_RAY_MARCHER ? SPHERE_LANES : r.use_packets ? PACKET_WIDTH : 1;
+        shutdown_cpu_renderer(&r);
+
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", result.width, result.height);
+        char change[32] = "";
+        f64 old_ms = baseline ? find_bench_baseline(baseline, &result) : NAN;
+        if (!isnan(old_ms) && old_ms > 0) {
+          snprintf(change, sizeof(change), "%+0.1f%%", 100.0 * (result.ms_per_frame / old_ms - 1.0));
+        }
+        printf("  %-12s %-13s %-9s %9.3f %9.3f %9.2f %9.2f %9.2f %9.2f %9s\n",
+          result.pipeline, result.scene, size, result.ms_per_frame, result.min_ms,
+          result.mrays_per_sec, result.steps_per_pixel, result.evals_per_pixel, result.nodes_per_ray, change);
+        if (out) {
+          write_bench_result(out, &result, bench_jobs.thread_count, lanes);
+        }
+      }
+    }
+  }
+
+  for (int i=0; i < BENCH_SPHERES_COUNT; i++) {
+    free_sphere_scene(&spheres[i]);
+  }
+  shutdown_job_system(&bench_jobs);
+  if (baseline) fclose(baseline);
+  if (out) {
+    fclose(out);
+    printf("wrote %s\n", config->output_path);
+  }
+  return true;
+}
+
+//
+// -bench-math: error of the cave_fast_math.h approximations against libm's
+// double versions over their documented ranges, and their speed against
+// libm's float ones. Fails if any error is over its bound.
+//
+
+#define MATH_BENCH_SAMPLES (1 << 21) // per sign, stepping through bit patterns
+#define MATH_BENCH_VALUES 4096
+#define MATH_BENCH_REPEATS 256
+
+typedef enum math_error_t {
+  MATH_ERROR_ABSOLUTE,
+  MATH_ERROR_RELATIVE,
+  // Relative, over max(1, |ln result|). exp(y*log(x)) scales the rounding
+  // of y*log(x) by its size, so pow can't do better than this in f32.
+  MATH_ERROR_POW,
+} math_error_t;
+
+typedef void math_loop_t(const f32* xs, f32* ys, int count);
+
+typedef struct math_case_t {
+  const char* name;
+  f32 lo;
+  f32 hi;
+  math_error_t error;
+  f64 bound;
+  f32 (*fast)(f32);
+  f32x8 (*wide)(f32x8);
+  f64 (*exact)(f64);
+  // Timed loops, written out so every call inlines.
+  math_loop_t* libm_loop;
+  math_loop_t* fast_loop;
+  math_loop_t* wide_loop;
+} math_case_t;
+
+static f32 fast_pow_srgb(f32 x) { return fast_pow(x, 1.0f/2.4f); }
+static f32 fast_pow_12(f32 x) { return fast_pow(x, 12.0f); }
+static f32 fast_pow_neg(f32 x) { return fast_pow(x, -2.2f); }
+static f32x8 f32x8_pow_srgb(f32x8 x) { return f32x8_pow(x, f32x8_set1(1.0f/2.4f)); }
+static f32x8 f32x8_pow_12(f32x8 x) { return f32x8_pow(x, f32x8_set1(12.0f)); }
+static f32x8 f32x8_pow_neg(f32x8 x) { return f32x8_pow(x, f32x8_set1(-2.2f)); }
+static f64 pow_srgb(f64 x) { return pow(x, (f64)(1.0f/2.4f)); }
+static f64 pow_12(f64 x) { return pow(x, 12.0); }
+static f64 pow_neg(f64 x) { return pow(x, (f64)-2.2f); }
+static f32 powf_srgb(f32 x) { return powf(x, 1.0f/2.4f); }
+static f32 powf_12(f32 x) { return powf(x, 12.0f); }
+static f32 powf_neg(f32 x) { return powf(x, -2.2f); }
+
+#define MATH_LOOPS(name, libm, fast, wide) \
+  static void name##_libm_loop(const f32* xs, f32* ys, int count) { for (int i=0; i < count; i++) ys[i] = libm(xs[i]); } \
+  static void name##_fast_loop(const f32* xs, f32* ys, int count) { for (int i=0; i < count; i++) ys[i] = fast(xs[i]); } \
+  static void name##_wide_loop(const f32* xs, f32* ys, int count) { for (int i=0; i < count; i += 8) f32x8_store(ys + i, wide(f32x8_load(xs + i))); }
+
+MATH_LOOPS(exp, expf, fast_exp, f32x8_exp)
+MATH_LOOPS(exp2, exp2f, fast_exp2, f32x8_exp2)
+MATH_LOOPS(log, logf, fast_log, f32x8_log)
+MATH_LOOPS(log2, log2f, fast_log2, f32x8_log2)
+MATH_LOOPS(pow_srgb, powf_srgb, fast_pow_srgb, f32x8_pow_srgb)
+MATH_LOOPS(pow_12, powf_12, fast_pow_12, f32x8_pow_12)
+MATH_LOOPS(pow_neg, powf_neg, fast_pow_neg, f32x8_pow_neg)
+MATH_LOOPS(sin, sinf, fast_sin, f32x8_sin)
+MATH_LOOPS(cos, cosf, fast_cos, f32x8_cos)
+
+#define MATH_CASE(name, lo, hi, error, bound, fast, wide, exact, loops) \
+  {name, lo, hi, error, bound, fast, wide, exact, loops##_libm_loop, loops##_fast_loop, loops##_wide_loop}
+
+// Bounds match the table in cave_fast_math.h.
+static const math_case_t math_cases[] = {
+  MATH_CASE("exp",          -87.0f,   88.0f,   MATH_ERROR_RELATIVE, 1.0e-7, fast_exp,      f32x8_exp,      exp,      exp),
+  MATH_CASE("exp2",         -126.0f,  127.0f,  MATH_ERROR_RELATIVE, 1.0e-7, fast_exp2,     f32x8_exp2,     exp2,     exp2),
+  MATH_CASE("log",          FLT_MIN,  FLT_MAX, MATH_ERROR_RELATIVE, 1.0e-7, fast_log,      f32x8_log,      log,      log),
+  MATH_CASE("log2",         FLT_MIN,  FLT_MAX, MATH_ERROR_RELATIVE, 1.5e-7, fast_log2,     f32x8_log2,     log2,     log2),
+  MATH_CASE("pow(x,1/2.4)", FLT_MIN,  FLT_MAX, MATH_ERROR_POW,      2.0e-7, fast_pow_srgb, f32x8_pow_srgb, pow_srgb, pow_srgb),
+  MATH_CASE("pow(x,12)",    0.0032f,  316.0f,  MATH_ERROR_POW,      2.0e-7, fast_pow_12,   f32x8_pow_12,   pow_12,   pow_12),
+  MATH_CASE("pow(x,-2.2)",  2e-14f,   4e13f,   MATH_ERROR_POW,      2.0e-7, fast_pow_neg,  f32x8_pow_neg,  pow_neg,  pow_neg),
+  MATH_CASE("sin",          -8192.0f, 8192.0f, MATH_ERROR_ABSOLUTE, 8.0e-8, fast_sin,      f32x8_sin,      sin,      sin),
+  MATH_CASE("cos",          -8192.0f, 8192.0f, MATH_ERROR_ABSOLUTE, 8.0e-8, fast_cos,      f32x8_cos,      cos,      cos),
+};
+
+static const char* math_error_names[] = {"abs", "rel", "pow"};
+
+static f64 math_error(const math_case_t* c, f32 approx, f64 exact) {
+  f64 e = fabs((f64)approx - exact);
+  switch (c->error) {
+    case MATH_ERROR_ABSOLUTE: return e;
+    case MATH_ERROR_RELATIVE: return exact != 0 ? e / fabs(exact) : e;
+    default: return e / fabs(exact) / fmax(1.0, fabs(log(fabs(exact))));
+  }
+}
+
+static u32 math_f32_bits(f32 a) {
+  u32 r;
+  memcpy(&r, &a, sizeof(r));
+  return r;
+}
+
+static f32 math_f32_from_bits(u32 a) {
+  f32 r;
+  memcpy(&r, &a, sizeof(r));
+  return r;
+}
+
+// Worst scalar and f32x8 error over [lo, hi] of one sign, with lo and hi >= 0.
+static void math_sweep(const math_case_t* c, f32 lo, f32 hi, f32 sign, f64* worst, f64* worst_wide, f32* worst_x) {
+  u32 first = math_f32_bits(lo);
+  u32 last = math_f32_bits(hi);
+  u32 step = (last - first) / MATH_BENCH_SAMPLES;
+  if (step == 0) step = 1;
+
+  f32 xs[8];
+  int n = 0;
+  for (u64 bits=first; bits <= last; bits += step) {
+    f32 x = sign * math_f32_from_bits((u32)bits);
+    f64 exact = c->exact((f64)x);
+    f64 e = math_error(c, c->fast(x), exact);
+    if (e > *worst) {
+      *worst = e;
+      *worst_x = x;
+    }
+
+    xs[n++] = x;
+    if (n == 8) {
+      f32 ys[8];
+      f32x8_store(ys, c->wide(f32x8_load(xs)));
+      for (int i=0; i < 8; i++) {
+        e = math_error(c, ys[i], c->exact((f64)xs[i]));
+        if (e > *worst_wide) *worst_wide = e;
+      }
+      n = 0;
+    }
+  }
+}
+
+static bool run_math_benchmarks(void) {
+  f32* xs = aligned_alloc(64, sizeof(f32) * MATH_BENCH_VALUES);
+  f32* ys = aligned_alloc(64, sizeof(f32) * MATH_BENCH_VALUES);
+  bool ok = true;
+  volatile f32 sink = 0;
+
+  printf("math: max error against libm, and ns per value against libm's float versions\n");
+  printf("  %-13s %-22s %-4s %9s %9s %9s %12s %8s %8s %8s %8s\n",
+    "function", "range", "", "bound", "error", "f32x8 err", "worst at", "libm ns", "fast ns", "f32x8 ns", "speedup");
+  for (u32 i=0; i < sizeof(math_cases)/sizeof(math_cases[0]); i++) {
+    const math_case_t* c = &math_cases[i];
+    f64 worst = 0, worst_wide = 0;
+    f32 worst_x = 0;
+    if (c->hi > 0) {
+      math_sweep(c, c->lo > 0 ? c->lo : 0.0f, c->hi, 1.0f, &worst, &worst_wide, &worst_x);
+    }
+    if (c->lo < 0) {
+      math_sweep(c, c->hi < 0 ? -c->hi : 0.0f, -c->lo, -1.0f, &worst, &worst_wide, &worst_x);
+    }
+    bool pass = worst <= c->bound && worst_wide <= c->bound;
+    ok = ok && pass;
+
+    // Evenly spaced values, except the log and pow cases that span the whole
+    // float range, which are spaced evenly in exponent instead.
+    for (int j=0; j < MATH_BENCH_VALUES; j++) {
+      f32 t = (j + 0.5f) / MATH_BENCH_VALUES;
+      xs[j] = c->hi / c->lo > 1e6f ? c->lo * powf(c->hi / c->lo, t) : lerp(c->lo, t, c->hi);
+    }
+    math_loop_t* loops[3] = {c->libm_loop, c->fast_loop, c->wide_loop};
+    u64 ns[3];
+    for (int k=0; k < 3; k++) {
+      u64 start = profiler_ticks_ns();
+      for (int r=0; r < MATH_BENCH_REPEATS; r++) {
+        loops[k](xs, ys, MATH_BENCH_VALUES);
+        sink += ys[r % MATH_BENCH_VALUES];
+      }
+      ns[k] = profiler_ticks_ns() - start;
+    }
+    f64 count = (f64)MATH_BENCH_VALUES * MATH_BENCH_REPEATS;
+
+    char range[32];
+    snprintf(range, sizeof(range), "[%.3g, %.3g]", c->lo, c->hi);
+    printf("  %-13s %-22s %-4s %9.2e %9.2e %9.2e %12.5g %8.2f %8.2f %8.2f %7.1fx%s\n",
+      c->name, range, math_error_names[c->error], c->bound, worst, worst_wide, worst_x,
+      ns[0] / count, ns[1] / count, ns[2] / count, (f64)ns[0] / (f64)ns[2], pass ? "" : "  FAIL");
+  }
+
+  free(xs);
+  free(ys);
+  return ok;
+}
+
+//
+// -bench-resolve: the resolve pass over a 4K frame of linear sums, as f32
+// and f16, against bgra_pack3 with powf per pixel, which is what it
+// replaced. Single threaded. Fails if any channel is more than one off.
+//
+
+#define RESOLVE_BENCH_WIDTH 3840
+#define RESOLVE_BENCH_HEIGHT 2160
+#define RESOLVE_BENCH_REPEATS 8
+#define RESOLVE_BENCH_SAMPLES 4
+
+typedef struct resolve_case_t {
+  const char* name;
+  resolve_format_t format;
+  resolve_curve_t curve;
+  bool stream;
+} resolve_case_t;
+
+static const resolve_case_t resolve_cases[] = {
+  {"f32 unorm", RESOLVE_RGB_F32, RESOLVE_CURVE_UNORM, true},
+  {"f32 srgb", RESOLVE_RGB_F32, RESOLVE_CURVE_SRGB, true},
+  {"f32 srgb cached", RESOLVE_RGB_F32, RESOLVE_CURVE_SRGB, false},
+  {"f16 srgb", RESOLVE_RGB_F16, RESOLVE_CURVE_SRGB, true},
+};
+
+static u32 resolve_reference(v3 rgb, f32 scale, resolve_curve_t curve) {
+  rgb = mul3(rgb, scale);
+  if (curve == RESOLVE_CURVE_SRGB) {
+    rgb = max3(rgb, v3_zero);
+    rgb = V3(
+      maximum(1.055f * powf(rgb.r, 0.416666667f) - 0.055f, 0.0f),
+      maximum(1.055f * powf(rgb.g, 0.416666667f) - 0.055f, 0.0f),
+      maximum(1.055f * powf(rgb.b, 0.416666667f) - 0.055f, 0.0f)
+    );
+  }
+  return bgra_pack3(mul3(clamp3(rgb, 0.0f, 1.0f), 255.0f));
+}
+
+static int resolve_channel_error(u32 a, u32 b) {
+  int worst = 0;
+  for (int shift=0; shift < 32; shift += 8) {
+    int d = abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+    worst = d > worst ? d : worst;
+  }
+  return worst;
+}
+
+static bool run_resolve_benchmarks(void) {
+  usize count = (usize)RESOLVE_BENCH_WIDTH * RESOLVE_BENCH_HEIGHT;
+  v3* sums = (v3*)malloc(sizeof(v3) * count);
+  u16* halfs = (u16*)malloc(sizeof(u16) * 3 * count);
+  render_target_t target = {
+    .pixels = (u32*)aligned_alloc(64, sizeof(u32) * count),
+    .width = RESOLVE_BENCH_WIDTH,
+    .height = RESOLVE_BENCH_HEIGHT,
+    .stride = RESOLVE_BENCH_WIDTH,
+  };
+  f32 scale = 1.0f / RESOLVE_BENCH_SAMPLES;
+
+  // Sums of a few samples that mostly land in [0, 1] once averaged, with some
+  // overexposed ones to clamp.
+  u32 rng = 0x9E3779B9u;
+  for (usize i=0; i < count; i++) {
+    for (int c=0; c < 3; c++) {
+      f32 x = randf(&rng);
+      sums[i].e[c] = x*x * 1.2f * RESOLVE_BENCH_SAMPLES;
+      halfs[i*3+c] = f16_from_f32(sums[i].e[c]);
+    }
+  }
+
+  printf("resolve: %dx%d, ms per frame on one thread\n", RESOLVE_BENCH_WIDTH, RESOLVE_BENCH_HEIGHT);
+  printf("  %-16s %9s %9s %8s\n", "case", "ms", "max err", "speedup");
+  f64 reference_ms[2] = {0};
+  for (int curve=0; curve < 2; curve++) {
+    u64 start = profiler_ticks_ns();
+    for (int r=0; r < RESOLVE_BENCH_REPEATS; r++) {
+      for (usize i=0; i < count; i++) {
+        target.pixels[i] = resolve_reference(sums[i], scale, (resolve_curve_t)curve);
+      }
+    }
+    reference_ms[curve] = (f64)(profiler_ticks_ns() - start) / 1e6 / RESOLVE_BENCH_REPEATS;
+    printf("  %-16s %9.2f %9s %8s\n", curve == RESOLVE_CURVE_SRGB ? "bgra_pack3 srgb" : "bgra_pack3 unorm", reference_ms[curve], "", "");
+  }
+
+  bool ok = true;
+  for (u32 k=0; k < sizeof(resolve_cases)/sizeof(resolve_cases[0]); k++) {
+    const resolve_case_t* c = &resolve_cases[k];
+    resolve_source_t src = {
+      .pixels = c->format == RESOLVE_RGB_F16 ? (const void*)halfs : (const void*)sums,
+      .format = c->format,
+      .curve = c->curve,
+      .stride = RESOLVE_BENCH_WIDTH,
+      .scale = scale,
+    };
+    u64 start = profiler_ticks_ns();
+    for (int r=0; r < RESOLVE_BENCH_REPEATS; r++) {
+      if (c->stream) {
+        resolve_rows(&src, &target, 0, target.height);
+      } else {
+        for (int y=0; y < target.height; y++) {
+          resolve_span(target.pixels + (usize)y*target.stride, sums + (usize)y*RESOLVE_BENCH_WIDTH, c->format, target.width, scale, c->curve, false);
+        }
+      }
+    }
+    f64 ms = (f64)(profiler_ticks_ns() - start) / 1e6 / RESOLVE_BENCH_REPEATS;
+
+    // f16 is checked against its own rounded values.
+    int worst = 0;
+    for (usize i=0; i < count; i++) {
+      v3 rgb = sums[i];
+      if (c->format == RESOLVE_RGB_F16) {
+        rgb = V3(f32_from_f16(halfs[i*3+0]), f32_from_f16(halfs[i*3+1]), f32_from_f16(halfs[i*3+2]));
+      }
+      int err = resolve_channel_error(target.pixels[i], resolve_reference(rgb, scale, c->curve));
+      worst = err > worst ? err : worst;
+    }
+    bool pass = worst <= 1;
+    ok = ok && pass;
+    printf("  %-16s %9.2f %9d %7.1fx%s\n", c->name, ms, worst, reference_ms[c->curve] / ms, pass ? "" : "  FAIL");
+  }
+
+  free(sums);
+  free(halfs);
+  free(target.pixels);
+  return ok;
+}
+
+//
+// -bench-pt: path tracer noise at equal time. Renders a reference with every
+// sampling strategy and a lot of samples, then gives each strategy the same
+// time and reports the RMSE of its average against the reference. Variance
+// falls as 1/time, so the square of the RMSE ratio to the first case is how
+// many times longer that one would have to run to get as clean. Single
+// threaded, one view of the default scene.
+//
+
+#define PT_BENCH_WIDTH 128
+#define PT_BENCH_HEIGHT 72
+#define PT_BENCH_REFERENCE_SAMPLES 4096
+#define PT_BENCH_SECONDS 0.5
+#define PT_BENCH_REFERENCE_SEED 0x5eed5eedu
+
+typedef struct pt_bench_case_t {
+  const char* name;
+  u32 strategy;
+} pt_bench_case_t;
+
+static const pt_bench_case_t pt_bench_cases[] = {
+  {"sphere offset, 5 bounces", 0},
+  {"cosine", PT_COSINE_SAMPLING},
+  {"cosine + sun MIS", PT_COSINE_SAMPLING | PT_LIGHT_SAMPLING},
+  {"cosine + sun MIS + RR", PT_SAMPLING_ALL},
+};
+
+// Sample index of every pixel added to sums. xorshift is seeded from the
+// frame instead, so that follows the index too.
+static void pt_bench_pass(const sphere_scene_t* scene, fs_params_t* params, const sampler_config_t* sampling, u32 index, u32 strategy, v3* sums, render_counters_t* counters) {
+  params->frame_count = index + 1;
+  for (int y=0; y < PT_BENCH_HEIGHT; y++) {
+    f32 v = 1.0f - ((f32)y + 0.5f) / PT_BENCH_HEIGHT;
+    for (int x=0; x < PT_BENCH_WIDTH; x++) {
+      f32 u = ((f32)x + 0.5f) / PT_BENCH_WIDTH;
+      v3* sum = &sums[y*PT_BENCH_WIDTH + x];
+      *sum = add3(*sum, pt_sample_pixel(scene, params, sampling, x, y, u, v, index, 1, strategy, counters));
+    }
+  }
+}
+
+static void pt_bench_view(fs_params_t* params) {
+  app_t bench_app = {0};
+  world_t bench_world = {0};
+  v2 window = V2(PT_BENCH_WIDTH, PT_BENCH_HEIGHT);
+  bench_app.window.size_in_pixels = window;
+  bench_app.window.size_in_points = window;
+  bench_app.display.size_in_pixels = window;
+  bench_app.display.size_in_points = window;
+  bench_app.render_scale = 1.0f;
+  init_world(&bench_app, &bench_world);
+  update_and_render(&bench_app, &bench_world, &params->debug_params);
+  update_render_camera(&bench_world.camera, aspect2(window), &params->camera);
+  params->viewport_size.x = window.x;
+  params->viewport_size.y = window.y;
+}
+
+// Every strategy, Sobol with a seed the cases don't use, so its error is
+// independent of theirs and well below it.
+static v3* pt_bench_reference(const sphere_scene_t* scene, fs_params_t* params) {
+  usize count = (usize)PT_BENCH_WIDTH * PT_BENCH_HEIGHT;
+  v3* reference = (v3*)calloc(count, sizeof(v3));
+  sampler_config_t sampling = {SAMPLER_SOBOL, PT_BENCH_REFERENCE_SEED, NULL};
+  render_counters_t counters = {0};
+  u64 start = profiler_ticks_ns();
+  for (u32 s=0; s < PT_BENCH_REFERENCE_SAMPLES; s++) {
+    pt_bench_pass(scene, params, &sampling, s, PT_SAMPLING_ALL, reference, &counters);
+  }
+  for (usize i=0; i < count; i++) {
+    reference[i] = mul3(reference[i], 1.0f / PT_BENCH_REFERENCE_SAMPLES);
+  }
+  printf("path tracer: %dx%d, reference of %d spp in %0.1f s\n",
+    PT_BENCH_WIDTH, PT_BENCH_HEIGHT, PT_BENCH_REFERENCE_SAMPLES, (f64)(profiler_ticks_ns() - start) / 1e9);
+  return reference;
+}
+
+static f64 pt_bench_rmse(const v3* sums, u32 samples, const v3* reference) {
+  f64 error = 0;
+  for (int i=0; i < PT_BENCH_WIDTH*PT_BENCH_HEIGHT; i++) {
+    for (int c=0; c < 3; c++) {
+      f64 d = (f64)sums[i].e[c] / samples - (f64)reference[i].e[c];
+      error += d*d;
+    }
+  }
+  return sqrt(error / (PT_BENCH_WIDTH*PT_BENCH_HEIGHT*3));
+}
+
+static bool run_path_tracer_benchmarks(void) {
+  fs_params_t params = {0};
+  pt_bench_view(&params);
+  sphere_scene_t scene = {0};
+  init_default_scene(&scene, SPHERE_LANES);
+  usize count = (usize)PT_BENCH_WIDTH * PT_BENCH_HEIGHT;
+  v3* reference = pt_bench_reference(&scene, &params);
+  v3* sums = (v3*)malloc(count * sizeof(v3));
+  render_counters_t counters = {0};
+  sampler_config_t sampling = {SAMPLER_XORSHIFT, 0, NULL};
+
+  printf("strategies: xorshift32, %0.2f s per case on one thread\n", PT_BENCH_SECONDS);
+  printf("  %-26s %9s %9s %9s %9s %9s\n", "case", "spp", "rays/spp", "us/spp", "rmse", "speedup");
+
+  f64 first_rmse = 0;
+  for (u32 k=0; k < sizeof(pt_bench_cases)/sizeof(pt_bench_cases[0]); k++) {
+    const pt_bench_case_t* c = &pt_bench_cases[k];
+    memset(sums, 0, count * sizeof(v3));
+    counters = (render_counters_t){0};
+    u32 samples = 0;
+    u64 start = profiler_ticks_ns();
+    u64 elapsed = 0;
+    while (elapsed < (u64)(PT_BENCH_SECONDS * 1e9)) {
+      pt_bench_pass(&scene, &params, &sampling, samples++, c->strategy, sums, &counters);
+      elapsed = profiler_ticks_ns() - start;
+    }
+    f64 rmse = pt_bench_rmse(sums, samples, reference);
+    if (k == 0) first_rmse = rmse;
+    f64 pixel_samples = (f64)samples * count;
+    printf("  %-26s %9u %9.2f %9.3f %9.5f %8.1fx\n", c->name, samples, (f64)counters.rays / pixel_samples,
+      (f64)elapsed / 1e3 / pixel_samples, rmse, (first_rmse / rmse) * (first_rmse / rmse));
+  }
+
+  free(sums);
+  free(reference);
+  free_sphere_scene(&scene);
+  return true;
+}
+
+//
+// -bench-samplers: how fast each sampler converges on the path tracer. Every
+// sampler renders the same view with all the strategies on, and the RMSE
+// against the reference is printed at each power of four samples. White
+// noise falls as 1/sqrt(spp), low discrepancy samples faster where the
+// integrand is smooth. The last two columns are how many xorshift samples
+// the final RMSE is worth, per sample and per unit of time. Blue noise
+// doesn't lower the error so much as push it to high frequencies, so "blur"
+// is the 1 spp RMSE after a 3x3 box filter, roughly what a denoiser or the
+// eye leaves of it.
+//
+
+#define SAMPLER_BENCH_STEPS 5 // 1, 4, 16, 64, 256 spp
+
+static f64 pt_bench_blurred_rmse(const v3* sums, u32 samples, const v3* reference) {
+  f64 error = 0;
+  for (int y=0; y < PT_BENCH_HEIGHT; y++) {
+    for (int x=0; x < PT_BENCH_WIDTH; x++) {
+      v3 sum = v3_zero;
+      int taps = 0;
+      for (int dy=-1; dy <= 1; dy++) {
+        for (int dx=-1; dx <= 1; dx++) {
+          int sx = x + dx;
+          int sy = y + dy;
+          if (sx < 0 || sy < 0 || sx >= PT_BENCH_WIDTH || sy >= PT_BENCH_HEIGHT) continue;
+          int i = sy*PT_BENCH_WIDTH + sx;
+          sum = add3(sum, sub3(mul3(sums[i], 1.0f / samples), reference[i]));
+          taps++;
+        }
+      }
+      for (int c=0; c < 3; c++) {
+        f64 d = (f64)sum.e[c] / taps;
+        error += d*d;
+      }
+    }
+  }
+  return sqrt(error / (PT_BENCH_WIDTH*PT_BENCH_HEIGHT*3));
+}
+
+static bool run_sampler_benchmarks(const blue_noise_t* blue_noise) {
+  fs_params_t params = {0};
+  pt_bench_view(&params);
+  sphere_scene_t scene = {0};
+  init_default_scene(&scene, SPHERE_LANES);
+  usize count = (usize)PT_BENCH_WIDTH * PT_BENCH_HEIGHT;
+  v3* reference = pt_bench_reference(&scene, &params);
+  v3* sums = (v3*)malloc(count * sizeof(v3));
+
+  printf("samplers: rmse by spp on one thread\n");
+  printf("  %-11s", "sampler");
+  for (int k=0; k < SAMPLER_BENCH_STEPS; k++) {
+    printf(" %9u", 1u << (2*k));
+  }
+  printf(" %9s %9s %9s %9s\n", "blur", "us/spp", "per spp", "per time");
+
+  f64 white_rmse = 0;
+  f64 white_us = 0;
+  for (int kind=0; kind < SAMPLER_KIND_COUNT; kind++) {
+    sampler_config_t sampling = {(sampler_kind_t)kind, 1, blue_noise};
+    render_counters_t counters = {0};
+    memset(sums, 0, count * sizeof(v3));
+    printf("  %-11s", sampler_kind_names[kind]);
+    u32 samples = 0;
+    f64 rmse = 0;
+    f64 blurred = 0;
+    u64 elapsed = 0;
+    for (int k=0; k < SAMPLER_BENCH_STEPS; k++) {
+      u64 start = profiler_ticks_ns();
+      for (; samples < 1u << (2*k); samples++) {
+        pt_bench_pass(&scene, &params, &sampling, samples, PT_SAMPLING_ALL, sums, &counters);
+      }
+      elapsed += profiler_ticks_ns() - start;
+      rmse = pt_bench_rmse(sums, samples, reference);
+      if (k == 0) blurred = pt_bench_blurred_rmse(sums, samples, reference);
+      printf(" %9.5f", rmse);
+    }
+    f64 us = (f64)elapsed / 1e3 / ((f64)samples * count);
+    if (kind == SAMPLER_XORSHIFT) {
+      white_rmse = rmse;
+      white_us = us;
+    }
+    f64 per_spp = (white_rmse / rmse) * (white_rmse / rmse);
+    printf(" %9.5f %9.3f %8.1fx %8.1fx\n", blurred, us, per_spp, per_spp * white_us / us);
+  }
+
+  free(sums);
+  free(reference);
+  free_sphere_scene(&scene);
+  return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "types.h"
+
+#define BENCH_MAX_SIZES 8
+#define BENCH_WARMUP_FRAMES 1
+// Frame delta of the built in orbit path, it holds the right arrow.
+#define BENCH_ORBIT_DT (1.0f/30.0f)
+
+typedef struct bench_size_t {
+  int width;
+  int height;
+} bench_size_t;
+
+typedef struct bench_config_t {
+  int thread_count;
+  bool scalar;
+  u32 frames; // per case, after the warmup
+  bench_size_t sizes[BENCH_MAX_SIZES];
+  int size_count;
+  const char* path;          // input log to follow, NULL for the built in orbit
+  const char* output_path;   // JSON lines, one per case
+  const char* baseline_path; // an earlier output_path to compare against
+} bench_config_t;
+
+// One pipeline, scene and size rendered along the whole path.
+typedef struct bench_result_t {
+  const char* pipeline;
+  const char* scene;
+  int width;
+  int height;
+  u32 frames;
+  f64 ms_per_frame;
+  f64 min_ms;
+  f64 mrays_per_sec;
+  f64 steps_per_pixel;
+  f64 evals_per_pixel;
+  f64 nodes_per_ray;
+  f64 spheres_per_ray;
+} bench_result_t;
@@ -0,0 +1,239 @@
+#include "bvh.h"
+
+//
+// Binned SAH bounding volume hierarchy over spheres.
+// Built top down into one flat array of bvh_node_t, which is uploaded to the
+// GPU as is and walked with a small stack on both sides.
+//
+
+typedef struct bvh_bin_t {
+  aabb_t bounds;
+  u32 count;
+} bvh_bin_t;
+
+typedef struct bvh_builder_t {
+  const scene_sphere_t* spheres;
+  u32 leaf_lanes;
+  u32 max_leaf_size;
+  aabb_t* prim_bounds;
+  v3* centroids;
+  u32* indices;
+  bvh_t* bvh;
+} bvh_builder_t;
+
+static u64 bvh_ticks_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec*1000000000ull + (u64)ts.tv_nsec;
+}
+
+static inline aabb_t aabb_empty(void) {
+  aabb_t r = {V3(FLT_MAX, FLT_MAX, FLT_MAX), V3(-FLT_MAX, -FLT_MAX, -FLT_MAX)};
+  return r;
+}
+
+static inline aabb_t aabb_join(aabb_t a, aabb_t b) {
+  aabb_t r = {min3(a.min, b.min), max3(a.max, b.max)};
+  return r;
+}
+
+static inline aabb_t aabb_grow(aabb_t a, v3 p) {
+  aabb_t r = {min3(a.min, p), max3(a.max, p)};
+  return r;
+}
+
+// Leaves are tested leaf_lanes spheres at a time, so a partly full group
+// costs as much as a full one.
+static inline f32 bvh_leaf_cost(const bvh_builder_t* b, u32 count) {
+  return (f32)((count + b->leaf_lanes-1) / b->leaf_lanes);
+}
+
+static inline f32 aabb_half_area(aabb_t a) {
+  v3 d = sub3(a.max, a.min);
+  if (d.x < 0 || d.y < 0 || d.z < 0) return 0;
+  return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+static u32 bvh_build_node(bvh_builder_t* b, u32 first, u32 count, u32 depth) {
+  bvh_t* bvh = b->bvh;
+  u32 index = bvh->node_count++;
+  if (depth > bvh->max_depth) bvh->max_depth = depth;
+
+  aabb_t bounds = aabb_empty();
+  aabb_t centroid_bounds = aabb_empty();
+  for (u32 i=first; i < first+count; i++) {
+    u32 prim = b->indices[i];
+    bounds = aabb_join(bounds, b->prim_bounds[prim]);
+    centroid_bounds = aabb_grow(centroid_bounds, b->centroids[prim]);
+  }
+
+  bvh_node_t* node = &bvh->nodes[index];
+  for (int k=0; k < 3; k++) {
+    node->bounds_min[k] = bounds.min.e[k];
+    node->bounds_max[k] = bounds.max.e[k];
+  }
+
+  // Find the cheapest split plane over all three axes.
+  f32 leaf_cost = bvh_leaf_cost(b, count);
+  f32 best_cost = FLT_MAX;
+  int best_axis = -1;
+  int best_split = 0;
+  if (count > 1) {
+    f32 parent_area = aabb_half_area(bounds);
+    for (int axis=0; axis < 3; axis++) {
+      f32 lo = centroid_bounds.min.e[axis];
+      f32 extent = centroid_bounds.max.e[axis] - lo;
+      if (extent <= 0) continue;
+
+      bvh_bin_t bins[BVH_BIN_COUNT];
+      for (int i=0; i < BVH_BIN_COUNT; i++) {
+        bins[i].bounds = aabb_empty();
+        bins[i].count = 0;
+      }
+      f32 scale = (f32)BVH_BIN_COUNT / extent;
+      for (u32 i=first; i < first+count; i++) {
+        u32 prim = b->indices[i];
+        int bin = (int)((b->centroids[prim].e[axis] - lo) * scale);
+        if (bin > BVH_BIN_COUNT-1) bin = BVH_BIN_COUNT-1;
+        bins[bin].bounds = aabb_join(bins[bin].bounds, b->prim_bounds[prim]);
+        bins[bin].count++;
+      }
+
+      // Sweep from the right to get the cost of everything past each plane,
+      // then from the left to finish it.
+      f32 right_cost[BVH_BIN_COUNT];
+      aabb_t right = aabb_empty();
+      u32 right_count = 0;
+      for (int i=BVH_BIN_COUNT-1; i > 0; i--) {
+        right = aabb_join(right, bins[i].bounds);
+        right_count += bins[i].count;
+        right_cost[i] = aabb_half_area(right) * bvh_leaf_cost(b, right_count);
+      }
+      aabb_t left = aabb_empty();
+      u32 left_count = 0;
+      for (int i=1; i < BVH_BIN_COUNT; i++) {
+        left = aabb_join(left, bins[i-1].bounds);
+        left_count += bins[i-1].count;
+        if (left_count == 0 || left_count == count) continue;
+        f32 cost = BVH_TRAVERSAL_COST + (aabb_half_area(left)*bvh_leaf_cost(b, left_count) + right_cost[i]) / parent_area;
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = i;
+        }
+      }
+    }
+  }
+
+  bool make_leaf = count == 1 || best_axis == -1 ||
+    (best_cost >= leaf_cost && count <= b->max_leaf_size);
+  if (make_leaf && count > b->max_leaf_size) {
+    // Every centroid is in the same spot, there's no good plane. Cut it in half
+    // anyway so leaves stay small.
+    make_leaf = false;
+    best_axis = -1;
+  }
+  if (make_leaf || depth >= BVH_MAX_DEPTH) {
+    node->offset = first;
+    node->count = count;
+    bvh->leaf_count++;
+    return index;
+  }
+
+  u32 mid = first + count/2;
+  if (best_axis != -1) {
+    f32 lo = centroid_bounds.min.e[best_axis];
+    f32 scale = (f32)BVH_BIN_COUNT / (centroid_bounds.max.e[best_axis] - lo);
+    u32 i = first;
+    u32 j = first + count;
+    while (i < j) {
+      u32 prim = b->indices[i];
+      int bin = (int)((b->centroids[prim].e[best_axis] - lo) * scale);
+      if (bin > BVH_BIN_COUNT-1) bin = BVH_BIN_COUNT-1;
+      if (bin < best_split) {
+        i++;
+      } else {
+        j--;
+        b->indices[i] = b->indices[j];
+        b->indices[j] = prim;
+      }
+    }
+    mid = i;
+  }
+
+  // Left child is always index+1, so only the right one needs storing.
+  bvh_build_node(b, first, mid - first, depth+1);
+  u32 right = bvh_build_node(b, mid, first + count - mid, depth+1);
+  node = &bvh->nodes[index];
+  node->offset = right;
+  node->count = 0;
+  return index;
+}
+
+// Builds a BVH over the spheres. Leaves point into the spheres in the order
+// written to order, so callers must permute their arrays by it. leaf_lanes
+// is how many spheres the leaf test handles at once, 1 for the shaders.
+static void build_bvh(bvh_t* bvh, const scene_sphere_t* spheres, u32 sphere_count, u32 leaf_lanes, u32* order) {
+  u64 start = bvh_ticks_ns();
+
+  free(bvh->nodes);
+  *bvh = (bvh_t){0};
+  if (sphere_count == 0) {
+    return;
+  }
+  bvh->nodes = (bvh_node_t*)malloc(sizeof(bvh_node_t) * (2*sphere_count - 1));
+
+  bvh_builder_t b = {0};
+  b.spheres = spheres;
+  b.leaf_lanes = leaf_lanes ? leaf_lanes : 1;
+  b.max_leaf_size = b.leaf_lanes > BVH_MAX_LEAF_SIZE ? b.leaf_lanes : BVH_MAX_LEAF_SIZE;
+  arena_temp_t scratch = begin_scratch(NULL);
+  b.prim_bounds = push_array(scratch.arena, aabb_t, sphere_count);
+  b.centroids = push_array(scratch.arena, v3, sphere_count);
+  b.indices = order;
+  b.bvh = bvh;
+  for (u32 i=0; i < sphere_count; i++) {
+    const scene_sphere_t* s = &spheres[i];
+    v3 c = V3(s->center[0], s->center[1], s->center[2]);
+    v3 r = V3(s->radius, s->radius, s->radius);
+    b.prim_bounds[i] = (aabb_t){sub3(c, r), add3(c, r)};
+    b.centroids[i] = c;
+    order[i] = i;
+  }
+
+  bvh_build_node(&b, 0, sphere_count, 0);
+
+  end_scratch(scratch);
+  bvh->build_ms = (f64)(bvh_ticks_ns() - start) / 1e6;
+}
+
+// Checks that nodes is a tree as bvh_build_node lays it out, for nodes that
+// weren't built here. Nodes are in depth first order, so each right child
+// must be the next node once its sibling's subtree is done, and leaves must
+// stay within prim_count.
+static bool validate_bvh(const bvh_node_t* nodes, u32 node_count, u32 prim_count) {
+  u32 pending[BVH_MAX_DEPTH];
+  int depth = 0;
+  for (u32 i=0; i < node_count; i++) {
+    const bvh_node_t* node = &nodes[i];
+    if (node->count == 0) {
+      if (node->offset <= i+1 || node->offset >= node_count || depth == BVH_MAX_DEPTH) {
+        return false;
+      }
+      pending[depth++] = node->offset;
+      continue;
+    }
+    if ((u64)node->offset + node->count > prim_count) {
+      return false;
+    }
+    if (i+1 < node_count && (depth == 0 || pending[--depth] != i+1)) {
+      return false;
+    }
+  }
+  return depth == 0;
+}
+
+static void free_bvh(bvh_t* bvh) {
+  free(bvh->nodes);
+  *bvh = (bvh_t){0};
+}
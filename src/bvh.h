@@ -0,0 +1,21 @@
+#pragma once
+#include "types.h"
+
+#define BVH_BIN_COUNT 16
+#define BVH_MAX_LEAF_SIZE 8
+#define BVH_MAX_DEPTH 64
+// SAH cost of visiting a node, relative to testing one sphere.
+#define BVH_TRAVERSAL_COST 1.0f
+
+typedef struct aabb_t {
+  v3 min;
+  v3 max;
+} aabb_t;
+
+typedef struct bvh_t {
+  bvh_node_t* nodes;
+  u32 node_count;
+  u32 leaf_count;
+  u32 max_depth;
+  f64 build_ms;
+} bvh_t;
@@ -0,0 +1,290 @@
+#pragma once
+
+//
+// Polynomial approximations of exp, exp2, log, log2, pow, sin and cos, as
+// scalar fast_* and 8-wide f32x8_*. The polynomials and range reductions are
+// Cephes' (expf, exp2f, logf, sinf), and the scalar and wide forms take the
+// same steps, so they agree to within FMA contraction. Max error against
+// libm's double versions, checked by ./build/app_linux -bench-math:
+//
+//   exp   [-87, 88]          1e-7 relative
+//   exp2  [-126, 127]        1e-7 relative
+//   log   [FLT_MIN, FLT_MAX] 1e-7 relative
+//   log2  [FLT_MIN, FLT_MAX] 1.5e-7 relative
+//   pow   x > 0              2e-7 * max(1, |ln result|) relative
+//   sin   [-8192, 8192]      8e-8 absolute
+//   cos   [-8192, 8192]      8e-8 absolute
+//
+// The scalar forms are only about as fast as glibc (sin and cos twice as
+// fast, pow slower than powf), the f32x8 forms are 3-10x faster per value,
+// so loops that need these should go wide.
+//
+// Inputs outside those ranges are clamped instead of giving inf or NaN: exp
+// and exp2 saturate, log and log2 treat x below FLT_MIN (zero and negatives
+// too) as FLT_MIN, and pow of x <= 0 is 0. There's no sqrt here, square_root
+// and f32x8_sqrt are single instructions already.
+//
+
+#define FAST_MIN_NORMAL 1.17549435e-38f // FLT_MIN
+#define FAST_LOG2E 1.44269504088896341f
+#define FAST_LN2_HI 0.693359375f
+#define FAST_LN2_LO -2.12194440e-4f
+#define FAST_SQRT2 1.41421356237309505f
+#define FAST_4_OVER_PI 1.27323954473516268f
+#define FAST_PI_4_A 0.78515625f
+#define FAST_PI_4_B 2.4187564849853515625e-4f
+#define FAST_PI_4_C 3.77489497744594108e-8f
+
+typedef union fast_bits_t {
+  f32 f;
+  u32 u;
+} fast_bits_t;
+
+// 2^n for integer valued n in [-126, 127].
+static inline f32
+fast_exp2i(f32 n) {
+  fast_bits_t b = {.u = (u32)((s32)n + 127) << 23};
+  return b.f;
+}
+
+static inline f32
+fast_exp(f32 x) {
+  x = clamp(-87.3f, x, 88.3f);
+  f32 n = floorf(x*FAST_LOG2E + 0.5f);
+  f32 r = x - n*FAST_LN2_HI - n*FAST_LN2_LO;
+
+  f32 p = 1.9875691500e-4f;
+  p = p*r + 1.3981999507e-3f;
+  p = p*r + 8.3334519073e-3f;
+  p = p*r + 4.1665795894e-2f;
+  p = p*r + 1.6666665459e-1f;
+  p = p*r + 5.0000001201e-1f;
+  p = p*r*r + r + 1.0f;
+  return p * fast_exp2i(n);
+}
+
+static inline f32
+fast_exp2(f32 x) {
+  x = clamp(-126.0f, x, 127.4f);
+  f32 n = floorf(x + 0.5f);
+  f32 f = x - n;
+
+  f32 p = 1.535336188319500e-4f;
+  p = p*f + 1.339887440266574e-3f;
+  p = p*f + 9.618437357674640e-3f;
+  p = p*f + 5.550332471162809e-2f;
+  p = p*f + 2.402264791363012e-1f;
+  p = p*f + 6.931472028550421e-1f;
+  p = p*f + 1.0f;
+  return p * fast_exp2i(n);
+}
+
+static inline f32
+fast_log(f32 x) {
+  fast_bits_t b = {maximum(x, FAST_MIN_NORMAL)};
+  f32 e = (f32)((s32)(b.u >> 23) - 127);
+  b.u = (b.u & 0x007FFFFF) | 0x3F800000;
+  f32 m = b.f;
+  if (m > FAST_SQRT2) {
+    m *= 0.5f;
+    e += 1.0f;
+  }
+  f32 t = m - 1.0f;
+  f32 z = t*t;
+
+  f32 p = 7.0376836292e-2f;
+  p = p*t - 1.1514610310e-1f;
+  p = p*t + 1.1676998740e-1f;
+  p = p*t - 1.2420140846e-1f;
+  p = p*t + 1.4249322787e-1f;
+  p = p*t - 1.6668057665e-1f;
+  p = p*t + 2.0000714765e-1f;
+  p = p*t - 2.4999993993e-1f;
+  p = p*t + 3.3333331174e-1f;
+  f32 y = p*t*z + e*FAST_LN2_LO - 0.5f*z;
+  return t + y + e*FAST_LN2_HI;
+}
+
+static inline f32
+fast_log2(f32 x) {
+  return fast_log(x) * FAST_LOG2E;
+}
+
+// x^y for x > 0, 0 for x <= 0.
+static inline f32
+fast_pow(f32 x, f32 y) {
+  return x > 0.0f ? fast_exp(y * fast_log(x)) : 0.0f;
+}
+
+// Octant polynomials on [-pi/4, pi/4], r2 = r*r.
+static inline f32
+fast_sin_poly(f32 r, f32 r2) {
+  return ((-1.9515295891e-4f*r2 + 8.3321608736e-3f)*r2 - 1.6666654611e-1f)*r2*r + r;
+}
+
+static inline f32
+fast_cos_poly(f32 r2) {
+  return ((2.443315711809948e-5f*r2 - 1.388731625493765e-3f)*r2 + 4.166664568298827e-2f)*r2*r2 - 0.5f*r2 + 1.0f;
+}
+
+// Reduces |x| to [-pi/4, pi/4] and returns which quarter turn it was in.
+static inline int
+fast_reduce_quadrant(f32 x, f32* r) {
+  f32 ax = fabsf(x);
+  f32 h = floorf(ax*FAST_4_OVER_PI*0.5f + 0.5f);
+  f32 j = h + h;
+  *r = ((ax - j*FAST_PI_4_A) - j*FAST_PI_4_B) - j*FAST_PI_4_C;
+  return (int)h & 3;
+}
+
+static inline f32
+fast_sin(f32 x) {
+  f32 r;
+  int q = fast_reduce_quadrant(x, &r);
+  f32 r2 = r*r;
+  f32 y = (q & 1) ? fast_cos_poly(r2) : fast_sin_poly(r, r2);
+  return ((q >= 2) != (x < 0.0f)) ? -y : y;
+}
+
+static inline f32
+fast_cos(f32 x) {
+  f32 r;
+  int q = fast_reduce_quadrant(x, &r);
+  f32 r2 = r*r;
+  f32 y = (q & 1) ? fast_sin_poly(r, r2) : fast_cos_poly(r2);
+  return (q == 1 || q == 2) ? -y : y;
+}
+
+//
+// f32x8 forms, same arithmetic as the scalar ones above.
+//
+
+static inline f32x8
+f32x8_poly_step(f32x8 p, f32x8 x, f32 c) {
+  return f32x8_add(f32x8_mul(p, x), f32x8_set1(c));
+}
+
+static inline f32x8
+f32x8_exp(f32x8 x) {
+  x = f32x8_min(f32x8_max(x, f32x8_set1(-87.3f)), f32x8_set1(88.3f));
+  f32x8 n = f32x8_floor(f32x8_add(f32x8_mul(x, f32x8_set1(FAST_LOG2E)), f32x8_set1(0.5f)));
+  f32x8 r = f32x8_sub(x, f32x8_mul(n, f32x8_set1(FAST_LN2_HI)));
+  r = f32x8_sub(r, f32x8_mul(n, f32x8_set1(FAST_LN2_LO)));
+
+  f32x8 p = f32x8_set1(1.9875691500e-4f);
+  p = f32x8_poly_step(p, r, 1.3981999507e-3f);
+  p = f32x8_poly_step(p, r, 8.3334519073e-3f);
+  p = f32x8_poly_step(p, r, 4.1665795894e-2f);
+  p = f32x8_poly_step(p, r, 1.6666665459e-1f);
+  p = f32x8_poly_step(p, r, 5.0000001201e-1f);
+  p = f32x8_add(f32x8_add(f32x8_mul(f32x8_mul(p, r), r), r), f32x8_set1(1.0f));
+  return f32x8_mul(p, f32x8_exp2i(n));
+}
+
+static inline f32x8
+f32x8_exp2(f32x8 x) {
+  x = f32x8_min(f32x8_max(x, f32x8_set1(-126.0f)), f32x8_set1(127.4f));
+  f32x8 n = f32x8_floor(f32x8_add(x, f32x8_set1(0.5f)));
+  f32x8 f = f32x8_sub(x, n);
+
+  f32x8 p = f32x8_set1(1.535336188319500e-4f);
+  p = f32x8_poly_step(p, f, 1.339887440266574e-3f);
+  p = f32x8_poly_step(p, f, 9.618437357674640e-3f);
+  p = f32x8_poly_step(p, f, 5.550332471162809e-2f);
+  p = f32x8_poly_step(p, f, 2.402264791363012e-1f);
+  p = f32x8_poly_step(p, f, 6.931472028550421e-1f);
+  p = f32x8_poly_step(p, f, 1.0f);
+  return f32x8_mul(p, f32x8_exp2i(n));
+}
+
+static inline f32x8
+f32x8_log(f32x8 x) {
+  x = f32x8_max(x, f32x8_set1(FAST_MIN_NORMAL));
+  f32x8 e = f32x8_exponent(x);
+  f32x8 m = f32x8_mantissa(x);
+  f32x8_mask big = f32x8_gt(m, f32x8_set1(FAST_SQRT2));
+  m = f32x8_select(big, f32x8_mul(m, f32x8_set1(0.5f)), m);
+  e = f32x8_select(big, f32x8_add(e, f32x8_set1(1.0f)), e);
+  f32x8 t = f32x8_sub(m, f32x8_set1(1.0f));
+  f32x8 z = f32x8_mul(t, t);
+
+  f32x8 p = f32x8_set1(7.0376836292e-2f);
+  p = f32x8_poly_step(p, t, -1.1514610310e-1f);
+  p = f32x8_poly_step(p, t, 1.1676998740e-1f);
+  p = f32x8_poly_step(p, t, -1.2420140846e-1f);
+  p = f32x8_poly_step(p, t, 1.4249322787e-1f);
+  p = f32x8_poly_step(p, t, -1.6668057665e-1f);
+  p = f32x8_poly_step(p, t, 2.0000714765e-1f);
+  p = f32x8_poly_step(p, t, -2.4999993993e-1f);
+  p = f32x8_poly_step(p, t, 3.3333331174e-1f);
+  f32x8 y = f32x8_mul(f32x8_mul(p, t), z);
+  y = f32x8_add(y, f32x8_mul(e, f32x8_set1(FAST_LN2_LO)));
+  y = f32x8_sub(y, f32x8_mul(z, f32x8_set1(0.5f)));
+  return f32x8_add(f32x8_add(t, y), f32x8_mul(e, f32x8_set1(FAST_LN2_HI)));
+}
+
+static inline f32x8
+f32x8_log2(f32x8 x) {
+  return f32x8_mul(f32x8_log(x), f32x8_set1(FAST_LOG2E));
+}
+
+static inline f32x8
+f32x8_pow(f32x8 x, f32x8 y) {
+  f32x8 r = f32x8_exp(f32x8_mul(y, f32x8_log(x)));
+  return f32x8_select(f32x8_gt(x, f32x8_zero()), r, f32x8_zero());
+}
+
+static inline f32x8
+f32x8_sin_poly(f32x8 r, f32x8 r2) {
+  f32x8 p = f32x8_set1(-1.9515295891e-4f);
+  p = f32x8_poly_step(p, r2, 8.3321608736e-3f);
+  p = f32x8_poly_step(p, r2, -1.6666654611e-1f);
+  return f32x8_add(f32x8_mul(f32x8_mul(p, r2), r), r);
+}
+
+static inline f32x8
+f32x8_cos_poly(f32x8 r2) {
+  f32x8 p = f32x8_set1(2.443315711809948e-5f);
+  p = f32x8_poly_step(p, r2, -1.388731625493765e-3f);
+  p = f32x8_poly_step(p, r2, 4.166664568298827e-2f);
+  p = f32x8_mul(f32x8_mul(p, r2), r2);
+  return f32x8_add(f32x8_sub(p, f32x8_mul(r2, f32x8_set1(0.5f))), f32x8_set1(1.0f));
+}
+
+// Quarter turn in [0, 4) as a float.
+static inline f32x8
+f32x8_reduce_quadrant(f32x8 x, f32x8* r) {
+  f32x8 ax = f32x8_abs(x);
+  f32x8 h = f32x8_floor(f32x8_add(f32x8_mul(ax, f32x8_set1(FAST_4_OVER_PI*0.5f)), f32x8_set1(0.5f)));
+  f32x8 j = f32x8_add(h, h);
+  f32x8 y = f32x8_sub(ax, f32x8_mul(j, f32x8_set1(FAST_PI_4_A)));
+  y = f32x8_sub(y, f32x8_mul(j, f32x8_set1(FAST_PI_4_B)));
+  *r = f32x8_sub(y, f32x8_mul(j, f32x8_set1(FAST_PI_4_C)));
+  return f32x8_sub(h, f32x8_mul(f32x8_floor(f32x8_mul(h, f32x8_set1(0.25f))), f32x8_set1(4.0f)));
+}
+
+static inline f32x8_mask
+f32x8_quadrant_odd(f32x8 q) {
+  return f32x8_eq(f32x8_sub(q, f32x8_mul(f32x8_floor(f32x8_mul(q, f32x8_set1(0.5f))), f32x8_set1(2.0f))), f32x8_set1(1.0f));
+}
+
+static inline f32x8
+f32x8_sin(f32x8 x) {
+  f32x8 r;
+  f32x8 q = f32x8_reduce_quadrant(x, &r);
+  f32x8 r2 = f32x8_mul(r, r);
+  f32x8 y = f32x8_select(f32x8_quadrant_odd(q), f32x8_cos_poly(r2), f32x8_sin_poly(r, r2));
+  y = f32x8_select(f32x8_ge(q, f32x8_set1(2.0f)), f32x8_neg(y), y);
+  return f32x8_select(f32x8_lt(x, f32x8_zero()), f32x8_neg(y), y);
+}
+
+static inline f32x8
+f32x8_cos(f32x8 x) {
+  f32x8 r;
+  f32x8 q = f32x8_reduce_quadrant(x, &r);
+  f32x8 r2 = f32x8_mul(r, r);
+  f32x8_mask odd = f32x8_quadrant_odd(q);
+  f32x8 y = f32x8_select(odd, f32x8_sin_poly(r, r2), f32x8_cos_poly(r2));
+  f32x8_mask negative = f32x8_and(f32x8_ge(q, f32x8_set1(1.0f)), f32x8_le(q, f32x8_set1(2.0f)));
+  return f32x8_select(negative, f32x8_neg(y), y);
+}
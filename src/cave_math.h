@@ -81,6 +81,9 @@ typedef union m4x4 {
   f32 e[4][4];
 } m4x4;
 
+// f32x4 and f32x8, the lanes behind v4, m4x4 and the wide types below.
+#include "cave_simd.h"
+
 
 //
 // constructors
@@ -164,6 +167,35 @@ clamp01(f32 value) {
   return clamp(0.0f, value, 1.0f);
 }
 
+static inline f32
+minimum(f32 a, f32 b) {
+  return a < b ? a : b;
+}
+
+static inline f32
+maximum(f32 a, f32 b) {
+  return a > b ? a : b;
+}
+
+static inline f32
+lerp(f32 a, f32 t, f32 b) {
+  return a + (b - a) * t;
+}
+
+static inline f32
+fract(f32 a) {
+  return a - floorf(a);
+}
+
+static inline f32
+smoothstep(f32 edge0, f32 edge1, f32 x) {
+  f32 t = clamp01((x - edge0) / (edge1 - edge0));
+  return t * t * (3.0f - 2.0f * t);
+}
+
+// fast_exp, fast_pow, f32x8_sin and friends.
+#include "cave_fast_math.h"
+
 //
 // V2 operations
 //
@@ -202,6 +234,11 @@ aspect2(v2 a) {
   return a.x / a.y;
 }
 
+static inline f32
+magnitude2(v2 a) {
+  return square_root(a.x*a.x + a.y*a.y);
+}
+
 //
 // V3 operations
 //
@@ -302,6 +339,30 @@ lerp3(v3 a, f32 t, v3 b) {
   return r;
 }
 
+static inline v3
+abs3(v3 a) {
+  v3 r = {fabsf(a.x), fabsf(a.y), fabsf(a.z)};
+  return r;
+}
+
+static inline v3
+min3(v3 a, v3 b) {
+  v3 r = {minimum(a.x, b.x), minimum(a.y, b.y), minimum(a.z, b.z)};
+  return r;
+}
+
+static inline v3
+max3(v3 a, v3 b) {
+  v3 r = {maximum(a.x, b.x), maximum(a.y, b.y), maximum(a.z, b.z)};
+  return r;
+}
+
+static inline v3
+clamp3(v3 a, f32 min, f32 max) {
+  v3 r = {clamp(min, a.x, max), clamp(min, a.y, max), clamp(min, a.z, max)};
+  return r;
+}
+
 //
 // quaternion operations
 //
@@ -317,21 +378,73 @@ angle_axis(f32 angle, v3 axis) {
   return q;
 }
 
+//
+// v4 operations
+//
+
+static inline f32x4
+f32x4_from_v4(v4 a) {
+  return f32x4_load(a.e);
+}
+
+static inline v4
+v4_from_f32x4(f32x4 a) {
+  v4 r;
+  f32x4_store(r.e, a);
+  return r;
+}
+
+static inline v4
+add4(v4 a, v4 b) {
+  return v4_from_f32x4(f32x4_add(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
+static inline v4
+sub4(v4 a, v4 b) {
+  return v4_from_f32x4(f32x4_sub(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
+static inline v4
+mul4(v4 a, f32 f) {
+  return v4_from_f32x4(f32x4_mul(f32x4_from_v4(a), f32x4_set1(f)));
+}
+
+static inline v4
+hadamard4(v4 a, v4 b) {
+  return v4_from_f32x4(f32x4_mul(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
+static inline f32
+dot4(v4 a, v4 b) {
+  return f32x4_hsum(f32x4_mul(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
+static inline v4
+lerp4(v4 a, f32 t, v4 b) {
+  f32x4 fa = f32x4_from_v4(a);
+  return v4_from_f32x4(f32x4_mul_add(f32x4_sub(f32x4_from_v4(b), fa), f32x4_set1(t), fa));
+}
+
+static inline v4
+min4(v4 a, v4 b) {
+  return v4_from_f32x4(f32x4_min(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
+static inline v4
+max4(v4 a, v4 b) {
+  return v4_from_f32x4(f32x4_max(f32x4_from_v4(a), f32x4_from_v4(b)));
+}
+
 //
 // m3x3 operations
 //
 
-// TODO: Make this fast!
 static inline v3
 mul3x3(m3x3 m, v3 v) {
   v3 r;
-  for (int col=0; col < 3; col++) {
-    f32 sum = 0;
-    for (int row=0; row < 3; row++) {
-      sum += m.e[row][col] * v.e[row];
-    }
-    r.e[col] = sum;
-  }
+  r.x = m.e[0][0]*v.x + m.e[1][0]*v.y + m.e[2][0]*v.z;
+  r.y = m.e[0][1]*v.x + m.e[1][1]*v.y + m.e[2][1]*v.z;
+  r.z = m.e[0][2]*v.x + m.e[1][2]*v.y + m.e[2][2]*v.z;
   return r;
 }
 
@@ -346,6 +459,434 @@ m3x3 rot3xy(f32 pitch, f32 yaw) {
   };
 }
 
+//
+// m4x4 operations
+//
+
+static inline m4x4
+identity4x4(void) {
+  m4x4 r = {{
+    {1, 0, 0, 0},
+    {0, 1, 0, 0},
+    {0, 0, 1, 0},
+    {0, 0, 0, 1},
+  }};
+  return r;
+}
+
+static inline v4
+mul4x4(m4x4 m, v4 v) {
+  f32x4 r = f32x4_mul(f32x4_load(m.e[0]), f32x4_set1(v.x));
+  r = f32x4_mul_add(f32x4_load(m.e[1]), f32x4_set1(v.y), r);
+  r = f32x4_mul_add(f32x4_load(m.e[2]), f32x4_set1(v.z), r);
+  r = f32x4_mul_add(f32x4_load(m.e[3]), f32x4_set1(v.w), r);
+  return v4_from_f32x4(r);
+}
+
+// a*b, so b applies first.
+static inline m4x4
+matmul4x4(m4x4 a, m4x4 b) {
+  f32x4 c0 = f32x4_load(a.e[0]);
+  f32x4 c1 = f32x4_load(a.e[1]);
+  f32x4 c2 = f32x4_load(a.e[2]);
+  f32x4 c3 = f32x4_load(a.e[3]);
+
+  m4x4 r;
+  for (int col=0; col < 4; col++) {
+    f32x4 v = f32x4_mul(c0, f32x4_set1(b.e[col][0]));
+    v = f32x4_mul_add(c1, f32x4_set1(b.e[col][1]), v);
+    v = f32x4_mul_add(c2, f32x4_set1(b.e[col][2]), v);
+    v = f32x4_mul_add(c3, f32x4_set1(b.e[col][3]), v);
+    f32x4_store(r.e[col], v);
+  }
+  return r;
+}
+
+static inline m4x4
+transpose4x4(m4x4 m) {
+  m4x4 r;
+  for (int col=0; col < 4; col++) {
+    for (int row=0; row < 4; row++) {
+      r.e[col][row] = m.e[row][col];
+    }
+  }
+  return r;
+}
+
+// m must be invertible. Cross products of the columns instead of 16
+// cofactors, see Lengyel, Foundations of Game Engine Development vol 1.
+static inline m4x4
+inverse4x4(m4x4 m) {
+  v3 a = V3(m.e[0][0], m.e[0][1], m.e[0][2]);
+  v3 b = V3(m.e[1][0], m.e[1][1], m.e[1][2]);
+  v3 c = V3(m.e[2][0], m.e[2][1], m.e[2][2]);
+  v3 d = V3(m.e[3][0], m.e[3][1], m.e[3][2]);
+  f32 x = m.e[0][3];
+  f32 y = m.e[1][3];
+  f32 z = m.e[2][3];
+  f32 w = m.e[3][3];
+
+  v3 s = cross3(a, b);
+  v3 t = cross3(c, d);
+  v3 u = sub3(mul3(a, y), mul3(b, x));
+  v3 v = sub3(mul3(c, w), mul3(d, z));
+
+  f32 inv_det = 1.0f / (dot3(s, v) + dot3(t, u));
+  s = mul3(s, inv_det);
+  t = mul3(t, inv_det);
+  u = mul3(u, inv_det);
+  v = mul3(v, inv_det);
+
+  v3 r0 = add3(cross3(b, v), mul3(t, y));
+  v3 r1 = sub3(cross3(v, a), mul3(t, x));
+  v3 r2 = add3(cross3(d, u), mul3(s, w));
+  v3 r3 = sub3(cross3(u, c), mul3(s, z));
+
+  m4x4 r = {{
+    {r0.x, r1.x, r2.x, r3.x},
+    {r0.y, r1.y, r2.y, r3.y},
+    {r0.z, r1.z, r2.z, r3.z},
+    {-dot3(b, t), dot3(a, t), -dot3(d, s), dot3(c, s)},
+  }};
+  return r;
+}
+
+// w = 1 and no divide, for affine m.
+static inline v3
+transform_point4x4(m4x4 m, v3 p) {
+  v4 r = mul4x4(m, V4(p.x, p.y, p.z, 1.0f));
+  return r.xyz;
+}
+
+// w = 0, so translation is ignored.
+static inline v3
+transform_vector4x4(m4x4 m, v3 v) {
+  v4 r = mul4x4(m, V4(v.x, v.y, v.z, 0.0f));
+  return r.xyz;
+}
+
+// out may alias points.
+static inline void
+transform_points4x4(m4x4 m, const v3* points, v3* out, usize count) {
+  f32x4 c0 = f32x4_load(m.e[0]);
+  f32x4 c1 = f32x4_load(m.e[1]);
+  f32x4 c2 = f32x4_load(m.e[2]);
+  f32x4 c3 = f32x4_load(m.e[3]);
+  for (usize i=0; i < count; i++) {
+    v3 p = points[i];
+    f32x4 r = f32x4_mul_add(c0, f32x4_set1(p.x), c3);
+    r = f32x4_mul_add(c1, f32x4_set1(p.y), r);
+    r = f32x4_mul_add(c2, f32x4_set1(p.z), r);
+    out[i] = v4_from_f32x4(r).xyz;
+  }
+}
+
+static inline void
+transform_vectors4x4(m4x4 m, const v3* vectors, v3* out, usize count) {
+  f32x4 c0 = f32x4_load(m.e[0]);
+  f32x4 c1 = f32x4_load(m.e[1]);
+  f32x4 c2 = f32x4_load(m.e[2]);
+  for (usize i=0; i < count; i++) {
+    v3 v = vectors[i];
+    f32x4 r = f32x4_mul(c0, f32x4_set1(v.x));
+    r = f32x4_mul_add(c1, f32x4_set1(v.y), r);
+    r = f32x4_mul_add(c2, f32x4_set1(v.z), r);
+    out[i] = v4_from_f32x4(r).xyz;
+  }
+}
+
+//
+// wide v3 operations
+//
+// v3x4 and v3x8 hold 4 or 8 v3s in SoA form, one f32x4 or f32x8 per axis,
+// and have the same operations as v3 working on every lane at once. Masks
+// come from comparing their f32x4 or f32x8 parts.
+//
+
+typedef struct v3x4 {
+  f32x4 x;
+  f32x4 y;
+  f32x4 z;
+} v3x4;
+
+static inline v3x4
+v3x4_set1(v3 a) {
+  v3x4 r = {f32x4_set1(a.x), f32x4_set1(a.y), f32x4_set1(a.z)};
+  return r;
+}
+
+// From SoA arrays, 4 floats each.
+static inline v3x4
+v3x4_load(const f32* x, const f32* y, const f32* z) {
+  v3x4 r = {f32x4_load(x), f32x4_load(y), f32x4_load(z)};
+  return r;
+}
+
+static inline void
+v3x4_store(f32* x, f32* y, f32* z, v3x4 a) {
+  f32x4_store(x, a.x);
+  f32x4_store(y, a.y);
+  f32x4_store(z, a.z);
+}
+
+static inline v3
+v3x4_get(v3x4 a, int lane) {
+  f32 x[4], y[4], z[4];
+  v3x4_store(x, y, z, a);
+  return V3(x[lane], y[lane], z[lane]);
+}
+
+static inline v3x4
+v3x4_add(v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_add(a.x, b.x), f32x4_add(a.y, b.y), f32x4_add(a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_sub(v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_sub(a.x, b.x), f32x4_sub(a.y, b.y), f32x4_sub(a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_mul(v3x4 a, f32x4 f) {
+  v3x4 r = {f32x4_mul(a.x, f), f32x4_mul(a.y, f), f32x4_mul(a.z, f)};
+  return r;
+}
+
+static inline v3x4
+v3x4_hadamard(v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_mul(a.x, b.x), f32x4_mul(a.y, b.y), f32x4_mul(a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_neg(v3x4 a) {
+  v3x4 r = {f32x4_neg(a.x), f32x4_neg(a.y), f32x4_neg(a.z)};
+  return r;
+}
+
+static inline f32x4
+v3x4_dot(v3x4 a, v3x4 b) {
+  return f32x4_add(f32x4_add(f32x4_mul(a.x, b.x), f32x4_mul(a.y, b.y)), f32x4_mul(a.z, b.z));
+}
+
+static inline v3x4
+v3x4_cross(v3x4 a, v3x4 b) {
+  v3x4 r = {
+    f32x4_sub(f32x4_mul(a.y, b.z), f32x4_mul(a.z, b.y)),
+    f32x4_sub(f32x4_mul(a.z, b.x), f32x4_mul(a.x, b.z)),
+    f32x4_sub(f32x4_mul(a.x, b.y), f32x4_mul(a.y, b.x)),
+  };
+  return r;
+}
+
+static inline f32x4
+v3x4_magnitude(v3x4 a) {
+  return f32x4_sqrt(v3x4_dot(a, a));
+}
+
+static inline v3x4
+v3x4_unit(v3x4 a) {
+  return v3x4_mul(a, f32x4_div(f32x4_set1(1.0f), v3x4_magnitude(a)));
+}
+
+static inline v3x4
+v3x4_abs(v3x4 a) {
+  v3x4 r = {f32x4_abs(a.x), f32x4_abs(a.y), f32x4_abs(a.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_min(v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_min(a.x, b.x), f32x4_min(a.y, b.y), f32x4_min(a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_max(v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_max(a.x, b.x), f32x4_max(a.y, b.y), f32x4_max(a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_lerp(v3x4 a, f32x4 t, v3x4 b) {
+  v3x4 r = {
+    f32x4_mul_add(f32x4_sub(b.x, a.x), t, a.x),
+    f32x4_mul_add(f32x4_sub(b.y, a.y), t, a.y),
+    f32x4_mul_add(f32x4_sub(b.z, a.z), t, a.z),
+  };
+  return r;
+}
+
+// m ? a : b per lane.
+static inline v3x4
+v3x4_select(f32x4_mask m, v3x4 a, v3x4 b) {
+  v3x4 r = {f32x4_select(m, a.x, b.x), f32x4_select(m, a.y, b.y), f32x4_select(m, a.z, b.z)};
+  return r;
+}
+
+static inline v3x4
+v3x4_mul3x3(m3x3 m, v3x4 v) {
+  v3x4 r;
+  r.x = f32x4_mul_add(f32x4_set1(m.e[2][0]), v.z, f32x4_mul_add(f32x4_set1(m.e[1][0]), v.y, f32x4_mul(f32x4_set1(m.e[0][0]), v.x)));
+  r.y = f32x4_mul_add(f32x4_set1(m.e[2][1]), v.z, f32x4_mul_add(f32x4_set1(m.e[1][1]), v.y, f32x4_mul(f32x4_set1(m.e[0][1]), v.x)));
+  r.z = f32x4_mul_add(f32x4_set1(m.e[2][2]), v.z, f32x4_mul_add(f32x4_set1(m.e[1][2]), v.y, f32x4_mul(f32x4_set1(m.e[0][2]), v.x)));
+  return r;
+}
+
+// Same as transform_point4x4 for 4 points at once.
+static inline v3x4
+v3x4_transform_point(m4x4 m, v3x4 p) {
+  v3x4 r;
+  r.x = f32x4_mul_add(f32x4_set1(m.e[2][0]), p.z, f32x4_mul_add(f32x4_set1(m.e[1][0]), p.y, f32x4_mul_add(f32x4_set1(m.e[0][0]), p.x, f32x4_set1(m.e[3][0]))));
+  r.y = f32x4_mul_add(f32x4_set1(m.e[2][1]), p.z, f32x4_mul_add(f32x4_set1(m.e[1][1]), p.y, f32x4_mul_add(f32x4_set1(m.e[0][1]), p.x, f32x4_set1(m.e[3][1]))));
+  r.z = f32x4_mul_add(f32x4_set1(m.e[2][2]), p.z, f32x4_mul_add(f32x4_set1(m.e[1][2]), p.y, f32x4_mul_add(f32x4_set1(m.e[0][2]), p.x, f32x4_set1(m.e[3][2]))));
+  return r;
+}
+
+typedef struct v3x8 {
+  f32x8 x;
+  f32x8 y;
+  f32x8 z;
+} v3x8;
+
+static inline v3x8
+v3x8_set1(v3 a) {
+  v3x8 r = {f32x8_set1(a.x), f32x8_set1(a.y), f32x8_set1(a.z)};
+  return r;
+}
+
+// From SoA arrays, 8 floats each.
+static inline v3x8
+v3x8_load(const f32* x, const f32* y, const f32* z) {
+  v3x8 r = {f32x8_load(x), f32x8_load(y), f32x8_load(z)};
+  return r;
+}
+
+static inline void
+v3x8_store(f32* x, f32* y, f32* z, v3x8 a) {
+  f32x8_store(x, a.x);
+  f32x8_store(y, a.y);
+  f32x8_store(z, a.z);
+}
+
+static inline v3
+v3x8_get(v3x8 a, int lane) {
+  f32 x[8], y[8], z[8];
+  v3x8_store(x, y, z, a);
+  return V3(x[lane], y[lane], z[lane]);
+}
+
+static inline v3x8
+v3x8_add(v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_add(a.x, b.x), f32x8_add(a.y, b.y), f32x8_add(a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_sub(v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_sub(a.x, b.x), f32x8_sub(a.y, b.y), f32x8_sub(a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_mul(v3x8 a, f32x8 f) {
+  v3x8 r = {f32x8_mul(a.x, f), f32x8_mul(a.y, f), f32x8_mul(a.z, f)};
+  return r;
+}
+
+static inline v3x8
+v3x8_hadamard(v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_mul(a.x, b.x), f32x8_mul(a.y, b.y), f32x8_mul(a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_neg(v3x8 a) {
+  v3x8 r = {f32x8_neg(a.x), f32x8_neg(a.y), f32x8_neg(a.z)};
+  return r;
+}
+
+static inline f32x8
+v3x8_dot(v3x8 a, v3x8 b) {
+  return f32x8_add(f32x8_add(f32x8_mul(a.x, b.x), f32x8_mul(a.y, b.y)), f32x8_mul(a.z, b.z));
+}
+
+static inline v3x8
+v3x8_cross(v3x8 a, v3x8 b) {
+  v3x8 r = {
+    f32x8_sub(f32x8_mul(a.y, b.z), f32x8_mul(a.z, b.y)),
+    f32x8_sub(f32x8_mul(a.z, b.x), f32x8_mul(a.x, b.z)),
+    f32x8_sub(f32x8_mul(a.x, b.y), f32x8_mul(a.y, b.x)),
+  };
+  return r;
+}
+
+static inline f32x8
+v3x8_magnitude(v3x8 a) {
+  return f32x8_sqrt(v3x8_dot(a, a));
+}
+
+static inline v3x8
+v3x8_unit(v3x8 a) {
+  return v3x8_mul(a, f32x8_div(f32x8_set1(1.0f), v3x8_magnitude(a)));
+}
+
+static inline v3x8
+v3x8_abs(v3x8 a) {
+  v3x8 r = {f32x8_abs(a.x), f32x8_abs(a.y), f32x8_abs(a.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_min(v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_min(a.x, b.x), f32x8_min(a.y, b.y), f32x8_min(a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_max(v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_max(a.x, b.x), f32x8_max(a.y, b.y), f32x8_max(a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_lerp(v3x8 a, f32x8 t, v3x8 b) {
+  v3x8 r = {
+    f32x8_mul_add(f32x8_sub(b.x, a.x), t, a.x),
+    f32x8_mul_add(f32x8_sub(b.y, a.y), t, a.y),
+    f32x8_mul_add(f32x8_sub(b.z, a.z), t, a.z),
+  };
+  return r;
+}
+
+// m ? a : b per lane.
+static inline v3x8
+v3x8_select(f32x8_mask m, v3x8 a, v3x8 b) {
+  v3x8 r = {f32x8_select(m, a.x, b.x), f32x8_select(m, a.y, b.y), f32x8_select(m, a.z, b.z)};
+  return r;
+}
+
+static inline v3x8
+v3x8_mul3x3(m3x3 m, v3x8 v) {
+  v3x8 r;
+  r.x = f32x8_mul_add(f32x8_set1(m.e[2][0]), v.z, f32x8_mul_add(f32x8_set1(m.e[1][0]), v.y, f32x8_mul(f32x8_set1(m.e[0][0]), v.x)));
+  r.y = f32x8_mul_add(f32x8_set1(m.e[2][1]), v.z, f32x8_mul_add(f32x8_set1(m.e[1][1]), v.y, f32x8_mul(f32x8_set1(m.e[0][1]), v.x)));
+  r.z = f32x8_mul_add(f32x8_set1(m.e[2][2]), v.z, f32x8_mul_add(f32x8_set1(m.e[1][2]), v.y, f32x8_mul(f32x8_set1(m.e[0][2]), v.x)));
+  return r;
+}
+
+// Same as transform_point4x4 for 8 points at once.
+static inline v3x8
+v3x8_transform_point(m4x4 m, v3x8 p) {
+  v3x8 r;
+  r.x = f32x8_mul_add(f32x8_set1(m.e[2][0]), p.z, f32x8_mul_add(f32x8_set1(m.e[1][0]), p.y, f32x8_mul_add(f32x8_set1(m.e[0][0]), p.x, f32x8_set1(m.e[3][0]))));
+  r.y = f32x8_mul_add(f32x8_set1(m.e[2][1]), p.z, f32x8_mul_add(f32x8_set1(m.e[1][1]), p.y, f32x8_mul_add(f32x8_set1(m.e[0][1]), p.x, f32x8_set1(m.e[3][1]))));
+  r.z = f32x8_mul_add(f32x8_set1(m.e[2][2]), p.z, f32x8_mul_add(f32x8_set1(m.e[1][2]), p.y, f32x8_mul_add(f32x8_set1(m.e[0][2]), p.x, f32x8_set1(m.e[3][2]))));
+  return r;
+}
+
 //
 // color operations
 //
@@ -355,6 +896,19 @@ round_f32_to_u32(f32 f) {
   return (u32)(f + 0.5f);
 }
 
+// 0-1 channels to RGBA8, r in the low byte, as Metal's unpack_unorm4x8_to_float
+// expects.
+static inline u32 
+rgba_pack4(v4 color) {
+  v4 c = max4(min4(color, V4(1, 1, 1, 1)), V4(0, 0, 0, 0));
+  return (
+    (round_f32_to_u32(c.a * 255.0f) << 24) |
+    (round_f32_to_u32(c.b * 255.0f) << 16) |
+    (round_f32_to_u32(c.g * 255.0f) << 8) |
+    (round_f32_to_u32(c.r * 255.0f) << 0)
+  );
+}
+
 static inline u32 
 bgra_pack3(v3 unpacked) {
   u32 r = (
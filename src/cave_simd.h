@@ -0,0 +1,467 @@
+#pragma once
+
+//
+// f32x4 and f32x8 and their lane masks, over whatever SIMD the target has.
+// CAVE_SIMD picks the instruction set at compile time: SSE needs SSE2 (and
+// uses SSE4.1, AVX and FMA when they are there), NEON needs AArch64, NONE is
+// plain C for everything else. Without AVX an f32x8 is two f32x4s.
+//
+// A mask lane is all ones when true and all zeros when false, whatever the
+// instruction set, so masks can be and'ed, or'ed and selected with.
+//
+
+#define CAVE_SIMD_NONE 0
+#define CAVE_SIMD_SSE  1
+#define CAVE_SIMD_NEON 2
+
+#ifndef CAVE_SIMD
+  #if defined(__SSE2__) || defined(_M_X64)
+    #define CAVE_SIMD CAVE_SIMD_SSE
+  #elif defined(__ARM_NEON) && defined(__aarch64__)
+    #define CAVE_SIMD CAVE_SIMD_NEON
+  #else
+    #define CAVE_SIMD CAVE_SIMD_NONE
+  #endif
+#endif
+
+#if CAVE_SIMD == CAVE_SIMD_SSE
+
+#include <immintrin.h>
+
+typedef __m128 f32x4;
+typedef __m128 f32x4_mask;
+
+static inline f32x4 f32x4_set1(f32 a) { return _mm_set1_ps(a); }
+static inline f32x4 f32x4_set(f32 a, f32 b, f32 c, f32 d) { return _mm_setr_ps(a, b, c, d); }
+static inline f32x4 f32x4_load(const f32* a) { return _mm_loadu_ps(a); }
+static inline void f32x4_store(f32* dst, f32x4 a) { _mm_storeu_ps(dst, a); }
+static inline f32x4 f32x4_index(void) { return _mm_setr_ps(0, 1, 2, 3); }
+
+static inline f32x4 f32x4_add(f32x4 a, f32x4 b) { return _mm_add_ps(a, b); }
+static inline f32x4 f32x4_sub(f32x4 a, f32x4 b) { return _mm_sub_ps(a, b); }
+static inline f32x4 f32x4_mul(f32x4 a, f32x4 b) { return _mm_mul_ps(a, b); }
+static inline f32x4 f32x4_div(f32x4 a, f32x4 b) { return _mm_div_ps(a, b); }
+static inline f32x4 f32x4_min(f32x4 a, f32x4 b) { return _mm_min_ps(a, b); }
+static inline f32x4 f32x4_max(f32x4 a, f32x4 b) { return _mm_max_ps(a, b); }
+static inline f32x4 f32x4_sqrt(f32x4 a) { return _mm_sqrt_ps(a); }
+static inline f32x4 f32x4_abs(f32x4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline f32x4 f32x4_neg(f32x4 a) { return _mm_xor_ps(_mm_set1_ps(-0.0f), a); }
+// a*b + c, fused when the target has FMA.
+static inline f32x4 f32x4_mul_add(f32x4 a, f32x4 b, f32x4 c) {
+#if defined(__FMA__)
+  return _mm_fmadd_ps(a, b, c);
+#else
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+static inline f32x4_mask f32x4_lt(f32x4 a, f32x4 b) { return _mm_cmplt_ps(a, b); }
+static inline f32x4_mask f32x4_le(f32x4 a, f32x4 b) { return _mm_cmple_ps(a, b); }
+static inline f32x4_mask f32x4_gt(f32x4 a, f32x4 b) { return _mm_cmpgt_ps(a, b); }
+static inline f32x4_mask f32x4_ge(f32x4 a, f32x4 b) { return _mm_cmpge_ps(a, b); }
+static inline f32x4_mask f32x4_eq(f32x4 a, f32x4 b) { return _mm_cmpeq_ps(a, b); }
+static inline f32x4_mask f32x4_and(f32x4_mask a, f32x4_mask b) { return _mm_and_ps(a, b); }
+static inline f32x4_mask f32x4_or(f32x4_mask a, f32x4_mask b) { return _mm_or_ps(a, b); }
+static inline f32x4_mask f32x4_andnot(f32x4_mask a, f32x4_mask b) { return _mm_andnot_ps(a, b); } // ~a & b
+static inline f32x4_mask f32x4_all_mask(void) { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+static inline f32x4 f32x4_select(f32x4_mask m, f32x4 a, f32x4 b) {
+#if defined(__SSE4_1__)
+  return _mm_blendv_ps(b, a, m);
+#else
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+#endif
+}
+static inline u32 f32x4_bits(f32x4_mask m) { return (u32)_mm_movemask_ps(m); }
+
+// |a| < 2^31.
+static inline f32x4 f32x4_floor(f32x4 a) {
+#if defined(__SSE4_1__)
+  return _mm_floor_ps(a);
+#else
+  f32x4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+#endif
+}
+// 2^n for integer valued n in [-126, 127].
+static inline f32x4 f32x4_exp2i(f32x4 n) {
+  f32x4 biased = _mm_mul_ps(_mm_add_ps(n, _mm_set1_ps(127.0f)), _mm_set1_ps(8388608.0f));
+  return _mm_castsi128_ps(_mm_cvtps_epi32(biased));
+}
+// Unbiased exponent of a normal a, as a float.
+static inline f32x4 f32x4_exponent(f32x4 a) {
+  f32x4 bits = _mm_cvtepi32_ps(_mm_castps_si128(_mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x7F800000)))));
+  return _mm_sub_ps(_mm_mul_ps(bits, _mm_set1_ps(1.0f/8388608.0f)), _mm_set1_ps(127.0f));
+}
+// a with its exponent replaced by 0, in [1, 2) for a normal a > 0.
+static inline f32x4 f32x4_mantissa(f32x4 a) {
+  return _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(1.0f));
+}
+
+// Truncates a in [0, 2^31) to integers and stores them or'ed with bits.
+static inline void f32x4_store_u32(u32* dst, f32x4 a, u32 bits) {
+  _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_cvttps_epi32(a), _mm_set1_epi32((int)bits)));
+}
+// Same, bypassing the cache. dst must be 16 byte aligned, and the stores are
+// only ordered with others after cave_stream_fence.
+static inline void f32x4_stream_u32(u32* dst, f32x4 a, u32 bits) {
+  _mm_stream_si128((__m128i*)dst, _mm_or_si128(_mm_cvttps_epi32(a), _mm_set1_epi32((int)bits)));
+}
+static inline void cave_stream_fence(void) { _mm_sfence(); }
+
+static inline f32 f32x4_hmin(f32x4 a) {
+  a = _mm_min_ps(a, _mm_movehl_ps(a, a));
+  a = _mm_min_ss(a, _mm_shuffle_ps(a, a, 1));
+  return _mm_cvtss_f32(a);
+}
+
+static inline f32 f32x4_hmax(f32x4 a) {
+  a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+  a = _mm_max_ss(a, _mm_shuffle_ps(a, a, 1));
+  return _mm_cvtss_f32(a);
+}
+
+static inline f32 f32x4_hsum(f32x4 a) {
+  a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+  return _mm_cvtss_f32(a);
+}
+
+#elif CAVE_SIMD == CAVE_SIMD_NEON
+
+#include <arm_neon.h>
+
+typedef float32x4_t f32x4;
+typedef uint32x4_t f32x4_mask;
+
+static inline f32x4 f32x4_set1(f32 a) { return vdupq_n_f32(a); }
+static inline f32x4 f32x4_set(f32 a, f32 b, f32 c, f32 d) { f32 e[4] = {a, b, c, d}; return vld1q_f32(e); }
+static inline f32x4 f32x4_load(const f32* a) { return vld1q_f32(a); }
+static inline void f32x4_store(f32* dst, f32x4 a) { vst1q_f32(dst, a); }
+static inline f32x4 f32x4_index(void) { return f32x4_set(0, 1, 2, 3); }
+
+static inline f32x4 f32x4_add(f32x4 a, f32x4 b) { return vaddq_f32(a, b); }
+static inline f32x4 f32x4_sub(f32x4 a, f32x4 b) { return vsubq_f32(a, b); }
+static inline f32x4 f32x4_mul(f32x4 a, f32x4 b) { return vmulq_f32(a, b); }
+static inline f32x4 f32x4_div(f32x4 a, f32x4 b) { return vdivq_f32(a, b); }
+static inline f32x4 f32x4_min(f32x4 a, f32x4 b) { return vminq_f32(a, b); }
+static inline f32x4 f32x4_max(f32x4 a, f32x4 b) { return vmaxq_f32(a, b); }
+static inline f32x4 f32x4_sqrt(f32x4 a) { return vsqrtq_f32(a); }
+static inline f32x4 f32x4_abs(f32x4 a) { return vabsq_f32(a); }
+static inline f32x4 f32x4_neg(f32x4 a) { return vnegq_f32(a); }
+static inline f32x4 f32x4_mul_add(f32x4 a, f32x4 b, f32x4 c) { return vfmaq_f32(c, a, b); }
+
+static inline f32x4_mask f32x4_lt(f32x4 a, f32x4 b) { return vcltq_f32(a, b); }
+static inline f32x4_mask f32x4_le(f32x4 a, f32x4 b) { return vcleq_f32(a, b); }
+static inline f32x4_mask f32x4_gt(f32x4 a, f32x4 b) { return vcgtq_f32(a, b); }
+static inline f32x4_mask f32x4_ge(f32x4 a, f32x4 b) { return vcgeq_f32(a, b); }
+static inline f32x4_mask f32x4_eq(f32x4 a, f32x4 b) { return vceqq_f32(a, b); }
+static inline f32x4_mask f32x4_and(f32x4_mask a, f32x4_mask b) { return vandq_u32(a, b); }
+static inline f32x4_mask f32x4_or(f32x4_mask a, f32x4_mask b) { return vorrq_u32(a, b); }
+static inline f32x4_mask f32x4_andnot(f32x4_mask a, f32x4_mask b) { return vbicq_u32(b, a); } // ~a & b
+static inline f32x4_mask f32x4_all_mask(void) { return vdupq_n_u32(0xFFFFFFFFu); }
+static inline f32x4 f32x4_select(f32x4_mask m, f32x4 a, f32x4 b) { return vbslq_f32(m, a, b); }
+static inline u32 f32x4_bits(f32x4_mask m) {
+  const u32 weights[4] = {1, 2, 4, 8};
+  return vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+}
+
+static inline f32x4 f32x4_floor(f32x4 a) { return vrndmq_f32(a); }
+static inline f32x4 f32x4_exp2i(f32x4 n) {
+  return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23));
+}
+static inline f32x4 f32x4_exponent(f32x4 a) {
+  int32x4_t biased = vreinterpretq_s32_u32(vshrq_n_u32(vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x7F800000)), 23));
+  return vcvtq_f32_s32(vsubq_s32(biased, vdupq_n_s32(127)));
+}
+static inline f32x4 f32x4_mantissa(f32x4 a) {
+  uint32x4_t bits = vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x007FFFFF));
+  return vreinterpretq_f32_u32(vorrq_u32(bits, vdupq_n_u32(0x3F800000)));
+}
+
+static inline void f32x4_store_u32(u32* dst, f32x4 a, u32 bits) { vst1q_u32(dst, vorrq_u32(vcvtq_u32_f32(a), vdupq_n_u32(bits))); }
+// No non temporal store intrinsic, a plain store it is.
+static inline void f32x4_stream_u32(u32* dst, f32x4 a, u32 bits) { f32x4_store_u32(dst, a, bits); }
+static inline void cave_stream_fence(void) {}
+
+static inline f32 f32x4_hmin(f32x4 a) { return vminvq_f32(a); }
+static inline f32 f32x4_hmax(f32x4 a) { return vmaxvq_f32(a); }
+static inline f32 f32x4_hsum(f32x4 a) { return vaddvq_f32(a); }
+
+#elif CAVE_SIMD == CAVE_SIMD_NONE
+
+typedef struct f32x4 { f32 e[4]; } f32x4;
+typedef struct f32x4_mask { u32 e[4]; } f32x4_mask;
+
+#define F32X4_MAP(expr) f32x4 r; for (int i=0; i < 4; i++) r.e[i] = (expr); return r
+#define F32X4_TEST(expr) f32x4_mask r; for (int i=0; i < 4; i++) r.e[i] = (expr) ? 0xFFFFFFFFu : 0; return r
+
+static inline f32x4 f32x4_set1(f32 a) { F32X4_MAP(a); }
+static inline f32x4 f32x4_set(f32 a, f32 b, f32 c, f32 d) { f32x4 r = {{a, b, c, d}}; return r; }
+static inline f32x4 f32x4_load(const f32* a) { F32X4_MAP(a[i]); }
+static inline void f32x4_store(f32* dst, f32x4 a) { for (int i=0; i < 4; i++) dst[i] = a.e[i]; }
+static inline f32x4 f32x4_index(void) { F32X4_MAP((f32)i); }
+
+static inline f32x4 f32x4_add(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] + b.e[i]); }
+static inline f32x4 f32x4_sub(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] - b.e[i]); }
+static inline f32x4 f32x4_mul(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] * b.e[i]); }
+static inline f32x4 f32x4_div(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] / b.e[i]); }
+static inline f32x4 f32x4_min(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] < b.e[i] ? a.e[i] : b.e[i]); }
+static inline f32x4 f32x4_max(f32x4 a, f32x4 b) { F32X4_MAP(a.e[i] > b.e[i] ? a.e[i] : b.e[i]); }
+static inline f32x4 f32x4_sqrt(f32x4 a) { F32X4_MAP(sqrtf(a.e[i])); }
+static inline f32x4 f32x4_abs(f32x4 a) { F32X4_MAP(fabsf(a.e[i])); }
+static inline f32x4 f32x4_neg(f32x4 a) { F32X4_MAP(-a.e[i]); }
+static inline f32x4 f32x4_mul_add(f32x4 a, f32x4 b, f32x4 c) { F32X4_MAP(a.e[i]*b.e[i] + c.e[i]); }
+
+static inline f32x4_mask f32x4_lt(f32x4 a, f32x4 b) { F32X4_TEST(a.e[i] < b.e[i]); }
+static inline f32x4_mask f32x4_le(f32x4 a, f32x4 b) { F32X4_TEST(a.e[i] <= b.e[i]); }
+static inline f32x4_mask f32x4_gt(f32x4 a, f32x4 b) { F32X4_TEST(a.e[i] > b.e[i]); }
+static inline f32x4_mask f32x4_ge(f32x4 a, f32x4 b) { F32X4_TEST(a.e[i] >= b.e[i]); }
+static inline f32x4_mask f32x4_eq(f32x4 a, f32x4 b) { F32X4_TEST(a.e[i] == b.e[i]); }
+static inline f32x4_mask f32x4_and(f32x4_mask a, f32x4_mask b) { F32X4_TEST(a.e[i] & b.e[i]); }
+static inline f32x4_mask f32x4_or(f32x4_mask a, f32x4_mask b) { F32X4_TEST(a.e[i] | b.e[i]); }
+static inline f32x4_mask f32x4_andnot(f32x4_mask a, f32x4_mask b) { F32X4_TEST(~a.e[i] & b.e[i]); } // ~a & b
+static inline f32x4_mask f32x4_all_mask(void) { F32X4_TEST(true); }
+static inline f32x4 f32x4_select(f32x4_mask m, f32x4 a, f32x4 b) { F32X4_MAP(m.e[i] ? a.e[i] : b.e[i]); }
+static inline u32 f32x4_bits(f32x4_mask m) {
+  u32 r = 0;
+  for (int i=0; i < 4; i++) r |= (m.e[i] ? 1u : 0u) << i;
+  return r;
+}
+
+typedef union f32x4_bits_t { f32 f; u32 u; } f32x4_bits_t;
+
+static inline f32x4 f32x4_floor(f32x4 a) { F32X4_MAP(floorf(a.e[i])); }
+static inline f32x4 f32x4_exp2i(f32x4 n) {
+  f32x4 r;
+  for (int i=0; i < 4; i++) {
+    f32x4_bits_t b = {.u = (u32)((s32)n.e[i] + 127) << 23};
+    r.e[i] = b.f;
+  }
+  return r;
+}
+static inline f32x4 f32x4_exponent(f32x4 a) {
+  f32x4 r;
+  for (int i=0; i < 4; i++) {
+    f32x4_bits_t b = {a.e[i]};
+    r.e[i] = (f32)((s32)((b.u >> 23) & 0xFF) - 127);
+  }
+  return r;
+}
+static inline f32x4 f32x4_mantissa(f32x4 a) {
+  f32x4 r;
+  for (int i=0; i < 4; i++) {
+    f32x4_bits_t b = {a.e[i]};
+    b.u = (b.u & 0x007FFFFF) | 0x3F800000;
+    r.e[i] = b.f;
+  }
+  return r;
+}
+
+static inline void f32x4_store_u32(u32* dst, f32x4 a, u32 bits) { for (int i=0; i < 4; i++) dst[i] = (u32)a.e[i] | bits; }
+static inline void f32x4_stream_u32(u32* dst, f32x4 a, u32 bits) { f32x4_store_u32(dst, a, bits); }
+static inline void cave_stream_fence(void) {}
+
+static inline f32 f32x4_hmin(f32x4 a) { return fminf(fminf(a.e[0], a.e[1]), fminf(a.e[2], a.e[3])); }
+static inline f32 f32x4_hmax(f32x4 a) { return fmaxf(fmaxf(a.e[0], a.e[1]), fmaxf(a.e[2], a.e[3])); }
+static inline f32 f32x4_hsum(f32x4 a) { return (a.e[0] + a.e[2]) + (a.e[1] + a.e[3]); }
+
+#undef F32X4_MAP
+#undef F32X4_TEST
+
+#else
+#error "CAVE_SIMD must be CAVE_SIMD_NONE, CAVE_SIMD_SSE or CAVE_SIMD_NEON"
+#endif
+
+static inline f32x4 f32x4_zero(void) { return f32x4_set1(0.0f); }
+static inline f32x4 f32x4_clamp01(f32x4 a) { return f32x4_min(f32x4_max(a, f32x4_zero()), f32x4_set1(1.0f)); }
+static inline bool f32x4_any(f32x4_mask m) { return f32x4_bits(m) != 0; }
+static inline bool f32x4_all(f32x4_mask m) { return f32x4_bits(m) == 0xF; }
+
+static inline f32 f32x4_get(f32x4 a, int lane) {
+  f32 e[4];
+  f32x4_store(e, a);
+  return e[lane];
+}
+
+//
+// f16, for buffers stored as IEEE halfs. Conversions round to nearest even
+// and keep infinities, NaNs and denormals.
+//
+
+typedef union f16_bits_t { f32 f; u32 u; } f16_bits_t;
+
+static inline f32 f32_from_f16(u16 h) {
+  // Shift the exponent and mantissa into place and rescale by 2^112, which
+  // handles denormals too. Infinities and NaNs get the top exponent back.
+  f16_bits_t v;
+  v.u = (u32)(h & 0x7FFF) << 13;
+  v.f *= 5.192296858534828e+33f; // 2^112
+  if ((h & 0x7C00) == 0x7C00) v.u |= 0x7F800000;
+  v.u |= (u32)(h & 0x8000) << 16;
+  return v.f;
+}
+
+static inline u16 f16_from_f32(f32 f) {
+  f16_bits_t v = {f};
+  u32 sign = (v.u >> 16) & 0x8000;
+  v.u &= 0x7FFFFFFF;
+  u32 h;
+  if (v.u >= 0x7F800000) {
+    h = v.u > 0x7F800000 ? 0x7E00 : 0x7C00;
+  } else if (v.u >= 0x477FF000) { // rounds to 65536 or more
+    h = 0x7C00;
+  } else if (v.u < 0x38800000) { // denormal, let the float adder round it
+    v.f += 0.5f;
+    h = v.u - 0x3F000000;
+  } else {
+    u32 odd = (v.u >> 13) & 1;
+    v.u += 0xC8000FFF + odd; // rebias to 15 and round to nearest even
+    h = v.u >> 13;
+  }
+  return (u16)(sign | h);
+}
+
+//
+// f32x8
+//
+
+#if CAVE_SIMD == CAVE_SIMD_SSE && defined(__AVX__)
+
+#define CAVE_SIMD_NATIVE_X8 1
+
+typedef __m256 f32x8;
+typedef __m256 f32x8_mask;
+
+static inline f32x8 f32x8_set1(f32 a) { return _mm256_set1_ps(a); }
+static inline f32x8 f32x8_load(const f32* a) { return _mm256_loadu_ps(a); }
+static inline void f32x8_store(f32* dst, f32x8 a) { _mm256_storeu_ps(dst, a); }
+static inline f32x8 f32x8_index(void) { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+static inline f32x8 f32x8_add(f32x8 a, f32x8 b) { return _mm256_add_ps(a, b); }
+static inline f32x8 f32x8_sub(f32x8 a, f32x8 b) { return _mm256_sub_ps(a, b); }
+static inline f32x8 f32x8_mul(f32x8 a, f32x8 b) { return _mm256_mul_ps(a, b); }
+static inline f32x8 f32x8_div(f32x8 a, f32x8 b) { return _mm256_div_ps(a, b); }
+static inline f32x8 f32x8_min(f32x8 a, f32x8 b) { return _mm256_min_ps(a, b); }
+static inline f32x8 f32x8_max(f32x8 a, f32x8 b) { return _mm256_max_ps(a, b); }
+static inline f32x8 f32x8_sqrt(f32x8 a) { return _mm256_sqrt_ps(a); }
+static inline f32x8 f32x8_abs(f32x8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline f32x8 f32x8_neg(f32x8 a) { return _mm256_xor_ps(_mm256_set1_ps(-0.0f), a); }
+static inline f32x8 f32x8_mul_add(f32x8 a, f32x8 b, f32x8 c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#else
+  return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline f32x8_mask f32x8_lt(f32x8 a, f32x8 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline f32x8_mask f32x8_le(f32x8 a, f32x8 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline f32x8_mask f32x8_gt(f32x8 a, f32x8 b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline f32x8_mask f32x8_ge(f32x8 a, f32x8 b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline f32x8_mask f32x8_eq(f32x8 a, f32x8 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline f32x8_mask f32x8_and(f32x8_mask a, f32x8_mask b) { return _mm256_and_ps(a, b); }
+static inline f32x8_mask f32x8_or(f32x8_mask a, f32x8_mask b) { return _mm256_or_ps(a, b); }
+static inline f32x8_mask f32x8_andnot(f32x8_mask a, f32x8_mask b) { return _mm256_andnot_ps(a, b); } // ~a & b
+static inline f32x8_mask f32x8_all_mask(void) { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+static inline f32x8 f32x8_select(f32x8_mask m, f32x8 a, f32x8 b) { return _mm256_blendv_ps(b, a, m); }
+static inline u32 f32x8_bits(f32x8_mask m) { return (u32)_mm256_movemask_ps(m); }
+
+static inline f32x8 f32x8_floor(f32x8 a) { return _mm256_floor_ps(a); }
+static inline f32x8 f32x8_exp2i(f32x8 n) {
+  f32x8 biased = _mm256_mul_ps(_mm256_add_ps(n, _mm256_set1_ps(127.0f)), _mm256_set1_ps(8388608.0f));
+  return _mm256_castsi256_ps(_mm256_cvtps_epi32(biased));
+}
+static inline f32x8 f32x8_exponent(f32x8 a) {
+  f32x8 bits = _mm256_cvtepi32_ps(_mm256_castps_si256(_mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x7F800000)))));
+  return _mm256_sub_ps(_mm256_mul_ps(bits, _mm256_set1_ps(1.0f/8388608.0f)), _mm256_set1_ps(127.0f));
+}
+static inline f32x8 f32x8_mantissa(f32x8 a) {
+  return _mm256_or_ps(_mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x007FFFFF))), _mm256_set1_ps(1.0f));
+}
+
+// Truncates a in [0, 2^31) to integers and stores them or'ed with bits.
+static inline void f32x8_store_u32(u32* dst, f32x8 a, u32 bits) {
+  _mm256_storeu_si256((__m256i*)dst, _mm256_castps_si256(_mm256_or_ps(_mm256_castsi256_ps(_mm256_cvttps_epi32(a)), _mm256_castsi256_ps(_mm256_set1_epi32((int)bits)))));
+}
+// Same, bypassing the cache. dst must be 32 byte aligned, see f32x4_stream_u32.
+static inline void f32x8_stream_u32(u32* dst, f32x8 a, u32 bits) {
+  _mm256_stream_si256((__m256i*)dst, _mm256_castps_si256(_mm256_or_ps(_mm256_castsi256_ps(_mm256_cvttps_epi32(a)), _mm256_castsi256_ps(_mm256_set1_epi32((int)bits)))));
+}
+static inline f32x8 f32x8_load_f16(const u16* a) {
+#if defined(__F16C__)
+  return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)a));
+#else
+  f32 e[8];
+  for (int i=0; i < 8; i++) e[i] = f32_from_f16(a[i]);
+  return _mm256_loadu_ps(e);
+#endif
+}
+
+static inline f32 f32x8_hmin(f32x8 a) { return f32x4_hmin(_mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1))); }
+static inline f32 f32x8_hmax(f32x8 a) { return f32x4_hmax(_mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1))); }
+static inline f32 f32x8_hsum(f32x8 a) { return f32x4_hsum(_mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1))); }
+
+#else
+
+#define CAVE_SIMD_NATIVE_X8 0
+
+typedef struct f32x8 { f32x4 lo, hi; } f32x8;
+typedef struct f32x8_mask { f32x4_mask lo, hi; } f32x8_mask;
+
+static inline f32x8 f32x8_set1(f32 a) { f32x8 r = {f32x4_set1(a), f32x4_set1(a)}; return r; }
+static inline f32x8 f32x8_load(const f32* a) { f32x8 r = {f32x4_load(a), f32x4_load(a + 4)}; return r; }
+static inline void f32x8_store(f32* dst, f32x8 a) { f32x4_store(dst, a.lo); f32x4_store(dst + 4, a.hi); }
+static inline f32x8 f32x8_index(void) { f32x8 r = {f32x4_set(0, 1, 2, 3), f32x4_set(4, 5, 6, 7)}; return r; }
+
+static inline f32x8 f32x8_add(f32x8 a, f32x8 b) { f32x8 r = {f32x4_add(a.lo, b.lo), f32x4_add(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_sub(f32x8 a, f32x8 b) { f32x8 r = {f32x4_sub(a.lo, b.lo), f32x4_sub(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_mul(f32x8 a, f32x8 b) { f32x8 r = {f32x4_mul(a.lo, b.lo), f32x4_mul(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_div(f32x8 a, f32x8 b) { f32x8 r = {f32x4_div(a.lo, b.lo), f32x4_div(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_min(f32x8 a, f32x8 b) { f32x8 r = {f32x4_min(a.lo, b.lo), f32x4_min(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_max(f32x8 a, f32x8 b) { f32x8 r = {f32x4_max(a.lo, b.lo), f32x4_max(a.hi, b.hi)}; return r; }
+static inline f32x8 f32x8_sqrt(f32x8 a) { f32x8 r = {f32x4_sqrt(a.lo), f32x4_sqrt(a.hi)}; return r; }
+static inline f32x8 f32x8_abs(f32x8 a) { f32x8 r = {f32x4_abs(a.lo), f32x4_abs(a.hi)}; return r; }
+static inline f32x8 f32x8_neg(f32x8 a) { f32x8 r = {f32x4_neg(a.lo), f32x4_neg(a.hi)}; return r; }
+static inline f32x8 f32x8_mul_add(f32x8 a, f32x8 b, f32x8 c) { f32x8 r = {f32x4_mul_add(a.lo, b.lo, c.lo), f32x4_mul_add(a.hi, b.hi, c.hi)}; return r; }
+
+static inline f32x8_mask f32x8_lt(f32x8 a, f32x8 b) { f32x8_mask r = {f32x4_lt(a.lo, b.lo), f32x4_lt(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_le(f32x8 a, f32x8 b) { f32x8_mask r = {f32x4_le(a.lo, b.lo), f32x4_le(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_gt(f32x8 a, f32x8 b) { f32x8_mask r = {f32x4_gt(a.lo, b.lo), f32x4_gt(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_ge(f32x8 a, f32x8 b) { f32x8_mask r = {f32x4_ge(a.lo, b.lo), f32x4_ge(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_eq(f32x8 a, f32x8 b) { f32x8_mask r = {f32x4_eq(a.lo, b.lo), f32x4_eq(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_and(f32x8_mask a, f32x8_mask b) { f32x8_mask r = {f32x4_and(a.lo, b.lo), f32x4_and(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_or(f32x8_mask a, f32x8_mask b) { f32x8_mask r = {f32x4_or(a.lo, b.lo), f32x4_or(a.hi, b.hi)}; return r; }
+static inline f32x8_mask f32x8_andnot(f32x8_mask a, f32x8_mask b) { f32x8_mask r = {f32x4_andnot(a.lo, b.lo), f32x4_andnot(a.hi, b.hi)}; return r; } // ~a & b
+static inline f32x8_mask f32x8_all_mask(void) { f32x8_mask r = {f32x4_all_mask(), f32x4_all_mask()}; return r; }
+static inline f32x8 f32x8_select(f32x8_mask m, f32x8 a, f32x8 b) { f32x8 r = {f32x4_select(m.lo, a.lo, b.lo), f32x4_select(m.hi, a.hi, b.hi)}; return r; }
+static inline u32 f32x8_bits(f32x8_mask m) { return f32x4_bits(m.lo) | (f32x4_bits(m.hi) << 4); }
+
+static inline f32x8 f32x8_floor(f32x8 a) { f32x8 r = {f32x4_floor(a.lo), f32x4_floor(a.hi)}; return r; }
+static inline f32x8 f32x8_exp2i(f32x8 n) { f32x8 r = {f32x4_exp2i(n.lo), f32x4_exp2i(n.hi)}; return r; }
+static inline f32x8 f32x8_exponent(f32x8 a) { f32x8 r = {f32x4_exponent(a.lo), f32x4_exponent(a.hi)}; return r; }
+static inline f32x8 f32x8_mantissa(f32x8 a) { f32x8 r = {f32x4_mantissa(a.lo), f32x4_mantissa(a.hi)}; return r; }
+
+static inline void f32x8_store_u32(u32* dst, f32x8 a, u32 bits) { f32x4_store_u32(dst, a.lo, bits); f32x4_store_u32(dst + 4, a.hi, bits); }
+static inline void f32x8_stream_u32(u32* dst, f32x8 a, u32 bits) { f32x4_stream_u32(dst, a.lo, bits); f32x4_stream_u32(dst + 4, a.hi, bits); }
+static inline f32x8 f32x8_load_f16(const u16* a) {
+  f32 e[8];
+  for (int i=0; i < 8; i++) e[i] = f32_from_f16(a[i]);
+  return f32x8_load(e);
+}
+
+static inline f32 f32x8_hmin(f32x8 a) { return f32x4_hmin(f32x4_min(a.lo, a.hi)); }
+static inline f32 f32x8_hmax(f32x8 a) { return f32x4_hmax(f32x4_max(a.lo, a.hi)); }
+static inline f32 f32x8_hsum(f32x8 a) { return f32x4_hsum(f32x4_add(a.lo, a.hi)); }
+
+#endif
+
+static inline f32x8 f32x8_zero(void) { return f32x8_set1(0.0f); }
+static inline f32x8 f32x8_clamp01(f32x8 a) { return f32x8_min(f32x8_max(a, f32x8_zero()), f32x8_set1(1.0f)); }
+static inline bool f32x8_any(f32x8_mask m) { return f32x8_bits(m) != 0; }
+static inline bool f32x8_all(f32x8_mask m) { return f32x8_bits(m) == 0xFF; }
+
+static inline f32 f32x8_get(f32x8 a, int lane) {
+  f32 e[8];
+  f32x8_store(e, a);
+  return e[lane];
+}
@@ -0,0 +1,36 @@
+//
+// CPU port of shaders/common.metal.
+//
+
+// http://reedbeta.com/blog/quick-and-easy-gpu-random-numbers-in-d3d11/
+static inline u32 wang_hash(u32 seed) {
+  seed = (seed ^ 61) ^ (seed >> 16);
+  seed *= 9;
+  seed = seed ^ (seed >> 4);
+  seed *= 0x27d4eb2d;
+  seed = seed ^ (seed >> 15);
+  return seed;
+}
+
+static inline u32 xorshift32(u32* state) {
+  u32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static inline f32 randf(u32* state) {
+  return (xorshift32(state) & 0xFFFFFF) / 16777216.0f;
+}
+
+static inline v3 rand_unit3(u32* state) {
+  f32 z = randf(state) * 2.0f - 1.0f;
+  f32 a = randf(state) * 2.0f * M_PI;
+  f32 r = square_root(1.0f - z * z);
+  f32 x = r * fast_cos(a);
+  f32 y = r * fast_sin(a);
+  return V3(x, y, z);
+}
+
@@ -0,0 +1,183 @@
+#pragma once
+
+//
+// Lane types for marching packets of rays in SoA form, on top of the f32x8
+// and f32x4 in cave_simd.h. PACKET_WIDTH picks the width at compile time: 8
+// needs AVX2, 4 needs SSE2 or NEON, 1 is plain C for everything else.
+//
+
+#ifndef PACKET_WIDTH
+  #if defined(__AVX2__)
+    #define PACKET_WIDTH 8
+  #elif CAVE_SIMD != CAVE_SIMD_NONE
+    #define PACKET_WIDTH 4
+  #else
+    #define PACKET_WIDTH 1
+  #endif
+#endif
+
+#if PACKET_WIDTH == 8 || PACKET_WIDTH == 4
+
+#if PACKET_WIDTH == 8
+typedef f32x8 lane_f32;
+typedef f32x8_mask lane_mask;
+#define LANE_OP(op) f32x8_##op
+#else
+typedef f32x4 lane_f32;
+typedef f32x4_mask lane_mask;
+#define LANE_OP(op) f32x4_##op
+#endif
+
+static inline lane_f32 lane_set1(f32 a) { return LANE_OP(set1)(a); }
+static inline lane_f32 lane_load(const f32* a) { return LANE_OP(load)(a); }
+static inline void lane_store(f32* dst, lane_f32 a) { LANE_OP(store)(dst, a); }
+static inline lane_f32 lane_index(void) { return LANE_OP(index)(); }
+
+static inline lane_f32 lane_add(lane_f32 a, lane_f32 b) { return LANE_OP(add)(a, b); }
+static inline lane_f32 lane_sub(lane_f32 a, lane_f32 b) { return LANE_OP(sub)(a, b); }
+static inline lane_f32 lane_mul(lane_f32 a, lane_f32 b) { return LANE_OP(mul)(a, b); }
+static inline lane_f32 lane_div(lane_f32 a, lane_f32 b) { return LANE_OP(div)(a, b); }
+static inline lane_f32 lane_min(lane_f32 a, lane_f32 b) { return LANE_OP(min)(a, b); }
+static inline lane_f32 lane_max(lane_f32 a, lane_f32 b) { return LANE_OP(max)(a, b); }
+static inline lane_f32 lane_sqrt(lane_f32 a) { return LANE_OP(sqrt)(a); }
+static inline lane_f32 lane_abs(lane_f32 a) { return LANE_OP(abs)(a); }
+
+static inline lane_mask lane_lt(lane_f32 a, lane_f32 b) { return LANE_OP(lt)(a, b); }
+static inline lane_mask lane_le(lane_f32 a, lane_f32 b) { return LANE_OP(le)(a, b); }
+static inline lane_mask lane_gt(lane_f32 a, lane_f32 b) { return LANE_OP(gt)(a, b); }
+static inline lane_mask lane_and(lane_mask a, lane_mask b) { return LANE_OP(and)(a, b); }
+static inline lane_mask lane_or(lane_mask a, lane_mask b) { return LANE_OP(or)(a, b); }
+static inline lane_mask lane_andnot(lane_mask a, lane_mask b) { return LANE_OP(andnot)(a, b); } // ~a & b
+static inline lane_mask lane_all_mask(void) { return LANE_OP(all_mask)(); }
+static inline lane_f32 lane_select(lane_mask m, lane_f32 a, lane_f32 b) { return LANE_OP(select)(m, a, b); }
+static inline u32 lane_bits(lane_mask m) { return LANE_OP(bits)(m); }
+
+#undef LANE_OP
+
+#elif PACKET_WIDTH == 1
+
+typedef f32 lane_f32;
+typedef u32 lane_mask;
+
+static inline lane_f32 lane_set1(f32 a) { return a; }
+static inline lane_f32 lane_load(const f32* a) { return *a; }
+static inline void lane_store(f32* dst, lane_f32 a) { *dst = a; }
+static inline lane_f32 lane_index(void) { return 0; }
+
+static inline lane_f32 lane_add(lane_f32 a, lane_f32 b) { return a + b; }
+static inline lane_f32 lane_sub(lane_f32 a, lane_f32 b) { return a - b; }
+static inline lane_f32 lane_mul(lane_f32 a, lane_f32 b) { return a * b; }
+static inline lane_f32 lane_div(lane_f32 a, lane_f32 b) { return a / b; }
+static inline lane_f32 lane_min(lane_f32 a, lane_f32 b) { return a < b ? a : b; }
+static inline lane_f32 lane_max(lane_f32 a, lane_f32 b) { return a > b ? a : b; }
+static inline lane_f32 lane_sqrt(lane_f32 a) { return sqrtf(a); }
+static inline lane_f32 lane_abs(lane_f32 a) { return fabsf(a); }
+
+static inline lane_mask lane_lt(lane_f32 a, lane_f32 b) { return a < b; }
+static inline lane_mask lane_le(lane_f32 a, lane_f32 b) { return a <= b; }
+static inline lane_mask lane_gt(lane_f32 a, lane_f32 b) { return a > b; }
+static inline lane_mask lane_and(lane_mask a, lane_mask b) { return a & b; }
+static inline lane_mask lane_or(lane_mask a, lane_mask b) { return a | b; }
+static inline lane_mask lane_andnot(lane_mask a, lane_mask b) { return !a & b; }
+static inline lane_mask lane_all_mask(void) { return 1; }
+static inline lane_f32 lane_select(lane_mask m, lane_f32 a, lane_f32 b) { return m ? a : b; }
+static inline u32 lane_bits(lane_mask m) { return m; }
+
+#else
+#error "PACKET_WIDTH must be 1, 4 or 8"
+#endif
+
+static inline bool lane_any(lane_mask m) { return lane_bits(m) != 0; }
+static inline lane_f32 lane_clamp01(lane_f32 a) { return lane_min(lane_max(a, lane_set1(0.0f)), lane_set1(1.0f)); }
+
+// cave_fast_math.h only has 8 wide forms, narrower packets call the scalar
+// ones a lane at a time.
+#if PACKET_WIDTH == 8
+static inline lane_f32 lane_floor(lane_f32 a) { return f32x8_floor(a); }
+static inline lane_f32 lane_exp(lane_f32 a) { return f32x8_exp(a); }
+static inline lane_f32 lane_log(lane_f32 a) { return f32x8_log(a); }
+static inline lane_f32 lane_sin(lane_f32 a) { return f32x8_sin(a); }
+static inline lane_f32 lane_cos(lane_f32 a) { return f32x8_cos(a); }
+static inline lane_f32 lane_pow(lane_f32 a, lane_f32 b) { return f32x8_pow(a, b); }
+#else
+static inline lane_f32 lane_map(lane_f32 a, f32 (*f)(f32)) {
+  f32 e[PACKET_WIDTH];
+  lane_store(e, a);
+  for (int i=0; i < PACKET_WIDTH; i++) e[i] = f(e[i]);
+  return lane_load(e);
+}
+static inline lane_f32 lane_floor(lane_f32 a) { return lane_map(a, floorf); }
+static inline lane_f32 lane_exp(lane_f32 a) { return lane_map(a, fast_exp); }
+static inline lane_f32 lane_log(lane_f32 a) { return lane_map(a, fast_log); }
+static inline lane_f32 lane_sin(lane_f32 a) { return lane_map(a, fast_sin); }
+static inline lane_f32 lane_cos(lane_f32 a) { return lane_map(a, fast_cos); }
+static inline lane_f32 lane_pow(lane_f32 a, lane_f32 b) {
+  lane_f32 r = lane_exp(lane_mul(b, lane_log(a)));
+  return lane_select(lane_gt(a, lane_set1(0.0f)), r, lane_set1(0.0f));
+}
+#endif
+
+static inline lane_f32 lane_smoothstep(f32 edge0, f32 edge1, lane_f32 x) {
+  lane_f32 t = lane_clamp01(lane_mul(lane_sub(x, lane_set1(edge0)), lane_set1(1.0f / (edge1 - edge0))));
+  return lane_mul(lane_mul(t, t), lane_sub(lane_set1(3.0f), lane_add(t, t)));
+}
+
+//
+// lane_v3
+//
+
+typedef struct lane_v3 {
+  lane_f32 x;
+  lane_f32 y;
+  lane_f32 z;
+} lane_v3;
+
+static inline lane_v3 lane_v3_set1(v3 a) {
+  lane_v3 r = {lane_set1(a.x), lane_set1(a.y), lane_set1(a.z)};
+  return r;
+}
+
+static inline lane_v3 lane_add3(lane_v3 a, lane_v3 b) {
+  lane_v3 r = {lane_add(a.x, b.x), lane_add(a.y, b.y), lane_add(a.z, b.z)};
+  return r;
+}
+
+static inline lane_v3 lane_sub3(lane_v3 a, lane_v3 b) {
+  lane_v3 r = {lane_sub(a.x, b.x), lane_sub(a.y, b.y), lane_sub(a.z, b.z)};
+  return r;
+}
+
+static inline lane_v3 lane_mul3(lane_v3 a, lane_f32 f) {
+  lane_v3 r = {lane_mul(a.x, f), lane_mul(a.y, f), lane_mul(a.z, f)};
+  return r;
+}
+
+static inline lane_v3 lane_abs3(lane_v3 a) {
+  lane_v3 r = {lane_abs(a.x), lane_abs(a.y), lane_abs(a.z)};
+  return r;
+}
+
+static inline lane_v3 lane_max3(lane_v3 a, lane_f32 b) {
+  lane_v3 r = {lane_max(a.x, b), lane_max(a.y, b), lane_max(a.z, b)};
+  return r;
+}
+
+static inline lane_f32 lane_dot3(lane_v3 a, lane_v3 b) {
+  return lane_add(lane_add(lane_mul(a.x, b.x), lane_mul(a.y, b.y)), lane_mul(a.z, b.z));
+}
+
+static inline lane_f32 lane_magnitude3(lane_v3 a) {
+  return lane_sqrt(lane_dot3(a, a));
+}
+
+static inline lane_v3 lane_unit3(lane_v3 a) {
+  return lane_mul3(a, lane_div(lane_set1(1.0f), lane_magnitude3(a)));
+}
+
+static inline v3 lane_v3_get(lane_v3 a, int lane) {
+  f32 x[PACKET_WIDTH], y[PACKET_WIDTH], z[PACKET_WIDTH];
+  lane_store(x, a.x);
+  lane_store(y, a.y);
+  lane_store(z, a.z);
+  return V3(x[lane], y[lane], z[lane]);
+}
@@ -0,0 +1,272 @@
+//
+// CPU port of shaders/path_tracer.metal.
+// Function names carry a pt_ prefix since everything lands in one
+// translation unit. Keep the constants in sync with the shader. The spheres
+// come from a sphere_scene_t, see scene.c.
+//
+
+#include "common.c"
+#include "sampler.c"
+#include "spheres.c"
+
+typedef struct pt_hit_t {
+  v3 p;
+  v3 n;
+  f32 t;
+} pt_hit_t;
+
+#define PT_SAMPLES_PER_PIXEL 10
+// Without Russian roulette paths stop here, with it this is only a backstop.
+#define PT_MAX_BOUNCES 5
+#define PT_MAX_DEPTH 32
+// Bounces before Russian roulette starts, and the highest survival odds, so
+// paths through white surfaces still end.
+#define PT_RR_MIN_BOUNCES 3
+#define PT_RR_MAX_SURVIVAL 0.95f
+
+// The sun, a disk in the sky in the direction of the ray tracer's light.
+// Small and bright, so BSDF sampling alone rarely finds it.
+#define PT_SUN_DIRECTION V3(2.0f, 5.0f, 3.0f)
+#define PT_SUN_COS_ANGLE 0.99875026f // cos(0.05 radians)
+#define PT_SUN_PDF (1.0f / (2.0f*(f32)M_PI*(1.0f - PT_SUN_COS_ANGLE)))
+#define PT_SUN_IRRADIANCE 2.0f
+#define PT_SUN_RADIANCE (PT_SUN_IRRADIANCE * PT_SUN_PDF)
+
+// How pt_render samples paths. The renderer uses all of them, the others
+// stay around for -bench-pt to compare against.
+#define PT_COSINE_SAMPLING   0x1 // cosine weighted hemisphere from an ONB, else n + a random unit vector
+#define PT_LIGHT_SAMPLING    0x2 // a shadow ray to the sun per bounce, combined with MIS
+#define PT_RUSSIAN_ROULETTE  0x4 // end paths by throughput, else after PT_MAX_BOUNCES
+#define PT_SAMPLING_ALL      0x7
+
+// Sample dimensions, see sampler.c. The pixel jitter, then a block per
+// bounce, so each decision along a path has its own.
+#define PT_DIM_PIXEL 0
+#define PT_DIM_BOUNCES 2
+#define PT_DIM_SUN 0      // in a bounce's block
+#define PT_DIM_SCATTER 2
+#define PT_DIM_ROULETTE 4
+#define PT_DIMS_PER_BOUNCE 5
+
+#define PT_BVH_STACK_SIZE 64
+
+// Distance to where the ray enters the box, FLT_MAX when it misses it or the
+// box is past max_t.
+static inline f32 pt_intersect_node(const bvh_node_t* node, v3 ro, v3 inv_rd, f32 max_t) {
+  f32 tx0 = (node->bounds_min[0] - ro.x) * inv_rd.x;
+  f32 tx1 = (node->bounds_max[0] - ro.x) * inv_rd.x;
+  f32 ty0 = (node->bounds_min[1] - ro.y) * inv_rd.y;
+  f32 ty1 = (node->bounds_max[1] - ro.y) * inv_rd.y;
+  f32 tz0 = (node->bounds_min[2] - ro.z) * inv_rd.z;
+  f32 tz1 = (node->bounds_max[2] - ro.z) * inv_rd.z;
+  f32 t_near = maximum(maximum(minimum(tx0, tx1), minimum(ty0, ty1)), minimum(tz0, tz1));
+  f32 t_far = minimum(minimum(maximum(tx0, tx1), maximum(ty0, ty1)), maximum(tz0, tz1));
+  if (t_far < maximum(t_near, 0.0f) || t_near >= max_t) {
+    return FLT_MAX;
+  }
+  return t_near;
+}
+
+// Returns the index of the closest sphere hit, or -1.
+static int pt_test_scene(const sphere_scene_t* scene, v3 ro, v3 rd, pt_hit_t* hit, render_counters_t* counters) {
+  f32 closest_t = FLT_MAX;
+  f32 min_t = 0.001f;
+  int hit_index = -1;
+
+  const bvh_node_t* nodes = scene->bvh.nodes;
+  if (scene->bvh.node_count == 0) {
+    return -1;
+  }
+
+  v3 inv_rd = V3(1.0f/rd.x, 1.0f/rd.y, 1.0f/rd.z);
+  u32 stack[PT_BVH_STACK_SIZE];
+  int stack_size = 0;
+  u32 index = 0;
+  u64 steps = 0;
+  u64 tests = 0;
+  if (pt_intersect_node(&nodes[0], ro, inv_rd, closest_t) == FLT_MAX) {
+    return -1;
+  }
+
+  for (;;) {
+    const bvh_node_t* node = &nodes[index];
+    steps++;
+    if (node->count) {
+      tests += node->count;
+      intersect_spheres(&scene->soa, node->offset, node->count, ro, rd, min_t, &closest_t, &hit_index);
+    } else {
+      // Visit the nearer child first and come back for the other one.
+      u32 left = index + 1;
+      u32 right = node->offset;
+      f32 t_left = pt_intersect_node(&nodes[left], ro, inv_rd, closest_t);
+      f32 t_right = pt_intersect_node(&nodes[right], ro, inv_rd, closest_t);
+      if (t_left != FLT_MAX && t_right != FLT_MAX) {
+        bool left_first = t_left <= t_right;
+        assert(stack_size < PT_BVH_STACK_SIZE);
+        stack[stack_size++] = left_first ? right : left;
+        index = left_first ? left : right;
+        continue;
+      } else if (t_left != FLT_MAX) {
+        index = left;
+        continue;
+      } else if (t_right != FLT_MAX) {
+        index = right;
+        continue;
+      }
+    }
+    if (stack_size == 0) break;
+    index = stack[--stack_size];
+  }
+  counters->bvh_steps += steps;
+  counters->sphere_tests += tests;
+
+  if (hit_index != -1) {
+    const scene_sphere_t* s = &scene->spheres[hit_index];
+    v3 p = add3(ro, mul3(rd, closest_t));
+    v3 n = unit3(sub3(p, V3(s->center[0], s->center[1], s->center[2])));
+
+    hit->t = closest_t;
+    hit->p = p;
+    hit->n = n;
+  }
+
+  return hit_index;
+}
+
+// Tangent and bitangent for a unit normal, without branches or a division by
+// zero at the poles. Duff et al., "Building an Orthonormal Basis, Revisited".
+static inline void pt_basis(v3 n, v3* t, v3* b) {
+  f32 sign = copysignf(1.0f, n.z);
+  f32 a = -1.0f / (sign + n.z);
+  f32 c = n.x * n.y * a;
+  *t = V3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+  *b = V3(c, sign + n.y * n.y * a, -n.y);
+}
+
+// Direction around axis at cos_theta from it, phi = 2 pi u.
+static inline v3 pt_direction_around(v3 axis, f32 cos_theta, f32 u) {
+  v3 t, b;
+  pt_basis(axis, &t, &b);
+  f32 sin_theta = square_root(maximum(0.0f, 1.0f - cos_theta*cos_theta));
+  f32 phi = 2.0f * (f32)M_PI * u;
+  return add3(add3(mul3(t, sin_theta * fast_cos(phi)), mul3(b, sin_theta * fast_sin(phi))), mul3(axis, cos_theta));
+}
+
+// Lambertian scattering, pdf cos / pi, so the weight is just the albedo.
+static inline v3 pt_sample_cosine(v3 n, u32 strategy, v2 u) {
+  if (!(strategy & PT_COSINE_SAMPLING)) {
+    // n plus a random unit vector (rand_unit3), also cosine distributed but
+    // it spends a normalize and can land on -n.
+    f32 z = u.x * 2.0f - 1.0f;
+    f32 a = u.y * 2.0f * (f32)M_PI;
+    f32 r = square_root(1.0f - z * z);
+    return unit3(add3(n, V3(r * fast_cos(a), r * fast_sin(a), z)));
+  }
+  return pt_direction_around(n, square_root(1.0f - u.x), u.y);
+}
+
+// Uniform over the sun's disk, pdf PT_SUN_PDF.
+static inline v3 pt_sample_sun(v2 u) {
+  return pt_direction_around(unit3(PT_SUN_DIRECTION), 1.0f - u.x*(1.0f - PT_SUN_COS_ANGLE), u.y);
+}
+
+static inline f32 pt_power_heuristic(f32 pdf, f32 other_pdf) {
+  return pdf*pdf / (pdf*pdf + other_pdf*other_pdf);
+}
+
+static inline v3 pt_sky(v3 rd) {
+  f32 t = 0.5f*(rd.y + 1.0f);
+  return add3(mul3(v3_one, 1.0f-t), mul3(V3(0.5f, 0.7f, 1.0f), t));
+}
+
+static v3 pt_render(const sphere_scene_t* scene, v3 ro, v3 rd, u32 strategy, pixel_sampler_t* sampler, render_counters_t* counters) {
+  v3 color = v3_zero;
+  v3 throughput = v3_one;
+  v3 sun = unit3(PT_SUN_DIRECTION);
+  // Of the direction rd was scattered in, 0 for the camera ray.
+  f32 bsdf_pdf = 0.0f;
+  int max_bounces = (strategy & PT_RUSSIAN_ROULETTE) ? PT_MAX_DEPTH : PT_MAX_BOUNCES;
+
+  for (int b=0; b < max_bounces; b++) {
+    pt_hit_t hit;
+    int id = pt_test_scene(scene, ro, rd, &hit, counters);
+    counters->rays += 1;
+    if (id == -1) {
+      v3 sky = pt_sky(rd);
+      if (dot3(rd, sun) >= PT_SUN_COS_ANGLE) {
+        // Light sampling could have found this too, unless it's the camera ray.
+        bool shared = (strategy & PT_LIGHT_SAMPLING) && bsdf_pdf > 0.0f;
+        f32 w = shared ? pt_power_heuristic(bsdf_pdf, PT_SUN_PDF) : 1.0f;
+        sky = add3(sky, mul3(v3_one, PT_SUN_RADIANCE * w));
+      }
+      color = add3(color, hadamard3(throughput, sky));
+      break;
+    }
+
+    const vector_float4* m = &scene->materials[scene->sphere_materials[id]];
+    v3 albedo = V3(m->x, m->y, m->z);
+    u32 dims = PT_DIM_BOUNCES + (u32)b*PT_DIMS_PER_BOUNCE;
+
+    if (strategy & PT_LIGHT_SAMPLING) {
+      v3 ld = pt_sample_sun(sample_2d(sampler, dims + PT_DIM_SUN));
+      f32 cos_l = dot3(hit.n, ld);
+      if (cos_l > 0.0f) {
+        pt_hit_t shadow_hit;
+        int occluder = pt_test_scene(scene, hit.p, ld, &shadow_hit, counters);
+        counters->rays += 1;
+        if (occluder == -1) {
+          // albedo/pi * cos * L / pdf, weighted against the BSDF finding it.
+          // After the last bounce no BSDF ray is traced, so it can't.
+          f32 bsdf = cos_l * (f32)M_1_PI;
+          f32 w = b < max_bounces-1 ? pt_power_heuristic(PT_SUN_PDF, bsdf) : 1.0f;
+          color = add3(color, hadamard3(throughput, mul3(albedo, bsdf * PT_SUN_RADIANCE * w / PT_SUN_PDF)));
+        }
+      }
+    }
+
+    ro = hit.p;
+    rd = pt_sample_cosine(hit.n, strategy, sample_2d(sampler, dims + PT_DIM_SCATTER));
+    bsdf_pdf = maximum(dot3(hit.n, rd), 0.0f) * (f32)M_1_PI;
+    throughput = hadamard3(throughput, albedo);
+
+    if ((strategy & PT_RUSSIAN_ROULETTE) && b >= PT_RR_MIN_BOUNCES) {
+      f32 survival = minimum(maximum(throughput.x, maximum(throughput.y, throughput.z)), PT_RR_MAX_SURVIVAL);
+      if (sample_1d(sampler, dims + PT_DIM_ROULETTE) >= survival) {
+        break;
+      }
+      throughput = mul3(throughput, 1.0f / survival);
+    }
+  }
+
+  return color;
+}
+
+// Returns the sum, not the average, of samples [first_sample,
+// first_sample+sample_count) for the pixel at (ix, iy) counted from the top
+// left, whose center is at (u, v).
+static v3 pt_sample_pixel(const sphere_scene_t* scene, const fs_params_t* params, const sampler_config_t* sampling, int ix, int iy, f32 u, f32 v, u32 first_sample, int sample_count, u32 strategy, render_counters_t* counters) {
+  const render_camera_t* c = &params->camera;
+  v3 pos = V3(c->position.x, c->position.y, c->position.z);
+  v3 film_h = V3(c->film_h.x, c->film_h.y, c->film_h.z);
+  v3 film_v = V3(c->film_v.x, c->film_v.y, c->film_v.z);
+  v3 film_ll = V3(c->film_lower_left.x, c->film_lower_left.y, c->film_lower_left.z);
+
+  pixel_sampler_t sampler;
+  init_pixel_sampler(&sampler, sampling, (u32)ix, (u32)iy, params->frame_count);
+
+  // normalized pixel size
+  f32 psx = 1/params->viewport_size.x;
+  f32 psy = 1/params->viewport_size.y;
+
+  v3 color = v3_zero;
+  for (int s=0; s<sample_count; s++) {
+    begin_pixel_sample(&sampler, first_sample + (u32)s);
+    v2 jitter = sample_2d(&sampler, PT_DIM_PIXEL);
+    f32 su = u + jitter.x*psx;
+    f32 sv = v + jitter.y*psy;
+
+    v3 rd = sub3(add3(film_ll, add3(mul3(film_h, su), mul3(film_v, sv))), pos);
+    color = add3(color, pt_render(scene, pos, unit3(rd), strategy, &sampler, counters));
+  }
+  return color;
+}
@@ -0,0 +1,238 @@
+//
+// CPU port of shaders/ray_marcher.metal.
+// Function names carry an rm_ prefix since everything lands in one
+// translation unit. Keep the constants and scenes in sync with the shader.
+//
+
+#include "sdf.h"
+#include "sdf_vm.c"
+#include "sdf_cache.c"
+
+#define RM_MAX_STEPS 64
+#define RM_MIN_DIST 1.0f
+#define RM_MAX_DIST 40.0f
+#define RM_LIGHT_POSITION V3(2.0f, 5.0f, 3.0f)
+
+// Scenes come from an sdf_program_t. Set RM_USE_SDF_PROGRAM to 0 to use the
+// hand written scene RM_SCENE_INDEX instead, to measure the interpreter.
+#ifndef RM_USE_SDF_PROGRAM
+#define RM_USE_SDF_PROGRAM 1
+#endif
+#ifndef RM_SCENE_INDEX
+#define RM_SCENE_INDEX 4
+#endif
+#ifndef RM_RENDER_NORMALS
+#define RM_RENDER_NORMALS 0
+#endif
+#ifndef RM_ENABLE_SHADOWS
+#define RM_ENABLE_SHADOWS 1
+#endif
+#ifndef RM_ENABLE_DF_PLANE
+#define RM_ENABLE_DF_PLANE 1
+#endif
+
+//
+// Distance Field Debug Plane
+// Thank you Mercury: https://www.shadertoy.com/view/ldK3zD
+//
+
+static v3 rm_fusion(f32 x) {
+  f32 t = clamp01(x);
+  v3 r = {
+    square_root(t),
+    t*t*t,
+    maximum(sinf(M_PI*1.75f*t), powf(t, 12.0f)),
+  };
+  return clamp3(r, 0.0f, 1.0f);
+}
+
+// Rays that never reach the plane come out white.
+static v3 rm_distance_meter(f32 dist, f32 ray_length, v3 ray_dir, f32 cam_height) {
+  if (ray_length == INFINITY) {
+    return V3(1, 1, 1);
+  }
+  f32 ideal_grid_distance = 20.0f/ray_length*powf(fabsf(ray_dir.y), 0.8f);
+  f32 nearest_base = floorf(logf(ideal_grid_distance)/logf(10.0f));
+  f32 relative_dist = fabsf(dist/cam_height);
+
+  f32 larger_distance = powf(10.0f, nearest_base+1.0f);
+  f32 smaller_distance = powf(10.0f, nearest_base);
+
+  v3 col = rm_fusion(logf(1.0f+relative_dist));
+  col = max3(v3_zero, col);
+  if (dist < 0.0f) {
+    col = mul3(V3(col.g, col.r, col.b), 3.0f);
+  }
+
+  f32 l0 = powf(0.5f+0.5f*cosf(dist*M_PI*2.0f*smaller_distance), 10.0f);
+  f32 l1 = powf(0.5f+0.5f*cosf(dist*M_PI*2.0f*larger_distance), 10.0f);
+
+  f32 x = fract(logf(ideal_grid_distance)/logf(10.0f));
+  l0 = lerp(l0, smoothstep(0.5f, 1.0f, x), 0.0f);
+  l1 = lerp(0.0f, smoothstep(0.0f, 0.5f, x), l1);
+
+  col = mul3(col, 0.1f+0.9f*(1.0f-l0)*(1.0f-l1));
+  return col;
+}
+
+//
+//
+//
+
+// What the marcher samples. Without a cache every sample runs the program.
+typedef struct rm_field_t {
+  const sdf_program_t* program;
+  sdf_cache_t* cache;
+  render_counters_t* counters;
+} rm_field_t;
+
+static f32 rm_scene_exact(const rm_field_t* field, v3 p) {
+#if RM_USE_SDF_PROGRAM
+  return sdf_eval(field->program, p);
+#elif RM_SCENE_INDEX == 0
+  f32 box = sd_box(sub3(p, V3(0,1,0)), V3(1,1,1));
+  return box;
+#elif RM_SCENE_INDEX == 1
+  f32 box = sd_box(p, V3(1,1,1));
+  f32 sphere = sd_sphere(p, 1.2f);
+  return sd_intersect(box, sphere);
+#elif RM_SCENE_INDEX == 2
+  f32 box = sd_box(p, V3(1,2,1));
+  f32 sphere = sd_sphere(sub3(p, V3(0,2.5f,0)), 0.3f);
+  f32 plane = sd_plane(p, V3(0,1,0), 0.5f);
+  return sd_smin(plane, sd_join(box, sphere), 1.5f);
+#elif RM_SCENE_INDEX == 3
+  f32 prism = sd_tri_prism(sub3(p, V3(0,1,0)), V2(2,1));
+  return prism;
+#elif RM_SCENE_INDEX == 4
+  f32 prism = sd_tri_prism(p, V2(1,1));
+  f32 sphere = sd_sphere(sub3(p, V3(0,1,0)), 0.5f);
+  return sd_subtract(sphere, prism);
+#else
+  return 0;
+#endif
+}
+
+// Marching only needs a lower bound, so it can go through the cache. Normals
+// and the distance meter need the real thing.
+static f32 rm_scene(const rm_field_t* field, v3 p) {
+#if RM_USE_SDF_PROGRAM
+  f32 d;
+  if (field->cache && sdf_cache_lookup(field->cache, p, &d, field->counters)) {
+    return d;
+  }
+#endif
+  return rm_scene_exact(field, p);
+}
+
+static v3 rm_calc_normal(const rm_field_t* field, v3 p) {
+  field->counters->scene_evals += 4;
+  f32 k = 0.5773f*0.0005f;
+  v3 e_xyy = V3( k, -k, -k);
+  v3 e_yyx = V3(-k, -k,  k);
+  v3 e_yxy = V3(-k,  k, -k);
+  v3 e_xxx = V3( k,  k,  k);
+  v3 n = mul3(e_xyy, rm_scene_exact(field, add3(p, e_xyy)));
+  n = add3(n, mul3(e_yyx, rm_scene_exact(field, add3(p, e_yyx))));
+  n = add3(n, mul3(e_yxy, rm_scene_exact(field, add3(p, e_yxy))));
+  n = add3(n, mul3(e_xxx, rm_scene_exact(field, add3(p, e_xxx))));
+  return unit3(n);
+}
+
+static f32 rm_calc_hard_shadow(const rm_field_t* field, v3 ro, v3 rd, f32 tmin, f32 tmax) {
+  f32 shadow = 1.0f;
+  u64 steps = 0;
+  for (f32 t=tmin; t<tmax;) {
+    f32 h = rm_scene(field, add3(ro, mul3(rd, t)));
+    steps++;
+    if (h<0.001f) {
+      shadow = 0.0f;
+      break;
+    }
+    t += h;
+  }
+  field->counters->march_steps += steps;
+  field->counters->scene_evals += steps;
+  return shadow;
+}
+
+static f32 rm_cast_ray(const rm_field_t* field, v3 ro, v3 rd) {
+  f32 tmin = RM_MIN_DIST;
+  f32 tmax = RM_MAX_DIST;
+
+  f32 t = tmin;
+  int steps = 0;
+  while (steps < RM_MAX_STEPS) {
+    f32 precis = 0.0005f*t;
+    f32 res = rm_scene(field, add3(ro, mul3(rd, t)));
+    steps++;
+    if (res<precis || t>tmax) break;
+    t += res;
+  }
+  field->counters->march_steps += (u64)steps;
+  field->counters->scene_evals += (u64)steps;
+
+  if (t>tmax) t=-1.0f;
+  return t;
+}
+
+static v3 rm_render(const rm_field_t* field, v3 ro, v3 rd, const render_camera_t* camera, const debug_params_t* debug_params) {
+  render_counters_t* counters = field->counters;
+  v3 color = v3_zero;
+  f32 t = rm_cast_ray(field, ro, rd);
+  v3 p = add3(ro, mul3(rd, t));
+  counters->rays += 1;
+
+#if RM_ENABLE_DF_PLANE == 1
+  f32 df_plane_y = debug_params->scalars[0];
+  if (p.y <= df_plane_y || t<-0.5f) {
+    f32 ray_length = INFINITY;
+    if (rd.y < 0.0f) {
+      ray_length = (ro.y-df_plane_y)/-rd.y;
+    }
+    f32 dist = 0.0f;
+    if (ray_length < INFINITY) {
+      dist = rm_scene_exact(field, add3(ro, mul3(rd, ray_length)));
+      counters->scene_evals += 1;
+    }
+    v3 field_color = rm_distance_meter(dist, ray_length, rd, camera->position.y-df_plane_y);
+    return field_color;
+  }
+#endif
+
+  if (t>-0.5f) {
+    v3 n = rm_calc_normal(field, p);
+
+    // light
+    v3 light = unit3(RM_LIGHT_POSITION);
+#if RM_ENABLE_SHADOWS
+    f32 shadow = rm_calc_hard_shadow(field, p, light, 0.01f, 3.0f);
+    counters->rays += 1;
+#else
+    f32 shadow = 1;
+#endif
+#if RM_RENDER_NORMALS
+    color = mul3(add3(mul3(n, 0.5f), V3(0.5f, 0.5f, 0.5f)), shadow);
+#else
+    v3 material = V3(1, 0, 0);
+    f32 diffuse = clamp01(dot3(n, light));
+    color = mul3(material, diffuse * shadow);
+
+    // fog
+    color = mul3(color, expf(-0.00005f*t*t*t));
+#endif
+  }
+
+  return color;
+}
+
+static void rm_shade_pixel(const rm_field_t* field, const fs_params_t* params, f32 u, f32 v, v3* color) {
+  const render_camera_t* c = &params->camera;
+  v3 ro = V3(c->position.x, c->position.y, c->position.z);
+  v3 rd = V3(
+    c->film_lower_left.x + u*c->film_h.x + v*c->film_v.x - ro.x,
+    c->film_lower_left.y + u*c->film_h.y + v*c->film_v.y - ro.y,
+    c->film_lower_left.z + u*c->film_h.z + v*c->film_v.z - ro.z
+  );
+  *color = rm_render(field, ro, unit3(rd), c, &params->debug_params);
+}
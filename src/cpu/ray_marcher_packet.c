@@ -0,0 +1,379 @@
+//
+// Packet version of cpu/ray_marcher.c.
+// Marches PACKET_WIDTH rays at once and masks off rays that have converged
+// or run past RM_MAX_DIST. The distance field debug plane is shaded for the
+// whole packet with cave_fast_math.h, the last bit of shading is done per
+// lane with the scalar code.
+//
+
+#include "packet.h"
+
+static inline lane_f32
+sd_box_packet(lane_v3 p, v3 b) {
+  lane_v3 d = lane_sub3(lane_abs3(p), lane_v3_set1(b));
+  lane_f32 zero = lane_set1(0.0f);
+  lane_f32 inside = lane_min(lane_max(d.x, lane_max(d.y, d.z)), zero);
+  return lane_add(inside, lane_magnitude3(lane_max3(d, zero)));
+}
+
+static inline lane_f32
+sd_plane_packet(lane_v3 p, v3 n, f32 dist) {
+  return lane_add(lane_dot3(p, lane_v3_set1(n)), lane_set1(dist));
+}
+
+static inline lane_f32
+sd_sphere_packet(lane_v3 p, f32 r) {
+  return lane_sub(lane_magnitude3(p), lane_set1(r));
+}
+
+static inline lane_f32
+sd_tri_prism_packet(lane_v3 p, v2 h) {
+  lane_v3 q = lane_abs3(p);
+  lane_f32 a = lane_sub(q.z, lane_set1(h.y));
+  lane_f32 b = lane_add(lane_mul(q.x, lane_set1(0.866025f)), lane_mul(p.y, lane_set1(0.5f)));
+  lane_f32 c = lane_sub(lane_max(b, lane_sub(lane_set1(0.0f), p.y)), lane_set1(h.x*0.5f));
+  return lane_max(a, c);
+}
+
+static inline lane_f32
+sd_torus_packet(lane_v3 p, v2 t) {
+  lane_f32 qx = lane_sub(lane_sqrt(lane_add(lane_mul(p.x, p.x), lane_mul(p.z, p.z))), lane_set1(t.x));
+  lane_f32 q = lane_sqrt(lane_add(lane_mul(qx, qx), lane_mul(p.y, p.y)));
+  return lane_sub(q, lane_set1(t.y));
+}
+
+static inline lane_f32
+sd_subtract_packet(lane_f32 a, lane_f32 b) {
+  return lane_max(lane_sub(lane_set1(0.0f), a), b);
+}
+
+static inline lane_f32
+sd_smin_packet(lane_f32 a, lane_f32 b, f32 k) {
+  lane_f32 h = lane_clamp01(lane_add(lane_set1(0.5f), lane_mul(lane_set1(0.5f/k), lane_sub(b, a))));
+  lane_f32 mixed = lane_add(b, lane_mul(lane_sub(a, b), h));
+  return lane_sub(mixed, lane_mul(lane_set1(k), lane_mul(h, lane_sub(lane_set1(1.0f), h))));
+}
+
+static inline lane_f32
+sd_join_packet(lane_f32 a, lane_f32 b) {
+  return lane_min(a, b);
+}
+
+static inline lane_f32
+sd_intersect_packet(lane_f32 a, lane_f32 b) {
+  return lane_max(a, b);
+}
+
+// Packet version of sdf_eval in sdf_vm.c. Every lane runs the same program,
+// so the dispatch cost is paid once per PACKET_WIDTH samples.
+static lane_f32 sdf_eval_packet(const sdf_program_t* prog, lane_v3 p) {
+  lane_v3 pr[SDF_POINT_REGISTERS];
+  lane_f32 dr[SDF_DIST_REGISTERS];
+  pr[0] = p;
+  dr[0] = lane_set1(FLT_MAX);
+
+  for (u32 i=0; i < prog->instruction_count; i++) {
+    sdf_instr_t in = prog->instructions[i];
+    const f32* k = prog->constants + in.constants;
+    switch (in.op) {
+      case SDF_OP_BOX:
+        dr[in.dst] = sd_box_packet(lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2]))), V3(k[3], k[4], k[5])); break;
+      case SDF_OP_SPHERE:
+        dr[in.dst] = sd_sphere_packet(lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2]))), k[3]); break;
+      case SDF_OP_TRI_PRISM:
+        dr[in.dst] = sd_tri_prism_packet(lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2]))), V2(k[3], k[4])); break;
+      case SDF_OP_TORUS:
+        dr[in.dst] = sd_torus_packet(lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2]))), V2(k[3], k[4])); break;
+      case SDF_OP_PLANE:
+        dr[in.dst] = sd_plane_packet(lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2]))), V3(k[3], k[4], k[5]), k[6]); break;
+      case SDF_OP_JOIN:
+        dr[in.dst] = sd_join_packet(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SUBTRACT:
+        dr[in.dst] = sd_subtract_packet(dr[in.a], dr[in.b]); break;
+      case SDF_OP_INTERSECT:
+        dr[in.dst] = sd_intersect_packet(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SMIN:
+        dr[in.dst] = sd_smin_packet(dr[in.a], dr[in.b], k[0]); break;
+      case SDF_OP_TRANSFORM: {
+        lane_v3 q = lane_sub3(pr[in.a], lane_v3_set1(V3(k[0], k[1], k[2])));
+        lane_v3 r = {
+          lane_add(lane_add(lane_mul(lane_set1(k[3]), q.x), lane_mul(lane_set1(k[4]), q.y)), lane_mul(lane_set1(k[5]), q.z)),
+          lane_add(lane_add(lane_mul(lane_set1(k[6]), q.x), lane_mul(lane_set1(k[7]), q.y)), lane_mul(lane_set1(k[8]), q.z)),
+          lane_add(lane_add(lane_mul(lane_set1(k[9]), q.x), lane_mul(lane_set1(k[10]), q.y)), lane_mul(lane_set1(k[11]), q.z)),
+        };
+        pr[in.dst] = r;
+      } break;
+      case SDF_OP_SCALE:
+        dr[in.dst] = lane_mul(dr[in.a], lane_set1(k[0])); break;
+      default: break;
+    }
+  }
+  return dr[0];
+}
+
+static lane_f32 rm_scene_exact_packet(const rm_field_t* field, lane_v3 p) {
+#if RM_USE_SDF_PROGRAM
+  return sdf_eval_packet(field->program, p);
+#elif RM_SCENE_INDEX == 0
+  return sd_box_packet(lane_sub3(p, lane_v3_set1(V3(0,1,0))), V3(1,1,1));
+#elif RM_SCENE_INDEX == 1
+  lane_f32 box = sd_box_packet(p, V3(1,1,1));
+  lane_f32 sphere = sd_sphere_packet(p, 1.2f);
+  return lane_max(box, sphere);
+#elif RM_SCENE_INDEX == 2
+  lane_f32 box = sd_box_packet(p, V3(1,2,1));
+  lane_f32 sphere = sd_sphere_packet(lane_sub3(p, lane_v3_set1(V3(0,2.5f,0))), 0.3f);
+  lane_f32 plane = sd_plane_packet(p, V3(0,1,0), 0.5f);
+  return sd_smin_packet(plane, lane_min(box, sphere), 1.5f);
+#elif RM_SCENE_INDEX == 3
+  return sd_tri_prism_packet(lane_sub3(p, lane_v3_set1(V3(0,1,0))), V2(2,1));
+#elif RM_SCENE_INDEX == 4
+  lane_f32 prism = sd_tri_prism_packet(p, V2(1,1));
+  lane_f32 sphere = sd_sphere_packet(lane_sub3(p, lane_v3_set1(V3(0,1,0))), 0.5f);
+  return sd_subtract_packet(sphere, prism);
+#else
+  return lane_set1(0.0f);
+#endif
+}
+
+// Lanes the cache can't answer are evaluated together, so a packet near the
+// surface costs one program run on top of the lookups.
+static lane_f32 rm_scene_packet(const rm_field_t* field, lane_v3 p) {
+#if RM_USE_SDF_PROGRAM
+  if (field->cache) {
+    f32 xs[PACKET_WIDTH], ys[PACKET_WIDTH], zs[PACKET_WIDTH], ds[PACKET_WIDTH];
+    lane_store(xs, p.x);
+    lane_store(ys, p.y);
+    lane_store(zs, p.z);
+    u32 miss_bits = 0;
+    for (int i=0; i < PACKET_WIDTH; i++) {
+      if (!sdf_cache_lookup(field->cache, V3(xs[i], ys[i], zs[i]), &ds[i], field->counters)) {
+        miss_bits |= 1u << i;
+      }
+    }
+    if (miss_bits) {
+      f32 exact[PACKET_WIDTH];
+      lane_store(exact, rm_scene_exact_packet(field, p));
+      for (u32 bits=miss_bits; bits; bits &= bits-1) {
+        int i = __builtin_ctz(bits);
+        ds[i] = exact[i];
+      }
+    }
+    return lane_load(ds);
+  }
+#endif
+  return rm_scene_exact_packet(field, p);
+}
+
+static lane_v3 rm_calc_normal_packet(const rm_field_t* field, lane_v3 p) {
+  field->counters->scene_evals += 4*PACKET_WIDTH;
+  f32 k = 0.5773f*0.0005f;
+  v3 e[4] = {
+    V3( k, -k, -k),
+    V3(-k, -k,  k),
+    V3(-k,  k, -k),
+    V3( k,  k,  k),
+  };
+  lane_v3 n = {lane_set1(0.0f), lane_set1(0.0f), lane_set1(0.0f)};
+  for (int i=0; i < 4; i++) {
+    lane_v3 ei = lane_v3_set1(e[i]);
+    n = lane_add3(n, lane_mul3(ei, rm_scene_exact_packet(field, lane_add3(p, ei))));
+  }
+  return lane_unit3(n);
+}
+
+// Lanes outside active come back lit.
+static lane_f32 rm_calc_hard_shadow_packet(const rm_field_t* field, lane_v3 ro, v3 rd, f32 tmin, f32 tmax, lane_mask active) {
+  lane_v3 d = lane_v3_set1(rd);
+  lane_f32 t = lane_set1(tmin);
+  lane_f32 shadow = lane_set1(1.0f);
+  lane_f32 zero = lane_set1(0.0f);
+
+  u64 steps = 0;
+  u64 evals = 0;
+  active = lane_and(active, lane_lt(t, lane_set1(tmax)));
+  while (lane_any(active)) {
+    steps += (u64)__builtin_popcount(lane_bits(active));
+    evals += PACKET_WIDTH;
+    lane_f32 h = rm_scene_packet(field, lane_add3(ro, lane_mul3(d, t)));
+    lane_mask occluded = lane_and(active, lane_lt(h, lane_set1(0.001f)));
+    shadow = lane_select(occluded, zero, shadow);
+    active = lane_andnot(occluded, active);
+    t = lane_add(t, lane_select(active, h, zero));
+    active = lane_and(active, lane_lt(t, lane_set1(tmax)));
+  }
+  field->counters->march_steps += steps;
+  field->counters->scene_evals += evals;
+  return shadow;
+}
+
+static lane_f32 rm_cast_ray_packet(const rm_field_t* field, lane_v3 ro, lane_v3 rd) {
+  lane_f32 tmax = lane_set1(RM_MAX_DIST);
+  lane_f32 t = lane_set1(RM_MIN_DIST);
+  lane_f32 zero = lane_set1(0.0f);
+  lane_mask active = lane_all_mask();
+  u64 steps = 0;
+  int i = 0;
+
+  while (i < RM_MAX_STEPS) {
+    steps += (u64)__builtin_popcount(lane_bits(active));
+    i++;
+    lane_f32 precis = lane_mul(lane_set1(0.0005f), t);
+    lane_f32 res = rm_scene_packet(field, lane_add3(ro, lane_mul3(rd, t)));
+    lane_mask done = lane_or(lane_lt(res, precis), lane_gt(t, tmax));
+    active = lane_andnot(done, active);
+    if (!lane_any(active)) break;
+    t = lane_add(t, lane_select(active, res, zero));
+  }
+  field->counters->march_steps += steps;
+  field->counters->scene_evals += (u64)i*PACKET_WIDTH;
+
+  return lane_select(lane_gt(t, tmax), lane_set1(-1.0f), t);
+}
+
+static lane_v3 rm_fusion_packet(lane_f32 x) {
+  lane_f32 t = lane_clamp01(x);
+  lane_f32 wave = lane_max(lane_sin(lane_mul(t, lane_set1((f32)M_PI*1.75f))), lane_pow(t, lane_set1(12.0f)));
+  lane_v3 r = {
+    lane_clamp01(lane_sqrt(t)),
+    lane_clamp01(lane_mul(lane_mul(t, t), t)),
+    lane_clamp01(wave),
+  };
+  return r;
+}
+
+// Same as rm_distance_meter, lanes whose ray never reaches the plane come out
+// white.
+static lane_v3 rm_distance_meter_packet(lane_f32 dist, lane_f32 ray_length, lane_f32 ray_dir_y, f32 cam_height) {
+  const f32 ln10 = 2.30258509f;
+  lane_f32 ideal_grid_distance = lane_mul(lane_div(lane_set1(20.0f), ray_length), lane_pow(lane_abs(ray_dir_y), lane_set1(0.8f)));
+  lane_f32 grid_log = lane_mul(lane_log(ideal_grid_distance), lane_set1(1.0f/ln10));
+  lane_f32 nearest_base = lane_floor(grid_log);
+  lane_f32 relative_dist = lane_abs(lane_div(dist, lane_set1(cam_height)));
+
+  lane_f32 smaller_distance = lane_exp(lane_mul(nearest_base, lane_set1(ln10)));
+  lane_f32 larger_distance = lane_mul(smaller_distance, lane_set1(10.0f));
+
+  lane_v3 col = rm_fusion_packet(lane_log(lane_add(lane_set1(1.0f), relative_dist)));
+  lane_mask inside = lane_lt(dist, lane_set1(0.0f));
+  lane_f32 three = lane_set1(3.0f);
+  lane_v3 swapped = {lane_mul(col.y, three), lane_mul(col.x, three), lane_mul(col.z, three)};
+  col.x = lane_select(inside, swapped.x, col.x);
+  col.y = lane_select(inside, swapped.y, col.y);
+  col.z = lane_select(inside, swapped.z, col.z);
+
+  lane_f32 half = lane_set1(0.5f);
+  lane_f32 ten = lane_set1(10.0f);
+  lane_f32 phase = lane_mul(dist, lane_set1((f32)M_PI*2.0f));
+  lane_f32 l0 = lane_pow(lane_add(half, lane_mul(half, lane_cos(lane_mul(phase, smaller_distance)))), ten);
+  lane_f32 l1 = lane_pow(lane_add(half, lane_mul(half, lane_cos(lane_mul(phase, larger_distance)))), ten);
+
+  lane_f32 x = lane_sub(grid_log, nearest_base);
+  lane_f32 one = lane_set1(1.0f);
+  l0 = lane_mul(l0, lane_sub(one, lane_smoothstep(0.5f, 1.0f, x)));
+  l1 = lane_mul(l1, lane_smoothstep(0.0f, 0.5f, x));
+
+  lane_f32 shade = lane_mul(lane_mul(lane_sub(one, l0), lane_sub(one, l1)), lane_set1(0.9f));
+  shade = lane_add(shade, lane_set1(0.1f));
+  col = lane_mul3(col, shade);
+  lane_mask below = lane_lt(ray_dir_y, lane_set1(0.0f));
+  col.x = lane_select(below, col.x, one);
+  col.y = lane_select(below, col.y, one);
+  col.z = lane_select(below, col.z, one);
+  return col;
+}
+
+// Shades PACKET_WIDTH pixels along a row, starting at horizontal uv u0 and
+// stepping by du.
+static void rm_shade_packet(const rm_field_t* field, const fs_params_t* params, f32 u0, f32 du, f32 v, v3* colors) {
+  render_counters_t* counters = field->counters;
+  const render_camera_t* c = &params->camera;
+  v3 pos = V3(c->position.x, c->position.y, c->position.z);
+  v3 film_h = V3(c->film_h.x, c->film_h.y, c->film_h.z);
+  v3 film_v = V3(c->film_v.x, c->film_v.y, c->film_v.z);
+  v3 film_ll = V3(c->film_lower_left.x, c->film_lower_left.y, c->film_lower_left.z);
+
+  lane_f32 u = lane_add(lane_set1(u0), lane_mul(lane_index(), lane_set1(du)));
+  v3 base = sub3(add3(film_ll, mul3(film_v, v)), pos);
+  lane_v3 ro = lane_v3_set1(pos);
+  lane_v3 rd = lane_add3(lane_v3_set1(base), lane_mul3(lane_v3_set1(film_h), u));
+  rd = lane_unit3(rd);
+
+  lane_f32 t = rm_cast_ray_packet(field, ro, rd);
+  lane_v3 p = lane_add3(ro, lane_mul3(rd, t));
+  counters->rays += PACKET_WIDTH;
+
+  lane_mask miss = lane_lt(t, lane_set1(-0.5f));
+#if RM_ENABLE_DF_PLANE == 1
+  f32 df_plane_y = params->debug_params.scalars[0];
+  lane_mask df = lane_or(lane_le(p.y, lane_set1(df_plane_y)), miss);
+#else
+  lane_mask df = lane_lt(lane_set1(0.0f), lane_set1(0.0f));
+#endif
+  lane_mask hit = lane_andnot(lane_or(df, miss), lane_all_mask());
+
+  u32 df_bits = lane_bits(df);
+  u32 hit_bits = lane_bits(hit);
+
+#if RM_ENABLE_DF_PLANE == 1
+  f32 meter[3][PACKET_WIDTH];
+  if (df_bits) {
+    lane_f32 ray_length = lane_div(lane_set1(pos.y-df_plane_y), lane_sub(lane_set1(0.0f), rd.y));
+    ray_length = lane_select(lane_lt(rd.y, lane_set1(0.0f)), ray_length, lane_set1(INFINITY));
+    f32 lengths[PACKET_WIDTH];
+    f32 dists[PACKET_WIDTH] = {0};
+    lane_store(lengths, ray_length);
+    for (u32 bits=df_bits; bits; bits &= bits-1) {
+      int i = __builtin_ctz(bits);
+      if (lengths[i] < INFINITY) {
+        dists[i] = rm_scene_exact(field, add3(pos, mul3(lane_v3_get(rd, i), lengths[i])));
+        counters->scene_evals += 1;
+      }
+    }
+    lane_v3 m = rm_distance_meter_packet(lane_load(dists), ray_length, rd.y, pos.y-df_plane_y);
+    lane_store(meter[0], m.x);
+    lane_store(meter[1], m.y);
+    lane_store(meter[2], m.z);
+  }
+#endif
+
+  f32 ns[3][PACKET_WIDTH];
+  f32 shadows[PACKET_WIDTH];
+  f32 fogs[PACKET_WIDTH];
+  if (hit_bits) {
+    lane_v3 n = rm_calc_normal_packet(field, p);
+    lane_store(ns[0], n.x);
+    lane_store(ns[1], n.y);
+    lane_store(ns[2], n.z);
+
+    v3 light = unit3(RM_LIGHT_POSITION);
+#if RM_ENABLE_SHADOWS
+    lane_store(shadows, rm_calc_hard_shadow_packet(field, p, light, 0.01f, 3.0f, hit));
+    for (u32 bits=hit_bits; bits; bits &= bits-1) counters->rays += 1;
+#else
+    lane_store(shadows, lane_set1(1.0f));
+#endif
+    lane_store(fogs, lane_exp(lane_mul(lane_mul(lane_mul(t, t), t), lane_set1(-0.00005f))));
+  }
+
+  for (int i=0; i < PACKET_WIDTH; i++) {
+    v3 color = v3_zero;
+    if (df_bits & (1u << i)) {
+#if RM_ENABLE_DF_PLANE == 1
+      color = V3(meter[0][i], meter[1][i], meter[2][i]);
+#endif
+    } else if (hit_bits & (1u << i)) {
+      v3 n = V3(ns[0][i], ns[1][i], ns[2][i]);
+#if RM_RENDER_NORMALS
+      color = mul3(add3(mul3(n, 0.5f), V3(0.5f, 0.5f, 0.5f)), shadows[i]);
+#else
+      v3 light = unit3(RM_LIGHT_POSITION);
+      f32 diffuse = clamp01(dot3(n, light));
+      color = mul3(V3(1, 0, 0), diffuse * shadows[i]);
+
+      color = mul3(color, fogs[i]);
+#endif
+    }
+    colors[i] = color;
+  }
+}
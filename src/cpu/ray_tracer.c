@@ -0,0 +1,63 @@
+//
+// CPU port of shaders/ray_tracer.metal.
+// Function names carry an rt_ prefix since everything lands in one
+// translation unit. One shadow ray towards a directional light and no
+// bounces. Reuses the BVH traversal in cpu/path_tracer.c, which is included
+// first.
+//
+
+#define RT_SAMPLES_PER_PIXEL 4
+#define RT_LIGHT_DIRECTION V3(2.0f, 5.0f, 3.0f)
+
+static v3 rt_render(const sphere_scene_t* scene, v3 ro, v3 rd, render_counters_t* counters) {
+  pt_hit_t hit;
+  int id = pt_test_scene(scene, ro, rd, &hit, counters);
+  counters->rays += 1;
+
+  if (id != -1) {
+    v3 ld = unit3(RT_LIGHT_DIRECTION);
+
+    // Check if in shadow
+    pt_hit_t shadow_hit;
+    int occluder = pt_test_scene(scene, hit.p, ld, &shadow_hit, counters);
+    counters->rays += 1;
+    if (occluder == -1) {
+      const vector_float4* albedo = &scene->materials[scene->sphere_materials[id]];
+      return mul3(V3(albedo->x, albedo->y, albedo->z), maximum(0.0f, dot3(hit.n, ld)));
+    }
+    return v3_zero;
+  }
+
+  // Skybox
+  f32 t = 0.5f*(rd.y + 1.0f);
+  return add3(mul3(v3_one, 1.0f-t), mul3(V3(0.5f, 0.7f, 1.0f), t));
+}
+
+// Average of RT_SAMPLES_PER_PIXEL jittered samples for the pixel at (ix, iy)
+// counted from the top left, whose center is at (u, v).
+static v3 rt_sample_pixel(const sphere_scene_t* scene, const fs_params_t* params, const sampler_config_t* sampling, int ix, int iy, f32 u, f32 v, render_counters_t* counters) {
+  const render_camera_t* c = &params->camera;
+  v3 pos = V3(c->position.x, c->position.y, c->position.z);
+  v3 film_h = V3(c->film_h.x, c->film_h.y, c->film_h.z);
+  v3 film_v = V3(c->film_v.x, c->film_v.y, c->film_v.z);
+  v3 film_ll = V3(c->film_lower_left.x, c->film_lower_left.y, c->film_lower_left.z);
+
+  pixel_sampler_t sampler;
+  init_pixel_sampler(&sampler, sampling, (u32)ix, (u32)iy, params->frame_count);
+
+  // normalized pixel size
+  f32 psx = 1/params->viewport_size.x;
+  f32 psy = 1/params->viewport_size.y;
+
+  v3 color = v3_zero;
+  for (int s=0; s < RT_SAMPLES_PER_PIXEL; s++) {
+    begin_pixel_sample(&sampler, (u32)s);
+    v2 jitter = sample_2d(&sampler, 0);
+    f32 su = u + jitter.x*psx;
+    f32 sv = v + jitter.y*psy;
+
+    v3 rd = sub3(add3(film_ll, add3(mul3(film_h, su), mul3(film_v, sv))), pos);
+    color = add3(color, rt_render(scene, pos, unit3(rd), counters));
+  }
+  return mul3(color, 1.0f / (f32)RT_SAMPLES_PER_PIXEL);
+}
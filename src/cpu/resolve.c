@@ -0,0 +1,112 @@
+#include "resolve.h"
+
+//
+// Framebuffer resolve.
+// Converts rows of linear RGB to packed BGRA8, RESOLVE_LANES pixels at a time
+// with f32x8, and with non temporal stores when whole rows are resolved, so
+// a 4K frame doesn't push everything else out of the cache on its way to
+// memory. The gamma is the same 1.055*x^(1/2.4) - 0.055 curve the path
+// tracer always used.
+//
+
+// x^(1/2.4) for x in [0, 1], to about 3e-4 relative, which is a tenth of a
+// step in 8 bits. Cubics for log2 of the mantissa and 2^ of the fraction
+// instead of f32x8_pow's full precision ones make it about twice as fast.
+// Anything under 2^-12 comes out of the curve below zero and is clamped.
+static inline f32x8 resolve_gamma(f32x8 x) {
+  x = f32x8_max(x, f32x8_set1(1.0f/4096.0f));
+  f32x8 m = f32x8_mantissa(x);
+  f32x8 log2m = f32x8_mul_add(f32x8_mul_add(f32x8_mul_add(f32x8_set1(0.152700285f), m, f32x8_set1(-1.02680491f)), m, f32x8_set1(3.01116215f)), m, f32x8_set1(-2.13623207f));
+  f32x8 y = f32x8_mul(f32x8_add(f32x8_exponent(x), log2m), f32x8_set1(1.0f/2.4f));
+  f32x8 whole = f32x8_floor(y);
+  f32x8 f = f32x8_sub(y, whole);
+  f32x8 exp2f = f32x8_mul_add(f32x8_mul_add(f32x8_mul_add(f32x8_set1(0.0789672570f), f, f32x8_set1(0.224693156f)), f, f32x8_set1(0.696324771f)), f, f32x8_set1(0.999900288f));
+  return f32x8_mul(f32x8_exp2i(whole), exp2f);
+}
+
+static inline f32x8 resolve_channel(f32x8 c, f32 scale, resolve_curve_t curve) {
+  c = f32x8_clamp01(f32x8_mul(c, f32x8_set1(scale)));
+  if (curve == RESOLVE_CURVE_SRGB) {
+    c = f32x8_sub(f32x8_mul(resolve_gamma(c), f32x8_set1(1.055f)), f32x8_set1(0.055f));
+    c = f32x8_max(c, f32x8_zero());
+  }
+  return f32x8_floor(f32x8_mul_add(c, f32x8_set1(255.0f), f32x8_set1(0.5f)));
+}
+
+// RESOLVE_LANES pixels of interleaved RGB to BGRA8, matching bgra_pack3.
+static inline void resolve_step(u32* dst, const f32* rgb, f32 scale, resolve_curve_t curve, bool stream) {
+  f32 e[3][RESOLVE_LANES];
+  for (int i=0; i < RESOLVE_LANES; i++) {
+    e[0][i] = rgb[i*3+0];
+    e[1][i] = rgb[i*3+1];
+    e[2][i] = rgb[i*3+2];
+  }
+  f32x8 r = resolve_channel(f32x8_load(e[0]), scale, curve);
+  f32x8 g = resolve_channel(f32x8_load(e[1]), scale, curve);
+  f32x8 b = resolve_channel(f32x8_load(e[2]), scale, curve);
+  // Under 2^24, so the float sum is exact.
+  f32x8 packed = f32x8_mul_add(r, f32x8_set1(65536.0f), f32x8_mul_add(g, f32x8_set1(256.0f), b));
+  if (stream) {
+    f32x8_stream_u32(dst, packed, 0xFF000000);
+  } else {
+    f32x8_store_u32(dst, packed, 0xFF000000);
+  }
+}
+
+static inline void resolve_load_f16(f32* rgb, const u16* src) {
+  for (int i=0; i < 3; i++) {
+    f32x8_store(rgb + i*8, f32x8_load_f16(src + i*8));
+  }
+}
+
+// Fewer than RESOLVE_LANES pixels, through a zero padded copy.
+static void resolve_partial(u32* dst, const void* src, resolve_format_t format, int count, f32 scale, resolve_curve_t curve) {
+  f32 rgb[3*RESOLVE_LANES] = {0};
+  u32 out[RESOLVE_LANES];
+  for (int i=0; i < count*3; i++) {
+    rgb[i] = format == RESOLVE_RGB_F16 ? f32_from_f16(((const u16*)src)[i]) : ((const f32*)src)[i];
+  }
+  resolve_step(out, rgb, scale, curve, false);
+  memcpy(dst, out, sizeof(u32) * count);
+}
+
+// Resolves count pixels. With stream set, the aligned middle of the span goes
+// around the cache and the caller has to cave_stream_fence before anyone else
+// reads dst.
+static void resolve_span(u32* dst, const void* src, resolve_format_t format, int count, f32 scale, resolve_curve_t curve, bool stream) {
+  usize pixel_bytes = format == RESOLVE_RGB_F16 ? 3*sizeof(u16) : 3*sizeof(f32);
+  const u8* in = (const u8*)src;
+  int x = 0;
+  if (stream) {
+    int head = (int)((32 - ((usize)dst & 31)) & 31) / (int)sizeof(u32);
+    head = head < count ? head : count;
+    if (head > 0) {
+      resolve_partial(dst, in, format, head, scale, curve);
+      x = head;
+    }
+  }
+  for (; x + RESOLVE_LANES <= count; x += RESOLVE_LANES) {
+    const u8* p = in + (usize)x*pixel_bytes;
+    if (format == RESOLVE_RGB_F16) {
+      f32 rgb[3*RESOLVE_LANES];
+      resolve_load_f16(rgb, (const u16*)p);
+      resolve_step(dst + x, rgb, scale, curve, stream);
+    } else {
+      resolve_step(dst + x, (const f32*)p, scale, curve, stream);
+    }
+  }
+  if (x < count) {
+    resolve_partial(dst + x, in + (usize)x*pixel_bytes, format, count - x, scale, curve);
+  }
+}
+
+// Resolves rows [y0, y1) of src into target, streaming, and fences.
+static void resolve_rows(const resolve_source_t* src, const render_target_t* target, int y0, int y1) {
+  usize pixel_bytes = src->format == RESOLVE_RGB_F16 ? 3*sizeof(u16) : 3*sizeof(f32);
+  for (int y=y0; y < y1; y++) {
+    const u8* in = (const u8*)src->pixels + (usize)y*src->stride*pixel_bytes;
+    u32* row = target->pixels + (usize)y*target->stride;
+    resolve_span(row, in, src->format, target->width, src->scale, src->curve, true);
+  }
+  cave_stream_fence();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Pixels per resolve step, the tails of rows go through it zero padded.
+#define RESOLVE_LANES 8
+// Rows per resolve job.
+#define RESOLVE_BAND_ROWS 16
+
+typedef enum resolve_format_t {
+  RESOLVE_RGB_F32,
+  RESOLVE_RGB_F16,
+} resolve_format_t;
+
+typedef enum resolve_curve_t {
+  RESOLVE_CURVE_UNORM, // already display ready, only clamped
+  RESOLVE_CURVE_SRGB,  // linear, gets the sRGB gamma
+} resolve_curve_t;
+
+// Rows of linear RGB, three floats or halfs per pixel, to be converted into
+// a render_target_t of the same size.
+typedef struct resolve_source_t {
+  const void* pixels;
+  resolve_format_t format;
+  resolve_curve_t curve;
+  int stride; // in pixels
+  f32 scale;  // applied before the curve, 1/count for sums of samples
+} resolve_source_t;
@@ -0,0 +1,367 @@
+#include <ctype.h>
+#include "sampler.h"
+
+//
+// Sample generators for the CPU path and ray tracers.
+// A pixel_sampler_t hands out the samples of one pixel by sample index and
+// dimension, so every decision along a path (the pixel jitter, each bounce's
+// light and scatter directions) draws from its own dimension and stays
+// stratified across samples. Sobol and R2 are low discrepancy sequences,
+// decorrelated between pixels by a per pixel scramble or shift. Blue noise
+// instead spreads one sample's error across neighbouring pixels, which the
+// eye and a denoiser both prefer at low sample counts. The xorshift32 stream
+// the shaders use is kept as is, for comparison.
+//
+
+// Chris Wellons' lowbias32.
+static inline u32 sampler_hash(u32 x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static inline u32 sampler_hash2(u32 a, u32 b) {
+  return sampler_hash(a ^ sampler_hash(b + 0x9e3779b9u));
+}
+
+// 32 bit fixed point in [0, 1) to a float, keeping the top 24 bits.
+static inline f32 sampler_unorm(u32 x) {
+  return (f32)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline u32 reverse_bits(u32 x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Owen scrambling by hashing, Burley, "Practical Hash-based Owen Scrambling"
+// (JCGT 2020). The permutation only lets lower bits affect higher ones, so
+// on reversed bits it flips each digit based on the digits before it.
+static inline u32 laine_karras_permutation(u32 x, u32 seed) {
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return x;
+}
+
+// Also shuffles sample indices: the first 2^k indices map onto one aligned
+// block of 2^k, in an order that depends on the seed.
+static inline u32 nested_uniform_scramble(u32 x, u32 seed) {
+  return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// Second Sobol dimension with its digits reversed, the first is the index
+// itself. Direction number k has digit j iff j's bits are a subset of k's
+// (Pascal's triangle mod 2), so each digit is the XOR of the index bits
+// whose positions are supersets of its own.
+static inline u32 sobol_dim1_reversed(u32 i) {
+  i ^= (i >> 1) & 0x55555555u;
+  i ^= (i >> 2) & 0x33333333u;
+  i ^= (i >> 4) & 0x0f0f0f0fu;
+  i ^= (i >> 8) & 0x00ff00ffu;
+  i ^= (i >> 16) & 0x0000ffffu;
+  return i;
+}
+
+// Shuffled and scrambled 2D Sobol, a different pattern for every seed. Any
+// power of two run of indices from 0 is a (0,2)-net in the unit square.
+// Everything stays in reversed digits until the end.
+static inline v2 sobol_2d(u32 index, u32 seed) {
+  u32 shuffled = reverse_bits(laine_karras_permutation(reverse_bits(index), seed));
+  u32 x = laine_karras_permutation(shuffled, seed * 0x9e3779b9u + 1);
+  u32 y = laine_karras_permutation(sobol_dim1_reversed(shuffled), seed * 0x85ebca6bu + 2);
+  return V2(sampler_unorm(reverse_bits(x)), sampler_unorm(reverse_bits(y)));
+}
+
+// Roberts' R2, 2^32 over the plastic number and its square.
+#define R2_ALPHA_X 0xc13fa9a9u
+#define R2_ALPHA_Y 0x91e10da6u
+// 2^32 over the golden ratio, R2's 1D sibling.
+#define R1_ALPHA 0x9e3779b9u
+
+static inline u32 blue_noise_at(const blue_noise_t* bn, u32 x, u32 y) {
+  u32 mask = bn->size - 1;
+  return bn->values[(y & mask)*bn->size + (x & mask)];
+}
+
+// The frame is only used by SAMPLER_XORSHIFT, which seeds its stream the way
+// the shaders do.
+static void init_pixel_sampler(pixel_sampler_t* s, const sampler_config_t* config, u32 x, u32 y, u32 frame) {
+  s->config = config;
+  s->x = x;
+  s->y = y;
+  s->pixel_seed = sampler_hash2(sampler_hash2(config->seed, y), x);
+  s->index = 0;
+  // Superficially, this seems like a decent source of entropy...
+  s->rng = wang_hash(((x*1973) + (y*9277) + (frame*26699))|1);
+}
+
+static inline void begin_pixel_sample(pixel_sampler_t* s, u32 index) {
+  s->index = index;
+}
+
+// Dimensions dimension and dimension+1 of the current sample.
+static inline v2 sample_2d(pixel_sampler_t* s, u32 dimension) {
+  const sampler_config_t* c = s->config;
+  switch (c->kind) {
+    case SAMPLER_SOBOL:
+      return sobol_2d(s->index, sampler_hash2(s->pixel_seed, dimension));
+    case SAMPLER_R2: {
+      // Every pair of dimensions walks the same sequence, in its own order
+      // so they don't correlate, from its own random shift.
+      u32 seed = sampler_hash2(s->pixel_seed, dimension);
+      u32 index = nested_uniform_scramble(s->index, seed);
+      u32 x = seed + index*R2_ALPHA_X;
+      u32 y = sampler_hash(seed) + index*R2_ALPHA_Y;
+      return V2(sampler_unorm(x), sampler_unorm(y));
+    }
+    case SAMPLER_BLUE_NOISE: {
+      // The same tile for every pixel, at an offset per dimension, and each
+      // sample steps every texel by the same R2 point. Shuffling the steps
+      // per pixel would lose the blue noise, so it's only per dimension.
+      u32 ox = sampler_hash2(c->seed, dimension);
+      u32 oy = sampler_hash(ox);
+      u32 index = nested_uniform_scramble(s->index, oy);
+      u32 x = blue_noise_at(c->blue_noise, s->x + ox, s->y + (ox >> 16)) + index*R2_ALPHA_X;
+      u32 y = blue_noise_at(c->blue_noise, s->x + oy, s->y + (oy >> 16)) + index*R2_ALPHA_Y;
+      return V2(sampler_unorm(x), sampler_unorm(y));
+    }
+    default: {
+      f32 x = randf(&s->rng);
+      f32 y = randf(&s->rng);
+      return V2(x, y);
+    }
+  }
+}
+
+static inline f32 sample_1d(pixel_sampler_t* s, u32 dimension) {
+  const sampler_config_t* c = s->config;
+  switch (c->kind) {
+    case SAMPLER_SOBOL:
+      return sobol_2d(s->index, sampler_hash2(s->pixel_seed, dimension)).x;
+    case SAMPLER_R2: {
+      u32 seed = sampler_hash2(s->pixel_seed, dimension);
+      return sampler_unorm(seed + nested_uniform_scramble(s->index, seed)*R1_ALPHA);
+    }
+    case SAMPLER_BLUE_NOISE: {
+      u32 o = sampler_hash2(c->seed, dimension);
+      u32 index = nested_uniform_scramble(s->index, sampler_hash(o));
+      return sampler_unorm(blue_noise_at(c->blue_noise, s->x + o, s->y + (o >> 16)) + index*R1_ALPHA);
+    }
+    default:
+      return randf(&s->rng);
+  }
+}
+
+//
+// Blue noise tiles
+//
+
+#define BLUE_NOISE_SIGMA 1.9f
+#define BLUE_NOISE_RADIUS 8
+// Share of texels in the initial pattern.
+#define BLUE_NOISE_INITIAL_DENSITY 0.1f
+
+typedef struct blue_noise_builder_t {
+  u32 size;
+  u8* on;
+  f32* energy;
+  f32 kernel[(2*BLUE_NOISE_RADIUS+1)*(2*BLUE_NOISE_RADIUS+1)];
+} blue_noise_builder_t;
+
+// Adds or takes away a texel's gaussian from the energy, wrapping around.
+static void blue_noise_splat(blue_noise_builder_t* b, u32 index, f32 sign) {
+  u32 mask = b->size - 1;
+  u32 x = index % b->size;
+  u32 y = index / b->size;
+  const f32* k = b->kernel;
+  for (int dy=-BLUE_NOISE_RADIUS; dy <= BLUE_NOISE_RADIUS; dy++) {
+    f32* row = b->energy + ((y + dy) & mask)*b->size;
+    for (int dx=-BLUE_NOISE_RADIUS; dx <= BLUE_NOISE_RADIUS; dx++) {
+      row[(x + dx) & mask] += sign * *k++;
+    }
+  }
+}
+
+// The texel with state on that has the most energy (the tightest cluster) or
+// the least (the largest void).
+static u32 blue_noise_extreme(const blue_noise_builder_t* b, u8 on, bool most) {
+  u32 best = 0;
+  f32 best_energy = most ? -FLT_MAX : FLT_MAX;
+  for (u32 i=0; i < b->size*b->size; i++) {
+    if (b->on[i] != on) continue;
+    f32 e = b->energy[i];
+    if (most ? e > best_energy : e < best_energy) {
+      best_energy = e;
+      best = i;
+    }
+  }
+  return best;
+}
+
+static void blue_noise_set(blue_noise_builder_t* b, u32 index, u8 on) {
+  b->on[index] = on;
+  blue_noise_splat(b, index, on ? 1.0f : -1.0f);
+}
+
+// Ulichney's void and cluster. Settles a sparse random pattern by moving its
+// tightest cluster into its largest void, ranks those texels by taking
+// clusters away, then ranks the rest by filling voids. Filling the void with
+// the least energy from the pattern is the same as taking the tightest
+// cluster of the texels still off, so that covers the last half too.
+static bool init_blue_noise(blue_noise_t* bn, u32 size, u32 seed) {
+  *bn = (blue_noise_t){0};
+  if (size < 4 || size > BLUE_NOISE_SIZE_MAX || (size & (size-1))) {
+    printf("ERROR: Blue noise tiles are 4 to %d texels and a power of two, not %u.\n", BLUE_NOISE_SIZE_MAX, size);
+    return false;
+  }
+  u32 count = size*size;
+  blue_noise_builder_t b = {0};
+  b.size = size;
+  b.on = (u8*)calloc(count, 1);
+  b.energy = (f32*)calloc(count, sizeof(f32));
+  u8* initial_on = (u8*)malloc(count);
+  f32* initial_energy = (f32*)malloc(count * sizeof(f32));
+  bn->size = size;
+  bn->values = (u32*)malloc(count * sizeof(u32));
+
+  f32* k = b.kernel;
+  for (int dy=-BLUE_NOISE_RADIUS; dy <= BLUE_NOISE_RADIUS; dy++) {
+    for (int dx=-BLUE_NOISE_RADIUS; dx <= BLUE_NOISE_RADIUS; dx++) {
+      *k++ = expf(-(f32)(dx*dx + dy*dy) / (2.0f*BLUE_NOISE_SIGMA*BLUE_NOISE_SIGMA));
+    }
+  }
+
+  u32 rng = sampler_hash(seed) | 1;
+  u32 initial = (u32)maximum(1.0f, (f32)count * BLUE_NOISE_INITIAL_DENSITY);
+  for (u32 placed=0; placed < initial;) {
+    u32 i = xorshift32(&rng) % count;
+    if (!b.on[i]) {
+      blue_noise_set(&b, i, 1);
+      placed++;
+    }
+  }
+  for (u32 step=0; step < count; step++) {
+    u32 cluster = blue_noise_extreme(&b, 1, true);
+    blue_noise_set(&b, cluster, 0);
+    u32 in_void = blue_noise_extreme(&b, 0, false);
+    blue_noise_set(&b, in_void, 1);
+    if (in_void == cluster) break;
+  }
+  memcpy(initial_on, b.on, count);
+  memcpy(initial_energy, b.energy, count * sizeof(f32));
+
+  for (u32 rank=initial; rank-- > 0;) {
+    u32 cluster = blue_noise_extreme(&b, 1, true);
+    blue_noise_set(&b, cluster, 0);
+    bn->values[cluster] = rank;
+  }
+  memcpy(b.on, initial_on, count);
+  memcpy(b.energy, initial_energy, count * sizeof(f32));
+  for (u32 rank=initial; rank < count; rank++) {
+    u32 in_void = blue_noise_extreme(&b, 0, false);
+    blue_noise_set(&b, in_void, 1);
+    bn->values[in_void] = rank;
+  }
+
+  // Ranks to the middle of their share of [0, 1).
+  for (u32 i=0; i < count; i++) {
+    bn->values[i] = (u32)(((f64)bn->values[i] + 0.5) / count * 4294967296.0);
+  }
+
+  free(initial_energy);
+  free(initial_on);
+  free(b.energy);
+  free(b.on);
+  return true;
+}
+
+static void free_blue_noise(blue_noise_t* bn) {
+  free(bn->values);
+  *bn = (blue_noise_t){0};
+}
+
+// Next whitespace separated number in a PGM header, skipping comments.
+static bool pgm_header_number(const u8** p, const u8* end, u32* value) {
+  while (*p < end && (isspace(**p) || **p == '#')) {
+    if (**p == '#') {
+      while (*p < end && **p != '\n') (*p)++;
+    } else {
+      (*p)++;
+    }
+  }
+  if (*p == end || !isdigit(**p)) {
+    return false;
+  }
+  u64 v = 0;
+  while (*p < end && isdigit(**p) && v <= UINT32_MAX) {
+    v = v*10 + (u64)(*(*p)++ - '0');
+  }
+  *value = (u32)v;
+  return v <= UINT32_MAX;
+}
+
+// A square binary PGM (P5), 8 or 16 bit, such as the ones
+// write_blue_noise writes.
+static bool load_blue_noise(blue_noise_t* bn, const char* path) {
+  *bn = (blue_noise_t){0};
+  asset_view_t view;
+  if (!map_asset(path, ASSET_MAP_SEQUENTIAL, &view)) {
+    return false;
+  }
+  const u8* p = view.data;
+  const u8* end = p + view.size;
+  u32 width = 0, height = 0, max_value = 0;
+  bool ok = view.size > 2 && p[0] == 'P' && p[1] == '5';
+  if (ok) {
+    p += 2;
+    ok = pgm_header_number(&p, end, &width) && pgm_header_number(&p, end, &height) &&
+      pgm_header_number(&p, end, &max_value) && p < end && isspace(*p++);
+  }
+  u32 bytes = max_value > 255 ? 2 : 1;
+  ok = ok && width == height && width >= 4 && width <= BLUE_NOISE_SIZE_MAX && !(width & (width-1)) &&
+    max_value > 0 && max_value <= 65535 && (usize)(end - p) >= (usize)width*height*bytes;
+  if (!ok) {
+    printf("ERROR: %s is not a square, power of two sized binary PGM.\n", path);
+    unmap_asset(&view);
+    return false;
+  }
+
+  bn->size = width;
+  bn->values = (u32*)malloc(sizeof(u32) * width * height);
+  for (u32 i=0; i < width*height; i++) {
+    u32 v = bytes == 2 ? (u32)p[i*2] << 8 | p[i*2+1] : p[i];
+    v = v < max_value ? v : max_value;
+    bn->values[i] = (u32)(((f64)v + 0.5) / ((f64)max_value + 1.0) * 4294967296.0);
+  }
+  unmap_asset(&view);
+  return true;
+}
+
+// 16 bit binary PGM, ranks stay distinct up to 256x256.
+static bool write_blue_noise(const blue_noise_t* bn, const char* path) {
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  fprintf(f, "P5\n%u %u\n65535\n", bn->size, bn->size);
+  bool ok = true;
+  for (u32 i=0; i < bn->size*bn->size && ok; i++) {
+    u8 v[2] = {(u8)(bn->values[i] >> 24), (u8)(bn->values[i] >> 16)};
+    ok = fwrite(v, 1, 2, f) == 2;
+  }
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    printf("ERROR: Cannot write %s.\n", path);
+  }
+  return ok;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Blue noise tiles are square and a power of two on a side.
+#define BLUE_NOISE_SIZE 64
+#define BLUE_NOISE_SIZE_MAX 1024
+
+typedef enum sampler_kind_t {
+  SAMPLER_XORSHIFT,   // white noise, one xorshift32 stream per pixel
+  SAMPLER_SOBOL,      // Owen scrambled 2D Sobol per pair of dimensions
+  SAMPLER_R2,         // Roberts' R2 with a random shift per pixel and dimension
+  SAMPLER_BLUE_NOISE, // a blue noise tile per dimension, stepped by the golden ratio per sample
+  SAMPLER_KIND_COUNT,
+} sampler_kind_t;
+
+static const char* sampler_kind_names[SAMPLER_KIND_COUNT] = {
+  "xorshift",
+  "sobol",
+  "r2",
+  "blue_noise",
+};
+
+// Threshold map of a tiling blue noise texture. Each value is the texel's
+// rank scaled to 32 bit fixed point, so every level is equally likely.
+typedef struct blue_noise_t {
+  u32 size;
+  u32* values;
+} blue_noise_t;
+
+typedef struct sampler_config_t {
+  sampler_kind_t kind;
+  // Changes every pattern. Keep it fixed while samples of one image are
+  // accumulated, so their indices continue one sequence.
+  u32 seed;
+  const blue_noise_t* blue_noise; // for SAMPLER_BLUE_NOISE
+} sampler_config_t;
+
+// The samples of one pixel. Dimensions are fixed by the caller, the same
+// decision gets the same dimension in every sample, see path_tracer.c.
+typedef struct pixel_sampler_t {
+  const sampler_config_t* config;
+  u32 x;
+  u32 y;
+  u32 pixel_seed;
+  u32 index;
+  u32 rng; // xorshift32 state, draws in call order and ignores dimensions
+} pixel_sampler_t;
@@ -0,0 +1,60 @@
+#pragma once
+
+//
+// Signed distance primitives and operators.
+// C ports of the ones in shaders/ray_marcher.metal, keep them in sync.
+//
+
+static inline f32
+sd_box(v3 p, v3 b) {
+  v3 d = sub3(abs3(p), b);
+  return minimum(maximum(d.x, maximum(d.y, d.z)), 0.0f) + magnitude3(max3(d, v3_zero));
+}
+
+static inline f32
+sd_plane(v3 p, v3 n, f32 dist) {
+  return dot3(p, n) + dist;
+}
+
+static inline f32
+ud_plane(v3 p) {
+  return p.y;
+}
+
+static inline f32
+sd_sphere(v3 p, f32 r) {
+  return magnitude3(p) - r;
+}
+
+static inline f32
+sd_tri_prism(v3 p, v2 h) {
+  v3 q = abs3(p);
+  return maximum(q.z - h.y, maximum(q.x*0.866025f + p.y*0.5f, -p.y) - h.x*0.5f);
+}
+
+static inline f32
+sd_torus(v3 p, v2 t) {
+  v2 q = V2(magnitude2(V2(p.x, p.z)) - t.x, p.y);
+  return magnitude2(q) - t.y;
+}
+
+static inline f32
+sd_intersect(f32 a, f32 b) {
+  return maximum(a, b);
+}
+
+static inline f32
+sd_subtract(f32 a, f32 b) {
+  return maximum(-a, b);
+}
+
+static inline f32
+sd_join(f32 a, f32 b) {
+  return minimum(a, b);
+}
+
+static inline f32
+sd_smin(f32 a, f32 b, f32 k) {
+  f32 h = clamp01(0.5f + 0.5f*(b - a)/k);
+  return lerp(b, h, a) - k*h*(1.0f - h);
+}
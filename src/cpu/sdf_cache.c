@@ -0,0 +1,213 @@
+#include "sdf_cache.h"
+
+//
+// Sparse brick cache for the ray marcher, see sdf_cache.h.
+// Everything but sdf_cache_lookup runs between frames on one thread.
+//
+
+static void init_sdf_cache(sdf_cache_t* cache, sdf_cache_config_t config) {
+  memset(cache, 0, sizeof(*cache));
+  cache->config = config;
+
+  int n = (int)ceilf(2.0f * config.half_extent / config.cell_size);
+  if (n < 1) n = 1;
+  cache->cells_per_axis = n;
+  cache->cell_count = (u32)n*(u32)n*(u32)n;
+  cache->origin = V3(-config.half_extent, -config.half_extent, -config.half_extent);
+  cache->inv_cell_size = 1.0f / config.cell_size;
+  cache->cell_half_diagonal = 0.5f * sqrtf(3.0f) * config.cell_size;
+  cache->voxel_size = config.cell_size / (f32)(SDF_BRICK_DIM-1);
+  cache->surface_band = 2.0f * cache->voxel_size;
+
+  cache->cells = (atomic_uint*)malloc(sizeof(atomic_uint) * cache->cell_count);
+  cache->cell_distances = (f32*)malloc(sizeof(f32) * cache->cell_count);
+
+  cache->brick_capacity = (u32)(config.brick_bytes / (sizeof(f32) * SDF_BRICK_SAMPLES));
+  if (cache->brick_capacity) {
+    cache->bricks = (f32*)aligned_alloc(64, sizeof(f32) * SDF_BRICK_SAMPLES * cache->brick_capacity);
+    cache->brick_cells = (u32*)malloc(sizeof(u32) * cache->brick_capacity);
+    cache->brick_frames = (atomic_uint*)malloc(sizeof(atomic_uint) * cache->brick_capacity);
+    cache->free_bricks = (u32*)malloc(sizeof(u32) * cache->brick_capacity);
+  }
+}
+
+static void free_sdf_cache(sdf_cache_t* cache) {
+  free(cache->cells);
+  free(cache->cell_distances);
+  free(cache->bricks);
+  free(cache->brick_cells);
+  free(cache->brick_frames);
+  free(cache->free_bricks);
+  memset(cache, 0, sizeof(*cache));
+}
+
+static usize sdf_cache_bytes(const sdf_cache_t* cache) {
+  return (sizeof(atomic_uint) + sizeof(f32)) * cache->cell_count +
+    (sizeof(f32)*SDF_BRICK_SAMPLES + sizeof(u32)*2 + sizeof(atomic_uint)) * cache->brick_capacity;
+}
+
+static void sdf_cache_rebuild_free_list(sdf_cache_t* cache) {
+  cache->free_count = 0;
+  for (u32 b=0; b < cache->brick_capacity; b++) {
+    if (cache->brick_cells[b] == UINT32_MAX) {
+      cache->free_bricks[cache->free_count++] = b;
+    }
+  }
+  cache->resident = cache->brick_capacity - cache->free_count;
+  atomic_store_explicit(&cache->free_cursor, 0, memory_order_relaxed);
+}
+
+// Drops everything, the next frame fills the cache from program.
+static void sdf_cache_clear(sdf_cache_t* cache, const sdf_program_t* program) {
+  cache->program = program;
+  for (u32 i=0; i < cache->cell_count; i++) {
+    atomic_store_explicit(&cache->cells[i], SDF_CELL_EMPTY, memory_order_relaxed);
+  }
+  for (u32 b=0; b < cache->brick_capacity; b++) {
+    cache->brick_cells[b] = UINT32_MAX;
+  }
+  atomic_store_explicit(&cache->near_count, 0, memory_order_relaxed);
+  sdf_cache_rebuild_free_list(cache);
+}
+
+// Evicts bricks nobody sampled for resident_frames frames and hands their
+// memory to cells that missed out on one.
+static void sdf_cache_begin_frame(sdf_cache_t* cache) {
+  cache->frame++;
+
+  for (u32 b=0; b < cache->brick_capacity; b++) {
+    u32 cell = cache->brick_cells[b];
+    if (cell == UINT32_MAX) continue;
+    u32 last = atomic_load_explicit(&cache->brick_frames[b], memory_order_relaxed);
+    if (cache->frame - last > cache->config.resident_frames) {
+      atomic_store_explicit(&cache->cells[cell], SDF_CELL_EMPTY, memory_order_relaxed);
+      cache->brick_cells[b] = UINT32_MAX;
+      cache->evicted++;
+    }
+  }
+  sdf_cache_rebuild_free_list(cache);
+
+  if (cache->free_count && atomic_load_explicit(&cache->near_count, memory_order_relaxed)) {
+    for (u32 i=0; i < cache->cell_count; i++) {
+      if (atomic_load_explicit(&cache->cells[i], memory_order_relaxed) == SDF_CELL_NEAR) {
+        atomic_store_explicit(&cache->cells[i], SDF_CELL_EMPTY, memory_order_relaxed);
+      }
+    }
+    atomic_store_explicit(&cache->near_count, 0, memory_order_relaxed);
+  }
+}
+
+// Called by the thread that won the cell, publishes its new state.
+static void sdf_cache_fill_cell(sdf_cache_t* cache, u32 cell, int ix, int iy, int iz, render_counters_t* counters) {
+  f32 size = cache->config.cell_size;
+  v3 corner = add3(cache->origin, V3((f32)ix*size, (f32)iy*size, (f32)iz*size));
+  f32 d = sdf_eval(cache->program, add3(corner, V3(0.5f*size, 0.5f*size, 0.5f*size)));
+  counters->sdf_evals += 1;
+
+  if (fabsf(d) > 2.0f*cache->cell_half_diagonal) {
+    cache->cell_distances[cell] = d;
+    atomic_store_explicit(&cache->cells[cell], SDF_CELL_FAR, memory_order_release);
+    return;
+  }
+
+  u32 slot = atomic_fetch_add_explicit(&cache->free_cursor, 1, memory_order_relaxed);
+  if (slot >= cache->free_count) {
+    atomic_fetch_add_explicit(&cache->near_count, 1, memory_order_relaxed);
+    atomic_store_explicit(&cache->cells[cell], SDF_CELL_NEAR, memory_order_release);
+    return;
+  }
+
+  u32 brick = cache->free_bricks[slot];
+  f32* samples = cache->bricks + (usize)brick*SDF_BRICK_SAMPLES;
+  f32 step = cache->voxel_size;
+  for (int z=0; z < SDF_BRICK_DIM; z++) {
+    for (int y=0; y < SDF_BRICK_DIM; y++) {
+      for (int x=0; x < SDF_BRICK_DIM; x++) {
+        v3 p = add3(corner, V3((f32)x*step, (f32)y*step, (f32)z*step));
+        *samples++ = sdf_eval(cache->program, p);
+      }
+    }
+  }
+  counters->sdf_evals += SDF_BRICK_SAMPLES;
+  counters->sdf_bricks_filled += 1;
+
+  cache->brick_cells[brick] = cell;
+  atomic_store_explicit(&cache->brick_frames[brick], cache->frame, memory_order_relaxed);
+  atomic_store_explicit(&cache->cells[cell], ((u32)brick << SDF_CELL_STATE_BITS) | SDF_CELL_BRICK, memory_order_release);
+}
+
+// Writes a lower bound on the distance at p to *dist and returns true, or
+// returns false if p is outside the cache or too close to the surface and
+// the caller should evaluate the field itself.
+static bool sdf_cache_lookup(sdf_cache_t* cache, v3 p, f32* dist, render_counters_t* counters) {
+  counters->sdf_samples += 1;
+
+  v3 rel = mul3(sub3(p, cache->origin), cache->inv_cell_size);
+  int n = cache->cells_per_axis;
+  if (!(rel.x >= 0 && rel.y >= 0 && rel.z >= 0 && rel.x < (f32)n && rel.y < (f32)n && rel.z < (f32)n)) {
+    return false;
+  }
+  int ix = (int)rel.x;
+  int iy = (int)rel.y;
+  int iz = (int)rel.z;
+  u32 cell = (u32)ix + (u32)n*((u32)iy + (u32)n*(u32)iz);
+
+  u32 state = atomic_load_explicit(&cache->cells[cell], memory_order_acquire);
+  if (state == SDF_CELL_EMPTY) {
+    if (!atomic_compare_exchange_strong_explicit(&cache->cells[cell], &state, SDF_CELL_BUSY,
+        memory_order_acquire, memory_order_acquire)) {
+      return false;
+    }
+    sdf_cache_fill_cell(cache, cell, ix, iy, iz, counters);
+    state = atomic_load_explicit(&cache->cells[cell], memory_order_relaxed);
+  }
+
+  switch (state & SDF_CELL_STATE_MASK) {
+    case SDF_CELL_FAR: {
+      f32 size = cache->config.cell_size;
+      v3 center = add3(cache->origin, V3(((f32)ix+0.5f)*size, ((f32)iy+0.5f)*size, ((f32)iz+0.5f)*size));
+      f32 d = cache->cell_distances[cell];
+      f32 r = magnitude3(sub3(p, center));
+      *dist = d > 0 ? d - r : d + r;
+      counters->sdf_cache_hits += 1;
+      return true;
+    }
+
+    case SDF_CELL_BRICK: {
+      u32 brick = state >> SDF_CELL_STATE_BITS;
+      if (atomic_load_explicit(&cache->brick_frames[brick], memory_order_relaxed) != cache->frame) {
+        atomic_store_explicit(&cache->brick_frames[brick], cache->frame, memory_order_relaxed);
+      }
+
+      f32 scale = (f32)(SDF_BRICK_DIM-1);
+      v3 local = V3((rel.x - (f32)ix)*scale, (rel.y - (f32)iy)*scale, (rel.z - (f32)iz)*scale);
+      int x = (int)local.x; if (x > SDF_BRICK_DIM-2) x = SDF_BRICK_DIM-2;
+      int y = (int)local.y; if (y > SDF_BRICK_DIM-2) y = SDF_BRICK_DIM-2;
+      int z = (int)local.z; if (z > SDF_BRICK_DIM-2) z = SDF_BRICK_DIM-2;
+      f32 fx = local.x - (f32)x;
+      f32 fy = local.y - (f32)y;
+      f32 fz = local.z - (f32)z;
+
+      const f32* s = cache->bricks + (usize)brick*SDF_BRICK_SAMPLES + x + SDF_BRICK_DIM*(y + SDF_BRICK_DIM*z);
+      const int dy = SDF_BRICK_DIM;
+      const int dz = SDF_BRICK_DIM*SDF_BRICK_DIM;
+      f32 c00 = lerp(s[0],       fx, s[1]);
+      f32 c10 = lerp(s[dy],      fx, s[dy+1]);
+      f32 c01 = lerp(s[dz],      fx, s[dz+1]);
+      f32 c11 = lerp(s[dz+dy],   fx, s[dz+dy+1]);
+      f32 d = lerp(lerp(c00, fy, c10), fz, lerp(c01, fy, c11));
+
+      // Interpolation is off by up to about a voxel, so stay clear of the
+      // surface and step a voxel short.
+      if (fabsf(d) < cache->surface_band) {
+        return false;
+      }
+      *dist = d > 0 ? d - cache->voxel_size : d + cache->voxel_size;
+      counters->sdf_cache_hits += 1;
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdatomic.h>
+
+// Samples per brick edge. Bricks include both faces of their cell, so the
+// spacing between samples is cell_size / (SDF_BRICK_DIM-1).
+#define SDF_BRICK_DIM 8
+#define SDF_BRICK_SAMPLES (SDF_BRICK_DIM*SDF_BRICK_DIM*SDF_BRICK_DIM)
+
+typedef enum sdf_cell_state_t {
+  SDF_CELL_EMPTY, // not looked at yet
+  SDF_CELL_BUSY,  // being filled by another thread
+  SDF_CELL_FAR,   // nothing inside, the distance at the center is enough
+  SDF_CELL_BRICK, // near the surface, upper bits hold the brick index
+  SDF_CELL_NEAR,  // near the surface but no brick was free
+} sdf_cell_state_t;
+
+#define SDF_CELL_STATE_BITS 3
+#define SDF_CELL_STATE_MASK ((1u << SDF_CELL_STATE_BITS) - 1)
+
+typedef struct sdf_cache_config_t {
+  f32 half_extent;   // cube around the origin the cache covers
+  f32 cell_size;
+  usize brick_bytes; // budget for brick samples
+  u32 resident_frames; // unused bricks are evicted after this many frames
+  // Shorter programs are cheaper to run than to look up, see readme.md.
+  u32 min_instructions;
+} sdf_cache_config_t;
+
+static const sdf_cache_config_t sdf_cache_default_config = {
+  .half_extent = 32.0f,
+  .cell_size = 0.5f,
+  .brick_bytes = 32ull << 20,
+  .resident_frames = 8,
+  .min_instructions = 16,
+};
+
+// Sparse cache of a static distance field, filled lazily by whichever
+// thread touches a cell first. Cells far from the surface keep one distance,
+// cells near it get a brick of samples that is trilinearly interpolated.
+// Lookups close enough to the surface that interpolation would show are left
+// to the analytic field.
+typedef struct sdf_cache_t {
+  sdf_cache_config_t config;
+  const sdf_program_t* program;
+
+  int cells_per_axis;
+  v3 origin;
+  f32 inv_cell_size;
+  f32 cell_half_diagonal;
+  f32 voxel_size;
+  f32 surface_band;
+
+  u32 cell_count;
+  atomic_uint* cells; // sdf_cell_state_t, and the brick index for SDF_CELL_BRICK
+  f32* cell_distances;
+
+  u32 brick_capacity;
+  f32* bricks;
+  u32* brick_cells; // owning cell, or UINT32_MAX while free
+  atomic_uint* brick_frames; // last frame a brick was sampled
+
+  // Rebuilt between frames, handed out with an atomic cursor during one.
+  u32* free_bricks;
+  u32 free_count;
+  atomic_uint free_cursor;
+  atomic_uint near_count;
+
+  u32 frame;
+  u32 resident;
+  u64 evicted;
+} sdf_cache_t;
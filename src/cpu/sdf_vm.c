@@ -0,0 +1,49 @@
+//
+// Interpreter for sdf_program_t, see sdf_graph.c for the compiler and
+// shaders/sdf_vm.metal for the GPU one. The packet version lives next to the
+// packet primitives in ray_marcher_packet.c.
+//
+
+static f32 sdf_eval(const sdf_program_t* prog, v3 p) {
+  v3 pr[SDF_POINT_REGISTERS];
+  f32 dr[SDF_DIST_REGISTERS];
+  pr[0] = p;
+  dr[0] = FLT_MAX;
+
+  for (u32 i=0; i < prog->instruction_count; i++) {
+    sdf_instr_t in = prog->instructions[i];
+    const f32* k = prog->constants + in.constants;
+    switch (in.op) {
+      case SDF_OP_BOX:
+        dr[in.dst] = sd_box(sub3(pr[in.a], V3(k[0], k[1], k[2])), V3(k[3], k[4], k[5])); break;
+      case SDF_OP_SPHERE:
+        dr[in.dst] = sd_sphere(sub3(pr[in.a], V3(k[0], k[1], k[2])), k[3]); break;
+      case SDF_OP_TRI_PRISM:
+        dr[in.dst] = sd_tri_prism(sub3(pr[in.a], V3(k[0], k[1], k[2])), V2(k[3], k[4])); break;
+      case SDF_OP_TORUS:
+        dr[in.dst] = sd_torus(sub3(pr[in.a], V3(k[0], k[1], k[2])), V2(k[3], k[4])); break;
+      case SDF_OP_PLANE:
+        dr[in.dst] = sd_plane(sub3(pr[in.a], V3(k[0], k[1], k[2])), V3(k[3], k[4], k[5]), k[6]); break;
+      case SDF_OP_JOIN:
+        dr[in.dst] = sd_join(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SUBTRACT:
+        dr[in.dst] = sd_subtract(dr[in.a], dr[in.b]); break;
+      case SDF_OP_INTERSECT:
+        dr[in.dst] = sd_intersect(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SMIN:
+        dr[in.dst] = sd_smin(dr[in.a], dr[in.b], k[0]); break;
+      case SDF_OP_TRANSFORM: {
+        v3 q = sub3(pr[in.a], V3(k[0], k[1], k[2]));
+        pr[in.dst] = V3(
+          k[3]*q.x + k[4]*q.y + k[5]*q.z,
+          k[6]*q.x + k[7]*q.y + k[8]*q.z,
+          k[9]*q.x + k[10]*q.y + k[11]*q.z
+        );
+      } break;
+      case SDF_OP_SCALE:
+        dr[in.dst] = dr[in.a] * k[0]; break;
+      default: break;
+    }
+  }
+  return dr[0];
+}
@@ -0,0 +1,142 @@
+//
+// Closest hit of one ray against a run of spheres stored as a sphere_soa_t,
+// SPHERE_LANES spheres at a time. This is the BVH leaf test for the path
+// tracer. SPHERE_LANES picks the instruction set at compile time: 16 needs
+// AVX-512, 8 runs on the f32x8 in cave_simd.h (one AVX register, or two SSE
+// or NEON ones), 1 is plain C for everything else. 16 is opt in, it measured
+// no faster than 8 on an AVX-512 part since leaves are small and the wider
+// reduce costs more.
+//
+
+#ifndef SPHERE_LANES
+  #if CAVE_SIMD != CAVE_SIMD_NONE
+    #define SPHERE_LANES 8
+  #else
+    #define SPHERE_LANES 1
+  #endif
+#endif
+
+#if SPHERE_LANES == 16
+#include <immintrin.h>
+#endif
+
+#if SPHERE_LANES > SCENE_SOA_PADDING
+#error "SCENE_SOA_PADDING must cover a full SPHERE_LANES load"
+#endif
+
+#if SPHERE_LANES == 16
+
+// Updates *closest_t and *hit_index if one of spheres [first, first+count)
+// is hit nearer than *closest_t and further than min_t.
+static void intersect_spheres(const sphere_soa_t* soa, u32 first, u32 count, v3 ro, v3 rd, f32 min_t, f32* closest_t, int* hit_index) {
+  __m512 ox = _mm512_set1_ps(ro.x);
+  __m512 oy = _mm512_set1_ps(ro.y);
+  __m512 oz = _mm512_set1_ps(ro.z);
+  __m512 dx = _mm512_set1_ps(rd.x);
+  __m512 dy = _mm512_set1_ps(rd.y);
+  __m512 dz = _mm512_set1_ps(rd.z);
+  __m512 zero = _mm512_setzero_ps();
+  __m512 tmin = _mm512_set1_ps(min_t);
+
+  for (u32 i=first; i < first+count; i += 16) {
+    u32 remaining = first + count - i;
+    __mmask16 valid = remaining >= 16 ? 0xFFFF : (__mmask16)((1u << remaining) - 1);
+
+    __m512 rx = _mm512_sub_ps(ox, _mm512_loadu_ps(soa->center_x + i));
+    __m512 ry = _mm512_sub_ps(oy, _mm512_loadu_ps(soa->center_y + i));
+    __m512 rz = _mm512_sub_ps(oz, _mm512_loadu_ps(soa->center_z + i));
+    __m512 r = _mm512_loadu_ps(soa->radius + i);
+
+    __m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(rx, dx), _mm512_mul_ps(ry, dy)), _mm512_mul_ps(rz, dz));
+    __m512 c = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(rx, rx), _mm512_mul_ps(ry, ry)), _mm512_mul_ps(rz, rz));
+    c = _mm512_sub_ps(c, _mm512_mul_ps(r, r));
+    __m512 d = _mm512_sub_ps(_mm512_mul_ps(b, b), c);
+    __mmask16 hit = _mm512_mask_cmp_ps_mask(valid, d, zero, _CMP_GT_OQ);
+    if (!hit) continue;
+
+    __m512 sqrd = _mm512_sqrt_ps(_mm512_max_ps(d, zero));
+    __m512 nb = _mm512_sub_ps(zero, b);
+    __m512 t_near = _mm512_sub_ps(nb, sqrd);
+    __m512 t_far = _mm512_add_ps(nb, sqrd);
+    __mmask16 inside = _mm512_cmp_ps_mask(t_near, tmin, _CMP_LE_OQ);
+    __m512 t = _mm512_mask_blend_ps(inside, t_near, t_far);
+    hit = _mm512_mask_cmp_ps_mask(hit, t, tmin, _CMP_GT_OQ);
+    hit = _mm512_mask_cmp_ps_mask(hit, t, _mm512_set1_ps(*closest_t), _CMP_LT_OQ);
+    if (!hit) continue;
+
+    // Lowest lane wins ties, same as testing them one at a time.
+    t = _mm512_mask_blend_ps(hit, _mm512_set1_ps(FLT_MAX), t);
+    f32 best = _mm512_reduce_min_ps(t);
+    __mmask16 at = _mm512_mask_cmp_ps_mask(hit, t, _mm512_set1_ps(best), _CMP_EQ_OQ);
+    *hit_index = (int)(i + (u32)__builtin_ctz(at));
+    *closest_t = best;
+  }
+}
+
+#elif SPHERE_LANES == 8
+
+// Updates *closest_t and *hit_index if one of spheres [first, first+count)
+// is hit nearer than *closest_t and further than min_t.
+static void intersect_spheres(const sphere_soa_t* soa, u32 first, u32 count, v3 ro, v3 rd, f32 min_t, f32* closest_t, int* hit_index) {
+  v3x8 o = v3x8_set1(ro);
+  v3x8 dir = v3x8_set1(rd);
+  f32x8 zero = f32x8_zero();
+  f32x8 tmin = f32x8_set1(min_t);
+  f32x8 lane = f32x8_index();
+
+  for (u32 i=first; i < first+count; i += 8) {
+    f32x8_mask valid = f32x8_lt(lane, f32x8_set1((f32)(first + count - i)));
+
+    v3x8 rel = v3x8_sub(o, v3x8_load(soa->center_x + i, soa->center_y + i, soa->center_z + i));
+    f32x8 r = f32x8_load(soa->radius + i);
+
+    f32x8 b = v3x8_dot(rel, dir);
+    f32x8 c = f32x8_sub(v3x8_dot(rel, rel), f32x8_mul(r, r));
+    f32x8 d = f32x8_sub(f32x8_mul(b, b), c);
+    f32x8_mask hit = f32x8_and(valid, f32x8_gt(d, zero));
+    if (!f32x8_any(hit)) continue;
+
+    f32x8 sqrd = f32x8_sqrt(f32x8_max(d, zero));
+    f32x8 nb = f32x8_sub(zero, b);
+    f32x8 t_near = f32x8_sub(nb, sqrd);
+    f32x8 t_far = f32x8_add(nb, sqrd);
+    f32x8 t = f32x8_select(f32x8_le(t_near, tmin), t_far, t_near);
+    hit = f32x8_and(hit, f32x8_gt(t, tmin));
+    hit = f32x8_and(hit, f32x8_lt(t, f32x8_set1(*closest_t)));
+    u32 hit_bits = f32x8_bits(hit);
+    if (!hit_bits) continue;
+
+    // Lowest lane wins ties, same as testing them one at a time.
+    t = f32x8_select(hit, t, f32x8_set1(FLT_MAX));
+    f32 best = f32x8_hmin(t);
+    u32 at = hit_bits & f32x8_bits(f32x8_eq(t, f32x8_set1(best)));
+    *hit_index = (int)(i + (u32)__builtin_ctz(at));
+    *closest_t = best;
+  }
+}
+
+#elif SPHERE_LANES == 1
+
+static void intersect_spheres(const sphere_soa_t* soa, u32 first, u32 count, v3 ro, v3 rd, f32 min_t, f32* closest_t, int* hit_index) {
+  for (u32 i=first; i < first+count; i++) {
+    v3 rel = V3(ro.x - soa->center_x[i], ro.y - soa->center_y[i], ro.z - soa->center_z[i]);
+    f32 b = dot3(rel, rd);
+    f32 c = dot3(rel, rel) - soa->radius[i]*soa->radius[i];
+    f32 d = b*b - c;
+    if (d > 0) {
+      f32 sqrd = square_root(d);
+      f32 t = (-b - sqrd);
+      if (t <= min_t) {
+        t = (-b + sqrd);
+      }
+      if (t > min_t && t<*closest_t) {
+        *hit_index = (int)i;
+        *closest_t = t;
+      }
+    }
+  }
+}
+
+#else
+#error "SPHERE_LANES must be 1, 8 or 16"
+#endif
@@ -0,0 +1,103 @@
+#include "ui_raster.h"
+
+//
+// UI rasterizer for the CPU renderer.
+// cpu_render_frame bins the frame's ui_rect_ts by render tile, and each tile
+// composites its rects right after rendering, while its pixels are still in
+// cache. Rects cover the pixels whose centers they contain, there's no
+// antialiasing. Opaque rects are plain fills, the rest blend src over dst
+// with 8 bit math rounded like (x + 127) / 255.
+//
+
+static inline ui_span_t ui_span_from_rect(const ui_rect_t* rect, f32 scale, int width, int height) {
+  ui_span_t s;
+  s.x0 = (int)ceilf(rect->x*scale - 0.5f);
+  s.y0 = (int)ceilf(rect->y*scale - 0.5f);
+  s.x1 = (int)ceilf((rect->x + rect->w)*scale - 0.5f);
+  s.y1 = (int)ceilf((rect->y + rect->h)*scale - 0.5f);
+  s.x0 = s.x0 > 0 ? s.x0 : 0;
+  s.y0 = s.y0 > 0 ? s.y0 : 0;
+  s.x1 = s.x1 < width ? s.x1 : width;
+  s.y1 = s.y1 < height ? s.y1 : height;
+  // RGBA8 with r in the low byte to BGRA8 with b in the low byte.
+  u32 c = rect->color;
+  s.color = (c & 0xFF00FF00) | ((c & 0xFF) << 16) | ((c >> 16) & 0xFF);
+  return s;
+}
+
+static inline bool ui_span_empty(ui_span_t s) {
+  return s.x0 >= s.x1 || s.y0 >= s.y1;
+}
+
+// Two channels at a time in the 16 bit halves of a u32. add holds src*a + 128
+// for both, inv is 255 - a.
+static inline u32 ui_blend_pair(u32 dst, u32 add, u32 inv) {
+  u32 x = dst*inv + add;
+  return ((x + ((x >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+}
+
+// src over count pixels of dst, src alpha in its top byte.
+static void ui_blend_span(u32* dst, int count, u32 src) {
+  u32 a = src >> 24;
+  u32 inv = 255 - a;
+  // Alpha blends as a channel whose src value is 255.
+  u32 add_rb = ((src & 0x00FF00FF) * a) + 0x00800080;
+  u32 add_ga = ((((src >> 8) & 0xFF) | 0x00FF0000) * a) + 0x00800080;
+  int x = 0;
+#if CAVE_SIMD == CAVE_SIMD_SSE
+  // The same math 16 bits per channel, each channel of src*a + 128 in its
+  // own lane.
+  u16 b = (u16)((src & 0xFF)*a + 128), g = (u16)(((src >> 8) & 0xFF)*a + 128);
+  u16 r = (u16)(((src >> 16) & 0xFF)*a + 128), al = (u16)(255*a + 128);
+#if defined(__AVX2__)
+  __m256i add8 = _mm256_setr_epi16(b, g, r, al, b, g, r, al, b, g, r, al, b, g, r, al);
+  __m256i inv8 = _mm256_set1_epi16((short)inv);
+  __m256i zero8 = _mm256_setzero_si256();
+  for (; x + 8 <= count; x += 8) {
+    __m256i d = _mm256_loadu_si256((const __m256i*)(dst + x));
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero8), inv8), add8);
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero8), inv8), add8);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_packus_epi16(lo, hi));
+  }
+#endif
+  __m128i add4 = _mm_setr_epi16(b, g, r, al, b, g, r, al);
+  __m128i inv4 = _mm_set1_epi16((short)inv);
+  __m128i zero4 = _mm_setzero_si128();
+  for (; x + 4 <= count; x += 4) {
+    __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero4), inv4), add4);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero4), inv4), add4);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+  }
+#endif
+  for (; x < count; x++) {
+    u32 d = dst[x];
+    dst[x] = ui_blend_pair(d & 0x00FF00FF, add_rb, inv) | (ui_blend_pair((d >> 8) & 0x00FF00FF, add_ga, inv) << 8);
+  }
+}
+
+// Composites spans over the part of target inside [x0, x1) x [y0, y1).
+static void ui_composite(const render_target_t* target, const ui_span_t* spans, const u32* indices, u32 count, int x0, int y0, int x1, int y1) {
+  for (u32 i=0; i < count; i++) {
+    ui_span_t s = spans[indices[i]];
+    int sx0 = s.x0 > x0 ? s.x0 : x0;
+    int sy0 = s.y0 > y0 ? s.y0 : y0;
+    int sx1 = s.x1 < x1 ? s.x1 : x1;
+    int sy1 = s.y1 < y1 ? s.y1 : y1;
+    if (sx0 >= sx1 || sy0 >= sy1 || (s.color >> 24) == 0) {
+      continue;
+    }
+    for (int y=sy0; y < sy1; y++) {
+      u32* row = target->pixels + (usize)y*target->stride;
+      if ((s.color >> 24) == 0xFF) {
+        for (int x=sx0; x < sx1; x++) row[x] = s.color;
+      } else {
+        ui_blend_span(row + sx0, sx1 - sx0, s.color);
+      }
+    }
+  }
+}
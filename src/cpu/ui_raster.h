@@ -0,0 +1,8 @@
+#pragma once
+
+// A ui_rect_t in target pixels, clipped to the target, with its color
+// swizzled to BGRA8.
+typedef struct ui_span_t {
+  int x0, y0, x1, y1;
+  u32 color;
+} ui_span_t;
@@ -0,0 +1,363 @@
+#include "cpu_renderer.h"
+#include "cpu/ray_marcher.c"
+#include "cpu/ray_marcher_packet.c"
+#include "cpu/path_tracer.c"
+#include "cpu/ray_tracer.c"
+#include "cpu/resolve.c"
+#include "cpu/ui_raster.c"
+
+//
+// Tiled CPU reference renderer.
+// The frame is cut into RENDER_TILE_SIZE tiles that are rendered as jobs, so
+// threads that finish cheap sky tiles early steal the expensive ones.
+// The marcher and ray tracer resolve each tile row as they go, the path tracer
+// leaves linear sums in its accum buffer that are resolved in a second pass.
+// UI rects are binned by tile and composited as soon as a tile's pixels are
+// final, at the end of the tile or of its resolve band.
+//
+
+static u64 render_ticks_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec*1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void render_tile_ray_marcher(cpu_renderer_t* r, int x0, int y0, int x1, int y1, render_counters_t* counters) {
+  const render_target_t* target = &r->target;
+  f32 inv_w = 1.0f / (f32)target->width;
+  f32 inv_h = 1.0f / (f32)target->height;
+  rm_field_t field = {r->sdf_program, NULL, counters};
+  if (r->sdf_cache && r->sdf_program->instruction_count >= r->sdf_cache->config.min_instructions) {
+    field.cache = r->sdf_cache;
+  }
+
+  for (int y=y0; y < y1; y++) {
+    u32* row = target->pixels + (usize)y*target->stride;
+    // uv.y runs bottom to top, rows run top to bottom
+    f32 v = 1.0f - ((f32)y + 0.5f) * inv_h;
+    // Room for the last packet to run past x1.
+    v3 colors[RENDER_TILE_SIZE + PACKET_WIDTH];
+    if (r->use_packets) {
+      for (int x=x0; x < x1; x += PACKET_WIDTH) {
+        rm_shade_packet(&field, r->params, ((f32)x + 0.5f) * inv_w, inv_w, v, colors + (x - x0));
+      }
+    } else {
+      for (int x=x0; x < x1; x++) {
+        f32 u = ((f32)x + 0.5f) * inv_w;
+        rm_shade_pixel(&field, r->params, u, v, &colors[x - x0]);
+      }
+    }
+    resolve_span(row + x0, colors, RESOLVE_RGB_F32, x1 - x0, 1.0f, RESOLVE_CURVE_UNORM, false);
+  }
+}
+
+static void render_tile_path_tracer(cpu_renderer_t* r, int x0, int y0, int x1, int y1, render_counters_t* counters) {
+  const render_target_t* target = &r->target;
+  f32 inv_w = 1.0f / (f32)target->width;
+  f32 inv_h = 1.0f / (f32)target->height;
+
+  accum_buffer_t* accum = &r->accum;
+  int samples = r->accumulate ? 1 : PT_SAMPLES_PER_PIXEL;
+  // Accumulated frames continue one sequence, the others each start one.
+  sampler_config_t sampling = r->sampling;
+  u32 first_sample = 0;
+  if (r->accumulate) {
+    first_sample = accum->sample_count - 1;
+  } else {
+    sampling.seed += r->params->frame_count;
+  }
+
+  for (int y=y0; y < y1; y++) {
+    v3* sums = accum->samples + (usize)y*accum->width;
+    f32 v = 1.0f - ((f32)y + 0.5f) * inv_h;
+    for (int x=x0; x < x1; x++) {
+      f32 u = ((f32)x + 0.5f) * inv_w;
+      v3 color = pt_sample_pixel(r->scene, r->params, &sampling, x, y, u, v, first_sample, samples, PT_SAMPLING_ALL, counters);
+      sums[x] = r->accumulate ? add3(sums[x], color) : color;
+    }
+  }
+}
+
+static void render_tile_ray_tracer(cpu_renderer_t* r, int x0, int y0, int x1, int y1, render_counters_t* counters) {
+  const render_target_t* target = &r->target;
+  f32 inv_w = 1.0f / (f32)target->width;
+  f32 inv_h = 1.0f / (f32)target->height;
+  sampler_config_t sampling = r->sampling;
+  sampling.seed += r->params->frame_count;
+
+  for (int y=y0; y < y1; y++) {
+    u32* row = target->pixels + (usize)y*target->stride;
+    f32 v = 1.0f - ((f32)y + 0.5f) * inv_h;
+    v3 colors[RENDER_TILE_SIZE];
+    for (int x=x0; x < x1; x++) {
+      f32 u = ((f32)x + 0.5f) * inv_w;
+      colors[x - x0] = rt_sample_pixel(r->scene, r->params, &sampling, x, y, u, v, counters);
+    }
+    resolve_span(row + x0, colors, RESOLVE_RGB_F32, x1 - x0, 1.0f, RESOLVE_CURVE_UNORM, false);
+  }
+}
+
+// Bins the UI rects by the tiles they touch, counting first so each tile's
+// list is one contiguous run of tile_ui.
+static void bin_ui_rects(cpu_renderer_t* r) {
+  r->tile_ui_first = push_array(&r->frame_arena, u32, r->tile_count + 1);
+  memset(r->tile_ui_first, 0, sizeof(u32) * (r->tile_count + 1));
+  if (r->ui_rect_count == 0) {
+    r->ui_spans = NULL;
+    r->tile_ui = NULL;
+    return;
+  }
+
+  f32 scale = (f32)r->target.width / r->params->viewport_size.x;
+  r->ui_spans = push_array(&r->frame_arena, ui_span_t, r->ui_rect_count);
+  u32* counts = r->tile_ui_first + 1;
+  u32 total = 0;
+  for (u32 i=0; i < r->ui_rect_count; i++) {
+    ui_span_t s = ui_span_from_rect(&r->ui_rects[i], scale, r->target.width, r->target.height);
+    r->ui_spans[i] = s;
+    if (ui_span_empty(s)) {
+      continue;
+    }
+    for (int ty=s.y0 / RENDER_TILE_SIZE; ty <= (s.y1-1) / RENDER_TILE_SIZE; ty++) {
+      for (int tx=s.x0 / RENDER_TILE_SIZE; tx <= (s.x1-1) / RENDER_TILE_SIZE; tx++) {
+        counts[ty*r->tiles_x + tx]++;
+        total++;
+      }
+    }
+  }
+
+  // counts[i] becomes the end of tile i-1 and the next free slot of tile i.
+  for (int i=1; i <= r->tile_count; i++) {
+    r->tile_ui_first[i] += r->tile_ui_first[i-1];
+  }
+  r->tile_ui = push_array(&r->frame_arena, u32, total ? total : 1);
+  u32* next = push_array(&r->frame_arena, u32, r->tile_count);
+  memcpy(next, r->tile_ui_first, sizeof(u32) * r->tile_count);
+  for (u32 i=0; i < r->ui_rect_count; i++) {
+    ui_span_t s = r->ui_spans[i];
+    if (ui_span_empty(s)) {
+      continue;
+    }
+    for (int ty=s.y0 / RENDER_TILE_SIZE; ty <= (s.y1-1) / RENDER_TILE_SIZE; ty++) {
+      for (int tx=s.x0 / RENDER_TILE_SIZE; tx <= (s.x1-1) / RENDER_TILE_SIZE; tx++) {
+        r->tile_ui[next[ty*r->tiles_x + tx]++] = i;
+      }
+    }
+  }
+}
+
+// Composites tile_index's UI over the part of it inside [x0, x1) x [y0, y1).
+static void composite_tile_ui(cpu_renderer_t* r, int tile_index, int x0, int y0, int x1, int y1) {
+  u32 first = r->tile_ui_first[tile_index];
+  u32 count = r->tile_ui_first[tile_index + 1] - first;
+  if (count) {
+    ui_composite(&r->target, r->ui_spans, r->tile_ui + first, count, x0, y0, x1, y1);
+  }
+}
+
+static void render_tile(cpu_renderer_t* r, int tile_index, render_thread_stats_t* stats) {
+  const render_target_t* target = &r->target;
+  int x0 = (tile_index % r->tiles_x) * RENDER_TILE_SIZE;
+  int y0 = (tile_index / r->tiles_x) * RENDER_TILE_SIZE;
+  int x1 = x0 + RENDER_TILE_SIZE < target->width ? x0 + RENDER_TILE_SIZE : target->width;
+  int y1 = y0 + RENDER_TILE_SIZE < target->height ? y0 + RENDER_TILE_SIZE : target->height;
+
+  profile_begin(PROFILE_RENDER_TILE);
+  render_counters_t* counters = &stats->counters;
+  switch (r->pipeline) {
+    case RENDER_PIPELINE_RAY_MARCHER:
+      render_tile_ray_marcher(r, x0, y0, x1, y1, counters); break;
+    case RENDER_PIPELINE_PATH_TRACER:
+      render_tile_path_tracer(r, x0, y0, x1, y1, counters); break;
+    case RENDER_PIPELINE_RAY_TRACER:
+      render_tile_ray_tracer(r, x0, y0, x1, y1, counters); break;
+    default: break;
+  }
+  if (r->pipeline != RENDER_PIPELINE_PATH_TRACER) {
+    composite_tile_ui(r, tile_index, x0, y0, x1, y1);
+  }
+
+  stats->pixels += (u64)(x1 - x0) * (u64)(y1 - y0);
+  stats->tiles += 1;
+  profile_end(PROFILE_RENDER_TILE);
+}
+
+// Starts the running sum over if anything that affects the image changed.
+// Without accumulate the buffer only holds this frame, and isn't cleared.
+static void update_accum_buffer(accum_buffer_t* accum, const render_target_t* target, const fs_params_t* params, bool accumulate) {
+  bool reset = accum->sample_count == 0 ||
+    target->width != accum->width ||
+    target->height != accum->height ||
+    memcmp(&params->camera, &accum->camera, sizeof(render_camera_t)) != 0 ||
+    memcmp(&params->debug_params, &accum->debug_params, sizeof(debug_params_t)) != 0;
+
+  if (target->width != accum->width || target->height != accum->height) {
+    accum->width = target->width;
+    accum->height = target->height;
+    reset_arena(&accum->memory);
+    accum->samples = push_array(&accum->memory, v3, (usize)accum->width * accum->height);
+    trim_arena(&accum->memory, 0);
+  }
+
+  if (!accumulate) {
+    accum->sample_count = 0;
+    return;
+  }
+
+  if (reset) {
+    memset(accum->samples, 0, sizeof(v3) * accum->width * accum->height);
+    accum->sample_count = 0;
+    accum->camera = params->camera;
+    accum->debug_params = params->debug_params;
+  }
+  accum->sample_count++;
+}
+
+static void render_tile_run_job(void* data) {
+  render_tile_run_t run = *(render_tile_run_t*)data;
+  cpu_renderer_t* r = run.renderer;
+
+  while (run.count > 1) {
+    int half = run.count / 2;
+    int index = atomic_fetch_add_explicit(&r->next_run, 1, memory_order_relaxed);
+    render_tile_run_t* back = &r->runs[index];
+    back->renderer = r;
+    back->first = run.first + half;
+    back->count = run.count - half;
+    job_submit(r->jobs, render_tile_run_job, back, &r->frame_counter);
+    run.count = half;
+  }
+
+  render_tile(r, run.first, &r->thread_stats[job_thread_index()]);
+}
+
+static void render_resolve_job(void* data) {
+  render_resolve_band_t* band = (render_resolve_band_t*)data;
+  cpu_renderer_t* r = band->renderer;
+  profile_begin(PROFILE_RESOLVE);
+  resolve_rows(&r->resolve, &r->target, band->y0, band->y1);
+  // Each tile only composites its own part of the band, a rect is binned
+  // into every tile it touches.
+  for (int ty=band->y0 / RENDER_TILE_SIZE; ty <= (band->y1-1) / RENDER_TILE_SIZE; ty++) {
+    int y0 = ty*RENDER_TILE_SIZE > band->y0 ? ty*RENDER_TILE_SIZE : band->y0;
+    int y1 = (ty+1)*RENDER_TILE_SIZE < band->y1 ? (ty+1)*RENDER_TILE_SIZE : band->y1;
+    for (int tx=0; tx < r->tiles_x; tx++) {
+      int x0 = tx*RENDER_TILE_SIZE;
+      int x1 = x0 + RENDER_TILE_SIZE < r->target.width ? x0 + RENDER_TILE_SIZE : r->target.width;
+      composite_tile_ui(r, ty*r->tiles_x + tx, x0, y0, x1, y1);
+    }
+  }
+  profile_end(PROFILE_RESOLVE);
+}
+
+// Resolves r->resolve into the target across the job threads.
+static void render_resolve(cpu_renderer_t* r) {
+  int band_count = (r->target.height + RESOLVE_BAND_ROWS-1) / RESOLVE_BAND_ROWS;
+  r->bands = push_array(&r->frame_arena, render_resolve_band_t, band_count);
+  for (int i=0; i < band_count; i++) {
+    int y0 = i * RESOLVE_BAND_ROWS;
+    int y1 = y0 + RESOLVE_BAND_ROWS < r->target.height ? y0 + RESOLVE_BAND_ROWS : r->target.height;
+    r->bands[i] = (render_resolve_band_t){r, y0, y1};
+    job_submit(r->jobs, render_resolve_job, &r->bands[i], &r->frame_counter);
+  }
+  job_wait(r->jobs, &r->frame_counter);
+}
+
+static void init_cpu_renderer(cpu_renderer_t* r, job_system_t* jobs) {
+  memset(r, 0, sizeof(*r));
+  r->jobs = jobs;
+  r->thread_count = jobs->thread_count;
+  r->pipeline = RENDER_PIPELINE_RAY_MARCHER;
+  r->use_packets = PACKET_WIDTH > 1;
+  r->accumulate = true;
+  r->sampling.kind = SAMPLER_SOBOL;
+  init_virtual_arena(&r->frame_arena, RENDER_FRAME_ARENA_RESERVE);
+  init_virtual_arena(&r->accum.memory, RENDER_ACCUM_ARENA_RESERVE);
+}
+
+static void shutdown_cpu_renderer(cpu_renderer_t* r) {
+  free_arena(&r->accum.memory);
+  r->accum = (accum_buffer_t){0};
+  free_arena(&r->frame_arena);
+  r->runs = NULL;
+  r->bands = NULL;
+  r->ui_spans = NULL;
+  r->tile_ui_first = NULL;
+  r->tile_ui = NULL;
+}
+
+static render_stats_t cpu_render_frame(cpu_renderer_t* r, render_target_t target, const fs_params_t* params) {
+  profile_begin(PROFILE_RENDER);
+  u64 start = render_ticks_ns();
+
+  r->target = target;
+  r->params = params;
+  r->tiles_x = (target.width + RENDER_TILE_SIZE-1) / RENDER_TILE_SIZE;
+  r->tiles_y = (target.height + RENDER_TILE_SIZE-1) / RENDER_TILE_SIZE;
+  r->tile_count = r->tiles_x * r->tiles_y;
+  for (int i=0; i < r->thread_count; i++) {
+    r->thread_stats[i] = (render_thread_stats_t){0};
+  }
+
+  if (r->pipeline == RENDER_PIPELINE_PATH_TRACER) {
+    update_accum_buffer(&r->accum, &target, params, r->accumulate);
+  }
+  if (r->pipeline == RENDER_PIPELINE_RAY_MARCHER && r->sdf_cache) {
+    sdf_cache_begin_frame(r->sdf_cache);
+  }
+
+  reset_arena(&r->frame_arena);
+  r->runs = push_array(&r->frame_arena, render_tile_run_t, r->tile_count + 1);
+  atomic_store_explicit(&r->next_run, 1, memory_order_relaxed);
+  bin_ui_rects(r);
+
+  r->runs[0] = (render_tile_run_t){r, 0, r->tile_count};
+  job_submit(r->jobs, render_tile_run_job, &r->runs[0], &r->frame_counter);
+  job_wait(r->jobs, &r->frame_counter);
+
+  if (r->pipeline == RENDER_PIPELINE_PATH_TRACER) {
+    r->resolve = (resolve_source_t){
+      .pixels = r->accum.samples,
+      .format = RESOLVE_RGB_F32,
+      .curve = RESOLVE_CURVE_SRGB,
+      .stride = r->accum.width,
+      .scale = r->accumulate ? 1.0f / (f32)r->accum.sample_count : 1.0f / (f32)PT_SAMPLES_PER_PIXEL,
+    };
+    render_resolve(r);
+  }
+
+  render_stats_t frame = {0};
+  for (int i=0; i < r->thread_count; i++) {
+    frame.rays += r->thread_stats[i].counters.rays;
+    frame.bvh_steps += r->thread_stats[i].counters.bvh_steps;
+    frame.sphere_tests += r->thread_stats[i].counters.sphere_tests;
+    frame.march_steps += r->thread_stats[i].counters.march_steps;
+    frame.scene_evals += r->thread_stats[i].counters.scene_evals;
+    frame.sdf_samples += r->thread_stats[i].counters.sdf_samples;
+    frame.sdf_cache_hits += r->thread_stats[i].counters.sdf_cache_hits;
+    frame.sdf_evals += r->thread_stats[i].counters.sdf_evals;
+    frame.sdf_bricks_filled += r->thread_stats[i].counters.sdf_bricks_filled;
+    frame.pixels += r->thread_stats[i].pixels;
+    frame.tiles += r->thread_stats[i].tiles;
+  }
+  frame.elapsed_ns = render_ticks_ns() - start;
+  if (r->pipeline == RENDER_PIPELINE_PATH_TRACER) {
+    frame.accumulated_samples = r->accumulate ? r->accum.sample_count : PT_SAMPLES_PER_PIXEL;
+  }
+
+  r->total.rays += frame.rays;
+  r->total.bvh_steps += frame.bvh_steps;
+  r->total.sphere_tests += frame.sphere_tests;
+  r->total.march_steps += frame.march_steps;
+  r->total.scene_evals += frame.scene_evals;
+  r->total.sdf_samples += frame.sdf_samples;
+  r->total.sdf_cache_hits += frame.sdf_cache_hits;
+  r->total.sdf_evals += frame.sdf_evals;
+  r->total.sdf_bricks_filled += frame.sdf_bricks_filled;
+  r->total.pixels += frame.pixels;
+  r->total.tiles += frame.tiles;
+  r->total.elapsed_ns += frame.elapsed_ns;
+
+  profile_end(PROFILE_RENDER);
+  return frame;
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "types.h"
+#include "arena.h"
+#include "jobs.h"
+#include "scene.h"
+#include "cpu/sdf_cache.h"
+#include "cpu/resolve.h"
+#include "cpu/ui_raster.h"
+#include "cpu/sampler.h"
+
+#define RENDER_TILE_SIZE 32
+#define RENDER_FRAME_ARENA_RESERVE megabytes(64)
+// Enough for an 8K accumulation buffer.
+#define RENDER_ACCUM_ARENA_RESERVE gigabytes(1)
+
+typedef struct render_target_t {
+  u32* pixels; // BGRA8, matches MTLPixelFormatBGRA8Unorm
+  int width;
+  int height;
+  int stride; // in pixels
+} render_target_t;
+
+// Bumped by the per pixel code as it goes.
+typedef struct render_counters_t {
+  u64 rays;
+  u64 bvh_steps; // nodes visited
+  u64 sphere_tests;
+  u64 march_steps; // distance samples taken by rays still marching
+  u64 scene_evals; // distance samples computed, including normals and idle packet lanes
+  u64 sdf_samples; // marching samples that went through the sdf cache
+  u64 sdf_cache_hits;
+  u64 sdf_evals; // program runs to fill the cache
+  u64 sdf_bricks_filled;
+} render_counters_t;
+
+// Padded to a cache line so workers never share one.
+typedef struct render_thread_stats_t {
+  alignas(64) render_counters_t counters;
+  u64 pixels;
+  u64 tiles;
+} render_thread_stats_t;
+
+typedef struct render_stats_t {
+  u64 rays;
+  u64 bvh_steps;
+  u64 sphere_tests;
+  u64 march_steps;
+  u64 scene_evals;
+  u64 sdf_samples;
+  u64 sdf_cache_hits;
+  u64 sdf_evals;
+  u64 sdf_bricks_filled;
+  u64 pixels;
+  u64 tiles;
+  u64 elapsed_ns;
+  u32 accumulated_samples;
+} render_stats_t;
+
+typedef enum render_pipeline_t {
+  RENDER_PIPELINE_RAY_MARCHER,
+  RENDER_PIPELINE_PATH_TRACER,
+  RENDER_PIPELINE_RAY_TRACER,
+  RENDER_PIPELINE_COUNT,
+} render_pipeline_t;
+
+static const char* render_pipeline_names[RENDER_PIPELINE_COUNT] = {
+  "ray_marcher",
+  "path_tracer",
+  "ray_tracer",
+};
+
+// Running sum of linear samples per pixel for progressive pipelines.
+// Starts over whenever the camera, debug params or target size change.
+typedef struct accum_buffer_t {
+  memory_arena_t memory;
+  v3* samples;
+  u32 sample_count;
+  int width;
+  int height;
+  render_camera_t camera;
+  debug_params_t debug_params;
+} accum_buffer_t;
+
+typedef struct cpu_renderer_t cpu_renderer_t;
+
+// A run of tiles handed to one job. Jobs split their run in half and submit
+// the back half until a single tile is left, so idle threads steal big runs
+// first and small ones at the end of the frame.
+typedef struct render_tile_run_t {
+  cpu_renderer_t* renderer;
+  int first;
+  int count;
+} render_tile_run_t;
+
+// Rows [y0, y1) of the frame's resolve pass.
+typedef struct render_resolve_band_t {
+  cpu_renderer_t* renderer;
+  int y0;
+  int y1;
+} render_resolve_band_t;
+
+struct cpu_renderer_t {
+  job_system_t* jobs;
+  int thread_count;
+  render_pipeline_t pipeline;
+  // March PACKET_WIDTH rays at a time, on by default when PACKET_WIDTH > 1.
+  bool use_packets;
+  // Average path tracer samples over frames instead of taking
+  // PT_SAMPLES_PER_PIXEL fresh ones every frame.
+  bool accumulate;
+  accum_buffer_t accum;
+  // Where the path and ray tracers' samples come from. The seed is offset by
+  // the frame whenever samples aren't accumulated.
+  sampler_config_t sampling;
+  // Spheres for the path and ray tracers.
+  const sphere_scene_t* scene;
+  // Distance field for the ray marcher.
+  const sdf_program_t* sdf_program;
+  // Optional, must be cleared whenever sdf_program changes.
+  sdf_cache_t* sdf_cache;
+  // Drawn over the frame, in window pixels (params->viewport_size).
+  const ui_rect_t* ui_rects;
+  u32 ui_rect_count;
+
+  // Current frame, only valid for the duration of cpu_render_frame.
+  render_target_t target;
+  const fs_params_t* params;
+  int tiles_x;
+  int tiles_y;
+  int tile_count;
+  job_counter_t frame_counter;
+
+  // Reset at the start of every frame, holds the runs and resolve bands.
+  memory_arena_t frame_arena;
+
+  // One per split, a frame of N tiles never needs more than N.
+  render_tile_run_t* runs;
+  atomic_int next_run;
+
+  // Pipelines that render to a linear buffer have it resolved into the
+  // target after the tiles, a band of rows per job.
+  resolve_source_t resolve;
+  render_resolve_band_t* bands;
+
+  // The UI rects in target pixels, and the ones touching each tile in the
+  // order they were pushed: tile i has tile_ui[tile_ui_first[i]] up to
+  // tile_ui[tile_ui_first[i+1]].
+  ui_span_t* ui_spans;
+  u32* tile_ui_first;
+  u32* tile_ui;
+
+  render_thread_stats_t thread_stats[MAX_JOB_THREADS];
+  render_stats_t total;
+};
@@ -0,0 +1,162 @@
+//
+// Frame pipeline.
+// The game thread fills a ring of frame slots and a consumer renders them in
+// order: a render thread running the CPU renderer on Linux, the GPU on macOS.
+// With more than one slot the game runs ahead, simulating frame N+1 while
+// frame N renders. Everything the consumer reads lives in the slot, so the
+// game is free to change its own state while earlier frames are in flight.
+// Included after platform.c.
+//
+
+#define FRAME_SLOTS_MAX 4
+
+// A monotonic frame number that can be waited on, like a GPU fence.
+typedef struct frame_fence_t {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  u64 value;
+  bool closed;
+} frame_fence_t;
+
+typedef struct frame_slot_t {
+  u64 frame; // 1 for the first frame, 0 before the slot is used
+
+  // Filled in by the game thread.
+  fs_params_t fs_params;
+  ui_context_t ui;
+  v2 window_size;
+  f32 render_scale;
+  int sdf_scene;
+
+  // Filled in by the consumer before it retires the slot.
+  u64 render_start_ns;
+  f32 render_ms;
+} frame_slot_t;
+
+typedef struct frame_pipeline_t {
+  u32 slot_count;
+  frame_slot_t slots[FRAME_SLOTS_MAX];
+  u64 frames_begun;
+  frame_fence_t submitted; // latest frame handed to the consumer
+  frame_fence_t retired;   // latest frame the consumer is done with
+  u64 wait_ns;             // game thread time spent waiting for free slots
+} frame_pipeline_t;
+
+static void init_frame_fence(frame_fence_t* f) {
+  pthread_mutex_init(&f->lock, NULL);
+  pthread_cond_init(&f->changed, NULL);
+  f->value = 0;
+  f->closed = false;
+}
+
+static void free_frame_fence(frame_fence_t* f) {
+  pthread_cond_destroy(&f->changed);
+  pthread_mutex_destroy(&f->lock);
+}
+
+static void frame_fence_signal(frame_fence_t* f, u64 value) {
+  pthread_mutex_lock(&f->lock);
+  if (value > f->value) {
+    f->value = value;
+  }
+  pthread_cond_broadcast(&f->changed);
+  pthread_mutex_unlock(&f->lock);
+}
+
+// Wakes every waiter, waits from then on only succeed if already reached.
+static void frame_fence_close(frame_fence_t* f) {
+  pthread_mutex_lock(&f->lock);
+  f->closed = true;
+  pthread_cond_broadcast(&f->changed);
+  pthread_mutex_unlock(&f->lock);
+}
+
+// False if the fence was closed before reaching value.
+static bool frame_fence_wait(frame_fence_t* f, u64 value) {
+  pthread_mutex_lock(&f->lock);
+  while (f->value < value && !f->closed) {
+    pthread_cond_wait(&f->changed, &f->lock);
+  }
+  bool reached = f->value >= value;
+  pthread_mutex_unlock(&f->lock);
+  return reached;
+}
+
+static u64 frame_fence_value(frame_fence_t* f) {
+  pthread_mutex_lock(&f->lock);
+  u64 value = f->value;
+  pthread_mutex_unlock(&f->lock);
+  return value;
+}
+
+static bool init_frame_pipeline(frame_pipeline_t* fp, u32 slot_count) {
+  *fp = (frame_pipeline_t){0};
+  if (slot_count < 1 || slot_count > FRAME_SLOTS_MAX) {
+    printf("ERROR: %u frames in flight, the most is %d.\n", slot_count, FRAME_SLOTS_MAX);
+    return false;
+  }
+  fp->slot_count = slot_count;
+  for (u32 i=0; i < slot_count; i++) {
+    if (!init_ui_context(&fp->slots[i].ui)) {
+      return false;
+    }
+  }
+  init_frame_fence(&fp->submitted);
+  init_frame_fence(&fp->retired);
+  return true;
+}
+
+static void free_frame_pipeline(frame_pipeline_t* fp) {
+  for (u32 i=0; i < fp->slot_count; i++) {
+    free_ui_context(&fp->slots[i].ui);
+  }
+  free_frame_fence(&fp->submitted);
+  free_frame_fence(&fp->retired);
+  *fp = (frame_pipeline_t){0};
+}
+
+// Game thread. Waits until the consumer is done with the frame that last used
+// the slot, then hands it out with an empty UI.
+static frame_slot_t* begin_frame_slot(frame_pipeline_t* fp) {
+  u64 frame = ++fp->frames_begun;
+  if (frame > fp->slot_count) {
+    u64 start = profiler_ticks_ns();
+    frame_fence_wait(&fp->retired, frame - fp->slot_count);
+    fp->wait_ns += profiler_ticks_ns() - start;
+  }
+  frame_slot_t* slot = &fp->slots[(frame-1) % fp->slot_count];
+  slot->frame = frame;
+  reset_ui_context(&slot->ui);
+  return slot;
+}
+
+// Game thread. The slot belongs to the consumer until it's retired.
+static void submit_frame_slot(frame_pipeline_t* fp, frame_slot_t* slot) {
+  frame_fence_signal(&fp->submitted, slot->frame);
+}
+
+// Game thread. The most recently retired slot, NULL before the first one.
+// What the consumer left in it stays put until the slot is submitted again.
+static const frame_slot_t* last_retired_frame_slot(frame_pipeline_t* fp) {
+  u64 frame = frame_fence_value(&fp->retired);
+  return frame ? &fp->slots[(frame-1) % fp->slot_count] : NULL;
+}
+
+// Game thread. No more frames are coming, consumers waiting for one give up.
+static void close_frame_pipeline(frame_pipeline_t* fp) {
+  frame_fence_close(&fp->submitted);
+}
+
+// Consumer. Waits for the given frame, NULL once the pipeline is closed and
+// it was never submitted.
+static frame_slot_t* acquire_frame_slot(frame_pipeline_t* fp, u64 frame) {
+  if (!frame_fence_wait(&fp->submitted, frame)) {
+    return NULL;
+  }
+  return &fp->slots[(frame-1) % fp->slot_count];
+}
+
+// Consumer, in frame order. Any thread, so it can be a GPU completion handler.
+static void retire_frame_slot(frame_pipeline_t* fp, frame_slot_t* slot) {
+  frame_fence_signal(&fp->retired, slot->frame);
+}
@@ -9,28 +9,54 @@
 // TODO: Move as much of the UI setup/layout as possible sit outside of the platform layer
 //
 
+// Derives the fp camera's target, or the orbit camera's position, from its
+// angles.
+static void place_camera(camera_state_t* cs, bool fp) {
+  if (fp) {
+    m3x3 rm = rot3xy(-cs->pitch, cs->yaw);
+    cs->target = add3(cs->position, mul3x3(rm, V3(0, 0, 1)));
+  } else {
+    m3x3 rm = rot3xy(-cs->pitch, -cs->yaw);
+    cs->position = mul3x3(rm, V3(0,0,cs->zoom));
+  }
+}
+
+static camera_state_t lerp_camera_state(const camera_state_t* a, f32 t, const camera_state_t* b, bool fp) {
+  camera_state_t cs;
+  cs.position = lerp3(a->position, t, b->position);
+  cs.target = lerp3(a->target, t, b->target);
+  cs.yaw = lerp(a->yaw, t, b->yaw);
+  cs.pitch = lerp(a->pitch, t, b->pitch);
+  cs.zoom = lerp(a->zoom, t, b->zoom);
+  cs.vfov = lerp(a->vfov, t, b->vfov);
+  // Angles, not the points they put the camera at, so orbits stay round.
+  place_camera(&cs, fp);
+  return cs;
+}
+
 void init_world(app_t* app, world_t* world) {
   world->orbit_cam.target = V3(0,1,0);
   world->orbit_cam.zoom = 10;
   world->orbit_cam.vfov = 45;
   world->orbit_cam.yaw = M_PI * 1.25;
   world->orbit_cam.pitch = M_PI * 0.1;
+  place_camera(&world->orbit_cam, false);
 
   world->fp_cam.position = V3(0,3,-10);
   world->fp_cam.vfov = 45;
+  place_camera(&world->fp_cam, true);
+
+  world->prev_orbit_cam = world->orbit_cam;
+  world->prev_fp_cam = world->fp_cam;
 
   world->camera.up = V3(0,1,0);
-}
 
-void update_and_render(app_t* app, world_t* world, debug_params_t* debug_params) {
-  // printf("%f\n", app->clocks.delta_secs);
-  f32 dt = app->clocks.delta_secs;
+  world->sdf_scene = 4; // SDF_PRESET_CARVED_PRISM
+}
 
-  int width = app->display.size_in_points.x;
-
-  if (app->keys[KEY_L].pressed) {
-    app->mouse.capture = !app->mouse.capture;
-  }
+// One SIM_DT step of everything driven by held keys and the mouse.
+void update_world(app_t* app, world_t* world, debug_params_t* debug_params) {
+  f32 dt = SIM_DT;
 
   // DEBUG PARAMS
   if (app->keys[KEY_MINUS].down) {
@@ -39,28 +65,6 @@ void update_and_render(app_t* app, world_t* world, debug_params_t* debug_params)
   if (app->keys[KEY_EQUALS].down) {
     debug_params->scalars[0] += 1.0f*dt;
   }
-  if (app->keys[KEY_0].pressed) {
-    debug_params->scalars[0] = 0;
-  }
-
-  // Render scale
-  f32 render_scale = app->render_scale;
-  if (app->keys[KEY_LEFTBRACKET].pressed) {
-    render_scale *= 0.5f;
-  }
-  if (app->keys[KEY_RIGHTBRACKET].pressed) {
-    render_scale *= 2.0f;
-  }
-  render_scale = clamp(0.0625, render_scale, 1.0);
-  if (render_scale != app->render_scale) {
-    app->render_scale = render_scale;
-    printf("render scale: %0.02f%%\n", 100.0*app->render_scale);
-  }
-
-  if (app->keys[KEY_O].pressed) {
-    world->enable_fp_cam = !world->enable_fp_cam;
-    printf("switched to %s camera\n", world->enable_fp_cam ? "fp" : "orbit");
-  }
 
   // Strafe
   v3 move = {0};
@@ -97,10 +101,13 @@ void update_and_render(app_t* app, world_t* world, debug_params_t* debug_params)
     pitch += 2.0f * dt;
   }
 
-  if (app->mouse.capture && app->mouse.moved) {
-    yaw += app->mouse.delta_position.x * dt;
-    pitch -= app->mouse.delta_position.y * dt;
-  }
+  // Mouse look is already a distance, the first step takes all of it.
+  yaw += world->pending_look.x;
+  pitch += world->pending_look.y;
+  world->pending_look = V2(0,0);
+
+  world->prev_orbit_cam = world->orbit_cam;
+  world->prev_fp_cam = world->fp_cam;
 
   // Apply new camera values
   camera_state_t *cs;
@@ -110,17 +117,79 @@ void update_and_render(app_t* app, world_t* world, debug_params_t* debug_params)
     cs->yaw += yaw;
     m3x3 rm = rot3xy(-cs->pitch, cs->yaw);
     cs->position = add3(cs->position, mul3x3(rm, move));
-    cs->target = add3(cs->position, mul3x3(rm, V3(0, 0, 1)));
+    place_camera(cs, true);
   } else {
     cs = &world->orbit_cam;
     cs->pitch += pitch;
     cs->yaw += yaw;
-    m3x3 rm = rot3xy(-cs->pitch, -cs->yaw);
     cs->zoom -= move.z;
-    cs->position = mul3x3(rm, V3(0,0,cs->zoom));
+    place_camera(cs, false);
   }
-  world->camera.position = cs->position;
-  world->camera.target = cs->target;
-  world->camera.vfov = cs->vfov;
+  world->sim_steps++;
 }
 
+// Places world->camera alpha of the way from the previous step to the latest.
+void render_world(world_t* world, f32 alpha) {
+  camera_state_t cs = world->enable_fp_cam ?
+    lerp_camera_state(&world->prev_fp_cam, alpha, &world->fp_cam, true) :
+    lerp_camera_state(&world->prev_orbit_cam, alpha, &world->orbit_cam, false);
+  world->camera.position = cs.position;
+  world->camera.target = cs.target;
+  world->camera.vfov = cs.vfov;
+}
+
+// Once per frame. Key presses are handled here, then the simulation catches
+// up with the frame's delta and the camera is interpolated for drawing.
+void update_and_render(app_t* app, world_t* world, debug_params_t* debug_params) {
+  if (app->keys[KEY_L].pressed) {
+    app->mouse.capture = !app->mouse.capture;
+  }
+
+  if (app->keys[KEY_0].pressed) {
+    debug_params->scalars[0] = 0;
+  }
+
+  // Render scale, picked by the governor unless set by hand
+  f32 render_scale = app->render_scale;
+  if (app->keys[KEY_G].pressed) {
+    app->governor.enabled = !app->governor.enabled;
+    reset_resolution_governor(&app->governor);
+    printf("resolution governor %s, target %0.2f ms\n", app->governor.enabled ? "on" : "off", app->governor.target_ms);
+  }
+  if (app->keys[KEY_LEFTBRACKET].pressed || app->keys[KEY_RIGHTBRACKET].pressed) {
+    app->governor.enabled = false;
+    render_scale *= app->keys[KEY_LEFTBRACKET].pressed ? 0.5f : 2.0f;
+    render_scale = clamp(GOVERNOR_MIN_SCALE, render_scale, GOVERNOR_MAX_SCALE);
+    printf("render scale: %0.02f%%\n", 100.0*render_scale);
+  } else if (app->governor.enabled) {
+    render_scale = update_resolution_governor(&app->governor, render_scale, app->frame_ms);
+  }
+  app->render_scale = render_scale;
+
+  if (app->keys[KEY_N].pressed) {
+    world->sdf_scene++;
+  }
+
+  if (app->keys[KEY_O].pressed) {
+    world->enable_fp_cam = !world->enable_fp_cam;
+    printf("switched to %s camera\n", world->enable_fp_cam ? "fp" : "orbit");
+  }
+
+  if (app->mouse.capture && app->mouse.moved) {
+    f32 frame_dt = app->clocks.delta_secs;
+    world->pending_look.x += app->mouse.delta_position.x * frame_dt;
+    world->pending_look.y -= app->mouse.delta_position.y * frame_dt;
+  }
+
+  world->sim_time += app->clocks.delta_secs;
+  if (world->sim_time >= SIM_DT * (SIM_MAX_STEPS + 1)) {
+    u32 dropped = (u32)(world->sim_time / SIM_DT) - SIM_MAX_STEPS;
+    world->sim_dropped_steps += dropped;
+    world->sim_time -= SIM_DT * dropped;
+  }
+  while (world->sim_time >= SIM_DT) {
+    update_world(app, world, debug_params);
+    world->sim_time -= SIM_DT;
+  }
+  render_world(world, world->sim_time / SIM_DT);
+}
@@ -1,6 +1,13 @@
 #pragma once
 #include "types.h"
 
+// The world is simulated in fixed steps, whatever the frame rate. A frame
+// runs however many steps its delta covers, at most SIM_MAX_STEPS of them,
+// and time past that is dropped so a slow frame can't snowball.
+#define SIM_HZ 120
+#define SIM_DT (1.0f / SIM_HZ)
+#define SIM_MAX_STEPS 8
+
 typedef struct camera_t {
   v3 position;
   v3 target;
@@ -22,7 +29,21 @@ typedef struct world_t {
 
   camera_state_t orbit_cam;
   camera_state_t fp_cam;
+  // As of the step before the latest one, camera is drawn between the two.
+  camera_state_t prev_orbit_cam;
+  camera_state_t prev_fp_cam;
 
   bool enable_fp_cam;
+
+  // Distance field preset for the ray marcher, the platform layer wraps it
+  // to SDF_PRESET_COUNT and compiles it when it changes.
+  int sdf_scene;
+
+  // Mouse look not applied yet, a frame with no steps carries it over.
+  v2 pending_look;
+
+  f32 sim_time; // frame time not simulated yet, under SIM_DT between frames
+  u64 sim_steps;
+  u64 sim_dropped_steps;
 } world_t;
 
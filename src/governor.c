@@ -0,0 +1,48 @@
+#include "governor.h"
+
+//
+// Dynamic resolution, see governor.h.
+//
+
+static void init_resolution_governor(resolution_governor_t* g, f32 target_ms) {
+  memset(g, 0, sizeof(*g));
+  g->target_ms = target_ms;
+  g->headroom = 0.15f;
+  g->smoothing = 0.25f;
+  g->engage_error = 0.07f; // ~15% off in frame time
+  g->hold_frames = 10;
+}
+
+// Forgets the frame time history, for when the load changes for reasons the
+// scale has nothing to do with.
+static void reset_resolution_governor(resolution_governor_t* g) {
+  g->filtered_ms = 0;
+  g->hold = 0;
+}
+
+// Returns the scale for the next frame given the one the last measured frame
+// rendered at. frame_ms <= 0 means there's no measurement yet.
+static f32 update_resolution_governor(resolution_governor_t* g, f32 scale, f32 frame_ms) {
+  if (frame_ms <= 0 || g->target_ms <= 0) {
+    return scale;
+  }
+
+  g->filtered_ms = g->filtered_ms > 0 ? lerp(g->filtered_ms, g->smoothing, frame_ms) : frame_ms;
+  if (g->hold > 0) {
+    // Frames from before the last change are still coming in.
+    g->hold--;
+    return scale;
+  }
+
+  f32 goal_ms = g->target_ms * (1.0f - g->headroom);
+  f32 error = 0.5f * logf(goal_ms / g->filtered_ms);
+  if (fabsf(error) < g->engage_error) {
+    return scale;
+  }
+
+  f32 next = clamp(GOVERNOR_MIN_SCALE, scale * expf(error), GOVERNOR_MAX_SCALE);
+  if (next != scale) {
+    g->hold = g->hold_frames;
+  }
+  return next;
+}
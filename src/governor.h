@@ -0,0 +1,24 @@
+#pragma once
+#include "types.h"
+
+#define GOVERNOR_MIN_SCALE 0.0625f
+#define GOVERNOR_MAX_SCALE 1.0f
+
+// Picks app.render_scale each frame so measured frame time lands on
+// target_ms. Frame time goes roughly with pixel count, so once the smoothed
+// frame time is off by more than a dead band it jumps straight to the scale
+// that should land on target, then holds that for hold_frames while the
+// measurements catch up. Every change resets accumulation, so it would rather
+// sit a little off target than keep nudging the scale.
+typedef struct resolution_governor_t {
+  bool enabled;
+  f32 target_ms;
+  f32 headroom; // fraction of target_ms to leave free for frame time noise
+
+  f32 smoothing;    // weight of the newest frame time in filtered_ms
+  f32 engage_error; // log scale error that's worth a change
+  u32 hold_frames;  // after a change, a few more than the frames in flight
+
+  f32 filtered_ms;
+  u32 hold;
+} resolution_governor_t;
@@ -0,0 +1,159 @@
+#include "input_log.h"
+
+//
+// Input recording and replay, see input_log.h.
+// Captures exactly what update_and_render reads (keys, mouse and
+// delta_secs), so replaying a log walks the camera down the same path no
+// matter how fast the frames come.
+//
+
+static button_t* input_log_button(app_t* app, int index) {
+  if (index < NUMBER_OF_KEYS) {
+    return &app->keys[index];
+  }
+  switch (index - NUMBER_OF_KEYS) {
+    case 0: return &app->mouse.left_button;
+    case 1: return &app->mouse.middle_button;
+    default: return &app->mouse.right_button;
+  }
+}
+
+static u8 pack_input_button(button_t b) {
+  int pressed = b.pressed < 7 ? b.pressed : 7;
+  int released = b.released < 7 ? b.released : 7;
+  return (u8)((b.down ? 1 : 0) | (pressed << 1) | (released << 4));
+}
+
+static button_t unpack_input_button(u8 state) {
+  return (button_t){
+    .down = (state & 1) != 0,
+    .pressed = (state >> 1) & 7,
+    .released = (state >> 4) & 7,
+  };
+}
+
+static bool begin_input_recording(input_log_t* log, const char* path, v2 window_size) {
+  memset(log, 0, sizeof(*log));
+  log->file = fopen(path, "wb");
+  if (!log->file) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  log->path = path;
+  log->window_size = window_size;
+
+  input_log_header_t header = {INPUT_LOG_MAGIC, INPUT_LOG_VERSION, window_size};
+  fwrite(&header, sizeof(header), 1, log->file);
+  return true;
+}
+
+static bool begin_input_replay(input_log_t* log, const char* path) {
+  memset(log, 0, sizeof(*log));
+  log->file = fopen(path, "rb");
+  if (!log->file) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  log->path = path;
+  log->replaying = true;
+
+  input_log_header_t header;
+  if (fread(&header, sizeof(header), 1, log->file) != 1 ||
+      header.magic != INPUT_LOG_MAGIC || header.version != INPUT_LOG_VERSION) {
+    printf("ERROR: %s is not a version %d input log.\n", path, INPUT_LOG_VERSION);
+    fclose(log->file);
+    log->file = NULL;
+    return false;
+  }
+  log->window_size = header.window_size;
+  return true;
+}
+
+static void end_input_log(input_log_t* log) {
+  if (log->file) {
+    fclose(log->file);
+  }
+  log->file = NULL;
+}
+
+// Call right before update_and_render, once the platform has applied this
+// frame's input.
+static void record_input_frame(input_log_t* log, app_t* app) {
+  u8 changes[INPUT_LOG_BUTTONS][2];
+  int change_count = 0;
+  for (int i=0; i < INPUT_LOG_BUTTONS; i++) {
+    button_t b = *input_log_button(app, i);
+    u8 state = pack_input_button(b);
+    if (state != pack_input_button(log->buttons[i])) {
+      changes[change_count][0] = (u8)i;
+      changes[change_count][1] = state;
+      change_count++;
+    }
+    log->buttons[i] = unpack_input_button(state);
+  }
+
+  u8 flags = 0;
+  if (app->mouse.moved) flags |= INPUT_LOG_MOUSE_MOVED;
+  if (app->mouse.scrolled) flags |= INPUT_LOG_MOUSE_SCROLLED;
+
+  // There are fewer buttons than fit in a u8.
+  u8 count = (u8)change_count;
+  fwrite(&app->clocks.delta_secs, sizeof(f32), 1, log->file);
+  fwrite(&flags, 1, 1, log->file);
+  fwrite(&count, 1, 1, log->file);
+  fwrite(changes, 2, change_count, log->file);
+  if (flags & INPUT_LOG_MOUSE_MOVED) {
+    fwrite(&app->mouse.position, sizeof(v2), 1, log->file);
+    fwrite(&app->mouse.delta_position, sizeof(v2), 1, log->file);
+  }
+  if (flags & INPUT_LOG_MOUSE_SCROLLED) {
+    fwrite(&app->mouse.delta_scroll, sizeof(v2), 1, log->file);
+  }
+  log->frames++;
+}
+
+// Overwrites app's input and delta_secs with the next recorded frame.
+// Returns false once the log runs out.
+static bool replay_input_frame(input_log_t* log, app_t* app) {
+  f32 dt;
+  u8 flags, count;
+  u8 changes[256][2];
+  if (fread(&dt, sizeof(f32), 1, log->file) != 1 ||
+      fread(&flags, 1, 1, log->file) != 1 ||
+      fread(&count, 1, 1, log->file) != 1 ||
+      fread(changes, 2, count, log->file) != count) {
+    return false;
+  }
+
+  v2 position = log->mouse_position;
+  v2 delta_position = {0};
+  v2 delta_scroll = {0};
+  if (flags & INPUT_LOG_MOUSE_MOVED) {
+    if (fread(&position, sizeof(v2), 1, log->file) != 1 ||
+        fread(&delta_position, sizeof(v2), 1, log->file) != 1) {
+      return false;
+    }
+  }
+  if ((flags & INPUT_LOG_MOUSE_SCROLLED) && fread(&delta_scroll, sizeof(v2), 1, log->file) != 1) {
+    return false;
+  }
+
+  for (int i=0; i < count; i++) {
+    if (changes[i][0] < INPUT_LOG_BUTTONS) {
+      log->buttons[changes[i][0]] = unpack_input_button(changes[i][1]);
+    }
+  }
+  for (int i=0; i < INPUT_LOG_BUTTONS; i++) {
+    *input_log_button(app, i) = log->buttons[i];
+  }
+
+  log->mouse_position = position;
+  app->mouse.position = position;
+  app->mouse.moved = (flags & INPUT_LOG_MOUSE_MOVED) != 0;
+  app->mouse.delta_position = delta_position;
+  app->mouse.scrolled = (flags & INPUT_LOG_MOUSE_SCROLLED) != 0;
+  app->mouse.delta_scroll = delta_scroll;
+  app->clocks.delta_secs = dt;
+  log->frames++;
+  return true;
+}
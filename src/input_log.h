@@ -0,0 +1,38 @@
+#pragma once
+#include "app.h"
+
+#define INPUT_LOG_MAGIC 0x4e495643u // "CVIN"
+#define INPUT_LOG_VERSION 1
+
+// Every key, then the left, middle and right mouse buttons.
+#define INPUT_LOG_BUTTONS (NUMBER_OF_KEYS + 3)
+
+#define INPUT_LOG_MOUSE_MOVED    0x1
+#define INPUT_LOG_MOUSE_SCROLLED 0x2
+
+// File layout, native endian:
+//   header: u32 magic, u32 version, f32 window width, f32 window height
+//   frame:  f32 delta_secs, u8 mouse flags, u8 button count,
+//           button count x (u8 button, u8 state),
+//           v2 position and v2 delta if moved, v2 delta if scrolled
+// Button state packs down in bit 0, pressed in bits 1-3 and released in
+// bits 4-6 (both saturate at 7). Only buttons that differ from the previous
+// frame are written.
+typedef struct input_log_header_t {
+  u32 magic;
+  u32 version;
+  v2 window_size;
+} input_log_header_t;
+
+// One recording or replay of the input the game sees each frame.
+typedef struct input_log_t {
+  FILE* file;
+  const char* path;
+  bool replaying;
+  u32 frames;
+  v2 window_size;
+
+  // What the last frame left behind, frames are stored as changes to it.
+  button_t buttons[INPUT_LOG_BUTTONS];
+  v2 mouse_position;
+} input_log_t;
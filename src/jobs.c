@@ -0,0 +1,288 @@
+#include "jobs.h"
+
+//
+// Work-stealing job system.
+// Every thread owns a deque. Submitting pushes onto the caller's deque, and a
+// thread that runs dry steals from a random other thread. Thread 0 is the
+// thread that called init_job_system, it only runs jobs while in job_wait.
+//
+
+static _Thread_local int job_thread_index_tls = 0;
+
+static inline int
+job_thread_index(void) {
+  return job_thread_index_tls;
+}
+
+static inline void
+job_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+//
+// Deque
+// Chase-Lev with the C11 orderings from Le et al. 2013, "Correct and
+// Efficient Work-Stealing for Weak Memory Models".
+//
+
+static inline void
+job_slot_store(job_slot_t* slot, const job_t* job) {
+  atomic_store_explicit(&slot->func, job->func, memory_order_relaxed);
+  atomic_store_explicit(&slot->data, job->data, memory_order_relaxed);
+  atomic_store_explicit(&slot->counter, job->counter, memory_order_relaxed);
+}
+
+static inline void
+job_slot_load(job_slot_t* slot, job_t* job) {
+  job->func = atomic_load_explicit(&slot->func, memory_order_relaxed);
+  job->data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+  job->counter = atomic_load_explicit(&slot->counter, memory_order_relaxed);
+}
+
+static bool
+job_queue_push(job_queue_t* q, const job_t* job) {
+  long long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+  long long t = atomic_load_explicit(&q->top, memory_order_acquire);
+  if (b - t >= JOB_QUEUE_CAPACITY) {
+    return false;
+  }
+  job_slot_store(&q->slots[b & (JOB_QUEUE_CAPACITY-1)], job);
+  // Publishes the slot to thieves.
+  atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+  return true;
+}
+
+static bool
+job_queue_pop(job_queue_t* q, job_t* job) {
+  long long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+  bool found = false;
+  if (t <= b) {
+    job_slot_load(&q->slots[b & (JOB_QUEUE_CAPACITY-1)], job);
+    found = true;
+    if (t == b) {
+      // Last one, race any thieves for it.
+      if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        found = false;
+      }
+      atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+  }
+  return found;
+}
+
+static bool
+job_queue_steal(job_queue_t* q, job_t* job) {
+  long long t = atomic_load_explicit(&q->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+
+  if (t < b) {
+    // May be torn by a push that wrapped around, but then the owner has
+    // already moved top past t and the CAS fails.
+    job_slot_load(&q->slots[t & (JOB_QUEUE_CAPACITY-1)], job);
+    return atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+        memory_order_seq_cst, memory_order_relaxed);
+  }
+  return false;
+}
+
+//
+// Scheduling
+//
+
+static void
+job_run(job_system_t* js, const job_t* job) {
+  atomic_fetch_sub_explicit(&js->queued, 1, memory_order_relaxed);
+
+  job->func(job->data);
+
+  if (job->counter) {
+    atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+  }
+}
+
+static bool
+job_find(job_system_t* js, job_thread_t* self, job_t* job) {
+  if (job_queue_pop(&js->queues[self->index], job)) {
+    return true;
+  }
+  if (js->thread_count == 1) {
+    return false;
+  }
+
+  // Start at a random victim so thieves don't all pile onto the same one.
+  u32 x = self->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  self->rng = x;
+
+  int start = (int)(x % (u32)js->thread_count);
+  for (int i=0; i < js->thread_count; i++) {
+    int victim = (start + i) % js->thread_count;
+    if (victim == self->index) continue;
+    if (job_queue_steal(&js->queues[victim], job)) {
+      self->stolen++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Runs one job if there is any, returns false if every queue looked empty.
+static bool
+job_run_one(job_system_t* js) {
+  job_thread_t* self = &js->threads[job_thread_index()];
+  job_t job;
+  if (job_find(js, self, &job)) {
+    job_run(js, &job);
+    self->executed++;
+    return true;
+  }
+  return false;
+}
+
+static void*
+job_worker_main(void* data) {
+  job_thread_t* self = (job_thread_t*)data;
+  job_system_t* js = self->system;
+  job_thread_index_tls = self->index;
+  char name[32];
+  snprintf(name, sizeof(name), "job worker %d", self->index);
+  profiler_name_thread(name);
+
+  int idle_spins = 0;
+  while (!atomic_load_explicit(&js->quit, memory_order_relaxed)) {
+    if (job_run_one(js)) {
+      idle_spins = 0;
+      continue;
+    }
+
+    if (++idle_spins < 64) {
+      job_cpu_relax();
+      continue;
+    }
+
+    // Nothing to do for a while, sleep until something is submitted.
+    pthread_mutex_lock(&js->sleep_lock);
+    atomic_fetch_add(&js->sleeping, 1);
+    while (atomic_load(&js->queued) <= 0 && !atomic_load(&js->quit)) {
+      pthread_cond_wait(&js->wake, &js->sleep_lock);
+    }
+    atomic_fetch_sub(&js->sleeping, 1);
+    pthread_mutex_unlock(&js->sleep_lock);
+    idle_spins = 0;
+  }
+
+  free_scratch_arenas();
+  return NULL;
+}
+
+//
+// API
+//
+
+static int
+default_job_thread_count(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) n = 1;
+  if (n > MAX_JOB_THREADS) n = MAX_JOB_THREADS;
+  return (int)n;
+}
+
+// thread_count includes the calling thread, 0 picks one per core.
+static void
+init_job_system(job_system_t* js, int thread_count) {
+  memset(js, 0, sizeof(*js));
+  if (thread_count <= 0) {
+    thread_count = default_job_thread_count();
+  }
+  if (thread_count > MAX_JOB_THREADS) {
+    thread_count = MAX_JOB_THREADS;
+  }
+  js->thread_count = thread_count;
+
+  usize queues_size = sizeof(job_queue_t) * thread_count;
+  js->queues = (job_queue_t*)aligned_alloc(64, queues_size);
+  memset(js->queues, 0, queues_size);
+
+  pthread_mutex_init(&js->sleep_lock, NULL);
+  pthread_cond_init(&js->wake, NULL);
+
+  job_thread_index_tls = 0;
+  for (int i=0; i < thread_count; i++) {
+    job_thread_t* t = &js->threads[i];
+    t->system = js;
+    t->index = i;
+    t->rng = 0x9E3779B9u * (u32)(i + 1);
+  }
+  for (int i=1; i < thread_count; i++) {
+    pthread_create(&js->threads[i].thread, NULL, job_worker_main, &js->threads[i]);
+  }
+}
+
+static void
+shutdown_job_system(job_system_t* js) {
+  pthread_mutex_lock(&js->sleep_lock);
+  atomic_store(&js->quit, true);
+  pthread_cond_broadcast(&js->wake);
+  pthread_mutex_unlock(&js->sleep_lock);
+
+  for (int i=1; i < js->thread_count; i++) {
+    pthread_join(js->threads[i].thread, NULL);
+  }
+
+  pthread_cond_destroy(&js->wake);
+  pthread_mutex_destroy(&js->sleep_lock);
+  free(js->queues);
+  js->queues = NULL;
+}
+
+// Queues func(data) on the calling thread's deque. counter may be NULL.
+static void
+job_submit(job_system_t* js, job_func_t* func, void* data, job_counter_t* counter) {
+  if (counter) {
+    atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+  }
+
+  job_t job = {func, data, counter};
+  atomic_fetch_add(&js->queued, 1);
+  if (!job_queue_push(&js->queues[job_thread_index()], &job)) {
+    // Deque is full, just run it here.
+    job_run(js, &job);
+    return;
+  }
+
+  if (atomic_load(&js->sleeping) > 0) {
+    pthread_mutex_lock(&js->sleep_lock);
+    pthread_cond_broadcast(&js->wake);
+    pthread_mutex_unlock(&js->sleep_lock);
+  }
+}
+
+// Runs queued jobs until everything submitted against counter has finished.
+static void
+job_wait(job_system_t* js, job_counter_t* counter) {
+  int idle_spins = 0;
+  while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+    if (job_run_one(js)) {
+      idle_spins = 0;
+    } else if (++idle_spins < 64) {
+      job_cpu_relax();
+    } else {
+      // The last jobs are running elsewhere, give their threads the core.
+      sched_yield();
+    }
+  }
+}
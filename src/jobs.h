@@ -0,0 +1,68 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "types.h"
+
+#define MAX_JOB_THREADS 64
+// Per-thread, must be a power of two. Bounds the number of jobs a single
+// thread can have queued or running at once.
+#define JOB_QUEUE_CAPACITY 4096
+
+typedef void job_func_t(void* data);
+
+// Jobs that share a counter can be waited on as a group. A job that
+// submits more work against its own counter acts as the parent of that
+// work, since the counter only reaches zero once all of it has run.
+typedef struct job_counter_t {
+  atomic_int pending;
+} job_counter_t;
+
+typedef struct job_t {
+  job_func_t* func;
+  void* data;
+  job_counter_t* counter;
+} job_t;
+
+// A job_t stored in place. Thieves read it before they know whether they won
+// it, so every field is atomic.
+typedef struct job_slot_t {
+  _Atomic(job_func_t*) func;
+  _Atomic(void*) data;
+  _Atomic(job_counter_t*) counter;
+} job_slot_t;
+
+// Chase-Lev work-stealing deque. The owning thread pushes and pops at the
+// bottom, every other thread steals from the top. Jobs live in their slot
+// until taken, so a slot is only reused once its job has left the deque.
+typedef struct job_queue_t {
+  alignas(64) atomic_llong top;
+  alignas(64) atomic_llong bottom;
+  job_slot_t slots[JOB_QUEUE_CAPACITY];
+} job_queue_t;
+
+typedef struct job_system_t job_system_t;
+
+typedef struct job_thread_t {
+  job_system_t* system;
+  pthread_t thread;
+  int index;
+  u32 rng;
+
+  u64 executed;
+  u64 stolen;
+} job_thread_t;
+
+struct job_system_t {
+  int thread_count;
+  job_thread_t threads[MAX_JOB_THREADS];
+  job_queue_t* queues;
+
+  // Queued but not yet taken, so idle workers know when to sleep.
+  atomic_int queued;
+  atomic_int sleeping;
+  atomic_bool quit;
+  pthread_mutex_t sleep_lock;
+  pthread_cond_t wake;
+};
@@ -0,0 +1,39 @@
+#include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+//
+// Stand-ins for the <simd/simd.h> types that shader_types.h uses.
+// Size and alignment match Apple's, so the parameter structs keep the same
+// layout on both platforms.
+//
+
+typedef struct vector_float2 {
+  float x, y;
+} __attribute__((aligned(8))) vector_float2;
+
+typedef struct vector_float3 {
+  float x, y, z;
+  float _pad;
+} __attribute__((aligned(16))) vector_float3;
+
+typedef struct vector_float4 {
+  float x, y, z, w;
+} __attribute__((aligned(16))) vector_float4;
+
+typedef struct matrix_float4x4 {
+  vector_float4 columns[4];
+} matrix_float4x4;
@@ -0,0 +1,861 @@
+#include "linux_inc.h"
+
+#include "types.h"
+#include "cave_math.h"
+#include "app.h"
+#include "game.h"
+#include "arena.c"
+#include "profiler.c"
+#include "input_log.c"
+#include "governor.c"
+#include "game.c"
+#include "shader_types.h"
+#include "platform.c"
+#include "frame_pipeline.c"
+#include "asset_io.c"
+#include "scene.c"
+#include "sdf_graph.c"
+#include "jobs.c"
+#include "asset_watcher.c"
+#include "cpu_renderer.c"
+#include "bench.c"
+
+//
+// Headless platform layer. Runs the game layer as fast as it will go with no
+// window, GPU or OS input, so per-frame CPU cost can be measured on any box.
+//
+
+static int initial_window_width = 840;
+static int initial_window_height = 480;
+static app_t app = {};
+static world_t world = {};
+
+static fs_params_t fs_params = {};
+static job_system_t jobs;
+static cpu_renderer_t renderer;
+static render_target_t render_target = {};
+static sphere_scene_t scene;
+static blue_noise_t blue_noise;
+static sdf_graph_t sdf_graph;
+static sdf_program_t sdf_program;
+static int sdf_program_scene = -1;
+static sdf_cache_t sdf_cache;
+static frame_pipeline_t frame_pipeline;
+static pthread_t render_thread;
+static render_stats_t last_render;
+static FILE* governor_record;
+static asset_watcher_t asset_watcher;
+static int scene_asset = -1;
+
+typedef struct run_options_t {
+  u32 frame_count;
+  bool orbit;
+  bool render;
+  bool scalar;
+  bool no_accumulate;
+  int sampler; // -1 for the renderer's default
+  const char* blue_noise_path;
+  const char* blue_noise_out_path;
+  bool frame_times;
+  u32 frames_in_flight;
+  render_pipeline_t pipeline;
+  int thread_count;
+  const char* dump_path;
+  const char* scene_path;
+  bool watch;
+  const char* bake_path;
+  u32 sphere_count;
+  int sdf_scene;
+  sdf_cache_config_t sdf_cache;
+  f32 governor_ms;
+  const char* governor_record_path;
+  const char* governor_replay_path;
+  u32 governor_latency;
+  bool profile;
+  const char* trace_path;
+  const char* record_path;
+  const char* replay_path;
+  f32 fixed_dt;
+  bool bench;
+  bool bench_math;
+  bool bench_resolve;
+  bool bench_path_tracer;
+  bool bench_samplers;
+  bench_config_t bench_config;
+} run_options_t;
+
+static u64 get_ticks(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec*1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void init_clocks(void) {
+  app.clocks.ticks_per_sec = 1000000000ull;
+  app.clocks.start_ticks = get_ticks();
+
+  app.clocks.frame_count = 0;
+}
+
+static void update_clocks(void) {
+  u64 ticks = get_ticks() - app.clocks.start_ticks;
+  app.clocks.delta_ticks = (int)(ticks - app.clocks.ticks);
+  app.clocks.ticks = ticks;
+
+  app.clocks.delta_secs = (f32)app.clocks.delta_ticks / (f32)app.clocks.ticks_per_sec;
+
+  app.clocks.frame_count++;
+}
+
+static void update_window_and_display_size(int width, int height) {
+  // There is no display, so pretend the window fills a 1x one.
+  app.display.scale = 1;
+  app.display.size_in_points = V2(width, height);
+  app.display.size_in_pixels = V2(width, height);
+
+  app.window.scale = 1;
+  app.window.size_in_points = V2(width, height);
+  app.window.size_in_pixels = V2(width, height);
+}
+
+static void usage(const char* exe) {
+  printf("usage: %s [-frames N] [-size WxH] [-orbit] [-render] [-pipeline NAME] [-scalar] [-noaccum] [-sampler NAME] [-blue-noise FILE] [-blue-noise-out FILE] [-frame-times] [-frames-in-flight N] [-threads N] [-dump out.ppm] [-scene FILE] [-watch] [-bake-scene FILE] [-spheres N] [-sdf NAME] [-sdfcache MB] [-sdfcache-frames N]\n"
+    "       [-governor MS] [-governor-record FILE] [-governor-replay FILE] [-governor-latency N]\n"
+    "       [-profile] [-profile-trace FILE] [-record FILE] [-replay FILE] [-dt SECONDS]\n"
+    "       [-bench] [-bench-math] [-bench-resolve] [-bench-pt] [-bench-samplers] [-bench-out FILE] [-bench-baseline FILE] [-bench-frames N] [-bench-sizes WxH,WxH]\n", exe);
+  printf("sdf scenes:");
+  for (int i=0; i < SDF_PRESET_COUNT; i++) printf(" %s", sdf_preset_names[i]);
+  printf("\n");
+}
+
+static bool parse_options(int argc, char** argv, run_options_t* opts) {
+  opts->frame_count = 10000;
+  opts->orbit = false;
+  opts->render = false;
+  opts->scalar = false;
+  opts->no_accumulate = false;
+  opts->sampler = -1;
+  opts->blue_noise_path = NULL;
+  opts->blue_noise_out_path = NULL;
+  opts->frame_times = false;
+  opts->frames_in_flight = 2;
+  opts->pipeline = RENDER_PIPELINE_RAY_MARCHER;
+  opts->thread_count = 0;
+  opts->dump_path = NULL;
+  opts->scene_path = NULL;
+  opts->watch = false;
+  opts->bake_path = NULL;
+  opts->sphere_count = 0;
+  opts->sdf_scene = -1;
+  opts->sdf_cache = sdf_cache_default_config;
+  opts->sdf_cache.brick_bytes = 0;
+  opts->governor_ms = 0;
+  opts->governor_record_path = NULL;
+  opts->governor_replay_path = NULL;
+  opts->governor_latency = 2;
+  opts->profile = false;
+  opts->trace_path = NULL;
+  opts->record_path = NULL;
+  opts->replay_path = NULL;
+  opts->fixed_dt = 0;
+  opts->bench = false;
+  opts->bench_math = false;
+  opts->bench_resolve = false;
+  opts->bench_path_tracer = false;
+  opts->bench_samplers = false;
+  bench_default_config(&opts->bench_config);
+
+  for (int i=1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "-frames") == 0 && i+1 < argc) {
+      opts->frame_count = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-size") == 0 && i+1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &initial_window_width, &initial_window_height) != 2) {
+        return false;
+      }
+    } else if (strcmp(arg, "-orbit") == 0) {
+      opts->orbit = true;
+    } else if (strcmp(arg, "-render") == 0) {
+      opts->render = true;
+    } else if (strcmp(arg, "-scalar") == 0) {
+      opts->scalar = true;
+    } else if (strcmp(arg, "-noaccum") == 0) {
+      opts->no_accumulate = true;
+    } else if (strcmp(arg, "-sampler") == 0 && i+1 < argc) {
+      const char* name = argv[++i];
+      int k = 0;
+      while (k < SAMPLER_KIND_COUNT && strcmp(name, sampler_kind_names[k]) != 0) k++;
+      if (k == SAMPLER_KIND_COUNT) {
+        return false;
+      }
+      opts->sampler = k;
+    } else if (strcmp(arg, "-blue-noise") == 0 && i+1 < argc) {
+      opts->blue_noise_path = argv[++i];
+    } else if (strcmp(arg, "-blue-noise-out") == 0 && i+1 < argc) {
+      opts->blue_noise_out_path = argv[++i];
+    } else if (strcmp(arg, "-frame-times") == 0) {
+      // The graph is drawn from the profiler's render history.
+      opts->frame_times = true;
+      opts->render = true;
+      opts->profile = true;
+    } else if (strcmp(arg, "-pipeline") == 0 && i+1 < argc) {
+      const char* name = argv[++i];
+      int p = 0;
+      while (p < RENDER_PIPELINE_COUNT && strcmp(name, render_pipeline_names[p]) != 0) p++;
+      if (p == RENDER_PIPELINE_COUNT) {
+        return false;
+      }
+      opts->pipeline = (render_pipeline_t)p;
+      opts->render = true;
+    } else if (strcmp(arg, "-frames-in-flight") == 0 && i+1 < argc) {
+      opts->frames_in_flight = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-threads") == 0 && i+1 < argc) {
+      opts->thread_count = atoi(argv[++i]);
+    } else if (strcmp(arg, "-dump") == 0 && i+1 < argc) {
+      opts->dump_path = argv[++i];
+      opts->render = true;
+    } else if (strcmp(arg, "-scene") == 0 && i+1 < argc) {
+      opts->scene_path = argv[++i];
+    } else if (strcmp(arg, "-watch") == 0) {
+      opts->watch = true;
+    } else if (strcmp(arg, "-bake-scene") == 0 && i+1 < argc) {
+      opts->bake_path = argv[++i];
+      opts->render = true;
+    } else if (strcmp(arg, "-spheres") == 0 && i+1 < argc) {
+      opts->sphere_count = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-sdf") == 0 && i+1 < argc) {
+      const char* name = argv[++i];
+      int p = 0;
+      while (p < SDF_PRESET_COUNT && strcmp(name, sdf_preset_names[p]) != 0) p++;
+      if (p == SDF_PRESET_COUNT) {
+        return false;
+      }
+      opts->sdf_scene = p;
+    } else if (strcmp(arg, "-sdfcache") == 0 && i+1 < argc) {
+      opts->sdf_cache.brick_bytes = (usize)strtoul(argv[++i], NULL, 10) << 20;
+    } else if (strcmp(arg, "-sdfcache-frames") == 0 && i+1 < argc) {
+      opts->sdf_cache.resident_frames = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-governor") == 0 && i+1 < argc) {
+      opts->governor_ms = strtof(argv[++i], NULL);
+    } else if (strcmp(arg, "-governor-record") == 0 && i+1 < argc) {
+      opts->governor_record_path = argv[++i];
+    } else if (strcmp(arg, "-governor-replay") == 0 && i+1 < argc) {
+      opts->governor_replay_path = argv[++i];
+    } else if (strcmp(arg, "-governor-latency") == 0 && i+1 < argc) {
+      opts->governor_latency = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-profile") == 0) {
+      opts->profile = true;
+    } else if (strcmp(arg, "-profile-trace") == 0 && i+1 < argc) {
+      opts->trace_path = argv[++i];
+      opts->profile = true;
+    } else if (strcmp(arg, "-record") == 0 && i+1 < argc) {
+      opts->record_path = argv[++i];
+    } else if (strcmp(arg, "-replay") == 0 && i+1 < argc) {
+      opts->replay_path = argv[++i];
+    } else if (strcmp(arg, "-dt") == 0 && i+1 < argc) {
+      opts->fixed_dt = strtof(argv[++i], NULL);
+    } else if (strcmp(arg, "-bench") == 0) {
+      opts->bench = true;
+    } else if (strcmp(arg, "-bench-math") == 0) {
+      opts->bench_math = true;
+    } else if (strcmp(arg, "-bench-resolve") == 0) {
+      opts->bench_resolve = true;
+    } else if (strcmp(arg, "-bench-pt") == 0) {
+      opts->bench_path_tracer = true;
+    } else if (strcmp(arg, "-bench-samplers") == 0) {
+      opts->bench_samplers = true;
+    } else if (strcmp(arg, "-bench-out") == 0 && i+1 < argc) {
+      opts->bench_config.output_path = argv[++i];
+      opts->bench = true;
+    } else if (strcmp(arg, "-bench-baseline") == 0 && i+1 < argc) {
+      opts->bench_config.baseline_path = argv[++i];
+      opts->bench = true;
+    } else if (strcmp(arg, "-bench-frames") == 0 && i+1 < argc) {
+      opts->bench_config.frames = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "-bench-sizes") == 0 && i+1 < argc) {
+      if (!parse_bench_sizes(argv[++i], &opts->bench_config)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return opts->frame_count > 0 && initial_window_width > 0 && initial_window_height > 0;
+}
+
+// Matches the viewport the Metal path renders the offscreen buffer with.
+static void update_render_target(const frame_slot_t* slot) {
+  int width = (int)(slot->window_size.x * slot->render_scale);
+  int height = (int)(slot->window_size.y * slot->render_scale);
+  if (width < 1) width = 1;
+  if (height < 1) height = 1;
+
+  if (width != render_target.width || height != render_target.height) {
+    free(render_target.pixels);
+    render_target.width = width;
+    render_target.height = height;
+    render_target.stride = width;
+    render_target.pixels = aligned_alloc(64, aligned_size(sizeof(u32) * width * height));
+  }
+}
+
+static bool write_ppm(const char* path, const render_target_t* target) {
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  fprintf(f, "P6\n%d %d\n255\n", target->width, target->height);
+  for (int y=0; y < target->height; y++) {
+    const u32* row = target->pixels + (usize)y*target->stride;
+    for (int x=0; x < target->width; x++) {
+      u32 c = row[x];
+      u8 rgb[3] = {(u8)(c >> 16), (u8)(c >> 8), (u8)c};
+      fwrite(rgb, 3, 1, f);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Recompiles the ray marcher's distance field when the world picks another one.
+static void update_sdf_program(int sdf_scene) {
+  int preset = sdf_scene % SDF_PRESET_COUNT;
+  if (preset == sdf_program_scene) {
+    return;
+  }
+  profile_begin(PROFILE_SDF_PROGRAM);
+  sdf_program_scene = preset;
+  sdf_build_preset(&sdf_graph, (sdf_preset_t)preset);
+  if (compile_sdf_graph(&sdf_graph, &sdf_program)) {
+    printf("sdf: %s, %u instructions, %u constants\n",
+      sdf_preset_names[preset], sdf_program.instruction_count, sdf_program.constant_count);
+  }
+  if (renderer.sdf_cache) {
+    sdf_cache_clear(renderer.sdf_cache, &sdf_program);
+  }
+  profile_end(PROFILE_SDF_PROGRAM);
+}
+
+static void* load_scene_asset(const char* path) {
+  sphere_scene_t* s = (sphere_scene_t*)calloc(1, sizeof(sphere_scene_t));
+  if (!load_sphere_scene(s, path, SPHERE_LANES)) {
+    free(s);
+    return NULL;
+  }
+  return s;
+}
+
+static void free_scene_asset(void* asset) {
+  free_sphere_scene((sphere_scene_t*)asset);
+  free(asset);
+}
+
+// Between frames, so the renderer never sees a scene change under it.
+static void update_scene(void) {
+  sphere_scene_t* reloaded = (sphere_scene_t*)take_reloaded_asset(&asset_watcher, scene_asset);
+  if (!reloaded) {
+    return;
+  }
+  free_sphere_scene(&scene);
+  scene = *reloaded;
+  free(reloaded);
+  // Starts the path tracer's running sum over.
+  renderer.accum.sample_count = 0;
+  printf("scene: reloaded, %u spheres, bvh: %u nodes, built in %0.3f ms\n",
+    scene.sphere_count, scene.bvh.node_count, scene.bvh.build_ms);
+}
+
+// Consumes the frame pipeline's slots in order until it's closed. It's the
+// only thread that touches the renderer, and stands in as job thread 0.
+static void* render_thread_main(void* data) {
+  profiler_name_thread("render");
+  for (u64 frame=1;; frame++) {
+    frame_slot_t* slot = acquire_frame_slot(&frame_pipeline, frame);
+    if (!slot) {
+      break;
+    }
+    update_scene();
+    update_sdf_program(slot->sdf_scene);
+    update_render_target(slot);
+    renderer.ui_rects = slot->ui.rects;
+    renderer.ui_rect_count = slot->ui.rect_count;
+    last_render = cpu_render_frame(&renderer, render_target, &slot->fs_params);
+    slot->render_ms = (f32)((f64)last_render.elapsed_ns / 1e6);
+    if (governor_record) {
+      fprintf(governor_record, "%f %f\n", slot->render_scale, slot->render_ms);
+    }
+    retire_frame_slot(&frame_pipeline, slot);
+  }
+  free_scratch_arenas();
+  return NULL;
+}
+
+typedef struct governor_replay_t {
+  f32 scale_sum;
+  u32 over_budget;
+  u32 changes;
+  f32 error_sum; // |log(ms / target)|
+} governor_replay_t;
+
+static void print_governor_replay(const char* name, const governor_replay_t* r, u32 frames) {
+  printf("  %-10s mean scale %0.3f, %4u frames over budget (%5.1f%%), mean |log error| %0.3f, %u scale changes\n",
+    name, r->scale_sum / (f32)frames, r->over_budget, 100.0 * (f64)r->over_budget / (f64)frames,
+    r->error_sum / (f32)frames, r->changes);
+}
+
+static void governor_replay_frame(governor_replay_t* r, f32 target_ms, f32 scale, f32 prev_scale, f32 ms) {
+  r->scale_sum += scale;
+  r->over_budget += ms > target_ms;
+  r->changes += scale != prev_scale;
+  r->error_sum += fabsf(logf(ms / target_ms));
+}
+
+// Fewest frames per scale change, on average, for a replay to pass.
+#define GOVERNOR_REPLAY_FRAMES_PER_CHANGE 20
+
+// Feeds a recorded trace of "scale ms" lines through the governor, without
+// rendering anything. Each frame's cost is assumed to go with pixel count,
+// and the governor sees frame times latency frames late, the way it does
+// with frames in flight on the GPU.
+static bool replay_governor_trace(const char* path, f32 target_ms, u32 latency) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+  u32 count = 0;
+  u32 capacity = 1024;
+  f32* costs = (f32*)malloc(sizeof(f32) * capacity);
+  char line[256];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), f)) {
+    line_number++;
+    char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) continue;
+    f32 scale, ms;
+    if (sscanf(p, "%f %f", &scale, &ms) != 2 || scale <= 0 || ms <= 0) {
+      printf("ERROR: %s:%d: expected \"scale ms\".\n", path, line_number);
+      fclose(f);
+      free(costs);
+      return false;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      costs = (f32*)realloc(costs, sizeof(f32) * capacity);
+    }
+    costs[count++] = ms / (scale*scale);
+  }
+  fclose(f);
+  if (count == 0) {
+    printf("ERROR: %s has no frames.\n", path);
+    free(costs);
+    return false;
+  }
+
+  printf("governor replay: %s, %u frames, target %0.2f ms, %u frames latency\n", path, count, target_ms, latency);
+
+  f32 fixed_scales[] = {0.25f, 0.5f, 1.0f};
+  for (int i=0; i < (int)(sizeof(fixed_scales)/sizeof(fixed_scales[0])); i++) {
+    governor_replay_t r = {0};
+    f32 scale = fixed_scales[i];
+    for (u32 frame=0; frame < count; frame++) {
+      governor_replay_frame(&r, target_ms, scale, scale, costs[frame]*scale*scale);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "fixed %0.2f", scale);
+    print_governor_replay(name, &r, count);
+  }
+
+  resolution_governor_t governor;
+  init_resolution_governor(&governor, target_ms);
+  governor_replay_t r = {0};
+  f32* frame_ms = (f32*)malloc(sizeof(f32) * count);
+  f32 scale = 0.5f;
+  f32 prev_scale = scale;
+  for (u32 frame=0; frame < count; frame++) {
+    frame_ms[frame] = costs[frame]*scale*scale;
+    governor_replay_frame(&r, target_ms, scale, prev_scale, frame_ms[frame]);
+    prev_scale = scale;
+    f32 measured = frame >= latency ? frame_ms[frame - latency] : 0;
+    scale = update_resolution_governor(&governor, scale, measured);
+  }
+  print_governor_replay("governor", &r, count);
+  // Each change throws away accumulated samples, a settled governor changes
+  // the scale a few times per change in load, not every few frames.
+  u32 max_changes = count / GOVERNOR_REPLAY_FRAMES_PER_CHANGE;
+  bool settled = r.changes <= max_changes;
+  printf("  %u scale changes, at most %u expected%s\n", r.changes, max_changes, settled ? "" : "  FAIL");
+
+  free(frame_ms);
+  free(costs);
+  return settled;
+}
+
+static void end_frame_input(void) {
+  for (int i=0; i < NUMBER_OF_KEYS; i++) {
+    reset_button(&app.keys[i]);
+  }
+
+  app.mouse.moved = false;
+  app.mouse.scrolled = false;
+  app.mouse.delta_position.x = 0;
+  app.mouse.delta_position.y = 0;
+  app.mouse.delta_scroll.x = 0;
+  app.mouse.delta_scroll.y = 0;
+  reset_button(&app.mouse.left_button);
+  reset_button(&app.mouse.middle_button);
+  reset_button(&app.mouse.right_button);
+}
+
+int main(int argc, char** argv) {
+  run_options_t opts;
+  if (!parse_options(argc, argv, &opts)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (opts.governor_replay_path) {
+    f32 target_ms = opts.governor_ms > 0 ? opts.governor_ms : 1000.0f/60.0f;
+    return replay_governor_trace(opts.governor_replay_path, target_ms, opts.governor_latency) ? 0 : 1;
+  }
+
+  if (opts.profile) {
+    init_profiler(opts.trace_path != NULL);
+  }
+
+  if (opts.bench_math) {
+    return run_math_benchmarks() ? 0 : 1;
+  }
+  if (opts.bench_resolve) {
+    return run_resolve_benchmarks() ? 0 : 1;
+  }
+  if (opts.bench_path_tracer) {
+    return run_path_tracer_benchmarks() ? 0 : 1;
+  }
+
+  // The tile is generated unless one is given, in a few tens of ms at 64x64.
+  if (opts.sampler == SAMPLER_BLUE_NOISE || opts.bench_samplers || opts.blue_noise_out_path) {
+    bool ok = opts.blue_noise_path ? load_blue_noise(&blue_noise, opts.blue_noise_path) :
+      init_blue_noise(&blue_noise, BLUE_NOISE_SIZE, 1);
+    if (!ok) {
+      return 1;
+    }
+  }
+  if (opts.blue_noise_out_path) {
+    bool ok = write_blue_noise(&blue_noise, opts.blue_noise_out_path);
+    if (ok) {
+      printf("wrote %s\n", opts.blue_noise_out_path);
+    }
+    free_blue_noise(&blue_noise);
+    return ok ? 0 : 1;
+  }
+  if (opts.bench_samplers) {
+    bool ok = run_sampler_benchmarks(&blue_noise);
+    free_blue_noise(&blue_noise);
+    return ok ? 0 : 1;
+  }
+
+  // The suite follows -replay's camera path if there is one.
+  if (opts.bench) {
+    opts.bench_config.thread_count = opts.thread_count;
+    opts.bench_config.scalar = opts.scalar;
+    opts.bench_config.path = opts.replay_path;
+    bool ok = run_benchmarks(&opts.bench_config);
+    print_profile_report();
+    return ok ? 0 : 1;
+  }
+
+  // Replays run at the recorded window size, so the camera aspect matches.
+  input_log_t input_log = {0};
+  if (opts.replay_path) {
+    if (!begin_input_replay(&input_log, opts.replay_path)) {
+      return 1;
+    }
+    initial_window_width = (int)input_log.window_size.x;
+    initial_window_height = (int)input_log.window_size.y;
+  }
+
+  update_window_and_display_size(initial_window_width, initial_window_height);
+  if (opts.record_path && !begin_input_recording(&input_log, opts.record_path, app.window.size_in_pixels)) {
+    return 1;
+  }
+  app.render_scale = 0.5f;
+  init_resolution_governor(&app.governor, opts.governor_ms);
+  app.governor.enabled = opts.governor_ms > 0;
+  init_clocks();
+  init_world(&app, &world);
+  if (opts.sdf_scene >= 0) {
+    world.sdf_scene = opts.sdf_scene;
+  }
+
+  if (opts.render) {
+    // The scene file is mapped and faulted in on the I/O thread while the
+    // job threads start up.
+    asset_io_t io = {0};
+    asset_request_t scene_request = {.path = opts.scene_path, .flags = ASSET_MAP_SEQUENTIAL | ASSET_MAP_POPULATE};
+    if (opts.scene_path) {
+      if (!init_asset_io(&io)) {
+        return 1;
+      }
+      submit_asset_request(&io, &scene_request);
+    }
+
+    init_job_system(&jobs, opts.thread_count);
+    init_cpu_renderer(&renderer, &jobs);
+    renderer.pipeline = opts.pipeline;
+    if (opts.scalar) {
+      renderer.use_packets = false;
+    }
+    if (opts.no_accumulate) {
+      renderer.accumulate = false;
+    }
+    if (opts.sampler >= 0) {
+      renderer.sampling.kind = (sampler_kind_t)opts.sampler;
+    }
+    renderer.sampling.blue_noise = &blue_noise;
+    app.show_frame_times = opts.frame_times;
+
+    if (opts.scene_path) {
+      u64 start = get_ticks();
+      bool ok = wait_asset_request(&io, &scene_request);
+      shutdown_asset_io(&io);
+      if (!ok || !load_sphere_scene_view(&scene, scene_request.view, opts.scene_path, SPHERE_LANES)) {
+        return 1;
+      }
+      printf("scene: %s, %0.1f MB %s, mapped in %0.3f ms, ready %0.3f ms later\n",
+        opts.scene_path, (f64)scene_request.view.size / (1024.0*1024.0), scene.baked.data ? "baked" : "text",
+        scene_request.ms, (f64)(get_ticks() - start) / 1e6);
+    } else if (opts.sphere_count) {
+      generate_sphere_scene(&scene, opts.sphere_count, 1, SPHERE_LANES);
+    } else {
+      init_default_scene(&scene, SPHERE_LANES);
+    }
+    renderer.scene = &scene;
+    renderer.sdf_program = &sdf_program;
+    if (opts.sdf_cache.brick_bytes) {
+      init_sdf_cache(&sdf_cache, opts.sdf_cache);
+      renderer.sdf_cache = &sdf_cache;
+      printf("sdf cache: %d^3 cells of %0.2f, %u bricks, %0.1f MB\n",
+        sdf_cache.cells_per_axis, sdf_cache.config.cell_size, sdf_cache.brick_capacity,
+        (f64)sdf_cache_bytes(&sdf_cache) / (1024.0*1024.0));
+    }
+    printf("scene: %u spheres, bvh: %u nodes, %u leaves, depth %u, built in %0.3f ms\n",
+      scene.sphere_count, scene.bvh.node_count, scene.bvh.leaf_count, scene.bvh.max_depth, scene.bvh.build_ms);
+
+    if (opts.bake_path) {
+      bool ok = bake_sphere_scene(&scene, opts.bake_path, SPHERE_LANES);
+      if (ok) {
+        printf("wrote %s\n", opts.bake_path);
+      }
+      shutdown_cpu_renderer(&renderer);
+      shutdown_job_system(&jobs);
+      free_sphere_scene(&scene);
+      return ok ? 0 : 1;
+    }
+
+    if (opts.watch && opts.scene_path) {
+      if (!init_asset_watcher(&asset_watcher)) {
+        return 1;
+      }
+      scene_asset = watch_asset(&asset_watcher, ASSET_SCENE, opts.scene_path, load_scene_asset, free_scene_asset);
+      if (scene_asset < 0 || !start_asset_watcher(&asset_watcher)) {
+        return 1;
+      }
+      printf("watching %s\n", opts.scene_path);
+    }
+  }
+
+  if (opts.governor_record_path) {
+    governor_record = fopen(opts.governor_record_path, "w");
+    if (!governor_record) {
+      printf("ERROR: Cannot open file %s.\n", opts.governor_record_path);
+      return 1;
+    }
+    fprintf(governor_record, "# render scale, frame ms\n");
+  }
+  f32 scale_sum = 0;
+
+  if (opts.render) {
+    if (!init_frame_pipeline(&frame_pipeline, opts.frames_in_flight)) {
+      return 1;
+    }
+    pthread_create(&render_thread, NULL, render_thread_main, NULL);
+  }
+
+  u64 total_ticks = 0;
+  u64 min_ticks = UINT64_MAX;
+  u64 max_ticks = 0;
+
+  u32 frames_run = 0;
+  for (; frames_run < opts.frame_count; frames_run++) {
+    profile_begin(PROFILE_FRAME);
+    profile_begin(PROFILE_INPUT);
+    // Hold the right arrow so the orbit camera has some work to do.
+    if (opts.orbit && !input_log.replaying) {
+      update_button(&app.keys[KEY_RIGHT], true);
+    }
+
+    update_button(&app.keys[KEY_SHIFT], app.keys[KEY_LSHIFT].down || app.keys[KEY_RSHIFT].down);
+    update_button(&app.keys[KEY_ALT], app.keys[KEY_LALT].down || app.keys[KEY_RALT].down);
+    update_button(&app.keys[KEY_CTRL], app.keys[KEY_LCTRL].down || app.keys[KEY_RCTRL].down);
+    update_button(&app.keys[KEY_META], app.keys[KEY_LMETA].down || app.keys[KEY_RMETA].down);
+
+    update_clocks();
+    if (input_log.replaying && !replay_input_frame(&input_log, &app)) {
+      profile_end(PROFILE_INPUT);
+      profile_end(PROFILE_FRAME);
+      break;
+    }
+    if (opts.fixed_dt > 0) {
+      app.clocks.delta_secs = opts.fixed_dt;
+    }
+    if (input_log.file && !input_log.replaying) {
+      record_input_frame(&input_log, &app);
+    }
+    if (app.keys[KEY_F].pressed) {
+      app.show_frame_times = !app.show_frame_times;
+    }
+    profile_end(PROFILE_INPUT);
+
+    u64 frame_start = get_ticks();
+    frame_slot_t* slot = NULL;
+    if (opts.render) {
+      // Blocks while every slot is still being rendered. The render time the
+      // game sees is from the last frame that finished, which is this one's
+      // predecessor only with a single frame in flight.
+      slot = begin_frame_slot(&frame_pipeline);
+      const frame_slot_t* retired = last_retired_frame_slot(&frame_pipeline);
+      app.frame_ms = retired ? retired->render_ms : 0;
+    }
+    profile_begin(PROFILE_UPDATE);
+    update_and_render(&app, &world, &fs_params.debug_params);
+    profile_end(PROFILE_UPDATE);
+    profile_begin(PROFILE_CAMERA);
+    update_render_camera(&world.camera, aspect2(app.window.size_in_pixels), &fs_params.camera);
+    profile_end(PROFILE_CAMERA);
+
+    fs_params.frame_count = app.clocks.frame_count;
+    fs_params.viewport_size.x = app.window.size_in_pixels.x;
+    fs_params.viewport_size.y = app.window.size_in_pixels.y;
+
+    if (slot) {
+      slot->fs_params = fs_params;
+      slot->window_size = app.window.size_in_pixels;
+      slot->render_scale = app.render_scale;
+      slot->sdf_scene = world.sdf_scene;
+      if (app.show_frame_times) {
+        push_frame_time_graph(&slot->ui, app.window.size_in_pixels, PROFILE_RENDER);
+      }
+      submit_frame_slot(&frame_pipeline, slot);
+    }
+    u64 frame_ticks = get_ticks() - frame_start;
+    scale_sum += app.render_scale;
+
+    total_ticks += frame_ticks;
+    if (frame_ticks < min_ticks) min_ticks = frame_ticks;
+    if (frame_ticks > max_ticks) max_ticks = frame_ticks;
+
+    end_frame_input();
+    profile_end(PROFILE_FRAME);
+    profiler_end_frame();
+  }
+
+  if (opts.render) {
+    close_frame_pipeline(&frame_pipeline);
+    pthread_join(render_thread, NULL);
+    profiler_end_frame();
+  }
+
+  f64 to_us = 1000000.0 / (f64)app.clocks.ticks_per_sec;
+  printf("frames: %u\n", frames_run);
+  printf("frame cpu time (us): avg %0.3f, min %0.3f, max %0.3f\n",
+    (f64)total_ticks * to_us / (f64)frames_run,
+    (f64)min_ticks * to_us,
+    (f64)max_ticks * to_us
+  );
+  if (opts.render) {
+    printf("pipeline: %u frames in flight, game thread waited %0.3f ms/frame for a free slot\n",
+      frame_pipeline.slot_count, (f64)frame_pipeline.wait_ns / 1e6 / (f64)frames_run);
+  }
+  printf("simulation: %" PRIu64 " steps at %d Hz, %" PRIu64 " dropped\n",
+    world.sim_steps, SIM_HZ, world.sim_dropped_steps);
+  printf("camera: %0.3f %0.3f %0.3f\n",
+    world.camera.position.x, world.camera.position.y, world.camera.position.z);
+  if (app.governor.enabled) {
+    printf("governor: target %0.2f ms, mean render scale %0.3f, last %0.3f\n",
+      app.governor.target_ms, scale_sum / (f32)frames_run, app.render_scale);
+  }
+  if (input_log.replaying) {
+    printf("replayed %u frames from %s\n", input_log.frames, opts.replay_path);
+  } else if (input_log.file) {
+    printf("recorded %u frames to %s\n", input_log.frames, opts.record_path);
+  }
+  end_input_log(&input_log);
+  print_profile_report();
+  if (opts.trace_path && write_chrome_trace(opts.trace_path)) {
+    printf("wrote %s\n", opts.trace_path);
+  }
+  if (governor_record) {
+    fclose(governor_record);
+    printf("wrote %s\n", opts.governor_record_path);
+  }
+
+  if (opts.render) {
+    render_stats_t* total = &renderer.total;
+    f64 secs = (f64)total->elapsed_ns / 1e9;
+    // Ray marcher lanes are rays, tracer lanes are spheres in a leaf.
+    int lanes = renderer.pipeline != RENDER_PIPELINE_RAY_MARCHER ? SPHERE_LANES :
+      renderer.use_packets ? PACKET_WIDTH : 1;
+    printf("render: %s, %dx%d, %d threads, %d-wide SIMD, %0.3f ms/frame\n",
+      render_pipeline_names[renderer.pipeline],
+      render_target.width, render_target.height, renderer.thread_count,
+      lanes, secs * 1000.0 / (f64)frames_run);
+    if (last_render.accumulated_samples) {
+      printf("samples per pixel in last frame: %u\n", last_render.accumulated_samples);
+    }
+    printf("rays: %" PRIu64 " (%0.2f Mrays/s), pixels: %0.2f Mpixels/s\n",
+      total->rays, (f64)total->rays / secs / 1e6, (f64)total->pixels / secs / 1e6);
+    if (total->bvh_steps) {
+      printf("bvh: %0.2f nodes and %0.2f spheres per ray\n",
+        (f64)total->bvh_steps / (f64)total->rays, (f64)total->sphere_tests / (f64)total->rays);
+    }
+    if (total->scene_evals) {
+      printf("march: %0.2f steps and %0.2f scene evals per pixel\n",
+        (f64)total->march_steps / (f64)total->pixels, (f64)total->scene_evals / (f64)total->pixels);
+    }
+
+    if (renderer.sdf_cache && !total->sdf_samples) {
+      printf("sdf cache: unused, the program is under %u instructions\n", sdf_cache.config.min_instructions);
+    } else if (renderer.sdf_cache) {
+      printf("sdf cache: %0.1f%% of %" PRIu64 " samples hit, %" PRIu64 " bricks filled, %u resident, %" PRIu64 " evicted, %0.2f fill evals per sample\n",
+        100.0 * (f64)total->sdf_cache_hits / (f64)total->sdf_samples,
+        total->sdf_samples, total->sdf_bricks_filled, sdf_cache.resident, sdf_cache.evicted,
+        (f64)total->sdf_evals / (f64)total->sdf_samples);
+    }
+
+    printf("memory: frame arena %0.1f KB, scratch %0.1f KB at most, accumulation %0.1f MB committed\n",
+      (f64)renderer.frame_arena.high_water / 1024.0, (f64)scratch_arena_high_water() / 1024.0,
+      (f64)renderer.accum.memory.size / (1024.0*1024.0));
+
+    if (opts.dump_path && write_ppm(opts.dump_path, &render_target)) {
+      printf("wrote %s\n", opts.dump_path);
+    }
+    if (scene_asset >= 0) {
+      printf("assets: %u reloads, %u failed\n",
+        asset_watcher.assets[scene_asset].reloads, asset_watcher.assets[scene_asset].failures);
+      shutdown_asset_watcher(&asset_watcher);
+    }
+    shutdown_cpu_renderer(&renderer);
+    free_frame_pipeline(&frame_pipeline);
+    shutdown_job_system(&jobs);
+    free_sphere_scene(&scene);
+    free_blue_noise(&blue_noise);
+    free_sdf_cache(&sdf_cache);
+  }
+  shutdown_profiler();
+  free_scratch_arenas();
+
+  return 0;
+}
@@ -4,5 +4,6 @@
 #import <MetalKit/MetalKit.h>
 #import <CoreText/CoreText.h>
 #import <mach/mach_time.h>
+#import <pthread.h>
 #import <simd/simd.h>
 
@@ -9,12 +9,31 @@
 #include "cave_math.h"
 #include "app.h"
 #include "game.h"
+#include "arena.c"
+#include "profiler.c"
+#include "input_log.c"
+#include "governor.c"
 #include "game.c"
 #include "shader_types.h"
+#include "platform.c"
+#include "frame_pipeline.c"
+#include "asset_io.c"
+#include "scene.c"
+#include "sdf_graph.c"
 
 // Not sure if this is a good scale factor. Docs don't say.
 #define PRECISE_SCROLLING_SCALE 0.1
-#define MAX_BUFFERS_IN_FLIGHT 1
+// Frames the CPU can encode ahead of the GPU. Each has its own slot in
+// _frame_pipeline, with its own params and UI rects.
+#define FRAMES_IN_FLIGHT 2
+
+// Set to 1 to accumulate path_tracer.metal across frames. Its linear samples
+// are summed into a float offscreen buffer, then averaged and encoded to sRGB
+// by the dynamic resolution pass. The sum starts over whenever the camera,
+// debug params, render scale or window size change. fs_params.accumulate
+// tells the shader, at 0 it encodes each frame itself. The other shaders
+// write finished colors and need 0.
+#define PROGRESSIVE_ACCUMULATION 0
 
 // TODO: Pass this into the application delegate
 static int initial_window_width = 840;
@@ -25,44 +44,36 @@ static world_t world = {};
 
 const char* shader_lib_path = "build/standard.metallib";
 
-#define kilobytes(value) ((value)*1024LL)
-#define megabytes(value) (kilobytes(value)*1024LL)
-#define gigabytes(value) (megabytes(value)*1024LL)
-
-typedef struct memory_arena_t {
-  size_t size;
-  size_t alignment;
-  u8 *base;
-  size_t used;
-} memory_arena_t;
-
-static void 
-init_arena(memory_arena_t* arena, size_t size, void* base) {
-  arena->size = size;
-  arena->base = (u8*)base;
-  arena->used = 0;
-}
-
-static void 
-reset_arena(memory_arena_t* arena) {
-  arena->used = 0;
-}
-
-static void* 
-push_size(memory_arena_t* arena, size_t size) {
-  assert((arena->used + size) <= arena->size);
-
-  void* result = arena->base + arena->used;
-  arena->used += size;
-
-  return result;
-}
-
-static void update_button(button_t* button, bool down) {
-  bool was_down = button->down;
-  button->down = down;
-  button->pressed += down && !was_down;
-  button->released += !down && was_down;
+// Spheres for path_tracer.metal and ray_tracer.metal. Pass -scene FILE or
+// -spheres N to replace the built in four.
+static const char* scene_path = NULL;
+static u32 scene_sphere_count = 0;
+static sphere_scene_t scene = {};
+
+// Distance field for ray_marcher.metal, recompiled when world.sdf_scene
+// changes.
+static sdf_graph_t sdf_graph;
+static sdf_program_t sdf_program;
+static int sdf_program_scene = -1;
+
+// -record FILE logs every frame's input for the Linux runner's -replay.
+// Opened on the first frame, once the window size is known.
+static const char* record_path = NULL;
+static input_log_t input_log;
+
+static void update_sdf_program(void) {
+  int preset = world.sdf_scene % SDF_PRESET_COUNT;
+  if (preset == sdf_program_scene) {
+    return;
+  }
+  profile_begin(PROFILE_SDF_PROGRAM);
+  sdf_program_scene = preset;
+  sdf_build_preset(&sdf_graph, (sdf_preset_t)preset);
+  if (compile_sdf_graph(&sdf_graph, &sdf_program)) {
+    printf("sdf: %s, %u instructions, %u constants\n",
+      sdf_preset_names[preset], sdf_program.instruction_count, sdf_program.constant_count);
+  }
+  profile_end(PROFILE_SDF_PROGRAM);
 }
 
 static void update_mouse_button(mouse_button_type_t button_type, bool down) {
@@ -79,11 +90,6 @@ static void update_mouse_button(mouse_button_type_t button_type, bool down) {
   update_button(button, down);
 }
 
-static void reset_button(button_t* button) {
-  button->pressed = 0;
-  button->released = 0;
-}
-
 static void init_clocks(void) {
   mach_timebase_info_data_t info;
   mach_timebase_info(&info);
@@ -107,109 +113,6 @@ static void update_clocks(void) {
   app.clocks.frame_count++;
 }
 
-vector_float3 v3_to_float3(v3 a) {
-  return (vector_float3){a.x, a.y, a.z};
-}
-
-static void update_render_camera(camera_t* c, f32 aspect, render_camera_t* r) {
-  f32 theta = c->vfov * M_PI / 180;
-  f32 half_height = tanf(theta/2);
-  f32 half_width = aspect * half_height;
-  v3 w = unit3(sub3(c->target, c->position));
-  v3 u = unit3(cross3(c->up, w));
-  v3 v = cross3(w, u);
-
-  v3 ll1 = sub3(c->position, mul3(u, half_width));
-  v3 ll2 = sub3(ll1, mul3(v, half_height));
-  v3 ll3 = add3(ll2, w);
-
-  r->position = v3_to_float3(c->position);
-  r->film_h = v3_to_float3(mul3(u, 2*half_width));
-  r->film_v = v3_to_float3(mul3(v, 2*half_height));
-  r->film_lower_left = v3_to_float3(ll3);
-}
-
-typedef struct ui_context_t {
-  u32 v_count;
-  u32 i_count;
-  memory_arena_t varena;
-  memory_arena_t iarena;
-} ui_context_t;
-
-static void
-reset_ui_context(ui_context_t* rs) {
-  reset_arena(&rs->varena);
-  reset_arena(&rs->iarena);
-  rs->v_count = 0;
-  rs->i_count = 0;
-}
-
-static void 
-push_ui_rect(ui_context_t* rs, v2 pos, v2 size, v4 color) {
-  render_vert_t* verts = push_size(&rs->varena, sizeof(render_vert_t)*4);
-  u16* indices = push_size(&rs->iarena, sizeof(u16)*6);
-
-  verts[0].position = (vector_float2){pos.x, pos.y};
-  verts[1].position = (vector_float2){pos.x + size.x, pos.y};
-  verts[2].position = (vector_float2){pos.x + size.x, pos.y + size.y};
-  verts[3].position = (vector_float2){pos.x, pos.y + size.y};
-
-  verts[0].color = (vector_float4){color.r, color.g, color.b, color.a};
-  verts[1].color = (vector_float4){color.r, color.g, color.b, color.a};
-  verts[2].color = (vector_float4){color.r, color.g, color.b, color.a};
-  verts[3].color = (vector_float4){color.r, color.g, color.b, color.a};
-
-  indices[0] = rs->v_count;
-  indices[1] = rs->v_count+1;
-  indices[2] = rs->v_count+2;
-  indices[3] = rs->v_count;
-  indices[4] = rs->v_count+2;
-  indices[5] = rs->v_count+3;
-
-  rs->v_count += 4;
-  rs->i_count += 6;
-}
-
-static int aligned_size(int sz) {
-  return (sz + 0xFF) & ~0xFF;
-}
-
-typedef struct {
-  long size;
-  char* contents;
-} file_t;
-
-file_t read_file(const char* path) {
-  file_t result = {};
-
-  FILE *f = fopen(path, "rb");
-  if (f) {
-    fseek(f, 0, SEEK_END);
-    result.size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    result.contents = (char*)malloc(result.size + 1);
-    fread(result.contents, result.size + 1, 1, f);
-    fclose(f);
-    result.contents[result.size] = 0;
-  } else {
-    printf("ERROR: Cannot open file %s.\n", path);
-  }
-  
-  return(result);
-}
-
-time_t get_last_write_time(const char *filename) {
-  time_t last_write_time = 0;
-
-  struct stat status;
-  if (stat(filename, &status) == 0) {
-    last_write_time = status.st_mtime;
-  }
-
-  return (last_write_time);
-}
-
 // TODO: better error handling
 id<MTLLibrary> compile_shaders_from_source(id<MTLDevice> device, const char* src) {
   NSError* err = NULL;
@@ -311,8 +214,6 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
 }
 @end
 
-#define MAX_FRAME_TIMES 128
-
 @implementation MetalKitView
 {
   id<MTLCommandQueue> _command_queue;
@@ -321,27 +222,32 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   id<MTLRenderPipelineState> _ui_pso;
   id<MTLTexture> _offscreen_buffer;
 
-  id<MTLBuffer> _ui_vbuffer;
-  id<MTLBuffer> _ui_ibuffer;
+  // Wraps a chunk of a frame slot's UI rects each, made the first time it's
+  // used.
+  id<MTLBuffer> _ui_buffers[FRAME_SLOTS_MAX][UI_MAX_CHUNKS];
+
+  id<MTLBuffer> _scene_spheres;
+  id<MTLBuffer> _scene_sphere_materials;
+  id<MTLBuffer> _scene_materials;
+  id<MTLBuffer> _scene_nodes;
 
-  ui_context_t _ui_context;
+  frame_pipeline_t _frame_pipeline;
+  frame_slot_t* _slot; // the frame being encoded
 
   fs_params_t fs_params;
+  scene_params_t scene_params;
   dr_params_t dr_params;
   ui_vs_params_t ui_vs_params;
 
   bool _capture_mouse;
-  u64 cmd_start_time;
-
-  f32 _frame_times[MAX_FRAME_TIMES];
-  int _frame_time_ordinal;
-
-  NSUInteger _max_buffers_in_flight;
-  dispatch_semaphore_t _frame_boundary_semaphore;
 
   time_t shader_lib_ts;
 
-  void* _app_memory;
+  bool _accum_reset;
+  render_camera_t _accum_camera;
+  debug_params_t _accum_debug_params;
+  f32 _accum_render_scale;
+  v2 _accum_window_size;
 }
 
 -(nonnull instancetype)initWithDevice:(nonnull id<MTLDevice>)device {
@@ -351,41 +257,69 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     [self _setupApp];
     [self _setupMetal];
     [self _createBuffers];
+    [self _createSceneBuffers];
   }
   return self;
 }
 
 - (void)_setupApp {
   app.render_scale = 0.5f;
+  init_resolution_governor(&app.governor, 1000.0f/60.0f);
+  app.governor.enabled = true;
+  init_profiler(true);
   init_clocks();
   init_world(&app, &world);
 }
 
 - (void)_createBuffers {
-  size_t ui_vbuffer_size = aligned_size(sizeof(render_vert_t) * UINT16_MAX);
-  size_t ui_ibuffer_size = aligned_size(sizeof(u16) * UINT16_MAX);
-  size_t total_size = ui_vbuffer_size + ui_ibuffer_size;
-
-  size_t page_size = getpagesize();
-  posix_memalign(&_app_memory, page_size, total_size);
-
-  init_arena(&_ui_context.varena, ui_vbuffer_size, _app_memory);
-  init_arena(&_ui_context.iarena, ui_ibuffer_size, 
-      (u8*)_app_memory + ui_vbuffer_size);
-
-  _ui_vbuffer = [self.device
-     newBufferWithBytesNoCopy:_ui_context.varena.base 
-                       length:_ui_context.varena.size
-                      options:MTLResourceStorageModeShared
-                  deallocator:nil
-  ];
+  if (!init_frame_pipeline(&_frame_pipeline, FRAMES_IN_FLIGHT)) {
+    printf("ERROR: failed to set up the frame slots\n");
+  }
+}
 
-  _ui_ibuffer = [self.device
-     newBufferWithBytesNoCopy:_ui_context.iarena.base 
-                       length:_ui_context.iarena.size
-                      options:MTLResourceStorageModeShared
-                  deallocator:nil
-  ];
+- (id<MTLBuffer>)_uiBufferForChunk:(u32)chunk {
+  usize index = _slot - _frame_pipeline.slots;
+  if (!_ui_buffers[index][chunk]) {
+    _ui_buffers[index][chunk] = [self.device
+       newBufferWithBytesNoCopy:_slot->ui.rects + (usize)chunk*UI_CHUNK_RECTS
+                         length:UI_CHUNK_BYTES
+                        options:MTLResourceStorageModeShared
+                    deallocator:nil
+    ];
+  }
+  return _ui_buffers[index][chunk];
+}
+
+- (id<MTLBuffer>)_newSceneBuffer:(const void*)bytes length:(size_t)length {
+  // Metal won't make empty buffers, and an empty scene is still a scene.
+  u32 empty = 0;
+  if (length == 0) {
+    bytes = &empty;
+    length = sizeof(empty);
+  }
+  return [self.device newBufferWithBytes:bytes length:length options:MTLResourceStorageModeShared];
+}
+
+- (void)_createSceneBuffers {
+  bool loaded = false;
+  if (scene_path) {
+    loaded = load_sphere_scene(&scene, scene_path, 1);
+  } else if (scene_sphere_count) {
+    generate_sphere_scene(&scene, scene_sphere_count, 1, 1);
+    loaded = true;
+  }
+  if (!loaded) {
+    init_default_scene(&scene, 1);
+  }
+  printf("scene: %u spheres, bvh: %u nodes, %u leaves, depth %u, built in %0.3f ms\n",
+    scene.sphere_count, scene.bvh.node_count, scene.bvh.leaf_count, scene.bvh.max_depth, scene.bvh.build_ms);
+
+  scene_params.sphere_count = scene.sphere_count;
+  scene_params.node_count = scene.bvh.node_count;
+  _scene_spheres = [self _newSceneBuffer:scene.spheres length:sizeof(scene_sphere_t) * scene.sphere_count];
+  _scene_sphere_materials = [self _newSceneBuffer:scene.sphere_materials length:sizeof(u32) * scene.sphere_count];
+  _scene_materials = [self _newSceneBuffer:scene.materials length:sizeof(vector_float4) * scene.material_count];
+  _scene_nodes = [self _newSceneBuffer:scene.bvh.nodes length:sizeof(bvh_node_t) * scene.bvh.node_count];
 }
 
 - (void)_createOffscreenBuffer {
@@ -394,7 +328,7 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   }
 
   MTLTextureDescriptor *td = [MTLTextureDescriptor
-    texture2DDescriptorWithPixelFormat: self.colorPixelFormat
+    texture2DDescriptorWithPixelFormat: [self _offscreenPixelFormat]
                                  width: app.display.size_in_pixels.x
                                 height: app.display.size_in_pixels.y
                              mipmapped: NO
@@ -403,6 +337,35 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   [td setStorageMode: MTLStorageModePrivate];
 
   _offscreen_buffer = [self.device newTextureWithDescriptor:td];
+  _accum_reset = true;
+}
+
+- (MTLPixelFormat)_offscreenPixelFormat {
+#if PROGRESSIVE_ACCUMULATION
+  return MTLPixelFormatRGBA32Float;
+#else
+  return self.colorPixelFormat;
+#endif
+}
+
+// True if the offscreen buffer has to be cleared rather than added to.
+- (bool)_updateAccumulation {
+#if PROGRESSIVE_ACCUMULATION
+  bool reset = _accum_reset ||
+    memcmp(&fs_params.camera, &_accum_camera, sizeof(render_camera_t)) != 0 ||
+    memcmp(&fs_params.debug_params, &_accum_debug_params, sizeof(debug_params_t)) != 0 ||
+    app.render_scale != _accum_render_scale ||
+    !eq2(app.window.size_in_pixels, _accum_window_size);
+
+  _accum_reset = false;
+  _accum_camera = fs_params.camera;
+  _accum_debug_params = fs_params.debug_params;
+  _accum_render_scale = app.render_scale;
+  _accum_window_size = app.window.size_in_pixels;
+  return reset;
+#else
+  return true;
+#endif
 }
 
 - (void)_createPSO {
@@ -426,7 +389,17 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
       psd.label = @"Offscreen Pipeline";
       psd.vertexFunction = vertex_func;
       psd.fragmentFunction = fragment_func;
-      psd.colorAttachments[0].pixelFormat = self.colorPixelFormat;
+      psd.colorAttachments[0].pixelFormat = [self _offscreenPixelFormat];
+#if PROGRESSIVE_ACCUMULATION
+      // Add this frame's samples (and their count, in alpha) to the buffer.
+      psd.colorAttachments[0].blendingEnabled = YES;
+      psd.colorAttachments[0].rgbBlendOperation = MTLBlendOperationAdd;
+      psd.colorAttachments[0].alphaBlendOperation = MTLBlendOperationAdd;
+      psd.colorAttachments[0].sourceRGBBlendFactor = MTLBlendFactorOne;
+      psd.colorAttachments[0].sourceAlphaBlendFactor = MTLBlendFactorOne;
+      psd.colorAttachments[0].destinationRGBBlendFactor = MTLBlendFactorOne;
+      psd.colorAttachments[0].destinationAlphaBlendFactor = MTLBlendFactorOne;
+#endif
       // psd.depthAttachmentPixelFormat = MTLPixelFormatDepth32Float_Stencil8;
       // psd.stencilAttachmentPixelFormat = MTLPixelFormatDepth32Float_Stencil8;
 
@@ -466,31 +439,18 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
       id<MTLFunction> vertex_func = [library newFunctionWithName:@"ui_vs_main"];
       id<MTLFunction> fragment_func = [library newFunctionWithName:@"ui_fs_main"];
 
-      MTLVertexDescriptor* vd = [[MTLVertexDescriptor alloc] init];
-      vd.attributes[0].format = MTLVertexFormatFloat2;
-      vd.attributes[0].bufferIndex = 0;
-      vd.attributes[0].offset = 0;
-
-      vd.attributes[1].format = MTLVertexFormatFloat4;
-      vd.attributes[1].bufferIndex = 0;
-      vd.attributes[1].offset = 2 * 4;
-
-      vd.layouts[0].stride = 6 * 4;
-      vd.layouts[0].stepFunction = MTLVertexStepFunctionPerVertex;
-
+      // ui_vs_main reads its rect straight from the buffer, no vertex descriptor.
       MTLRenderPipelineDescriptor *psd = [MTLRenderPipelineDescriptor new];
       psd.label = @"UI Pipeline";
       psd.vertexFunction = vertex_func;
       psd.fragmentFunction = fragment_func;
       psd.colorAttachments[0].pixelFormat = self.colorPixelFormat;
-      psd.vertexDescriptor = vd;
 
       NSError *error = nil;
       _ui_pso = [self.device newRenderPipelineStateWithDescriptor:psd error:&error];
       if (!_ui_pso) {
         NSLog(@"Error occurred when creating render pipeline state: %@", error);
       }
-      [vd release];
       [vertex_func release];
       [fragment_func release];
       [psd release];
@@ -498,6 +458,7 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
 
     [library release];
     library = nil;
+    _accum_reset = true;
   }
 }
 
@@ -507,8 +468,6 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   // [self setDepthStencilPixelFormat:MTLPixelFormatDepth32Float_Stencil8];
   [self setSampleCount:1];
 
-  _frame_boundary_semaphore = dispatch_semaphore_create(MAX_BUFFERS_IN_FLIGHT);
-
   _command_queue = [self.device newCommandQueue];
   [self _updateWindowAndDisplaySize];
 }
@@ -635,47 +594,18 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   }
 }
 
-// TODO: move this responsibility into the game code once it can handle render ops
-- (void)_drawFrameTimes {
-  v4 color = V4(0.67f, 0.69f, 0.75f, 1);
-  f32 height_mod = 2.0f;
-  f32 gutter_total = 2.0f * (MAX_FRAME_TIMES-2);
-  f32 bar_width = (app.window.size_in_pixels.x - gutter_total) / MAX_FRAME_TIMES;
-  f32 bar_spacing = 2.0f;
-
-  push_ui_rect(&_ui_context, 
-    V2(0,0), 
-    V2(app.window.size_in_pixels.x, 33.333f * height_mod), 
-    V4(0.16f, 0.17f, 0.2f, 1.0f)
-  );
-
-  push_ui_rect(&_ui_context, 
-    V2(0, 16.666f * height_mod), 
-    V2(app.window.size_in_pixels.x, 2.0f), 
-    V4(0.596f, 0.764f, 0.474f, 1)
-  );
-
-  push_ui_rect(&_ui_context, 
-    V2(0, 33.333f * height_mod), 
-    V2(app.window.size_in_pixels.x, 2.0f), 
-    V4(0.88f, 0.42f, 0.46f, 1)
-  );
-
-  for (int i=0; i < MAX_FRAME_TIMES; i++) {
-    int index = (i + (_frame_time_ordinal+1)) % MAX_FRAME_TIMES;
-    f32 x = ((f32)i) * (bar_width + bar_spacing);
-    f32 h = _frame_times[index] * height_mod;
-    push_ui_rect(&_ui_context, V2(x,0), V2(bar_width,h), color);
-  }
-}
-
 - (void)_render {
   fs_params.frame_count = app.clocks.frame_count;
+  fs_params.accumulate = PROGRESSIVE_ACCUMULATION;
   fs_params.viewport_size.x = app.window.size_in_pixels.x;
   fs_params.viewport_size.y = app.window.size_in_pixels.y;
+  _slot->fs_params = fs_params;
 
   dr_params.osb_to_rt_ratio.x = (app.window.size_in_pixels.x*app.render_scale) / app.display.size_in_pixels.x;
   dr_params.osb_to_rt_ratio.y = (app.window.size_in_pixels.y*app.render_scale) / app.display.size_in_pixels.y;
+  dr_params.resolve_accumulated = PROGRESSIVE_ACCUMULATION;
+
+  bool clear_offscreen = [self _updateAccumulation];
 
   v2 viewport_size = {app.window.size_in_pixels.x, app.window.size_in_pixels.y};
 
@@ -688,8 +618,9 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
 
   id<MTLCommandBuffer> command_buffer = [_command_queue commandBuffer];
 
+  frame_slot_t* slot = _slot;
   [command_buffer addScheduledHandler:^(id<MTLCommandBuffer> buffer) {
-    cmd_start_time = mach_absolute_time();
+    slot->render_start_ns = profiler_ticks_ns();
   }];
 
 #if 1
@@ -698,9 +629,13 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
   {
     MTLRenderPassDescriptor *pass = [MTLRenderPassDescriptor new];
     pass.colorAttachments[0].texture = _offscreen_buffer;
-    pass.colorAttachments[0].loadAction = MTLLoadActionClear;
+    pass.colorAttachments[0].loadAction = clear_offscreen ? MTLLoadActionClear : MTLLoadActionLoad;
     pass.colorAttachments[0].storeAction = MTLStoreActionStore;
+#if PROGRESSIVE_ACCUMULATION
+    pass.colorAttachments[0].clearColor = MTLClearColorMake(0, 0, 0, 0);
+#else
     pass.colorAttachments[0].clearColor = MTLClearColorMake(0.16f, 0.17f, 0.2f, 1.0f);
+#endif
 
     id<MTLRenderCommandEncoder> enc = [command_buffer 
       renderCommandEncoderWithDescriptor:pass];
@@ -711,9 +646,19 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     };
     [enc setViewport:vp];
     [enc setRenderPipelineState:_standard_pso];
-    [enc setFragmentBytes:&fs_params
+    [enc setFragmentBytes:&_slot->fs_params
                        length:sizeof(fs_params_t)
                       atIndex:0];
+    [enc setFragmentBytes:&scene_params
+                       length:sizeof(scene_params_t)
+                      atIndex:1];
+    [enc setFragmentBuffer:_scene_spheres offset:0 atIndex:2];
+    [enc setFragmentBuffer:_scene_sphere_materials offset:0 atIndex:3];
+    [enc setFragmentBuffer:_scene_materials offset:0 atIndex:4];
+    [enc setFragmentBuffer:_scene_nodes offset:0 atIndex:5];
+    [enc setFragmentBytes:&sdf_program
+                       length:sizeof(sdf_program_t)
+                      atIndex:6];
     [enc drawPrimitives:MTLPrimitiveTypeTriangle vertexStart:0 vertexCount:3];
     [enc endEncoding];
   }
@@ -760,33 +705,35 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     };
     [enc setViewport:vp];
     [enc setRenderPipelineState:_ui_pso];
-    [enc setVertexBuffer:_ui_vbuffer
-                  offset:0
-                 atIndex:0
-    ];
     [enc setVertexBytes:&ui_vs_params
                        length:sizeof(ui_vs_params_t)
                       atIndex:1];
-    [enc drawIndexedPrimitives:MTLPrimitiveTypeTriangle
-                    indexCount:_ui_context.i_count
-                     indexType:MTLIndexTypeUInt16
-                   indexBuffer:_ui_ibuffer
-             indexBufferOffset:0
-    ];
+    const ui_context_t* ui = &_slot->ui;
+    for (u32 chunk=0; chunk < ui_chunk_count(ui); chunk++) {
+      u32 first = chunk * UI_CHUNK_RECTS;
+      u32 count = ui->rect_count - first < UI_CHUNK_RECTS ? ui->rect_count - first : UI_CHUNK_RECTS;
+      [enc setVertexBuffer:[self _uiBufferForChunk:chunk]
+                    offset:0
+                   atIndex:0
+      ];
+      [enc drawPrimitives:MTLPrimitiveTypeTriangleStrip
+              vertexStart:0
+              vertexCount:4
+            instanceCount:count
+      ];
+    }
     [enc endEncoding];
   }
   [command_buffer presentDrawable:[self currentDrawable]];
 
-  dispatch_semaphore_t semaphore = _frame_boundary_semaphore;
+  frame_pipeline_t* pipeline = &_frame_pipeline;
+  submit_frame_slot(pipeline, slot);
   [command_buffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
-    // GPU work is complete
-    // Signal the semaphore to start the CPU work
-    dispatch_semaphore_signal(semaphore);
-    u64 cmd_end_time = mach_absolute_time();
-    u64 total_time = cmd_end_time - cmd_start_time;
-    f32 t = (f64)(total_time * 1000) / (f64)(app.clocks.ticks_per_sec);
-    _frame_time_ordinal = app.clocks.frame_count % MAX_FRAME_TIMES;
-    _frame_times[_frame_time_ordinal] = t;
+    // GPU work is complete, the slot can take another frame
+    u64 end_time = profiler_ticks_ns();
+    slot->render_ms = (f32)((f64)(end_time - slot->render_start_ns) / 1e6);
+    profile_record(PROFILE_GPU, slot->render_start_ns, end_time);
+    retire_frame_slot(pipeline, slot);
   }];
 
   [command_buffer commit];
@@ -807,7 +754,9 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     [self _updateWindowAndDisplaySize];
     [self _loadAssets];
 
-    dispatch_semaphore_wait(_frame_boundary_semaphore, DISPATCH_TIME_FOREVER);
+    profile_begin(PROFILE_FRAME);
+    _slot = begin_frame_slot(&_frame_pipeline);
+    profile_begin(PROFILE_INPUT);
 
     if (_capture_mouse != app.mouse.capture) {
       app.mouse.capture ? [self _captureMouse] : [self _releaseMouse];
@@ -819,21 +768,43 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     update_button(&app.keys[KEY_CTRL], app.keys[KEY_LCTRL].down || app.keys[KEY_RCTRL].down);
     update_button(&app.keys[KEY_META], app.keys[KEY_LMETA].down || app.keys[KEY_RMETA].down);
 
-    reset_ui_context(&_ui_context);
-
     if (app.keys[KEY_F].pressed) {
       app.show_frame_times = !app.show_frame_times;
     }
+    if (app.keys[KEY_P].pressed) {
+      print_profile_report();
+      if (write_chrome_trace("frame_trace.json")) {
+        printf("wrote frame_trace.json\n");
+      }
+    }
+    profile_end(PROFILE_INPUT);
 
     if (app.show_frame_times) {
-      [self _drawFrameTimes];
+      push_frame_time_graph(&_slot->ui, app.window.size_in_pixels, PROFILE_GPU);
     }
 
     update_clocks();
+    if (record_path && !input_log.file) {
+      begin_input_recording(&input_log, record_path, app.window.size_in_pixels);
+      record_path = NULL;
+    }
+    if (input_log.file) {
+      record_input_frame(&input_log, &app);
+    }
+    // Last completed command buffer, a frame or two behind this one.
+    const frame_slot_t* retired = last_retired_frame_slot(&_frame_pipeline);
+    app.frame_ms = retired ? retired->render_ms : 0;
+    profile_begin(PROFILE_UPDATE);
     update_and_render(&app, &world, &fs_params.debug_params);
+    profile_end(PROFILE_UPDATE);
+    profile_begin(PROFILE_CAMERA);
     update_render_camera(&world.camera, aspect2(app.window.size_in_pixels), &fs_params.camera);
+    profile_end(PROFILE_CAMERA);
+    update_sdf_program();
 
+    profile_begin(PROFILE_ENCODE);
     [self _render];
+    profile_end(PROFILE_ENCODE);
 
     // Reset keys
     for (int i=0; i < NUMBER_OF_KEYS; i++) {
@@ -850,6 +821,8 @@ id<MTLLibrary> load_shader_library(id<MTLDevice> device, const char* src) {
     reset_button(&app.mouse.left_button);
     reset_button(&app.mouse.middle_button);
     reset_button(&app.mouse.right_button);
+    profile_end(PROFILE_FRAME);
+    profiler_end_frame();
   }
 }
 @end
@@ -873,6 +846,16 @@ void macos_create_menu(void) {
 }
 
 int main(int argc, char **argv) {
+  for (int i=1; i+1 < argc; i++) {
+    if (strcmp(argv[i], "-scene") == 0) {
+      scene_path = argv[++i];
+    } else if (strcmp(argv[i], "-spheres") == 0) {
+      scene_sphere_count = (u32)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-record") == 0) {
+      record_path = argv[++i];
+    }
+  }
+
   [App sharedApplication];
   [NSApp setActivationPolicy:NSApplicationActivationPolicyRegular];
   macos_create_menu();
@@ -0,0 +1,143 @@
+//
+// Platform helpers shared by the macOS and Linux entry points.
+// Included directly by main.m and linux_main.c after shader_types.h.
+//
+
+static void update_button(button_t* button, bool down) {
+  bool was_down = button->down;
+  button->down = down;
+  button->pressed += down && !was_down;
+  button->released += !down && was_down;
+}
+
+static void reset_button(button_t* button) {
+  button->pressed = 0;
+  button->released = 0;
+}
+
+vector_float3 v3_to_float3(v3 a) {
+  return (vector_float3){a.x, a.y, a.z};
+}
+
+static void update_render_camera(camera_t* c, f32 aspect, render_camera_t* r) {
+  f32 theta = c->vfov * M_PI / 180;
+  f32 half_height = tanf(theta/2);
+  f32 half_width = aspect * half_height;
+  v3 w = unit3(sub3(c->target, c->position));
+  v3 u = unit3(cross3(c->up, w));
+  v3 v = cross3(w, u);
+
+  v3 ll1 = sub3(c->position, mul3(u, half_width));
+  v3 ll2 = sub3(ll1, mul3(v, half_height));
+  v3 ll3 = add3(ll2, w);
+
+  r->position = v3_to_float3(c->position);
+  r->film_h = v3_to_float3(mul3(u, 2*half_width));
+  r->film_v = v3_to_float3(mul3(v, 2*half_height));
+  r->film_lower_left = v3_to_float3(ll3);
+}
+
+// Rects are committed a chunk at a time, and the GPU side wraps each chunk in
+// its own buffer and draws it with one instanced call. 65536 rects is 80
+// pages at 16 KB, so chunks stay page aligned for newBufferWithBytesNoCopy.
+#define UI_CHUNK_RECTS 65536
+#define UI_MAX_CHUNKS 64
+#define UI_CHUNK_BYTES (sizeof(ui_rect_t) * UI_CHUNK_RECTS)
+
+typedef struct ui_context_t {
+  memory_arena_t arena;
+  ui_rect_t* rects; // the start of the arena, every rect pushed this frame
+  u32 rect_count;
+} ui_context_t;
+
+static bool
+init_ui_context(ui_context_t* rs) {
+  *rs = (ui_context_t){0};
+  if (!init_virtual_arena(&rs->arena, UI_CHUNK_BYTES * UI_MAX_CHUNKS)) {
+    return false;
+  }
+  rs->rects = (ui_rect_t*)rs->arena.base;
+  return true;
+}
+
+static void
+free_ui_context(ui_context_t* rs) {
+  free_arena(&rs->arena);
+  *rs = (ui_context_t){0};
+}
+
+static void
+reset_ui_context(ui_context_t* rs) {
+  reset_arena(&rs->arena);
+  rs->rect_count = 0;
+}
+
+static inline u32
+ui_chunk_count(const ui_context_t* rs) {
+  return (rs->rect_count + UI_CHUNK_RECTS-1) / UI_CHUNK_RECTS;
+}
+
+// Past UI_MAX_CHUNKS chunks rects are dropped.
+static void 
+push_ui_rect(ui_context_t* rs, v2 pos, v2 size, v4 color) {
+  if (rs->rect_count == UI_CHUNK_RECTS * UI_MAX_CHUNKS) {
+    return;
+  }
+  if (rs->rect_count % UI_CHUNK_RECTS == 0 && !push_array(&rs->arena, ui_rect_t, UI_CHUNK_RECTS)) {
+    return;
+  }
+  rs->rects[rs->rect_count++] = (ui_rect_t){pos.x, pos.y, size.x, size.y, rgba_pack4(color)};
+}
+
+#define MAX_FRAME_TIMES 128
+
+// Bars of the last MAX_FRAME_TIMES durations of scope along the top of the
+// window, 2 px per ms, with lines at 60 and 30 fps.
+static void
+push_frame_time_graph(ui_context_t* rs, v2 window_size, profile_scope_t scope) {
+  v4 color = V4(0.67f, 0.69f, 0.75f, 1);
+  f32 height_mod = 2.0f;
+  f32 gutter_total = 2.0f * (MAX_FRAME_TIMES-2);
+  f32 bar_width = (window_size.x - gutter_total) / MAX_FRAME_TIMES;
+  f32 bar_spacing = 2.0f;
+
+  push_ui_rect(rs, 
+    V2(0,0), 
+    V2(window_size.x, 33.333f * height_mod), 
+    V4(0.16f, 0.17f, 0.2f, 1.0f)
+  );
+
+  push_ui_rect(rs, 
+    V2(0, 16.666f * height_mod), 
+    V2(window_size.x, 2.0f), 
+    V4(0.596f, 0.764f, 0.474f, 1)
+  );
+
+  push_ui_rect(rs, 
+    V2(0, 33.333f * height_mod), 
+    V2(window_size.x, 2.0f), 
+    V4(0.88f, 0.42f, 0.46f, 1)
+  );
+
+  for (int i=0; i < MAX_FRAME_TIMES; i++) {
+    f32 x = ((f32)i) * (bar_width + bar_spacing);
+    f32 h = profile_history_ms(scope, MAX_FRAME_TIMES-1-i) * height_mod;
+    push_ui_rect(rs, V2(x,0), V2(bar_width,h), color);
+  }
+}
+
+static int aligned_size(int sz) {
+  return (sz + 0xFF) & ~0xFF;
+}
+
+time_t get_last_write_time(const char *filename) {
+  time_t last_write_time = 0;
+
+  struct stat status;
+  if (stat(filename, &status) == 0) {
+    last_write_time = status.st_mtime;
+  }
+
+  return (last_write_time);
+}
+
@@ -0,0 +1,252 @@
+#include "profiler.h"
+
+//
+// Frame profiler, see profiler.h.
+// Every thread appends finished scopes to its own ring, and the thread that
+// calls profiler_end_frame drains all of them into per-scope stats and the
+// trace. Nothing is shared between recording threads, so no locks.
+//
+
+static profiler_t profiler;
+static _Thread_local profiler_thread_t* profiler_thread_tls;
+static _Thread_local bool profiler_threads_full_tls;
+
+static u64 profiler_ticks_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec*1000000000ull + (u64)ts.tv_nsec;
+}
+
+static profiler_thread_t* profiler_thread(void) {
+  profiler_thread_t* t = profiler_thread_tls;
+  if (t || profiler_threads_full_tls) {
+    return t;
+  }
+
+  int index = atomic_fetch_add_explicit(&profiler.thread_count, 1, memory_order_relaxed);
+  if (index >= PROFILER_MAX_THREADS) {
+    profiler_threads_full_tls = true;
+    return NULL;
+  }
+  t = (profiler_thread_t*)aligned_alloc(64, sizeof(profiler_thread_t));
+  memset(t, 0, sizeof(*t));
+  snprintf(t->name, sizeof(t->name), "thread %d", index);
+  atomic_store_explicit(&profiler.threads[index], t, memory_order_release);
+  profiler_thread_tls = t;
+  return t;
+}
+
+// Call once, from the thread that will call profiler_end_frame.
+static void init_profiler(bool keep_trace) {
+  memset(&profiler, 0, sizeof(profiler));
+  profiler.enabled = true;
+  profiler.keep_trace = keep_trace;
+  profiler.start_ns = profiler_ticks_ns();
+
+  profiler_thread_t* t = profiler_thread();
+  if (t) {
+    snprintf(t->name, sizeof(t->name), "main");
+  }
+}
+
+// Only once every thread that recorded anything is done with it.
+static void shutdown_profiler(void) {
+  for (int i=0; i < PROFILER_MAX_THREADS; i++) {
+    free(atomic_load(&profiler.threads[i]));
+  }
+  free(profiler.trace);
+  memset(&profiler, 0, sizeof(profiler));
+}
+
+static void profiler_name_thread(const char* name) {
+  if (!profiler.enabled) return;
+  profiler_thread_t* t = profiler_thread();
+  if (t) {
+    snprintf(t->name, sizeof(t->name), "%s", name);
+  }
+}
+
+static void profiler_push(profiler_thread_t* t, profile_scope_t scope, int depth, u64 start_ns, u64 end_ns) {
+  u32 head = atomic_load_explicit(&t->head, memory_order_relaxed);
+  u32 tail = atomic_load_explicit(&t->tail, memory_order_acquire);
+  if (head - tail >= PROFILER_RING_CAPACITY) {
+    atomic_fetch_add_explicit(&t->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  t->events[head & (PROFILER_RING_CAPACITY-1)] = (profile_event_t){start_ns, end_ns, (u16)scope, (u16)depth, 0};
+  atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+static void profile_begin(profile_scope_t scope) {
+  if (!profiler.enabled) return;
+  profiler_thread_t* t = profiler_thread();
+  if (!t) return;
+
+  if (t->depth < PROFILER_MAX_DEPTH) {
+    t->open_scopes[t->depth] = (u16)scope;
+    t->open_starts[t->depth] = profiler_ticks_ns();
+  }
+  t->depth++;
+}
+
+static void profile_end(profile_scope_t scope) {
+  if (!profiler.enabled) return;
+  profiler_thread_t* t = profiler_thread();
+  if (!t) return;
+
+  u64 end_ns = profiler_ticks_ns();
+  t->depth--;
+  assert(t->depth >= 0);
+  if (t->depth < PROFILER_MAX_DEPTH) {
+    assert(t->open_scopes[t->depth] == scope);
+    profiler_push(t, scope, t->depth, t->open_starts[t->depth], end_ns);
+  }
+}
+
+// For spans timed somewhere else, like GPU work seen from a completion handler.
+static void profile_record(profile_scope_t scope, u64 start_ns, u64 end_ns) {
+  if (!profiler.enabled) return;
+  profiler_thread_t* t = profiler_thread();
+  if (t) {
+    profiler_push(t, scope, t->depth, start_ns, end_ns);
+  }
+}
+
+static void profiler_collect(const profile_event_t* e) {
+  profile_scope_stats_t* s = &profiler.scopes[e->scope];
+  u64 ns = e->end_ns > e->start_ns ? e->end_ns - e->start_ns : 0;
+  s->history_ns[s->calls % PROFILER_HISTORY] = ns < UINT32_MAX ? (u32)ns : UINT32_MAX;
+  s->calls++;
+  s->total_ns += ns;
+  if (ns > s->max_ns) s->max_ns = ns;
+
+  if (!profiler.keep_trace) return;
+  if (profiler.trace_count == PROFILER_MAX_TRACE_EVENTS) {
+    profiler.trace_skipped++;
+    return;
+  }
+  if (profiler.trace_count == profiler.trace_capacity) {
+    profiler.trace_capacity = profiler.trace_capacity ? profiler.trace_capacity*2 : 65536;
+    profiler.trace = (profile_event_t*)realloc(profiler.trace, sizeof(profile_event_t) * profiler.trace_capacity);
+  }
+  profiler.trace[profiler.trace_count++] = *e;
+}
+
+// Drains every thread's ring. Events still open, or recorded by threads that
+// are mid-scope, show up in a later frame.
+static void profiler_end_frame(void) {
+  if (!profiler.enabled) return;
+  profiler.frames++;
+
+  int count = atomic_load_explicit(&profiler.thread_count, memory_order_relaxed);
+  if (count > PROFILER_MAX_THREADS) count = PROFILER_MAX_THREADS;
+  for (int i=0; i < count; i++) {
+    profiler_thread_t* t = atomic_load_explicit(&profiler.threads[i], memory_order_acquire);
+    if (!t) continue;
+
+    u32 head = atomic_load_explicit(&t->head, memory_order_acquire);
+    u32 tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    for (; tail != head; tail++) {
+      profile_event_t e = t->events[tail & (PROFILER_RING_CAPACITY-1)];
+      e.thread = (u16)i;
+      profiler_collect(&e);
+    }
+    atomic_store_explicit(&t->tail, tail, memory_order_release);
+    profiler.dropped += atomic_exchange_explicit(&t->dropped, 0, memory_order_relaxed);
+  }
+}
+
+// Duration of the call `ago` calls before the latest one, 0 if there's none.
+static f32 profile_history_ms(profile_scope_t scope, u32 ago) {
+  const profile_scope_stats_t* s = &profiler.scopes[scope];
+  if (ago >= s->calls || ago >= PROFILER_HISTORY) {
+    return 0;
+  }
+  return (f32)s->history_ns[(s->calls - 1 - ago) % PROFILER_HISTORY] / 1e6f;
+}
+
+static int profiler_compare_u32(const void* a, const void* b) {
+  u32 x = *(const u32*)a;
+  u32 y = *(const u32*)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest rank percentiles over the last PROFILER_HISTORY calls, ps in [0,1].
+static void profile_percentiles(profile_scope_t scope, const f32* ps, f64* ms, int count) {
+  const profile_scope_stats_t* s = &profiler.scopes[scope];
+  u32 n = s->calls < PROFILER_HISTORY ? (u32)s->calls : PROFILER_HISTORY;
+  if (n == 0) {
+    for (int i=0; i < count; i++) ms[i] = 0;
+    return;
+  }
+
+  u32 sorted[PROFILER_HISTORY];
+  memcpy(sorted, s->history_ns, sizeof(u32) * n);
+  qsort(sorted, n, sizeof(u32), profiler_compare_u32);
+  for (int i=0; i < count; i++) {
+    int rank = (int)ceilf(ps[i] * (f32)n) - 1;
+    if (rank < 0) rank = 0;
+    if (rank > (int)n-1) rank = (int)n-1;
+    ms[i] = (f64)sorted[rank] / 1e6;
+  }
+}
+
+static void print_profile_report(void) {
+  if (!profiler.enabled || !profiler.frames) return;
+
+  printf("profile: %" PRIu64 " frames, percentiles over the last %d calls\n", profiler.frames, PROFILER_HISTORY);
+  printf("  %-22s %11s %10s %9s %9s %9s %9s\n", "scope", "calls/frame", "ms/frame", "p50 ms", "p95 ms", "p99 ms", "max ms");
+  for (int i=0; i < PROFILE_SCOPE_COUNT; i++) {
+    const profile_scope_stats_t* s = &profiler.scopes[i];
+    if (!s->calls) continue;
+
+    const f32 ps[] = {0.5f, 0.95f, 0.99f};
+    f64 ms[3];
+    profile_percentiles((profile_scope_t)i, ps, ms, 3);
+    printf("  %-22s %11.2f %10.3f %9.3f %9.3f %9.3f %9.3f\n",
+      profile_scope_names[i],
+      (f64)s->calls / (f64)profiler.frames,
+      (f64)s->total_ns / 1e6 / (f64)profiler.frames,
+      ms[0], ms[1], ms[2], (f64)s->max_ns / 1e6);
+  }
+  if (profiler.dropped) {
+    printf("  %" PRIu64 " events dropped, a thread filled its ring between frames\n", profiler.dropped);
+  }
+}
+
+// Chrome trace_event JSON, opens in chrome://tracing or ui.perfetto.dev.
+static bool write_chrome_trace(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    printf("ERROR: Cannot open file %s.\n", path);
+    return false;
+  }
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  int count = atomic_load(&profiler.thread_count);
+  if (count > PROFILER_MAX_THREADS) count = PROFILER_MAX_THREADS;
+  for (int i=0; i < count; i++) {
+    profiler_thread_t* t = atomic_load(&profiler.threads[i]);
+    if (!t) continue;
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+      first ? "" : ",\n", i, t->name);
+    first = false;
+  }
+  for (u32 i=0; i < profiler.trace_count; i++) {
+    const profile_event_t* e = &profiler.trace[i];
+    u64 start = e->start_ns > profiler.start_ns ? e->start_ns - profiler.start_ns : 0;
+    u64 dur = e->end_ns > e->start_ns ? e->end_ns - e->start_ns : 0;
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+      first ? "" : ",\n", profile_scope_names[e->scope], e->thread, (f64)start / 1e3, (f64)dur / 1e3);
+    first = false;
+  }
+  fprintf(f, "\n]}\n");
+  fclose(f);
+
+  if (profiler.trace_skipped) {
+    printf("trace: kept the first %u events, %" PRIu64 " later ones are only in the stats\n",
+      profiler.trace_count, profiler.trace_skipped);
+  }
+  return true;
+}
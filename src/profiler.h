@@ -0,0 +1,91 @@
+#pragma once
+#include <stdatomic.h>
+
+#include "types.h"
+
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_MAX_DEPTH 16
+// Per thread, must be a power of two. Bounds the events a thread can record
+// between two profiler_end_frame calls, the rest are dropped.
+#define PROFILER_RING_CAPACITY 8192
+// Calls per scope that percentiles are taken over.
+#define PROFILER_HISTORY 4096
+// Events kept for write_chrome_trace, later ones are only counted.
+#define PROFILER_MAX_TRACE_EVENTS (1u << 20)
+
+typedef enum profile_scope_t {
+  PROFILE_FRAME,
+  PROFILE_INPUT,
+  PROFILE_UPDATE,
+  PROFILE_CAMERA,
+  PROFILE_SDF_PROGRAM,
+  PROFILE_ENCODE,
+  PROFILE_GPU,
+  PROFILE_RENDER,
+  PROFILE_RENDER_TILE,
+  PROFILE_RESOLVE,
+  PROFILE_SCOPE_COUNT
+} profile_scope_t;
+
+static const char* profile_scope_names[PROFILE_SCOPE_COUNT] = {
+  "frame",
+  "input",
+  "update_and_render",
+  "update_render_camera",
+  "update_sdf_program",
+  "encode",
+  "gpu",
+  "cpu_render_frame",
+  "render_tile",
+  "resolve",
+};
+
+typedef struct profile_event_t {
+  u64 start_ns;
+  u64 end_ns;
+  u16 scope;
+  u16 depth;
+  u16 thread;
+} profile_event_t;
+
+// Written only by its own thread, drained by whoever calls profiler_end_frame.
+typedef struct profiler_thread_t {
+  alignas(64) atomic_uint head;
+  alignas(64) atomic_uint tail;
+  atomic_uint dropped;
+
+  int depth;
+  u16 open_scopes[PROFILER_MAX_DEPTH];
+  u64 open_starts[PROFILER_MAX_DEPTH];
+
+  char name[32];
+  profile_event_t events[PROFILER_RING_CAPACITY];
+} profiler_thread_t;
+
+typedef struct profile_scope_stats_t {
+  u64 calls;
+  u64 total_ns;
+  u64 max_ns;
+  u32 history_ns[PROFILER_HISTORY]; // call n lands in n % PROFILER_HISTORY
+} profile_scope_stats_t;
+
+// Named CPU timing scopes that nest per thread. Threads claim a ring the first
+// time they record anything, so job workers and Metal's completion handler
+// threads need no setup.
+typedef struct profiler_t {
+  bool enabled;
+  bool keep_trace;
+  u64 start_ns;
+  u64 frames;
+
+  atomic_int thread_count;
+  _Atomic(profiler_thread_t*) threads[PROFILER_MAX_THREADS];
+  u64 dropped;
+
+  profile_scope_stats_t scopes[PROFILE_SCOPE_COUNT];
+
+  profile_event_t* trace;
+  u32 trace_count;
+  u32 trace_capacity;
+  u64 trace_skipped;
+} profiler_t;
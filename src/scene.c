@@ -0,0 +1,349 @@
+#include "scene.h"
+#include "bvh.c"
+
+//
+// Sphere scenes for the ray and path tracers.
+// Scenes are either the built in four spheres, a generated field of N
+// spheres, or a text file with one entry per line:
+//
+//   # comment
+//   material <r> <g> <b>
+//   sphere <x> <y> <z> <radius> <material index>
+//
+// or a baked scene, see scene_baked_header_t.
+//
+
+static u32 scene_push_material(sphere_scene_t* scene, v3 albedo) {
+  assert(scene->material_count < SCENE_MAX_MATERIALS);
+  u32 index = scene->material_count++;
+  scene->materials[index] = (vector_float4){albedo.x, albedo.y, albedo.z, 1.0f};
+  return index;
+}
+
+static void scene_push_sphere(sphere_scene_t* scene, v3 center, f32 radius, u32 material) {
+  if (scene->sphere_count == scene->sphere_capacity) {
+    scene->sphere_capacity = scene->sphere_capacity ? scene->sphere_capacity*2 : 64;
+    scene->spheres = (scene_sphere_t*)realloc(scene->spheres, sizeof(scene_sphere_t) * scene->sphere_capacity);
+    scene->sphere_materials = (u32*)realloc(scene->sphere_materials, sizeof(u32) * scene->sphere_capacity);
+  }
+  u32 index = scene->sphere_count++;
+  scene->spheres[index] = (scene_sphere_t){{center.x, center.y, center.z}, radius};
+  scene->sphere_materials[index] = material;
+}
+
+static void free_sphere_scene(sphere_scene_t* scene) {
+  if (scene->baked.data) {
+    unmap_asset(&scene->baked);
+  } else {
+    free(scene->soa.center_x);
+    free(scene->spheres);
+    free(scene->sphere_materials);
+    free_bvh(&scene->bvh);
+  }
+  memset(scene, 0, sizeof(*scene));
+}
+
+static inline usize scene_soa_stride(u32 count) {
+  return (count + SCENE_SOA_PADDING + 15) & ~15u;
+}
+
+// Builds the BVH and puts the spheres in its leaf order. leaf_lanes is
+// passed on to build_bvh.
+static void finish_sphere_scene(sphere_scene_t* scene, u32 leaf_lanes) {
+  u32 count = scene->sphere_count;
+  arena_temp_t scratch = begin_scratch(NULL);
+  u32* order = push_array(scratch.arena, u32, count);
+  build_bvh(&scene->bvh, scene->spheres, count, leaf_lanes, order);
+
+  scene_sphere_t* spheres = (scene_sphere_t*)malloc(sizeof(scene_sphere_t) * scene->sphere_capacity);
+  u32* materials = NULL;
+  posix_memalign((void**)&materials, 64, sizeof(u32) * (count ? count : 1));
+  for (u32 i=0; i < count; i++) {
+    spheres[i] = scene->spheres[order[i]];
+    materials[i] = scene->sphere_materials[order[i]];
+  }
+  free(scene->spheres);
+  free(scene->sphere_materials);
+  scene->spheres = spheres;
+  scene->sphere_materials = materials;
+  end_scratch(scratch);
+
+  // One block, each array rounded up to a cache line. The padding holds
+  // zero radius spheres nothing can hit.
+  usize stride = scene_soa_stride(count);
+  f32* block = NULL;
+  posix_memalign((void**)&block, 64, sizeof(f32) * stride * 4);
+  scene->soa.center_x = block;
+  scene->soa.center_y = block + stride;
+  scene->soa.center_z = block + stride*2;
+  scene->soa.radius = block + stride*3;
+  for (usize i=0; i < stride; i++) {
+    const scene_sphere_t* s = i < count ? &spheres[i] : NULL;
+    scene->soa.center_x[i] = s ? s->center[0] : 0.0f;
+    scene->soa.center_y[i] = s ? s->center[1] : 0.0f;
+    scene->soa.center_z[i] = s ? s->center[2] : 0.0f;
+    scene->soa.radius[i] = s ? s->radius : 0.0f;
+  }
+}
+
+// The scene the shaders used to hard code.
+static void push_default_spheres(sphere_scene_t* scene) {
+  scene_push_sphere(scene, V3(-1,0.5f,1), 0.5f, scene_push_material(scene, V3(1.0f, 0.3f, 0.1f)));
+  scene_push_sphere(scene, V3(1,1,1), 1.0f, scene_push_material(scene, V3(0.9f, 0.9f, 0.9f)));
+  scene_push_sphere(scene, V3(0,0.25f,-0.5f), 0.25f, scene_push_material(scene, V3(0.2f, 0.2f, 1.0f)));
+  scene_push_sphere(scene, V3(0,-1000,0), 1000.0f, scene_push_material(scene, V3(0.5f, 0.5f, 0.5f)));
+}
+
+static void init_default_scene(sphere_scene_t* scene, u32 leaf_lanes) {
+  free_sphere_scene(scene);
+  push_default_spheres(scene);
+  finish_sphere_scene(scene, leaf_lanes);
+}
+
+static f32 scene_randf(u32* state) {
+  u32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return (f32)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// The default spheres plus count small ones on a jittered grid around them.
+static void generate_sphere_scene(sphere_scene_t* scene, u32 count, u32 seed, u32 leaf_lanes) {
+  free_sphere_scene(scene);
+  push_default_spheres(scene);
+
+  u32 rng = seed ? seed : 1;
+  u32 first_material = scene->material_count;
+  for (int i=0; i < 16; i++) {
+    v3 albedo = V3(scene_randf(&rng), scene_randf(&rng), scene_randf(&rng));
+    scene_push_material(scene, hadamard3(albedo, albedo));
+  }
+
+  int side = (int)ceilf(square_root((f32)count));
+  f32 spacing = 0.6f;
+  f32 origin = -0.5f * spacing * (f32)side;
+  for (int z=0; z < side && scene->sphere_count < count+4; z++) {
+    for (int x=0; x < side && scene->sphere_count < count+4; x++) {
+      f32 radius = 0.08f + 0.12f*scene_randf(&rng);
+      v3 center = V3(
+        origin + spacing*((f32)x + 0.2f + 0.6f*scene_randf(&rng)),
+        radius,
+        origin + spacing*((f32)z + 0.2f + 0.6f*scene_randf(&rng))
+      );
+      // Keep clear of the big spheres.
+      if (magnitude3(sub3(center, V3(-1,0.5f,1))) < 0.5f+radius ||
+          magnitude3(sub3(center, V3(1,1,1))) < 1.0f+radius ||
+          magnitude3(sub3(center, V3(0,0.25f,-0.5f))) < 0.25f+radius) {
+        continue;
+      }
+      u32 material = first_material + (u32)(scene_randf(&rng)*16.0f) % 16;
+      scene_push_sphere(scene, center, radius, material);
+    }
+  }
+
+  finish_sphere_scene(scene, leaf_lanes);
+}
+
+// Points scene into a mapped baked scene, which it then owns.
+static bool load_baked_sphere_scene(sphere_scene_t* scene, asset_view_t view, const char* path, u32 leaf_lanes) {
+  const scene_baked_header_t* h = (const scene_baked_header_t*)view.data;
+  u64 stride = scene_soa_stride(h->sphere_count);
+  u64 node_bytes = sizeof(bvh_node_t) * (u64)h->node_count;
+  u64 offsets[5] = {h->materials_offset, h->spheres_offset, h->sphere_materials_offset, h->soa_offset, h->nodes_offset};
+  u64 sizes[5] = {
+    sizeof(vector_float4) * (u64)h->material_count,
+    sizeof(scene_sphere_t) * (u64)h->sphere_count,
+    sizeof(u32) * (u64)h->sphere_count,
+    sizeof(f32) * stride * 4,
+    node_bytes,
+  };
+  if (h->version == SCENE_BAKED_VERSION && h->leaf_lanes != leaf_lanes) {
+    printf("ERROR: %s was baked for %u wide leaves, this build wants %u.\n", path, h->leaf_lanes, leaf_lanes);
+    unmap_asset(&view);
+    return false;
+  }
+  bool ok = h->version == SCENE_BAKED_VERSION && h->size == view.size &&
+    h->material_count <= SCENE_MAX_MATERIALS;
+  for (int i=0; i < 5 && ok; i++) {
+    ok = offsets[i] % SCENE_BAKED_ALIGNMENT == 0 && offsets[i] <= view.size && sizes[i] <= view.size - offsets[i];
+  }
+  if (!ok) {
+    printf("ERROR: %s is not a version %d baked scene, or it's cut short.\n", path, SCENE_BAKED_VERSION);
+    unmap_asset(&view);
+    return false;
+  }
+
+  // The tracers index with these unchecked, so a corrupt file is caught here.
+  const u32* sphere_materials = (const u32*)(view.data + h->sphere_materials_offset);
+  for (u32 i=0; i < h->sphere_count && ok; i++) {
+    ok = sphere_materials[i] < h->material_count;
+  }
+  if (!ok) {
+    printf("ERROR: %s: a sphere uses an undefined material.\n", path);
+    unmap_asset(&view);
+    return false;
+  }
+  if (!validate_bvh((const bvh_node_t*)(view.data + h->nodes_offset), h->node_count, h->sphere_count)) {
+    printf("ERROR: %s: the BVH is broken.\n", path);
+    unmap_asset(&view);
+    return false;
+  }
+
+  free_sphere_scene(scene);
+  scene->baked = view;
+  scene->sphere_count = h->sphere_count;
+  scene->sphere_capacity = h->sphere_count;
+  scene->spheres = (scene_sphere_t*)(view.data + h->spheres_offset);
+  scene->sphere_materials = (u32*)(view.data + h->sphere_materials_offset);
+  f32* soa = (f32*)(view.data + h->soa_offset);
+  scene->soa = (sphere_soa_t){soa, soa + stride, soa + stride*2, soa + stride*3};
+  scene->material_count = h->material_count;
+  memcpy(scene->materials, view.data + h->materials_offset, sizes[0]);
+  scene->bvh = (bvh_t){(bvh_node_t*)(view.data + h->nodes_offset), h->node_count, h->leaf_count, h->max_depth, 0};
+  return true;
+}
+
+static bool parse_sphere_scene(sphere_scene_t* scene, asset_view_t view, const char* path) {
+  const char* p = (const char*)view.data;
+  const char* end = p + view.size;
+  bool ok = true;
+  int line_number = 0;
+  while (p < end && ok) {
+    line_number++;
+    const char* newline = (const char*)memchr(p, '\n', (usize)(end - p));
+    const char* line_end = newline ? newline : end;
+    // Parsed from a copy, the mapping is read only and not NUL terminated.
+    char buffer[256];
+    usize length = (usize)(line_end - p);
+    if (length >= sizeof(buffer)) {
+      printf("ERROR: %s:%d: line is over %d characters.\n", path, line_number, (int)sizeof(buffer)-1);
+      ok = false;
+      break;
+    }
+    memcpy(buffer, p, length);
+    buffer[length] = 0;
+    p = newline ? newline + 1 : end;
+
+    char* line = buffer;
+    while (*line == ' ' || *line == '\t') line++;
+    v3 c;
+    f32 radius;
+    u32 material;
+    if (*line == 0 || *line == '#' || *line == '\r') {
+      // blank or comment
+    } else if (sscanf(line, "material %f %f %f", &c.x, &c.y, &c.z) == 3) {
+      if (scene->material_count == SCENE_MAX_MATERIALS) {
+        printf("ERROR: %s:%d: more than %d materials.\n", path, line_number, SCENE_MAX_MATERIALS);
+        ok = false;
+      } else {
+        scene_push_material(scene, c);
+      }
+    } else if (sscanf(line, "sphere %f %f %f %f %u", &c.x, &c.y, &c.z, &radius, &material) == 5) {
+      if (material >= scene->material_count) {
+        printf("ERROR: %s:%d: material %u is not defined.\n", path, line_number, material);
+        ok = false;
+      } else {
+        scene_push_sphere(scene, c, radius, material);
+      }
+    } else {
+      printf("ERROR: %s:%d: cannot parse '%s'.\n", path, line_number, line);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Takes a view of a text or baked scene file. Baked scenes keep it, text
+// scenes are parsed and unmap it.
+static bool load_sphere_scene_view(sphere_scene_t* scene, asset_view_t view, const char* path, u32 leaf_lanes) {
+  if (view.size >= sizeof(scene_baked_header_t) && *(const u32*)view.data == SCENE_BAKED_MAGIC) {
+    return load_baked_sphere_scene(scene, view, path, leaf_lanes);
+  }
+
+  free_sphere_scene(scene);
+  bool ok = parse_sphere_scene(scene, view, path);
+  unmap_asset(&view);
+  if (!ok) {
+    free_sphere_scene(scene);
+    return false;
+  }
+  finish_sphere_scene(scene, leaf_lanes);
+  return true;
+}
+
+static bool load_sphere_scene(sphere_scene_t* scene, const char* path, u32 leaf_lanes) {
+  asset_view_t view;
+  if (!map_asset(path, ASSET_MAP_SEQUENTIAL | ASSET_MAP_PREFETCH, &view)) {
+    return false;
+  }
+  return load_sphere_scene_view(scene, view, path, leaf_lanes);
+}
+
+static bool scene_write_aligned(FILE* f, const void* data, usize size, u64* offset) {
+  static const u8 zeros[SCENE_BAKED_ALIGNMENT] = {0};
+  usize padding = (usize)((SCENE_BAKED_ALIGNMENT - *offset % SCENE_BAKED_ALIGNMENT) % SCENE_BAKED_ALIGNMENT);
+  *offset += padding + size;
+  return fwrite(zeros, 1, padding, f) == padding && fwrite(data, 1, size, f) == size;
+}
+
+// Writes the finished scene so load_sphere_scene can map it back as is. The
+// file is replaced with a rename, since truncating one that's mapped would
+// fault whoever is reading it.
+static bool bake_sphere_scene(const sphere_scene_t* scene, const char* path, u32 leaf_lanes) {
+  char temp_path[1024];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path)) {
+    printf("ERROR: Path %s is too long.\n", path);
+    return false;
+  }
+  FILE* f = fopen(temp_path, "wb");
+  if (!f) {
+    printf("ERROR: Cannot open file %s.\n", temp_path);
+    return false;
+  }
+  usize stride = scene_soa_stride(scene->sphere_count);
+  usize sizes[5] = {
+    sizeof(vector_float4) * scene->material_count,
+    sizeof(scene_sphere_t) * scene->sphere_count,
+    sizeof(u32) * scene->sphere_count,
+    sizeof(f32) * stride * 4,
+    sizeof(bvh_node_t) * scene->bvh.node_count,
+  };
+  const void* arrays[5] = {scene->materials, scene->spheres, scene->sphere_materials, scene->soa.center_x, scene->bvh.nodes};
+
+  // Offsets first, then the same walk writes the arrays.
+  scene_baked_header_t h = {
+    .magic = SCENE_BAKED_MAGIC,
+    .version = SCENE_BAKED_VERSION,
+    .sphere_count = scene->sphere_count,
+    .material_count = scene->material_count,
+    .node_count = scene->bvh.node_count,
+    .leaf_count = scene->bvh.leaf_count,
+    .max_depth = scene->bvh.max_depth,
+    .leaf_lanes = leaf_lanes,
+  };
+  u64* offsets[5] = {&h.materials_offset, &h.spheres_offset, &h.sphere_materials_offset, &h.soa_offset, &h.nodes_offset};
+  u64 offset = sizeof(h);
+  for (int i=0; i < 5; i++) {
+    offset = (offset + SCENE_BAKED_ALIGNMENT-1) & ~(u64)(SCENE_BAKED_ALIGNMENT-1);
+    *offsets[i] = offset;
+    offset += sizes[i];
+  }
+  h.size = offset;
+
+  offset = 0;
+  bool ok = scene_write_aligned(f, &h, sizeof(h), &offset);
+  for (int i=0; i < 5 && ok; i++) {
+    ok = scene_write_aligned(f, arrays[i], sizes[i], &offset);
+  }
+  ok = fclose(f) == 0 && ok;
+  if (ok && rename(temp_path, path) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    printf("ERROR: Cannot write %s.\n", path);
+    remove(temp_path);
+  }
+  return ok;
+}
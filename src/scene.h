@@ -0,0 +1,60 @@
+#pragma once
+#include "types.h"
+#include "bvh.h"
+#include "asset_io.h"
+
+#define SCENE_MAX_MATERIALS 256
+// Spheres past the end of the SoA arrays, so a full width SIMD load that
+// starts on the last sphere stays in bounds.
+#define SCENE_SOA_PADDING 16
+
+// Sphere centers and radii as separate 64 byte aligned arrays, in the same
+// order as spheres. Used by the CPU leaf test in cpu/spheres.c.
+typedef struct sphere_soa_t {
+  f32* center_x;
+  f32* center_y;
+  f32* center_z;
+  f32* radius;
+} sphere_soa_t;
+
+// A scene written out with bake_sphere_scene. Every array is stored the way
+// it sits in memory once the scene is finished, at a 64 byte aligned offset,
+// so loading one maps the file and points the scene into it.
+#define SCENE_BAKED_MAGIC 0x42535643u // "CVSB"
+#define SCENE_BAKED_VERSION 1
+#define SCENE_BAKED_ALIGNMENT 64
+
+typedef struct scene_baked_header_t {
+  u32 magic;
+  u32 version;
+  u32 sphere_count;
+  u32 material_count;
+  u32 node_count;
+  u32 leaf_count;
+  u32 max_depth;
+  u32 leaf_lanes;
+  u64 materials_offset;
+  u64 spheres_offset;
+  u64 sphere_materials_offset;
+  u64 soa_offset;
+  u64 nodes_offset;
+  u64 size;
+} scene_baked_header_t;
+
+// Spheres in BVH order. The arrays are laid out the way the shaders read
+// them, so the GPU side uploads them as is.
+typedef struct sphere_scene_t {
+  u32 sphere_count;
+  u32 sphere_capacity;
+  scene_sphere_t* spheres;
+  u32* sphere_materials;
+  sphere_soa_t soa;
+
+  u32 material_count;
+  vector_float4 materials[SCENE_MAX_MATERIALS]; // albedo in rgb
+
+  bvh_t bvh;
+
+  // Set when the arrays point into a mapped baked scene rather than the heap.
+  asset_view_t baked;
+} sphere_scene_t;
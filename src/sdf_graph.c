@@ -0,0 +1,262 @@
+#include "sdf_graph.h"
+
+//
+// Distance field scene graphs, and the compiler that flattens them into an
+// sdf_program_t for the interpreters in cpu/sdf_vm.c and
+// shaders/sdf_vm.metal.
+//
+
+static int sdf_add_node(sdf_graph_t* g, sdf_op_t op) {
+  assert(g->node_count < SDF_MAX_NODES);
+  int index = g->node_count++;
+  sdf_node_t* node = &g->nodes[index];
+  memset(node, 0, sizeof(*node));
+  node->op = op;
+  node->children[0] = -1;
+  node->children[1] = -1;
+  g->root = index;
+  return index;
+}
+
+static int sdf_add_primitive(sdf_graph_t* g, sdf_op_t op, f32 a, f32 b, f32 c, f32 d) {
+  int index = sdf_add_node(g, op);
+  f32* params = g->nodes[index].params;
+  params[0] = a;
+  params[1] = b;
+  params[2] = c;
+  params[3] = d;
+  return index;
+}
+
+static int sdf_add_box(sdf_graph_t* g, v3 half_extents) { return sdf_add_primitive(g, SDF_OP_BOX, half_extents.x, half_extents.y, half_extents.z, 0); }
+static int sdf_add_sphere(sdf_graph_t* g, f32 radius) { return sdf_add_primitive(g, SDF_OP_SPHERE, radius, 0, 0, 0); }
+static int sdf_add_tri_prism(sdf_graph_t* g, v2 h) { return sdf_add_primitive(g, SDF_OP_TRI_PRISM, h.x, h.y, 0, 0); }
+static int sdf_add_torus(sdf_graph_t* g, v2 t) { return sdf_add_primitive(g, SDF_OP_TORUS, t.x, t.y, 0, 0); }
+static int sdf_add_plane(sdf_graph_t* g, v3 n, f32 dist) { return sdf_add_primitive(g, SDF_OP_PLANE, n.x, n.y, n.z, dist); }
+
+static int sdf_add_operator(sdf_graph_t* g, sdf_op_t op, int a, int b, f32 k) {
+  assert(a >= 0 && a < g->node_count && b >= 0 && b < g->node_count);
+  int index = sdf_add_node(g, op);
+  sdf_node_t* node = &g->nodes[index];
+  node->children[0] = a;
+  node->children[1] = b;
+  node->params[0] = k;
+  return index;
+}
+
+static int sdf_add_join(sdf_graph_t* g, int a, int b) { return sdf_add_operator(g, SDF_OP_JOIN, a, b, 0); }
+static int sdf_add_subtract(sdf_graph_t* g, int a, int b) { return sdf_add_operator(g, SDF_OP_SUBTRACT, a, b, 0); }
+static int sdf_add_intersect(sdf_graph_t* g, int a, int b) { return sdf_add_operator(g, SDF_OP_INTERSECT, a, b, 0); }
+static int sdf_add_smin(sdf_graph_t* g, int a, int b, f32 k) { return sdf_add_operator(g, SDF_OP_SMIN, a, b, k); }
+
+static int sdf_add_transform(sdf_graph_t* g, int child, v3 translation, v3 axis, f32 angle, f32 scale) {
+  assert(child >= 0 && child < g->node_count && scale > 0);
+  int index = sdf_add_node(g, SDF_OP_TRANSFORM);
+  sdf_node_t* node = &g->nodes[index];
+  node->children[0] = child;
+  node->translation = translation;
+  node->axis = unit3(axis);
+  node->angle = angle;
+  node->scale = scale;
+  return index;
+}
+
+static int sdf_add_translate(sdf_graph_t* g, int child, v3 translation) {
+  return sdf_add_transform(g, child, translation, v3_up, 0, 1);
+}
+
+// count stood up tori around the y axis, each one a bit smaller than the
+// last, smoothly joined and stood on a box.
+static int sdf_add_rings(sdf_graph_t* g, int count, f32 shrink) {
+  int rings = -1;
+  for (int i=0; i < count; i++) {
+    f32 angle = (f32)i * (f32)M_PI / (f32)count;
+    int ring = sdf_add_transform(g, sdf_add_torus(g, V2(1.0f, 0.15f)),
+      V3(0,1.5f,0), V3(cosf(angle), 0, sinf(angle)), (f32)M_PI*0.5f, 1.0f - shrink*(f32)i);
+    rings = rings < 0 ? ring : sdf_add_smin(g, rings, ring, 0.2f);
+  }
+  int base = sdf_add_transform(g, sdf_add_box(g, V3(1,0.25f,1)), V3(0,0.25f,0), v3_up, (f32)M_PI*0.25f, 1.0f);
+  return sdf_add_join(g, base, rings);
+}
+
+static void sdf_build_preset(sdf_graph_t* g, sdf_preset_t preset) {
+  memset(g, 0, sizeof(*g));
+  switch (preset) {
+    case SDF_PRESET_BOX: {
+      sdf_add_translate(g, sdf_add_box(g, V3(1,1,1)), V3(0,1,0));
+    } break;
+    case SDF_PRESET_ROUNDED_BOX: {
+      int box = sdf_add_box(g, V3(1,1,1));
+      int sphere = sdf_add_sphere(g, 1.2f);
+      sdf_add_intersect(g, box, sphere);
+    } break;
+    case SDF_PRESET_PILLAR: {
+      int box = sdf_add_box(g, V3(1,2,1));
+      int sphere = sdf_add_translate(g, sdf_add_sphere(g, 0.3f), V3(0,2.5f,0));
+      int plane = sdf_add_plane(g, V3(0,1,0), 0.5f);
+      sdf_add_smin(g, plane, sdf_add_join(g, box, sphere), 1.5f);
+    } break;
+    case SDF_PRESET_PRISM: {
+      sdf_add_translate(g, sdf_add_tri_prism(g, V2(2,1)), V3(0,1,0));
+    } break;
+    case SDF_PRESET_CARVED_PRISM: {
+      int prism = sdf_add_tri_prism(g, V2(1,1));
+      int sphere = sdf_add_translate(g, sdf_add_sphere(g, 0.5f), V3(0,1,0));
+      sdf_add_subtract(g, sphere, prism);
+    } break;
+    case SDF_PRESET_RINGS: {
+      sdf_add_rings(g, 3, 0.15f);
+    } break;
+    case SDF_PRESET_RING_STACK: {
+      sdf_add_rings(g, 12, 0.05f);
+    } break;
+    default: break;
+  }
+}
+
+//
+// Compiler
+//
+
+typedef struct sdf_compiler_t {
+  const sdf_graph_t* graph;
+  sdf_program_t* program;
+  int point_count;
+  int dist_count;
+  bool ok;
+} sdf_compiler_t;
+
+// Distance registers needed to evaluate node, evaluating the hungrier child
+// of every operator first (Sethi-Ullman).
+static int sdf_registers_needed(const sdf_graph_t* g, int index) {
+  const sdf_node_t* node = &g->nodes[index];
+  if (node->op == SDF_OP_TRANSFORM) {
+    return sdf_registers_needed(g, node->children[0]);
+  }
+  if (node->children[0] < 0) {
+    return 1;
+  }
+  int a = sdf_registers_needed(g, node->children[0]);
+  int b = sdf_registers_needed(g, node->children[1]);
+  return a == b ? a + 1 : (a > b ? a : b);
+}
+
+static void sdf_emit(sdf_compiler_t* c, sdf_op_t op, int dst, int a, int b, const f32* constants, int constant_count) {
+  sdf_program_t* prog = c->program;
+  if (prog->instruction_count == SDF_MAX_INSTRUCTIONS || prog->constant_count + constant_count > SDF_MAX_CONSTANTS) {
+    if (c->ok) printf("ERROR: sdf program is over %d instructions or %d constants.\n", SDF_MAX_INSTRUCTIONS, SDF_MAX_CONSTANTS);
+    c->ok = false;
+    return;
+  }
+  sdf_instr_t* instr = &prog->instructions[prog->instruction_count++];
+  instr->op = (uint8_t)op;
+  instr->dst = (uint8_t)dst;
+  instr->a = (uint8_t)a;
+  instr->b = (uint8_t)b;
+  instr->constants = prog->constant_count;
+  for (int i=0; i < constant_count; i++) {
+    prog->constants[prog->constant_count++] = constants[i];
+  }
+}
+
+static int sdf_alloc_register(sdf_compiler_t* c, int* count, int capacity, const char* kind) {
+  if (*count == capacity) {
+    if (c->ok) printf("ERROR: sdf program needs more than %d %s registers.\n", capacity, kind);
+    c->ok = false;
+    return capacity-1;
+  }
+  return (*count)++;
+}
+
+// Emits code that leaves the distance to node, sampled at p[point] - offset,
+// in the returned distance register. Translations are folded into offset
+// until something other than a primitive needs the point.
+static int sdf_compile_node(sdf_compiler_t* c, int index, int point, v3 offset) {
+  const sdf_node_t* node = &c->graph->nodes[index];
+  switch (node->op) {
+    case SDF_OP_BOX:
+    case SDF_OP_SPHERE:
+    case SDF_OP_TRI_PRISM:
+    case SDF_OP_TORUS:
+    case SDF_OP_PLANE: {
+      int dst = sdf_alloc_register(c, &c->dist_count, SDF_DIST_REGISTERS, "distance");
+      f32 k[7] = {offset.x, offset.y, offset.z, node->params[0], node->params[1], node->params[2], node->params[3]};
+      int count = node->op == SDF_OP_SPHERE ? 4 : (node->op == SDF_OP_BOX ? 6 : (node->op == SDF_OP_PLANE ? 7 : 5));
+      sdf_emit(c, node->op, dst, point, 0, k, count);
+      return dst;
+    }
+
+    case SDF_OP_JOIN:
+    case SDF_OP_SUBTRACT:
+    case SDF_OP_INTERSECT:
+    case SDF_OP_SMIN: {
+      int left = node->children[0];
+      int right = node->children[1];
+      int a, b;
+      if (sdf_registers_needed(c->graph, right) > sdf_registers_needed(c->graph, left)) {
+        b = sdf_compile_node(c, right, point, offset);
+        a = sdf_compile_node(c, left, point, offset);
+      } else {
+        a = sdf_compile_node(c, left, point, offset);
+        b = sdf_compile_node(c, right, point, offset);
+      }
+      int dst = a < b ? a : b;
+      sdf_emit(c, node->op, dst, a, b, node->params, node->op == SDF_OP_SMIN ? 1 : 0);
+      c->dist_count--;
+      return dst;
+    }
+
+    case SDF_OP_TRANSFORM: {
+      offset = add3(offset, node->translation);
+      if (node->angle == 0 && node->scale == 1) {
+        return sdf_compile_node(c, node->children[0], point, offset);
+      }
+
+      // Child space is the inverse: unscale(unrotate(p - offset)).
+      v3 k = node->axis;
+      f32 cs = cosf(-node->angle);
+      f32 sn = sinf(-node->angle);
+      f32 t = 1.0f - cs;
+      f32 inv_s = 1.0f / node->scale;
+      f32 m[12] = {
+        offset.x, offset.y, offset.z,
+        (cs + t*k.x*k.x)*inv_s,      (t*k.x*k.y - sn*k.z)*inv_s, (t*k.x*k.z + sn*k.y)*inv_s,
+        (t*k.x*k.y + sn*k.z)*inv_s,  (cs + t*k.y*k.y)*inv_s,     (t*k.y*k.z - sn*k.x)*inv_s,
+        (t*k.x*k.z - sn*k.y)*inv_s,  (t*k.y*k.z + sn*k.x)*inv_s, (cs + t*k.z*k.z)*inv_s,
+      };
+      int child_point = sdf_alloc_register(c, &c->point_count, SDF_POINT_REGISTERS, "point");
+      sdf_emit(c, SDF_OP_TRANSFORM, child_point, point, 0, m, 12);
+      int dst = sdf_compile_node(c, node->children[0], child_point, v3_zero);
+      c->point_count--;
+      if (node->scale != 1) {
+        sdf_emit(c, SDF_OP_SCALE, dst, dst, 0, &node->scale, 1);
+      }
+      return dst;
+    }
+
+    default:
+      if (c->ok) printf("ERROR: bad sdf node %d.\n", index);
+      c->ok = false;
+      return 0;
+  }
+}
+
+// Flattens the graph under g->root into prog. The result lands in d0.
+static bool compile_sdf_graph(const sdf_graph_t* g, sdf_program_t* prog) {
+  memset(prog, 0, sizeof(*prog));
+  if (g->node_count == 0) {
+    printf("ERROR: empty sdf graph.\n");
+    return false;
+  }
+
+  sdf_compiler_t c = {0};
+  c.graph = g;
+  c.program = prog;
+  c.point_count = 1; // p0 is the sample position
+  c.ok = true;
+  sdf_compile_node(&c, g->root, 0, v3_zero);
+  if (!c.ok) {
+    memset(prog, 0, sizeof(*prog));
+  }
+  return c.ok;
+}
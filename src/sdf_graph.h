@@ -0,0 +1,48 @@
+#pragma once
+#include "types.h"
+
+#define SDF_MAX_NODES 128
+
+// A node is a primitive, an operator over two children, or a transform of
+// one child. Nodes only ever point at nodes added before them.
+typedef struct sdf_node_t {
+  sdf_op_t op;
+  int children[2];
+  f32 params[4];
+
+  // SDF_OP_TRANSFORM: the child is scaled, then rotated by angle radians
+  // around axis, then moved by translation.
+  v3 translation;
+  v3 axis;
+  f32 angle;
+  f32 scale;
+} sdf_node_t;
+
+typedef struct sdf_graph_t {
+  sdf_node_t nodes[SDF_MAX_NODES];
+  int node_count;
+  int root;
+} sdf_graph_t;
+
+// The scenes ray_marcher.metal used to pick between with SCENE_INDEX, plus
+// two that need transforms. ring_stack is the expensive one.
+typedef enum sdf_preset_t {
+  SDF_PRESET_BOX,
+  SDF_PRESET_ROUNDED_BOX,
+  SDF_PRESET_PILLAR,
+  SDF_PRESET_PRISM,
+  SDF_PRESET_CARVED_PRISM,
+  SDF_PRESET_RINGS,
+  SDF_PRESET_RING_STACK,
+  SDF_PRESET_COUNT,
+} sdf_preset_t;
+
+static const char* sdf_preset_names[SDF_PRESET_COUNT] = {
+  "box",
+  "rounded_box",
+  "pillar",
+  "prism",
+  "carved_prism",
+  "rings",
+  "ring_stack",
+};
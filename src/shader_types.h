@@ -11,12 +11,90 @@ typedef struct render_camera_t {
 typedef struct fs_params_t {
   render_camera_t camera;
   uint32_t frame_count;
+  // The offscreen buffer sums frames, so write linear samples with their
+  // count in alpha rather than a finished color. Only path_tracer.metal
+  // reads it.
+  uint32_t accumulate;
   vector_float2 viewport_size;
   debug_params_t debug_params;
 } fs_params_t;
 
+//
+// Distance field programs, see sdf_graph.c
+//
+
+// Point registers hold positions, distance registers hold distances. p0 is
+// the sample position and d0 ends up with the result.
+#define SDF_POINT_REGISTERS 8
+#define SDF_DIST_REGISTERS 8
+#define SDF_MAX_INSTRUCTIONS 128
+#define SDF_MAX_CONSTANTS 512
+
+typedef enum sdf_op_t {
+  // d[dst] = primitive(p[a] - offset, params), constants: offset.xyz then
+  // params. Translations are folded into offset, so they have no op.
+  SDF_OP_BOX,       // half extents xyz
+  SDF_OP_SPHERE,    // radius
+  SDF_OP_TRI_PRISM, // h.xy
+  SDF_OP_TORUS,     // t.xy
+  SDF_OP_PLANE,     // normal xyz, dist
+  // d[dst] = op(d[a], d[b])
+  SDF_OP_JOIN,
+  SDF_OP_SUBTRACT,
+  SDF_OP_INTERSECT,
+  SDF_OP_SMIN,      // k
+  // p[dst] = m * (p[a] - offset), constants: offset.xyz then the 3x3 rows
+  SDF_OP_TRANSFORM,
+  // d[dst] = d[a] * scale
+  SDF_OP_SCALE,
+  SDF_OP_COUNT,
+} sdf_op_t;
+
+typedef struct sdf_instr_t {
+  uint8_t op;
+  uint8_t dst;
+  uint8_t a;
+  uint8_t b;
+  uint32_t constants; // index of the first constant
+} sdf_instr_t;
+
+// Small enough to go through setFragmentBytes.
+typedef struct sdf_program_t {
+  uint32_t instruction_count;
+  uint32_t constant_count;
+  sdf_instr_t instructions[SDF_MAX_INSTRUCTIONS];
+  float constants[SDF_MAX_CONSTANTS];
+} sdf_program_t;
+
+//
+// Sphere scenes, see scene.c and bvh.c
+//
+
+typedef struct scene_sphere_t {
+  float center[3];
+  float radius;
+} scene_sphere_t;
+
+// 32 bytes, stored depth first so an interior node's left child is the next
+// node. Interior nodes have count == 0 and offset is the right child, leaves
+// cover spheres [offset, offset+count).
+typedef struct bvh_node_t {
+  float bounds_min[3];
+  uint32_t offset;
+  float bounds_max[3];
+  uint32_t count;
+} bvh_node_t;
+
+typedef struct scene_params_t {
+  uint32_t sphere_count;
+  uint32_t node_count;
+} scene_params_t;
+
 typedef struct dr_params_t {
   vector_float2 osb_to_rt_ratio;
+  // The offscreen buffer holds a sum of linear samples, with the sample
+  // count in alpha. Average and encode to sRGB when resolving.
+  uint32_t resolve_accumulated;
 } dr_params_t;
 
 typedef struct ui_vs_params_t {
@@ -28,8 +106,11 @@ typedef struct render_rect_t {
   vector_float2 size;
 } render_rect_t;
 
-typedef struct render_vert_t {
-  vector_float2 position;
-  vector_float4 color; // TODO: store this in a more clever way
-} render_vert_t;
+// One UI rect, drawn as an instanced quad. Plain floats so the layout is the
+// same 20 bytes on both sides.
+typedef struct ui_rect_t {
+  float x, y; // top left, in window pixels
+  float w, h;
+  uint32_t color; // RGBA8, r in the low byte
+} ui_rect_t;
 
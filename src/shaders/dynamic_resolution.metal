@@ -9,6 +9,11 @@ typedef struct screen_vert_t {
   float2 uv;
 } screen_vert_t;
 
+static float3 dr_linear_to_srgb(float3 rgb) {
+  rgb = max(rgb, float3(0,0,0));
+  return max(1.055 * pow(rgb, 0.416666667) - 0.055, 0.0);
+}
+
 // Full screen triangle
 // Shamelessly taken from https://github.com/aras-p/ToyPathTracer
 vertex screen_vert_t dr_vs_main(ushort vid [[vertex_id]]) {
@@ -26,6 +31,10 @@ fragment float4 dr_fs_main(screen_vert_t i [[stage_in]],
   float u = ratio.x * i.uv.x;
   float v = -ratio.y * (i.uv.y - 1.0);
   constexpr sampler smp(mip_filter::none, mag_filter::nearest, min_filter::nearest);
-  return float4(tex.sample(smp, float2(u, v)).rgb, 1);
+  float4 c = tex.sample(smp, float2(u, v));
+  if (rp.resolve_accumulated) {
+    return float4(dr_linear_to_srgb(c.rgb / max(c.a, 1.0)), 1);
+  }
+  return float4(c.rgb, 1);
 }
 
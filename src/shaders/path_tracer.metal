@@ -4,6 +4,7 @@ using namespace metal;
 
 #include "../shader_types.h"
 #include "common.metal"
+#include "scene.metal"
 
 typedef struct ray_t {
   float3 o;
@@ -15,113 +16,110 @@ typedef struct screen_vert_t {
   float2 uv;
 } screen_vert_t;
 
-typedef struct sphere_t {
-  float3 p;
-  float r;
-} sphere_t;
-
-typedef struct hit_t {
-  float3 p;
-  float3 n;
-  float t;
-} hit_t;
-
-constant int sphere_count = 4;
-constant sphere_t spheres[] = {
-  {float3(-1,0.5,1), 0.5},
-  {float3(1,1,1), 1.0},
-  {float3(0,0.25,-0.5), 0.25},
-  {float3(0,-1000,0), 1000.0},
-};
-constant float3 sphere_colors[] = {
-  float3(1.0, 0.3, 0.1),
-  float3(0.9),
-  float3(0.2, 0.2, 1.0),
-  float3(0.5),
-};
-
-#define SAMPLES_PER_PIXEL 10
-constant int MAX_BOUNCES = 5;
-constant float SPP_MOD = 1.0 / float(SAMPLES_PER_PIXEL);
-
-float3 point_on_ray(float3 ro, float3 rd, float t) {
-  return ro + t*rd;
+// Samples are summed over frames in the offscreen buffer and averaged when
+// resolving (see PROGRESSIVE_ACCUMULATION in main.m), so one per frame is
+// enough while the camera holds still.
+#define SAMPLES_PER_PIXEL 1
+// Paths end by Russian roulette, this is only a backstop.
+constant int MAX_DEPTH = 32;
+constant int RR_MIN_BOUNCES = 3;
+constant float RR_MAX_SURVIVAL = 0.95;
+
+// The sun, a small bright disk in the direction of ray_tracer.metal's light.
+constant float SUN_COS_ANGLE = 0.99875026; // cos(0.05 radians)
+constant float SUN_PDF = 1.0 / (2.0*M_PI_F*(1.0 - SUN_COS_ANGLE));
+constant float SUN_IRRADIANCE = 2.0;
+constant float SUN_RADIANCE = SUN_IRRADIANCE * SUN_PDF;
+
+// Duff et al., "Building an Orthonormal Basis, Revisited".
+static inline void basis(float3 n, thread float3& t, thread float3& b) {
+  float sign = copysign(1.0f, n.z);
+  float a = -1.0f / (sign + n.z);
+  float c = n.x * n.y * a;
+  t = float3(1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x);
+  b = float3(c, sign + n.y * n.y * a, -n.y);
 }
 
-int test_scene(float3 ro, float3 rd, thread hit_t& hit) {
-  float closest_t = MAXFLOAT;
-  float min_t = 0.001f;
-  int hit_index = -1;
-
-  for (int i=0; i<sphere_count; i++) {
-    constant const sphere_t& s = spheres[i];
-    float3 rel = ro - s.p;
-    float b = dot(rel, rd);
-    float c = dot(rel, rel) - s.r*s.r;
-    float d = b*b - c;
-    if (d > 0) {
-      float sqrd = sqrt(d);
-      float t = (-b - sqrd);
-      if (t <= min_t) {
-        t = (-b + sqrd);
-      }
-      if (t > min_t && t<closest_t) {
-        hit_index = i;
-        closest_t = t;
-      }
-    }
-  }
-
-  if (hit_index != -1) {
-    float3 p = point_on_ray(ro, rd, closest_t);
-    float3 n = normalize(p - spheres[hit_index].p);
+// Direction around axis at cos_theta from it, phi = 2 pi u.
+static inline float3 direction_around(float3 axis, float cos_theta, float u) {
+  float3 t, b;
+  basis(axis, t, b);
+  float sin_theta = sqrt(max(0.0f, 1.0f - cos_theta*cos_theta));
+  float phi = 2.0f * M_PI_F * u;
+  return t*(sin_theta*cos(phi)) + b*(sin_theta*sin(phi)) + axis*cos_theta;
+}
 
-    hit.t = closest_t;
-    hit.p = p;
-    hit.n = n;
-  }
+// Lambertian scattering, pdf cos / pi, so the weight is just the albedo.
+static inline float3 sample_cosine(float3 n, thread uint32_t& rng) {
+  float u1 = randf(rng);
+  float u2 = randf(rng);
+  return direction_around(n, sqrt(1.0f - u1), u2);
+}
 
-  return hit_index;
+// Uniform over the sun's disk, pdf SUN_PDF.
+static inline float3 sample_sun(thread uint32_t& rng) {
+  float u1 = randf(rng);
+  float u2 = randf(rng);
+  return direction_around(normalize(float3(2.0, 5.0, 3.0)), 1.0f - u1*(1.0f - SUN_COS_ANGLE), u2);
 }
 
-static inline bool lambertian(int id, thread hit_t& hit, thread float3& attenuation, thread ray_t& scattered, thread uint32_t& rng) {
-  float3 target = hit.p + hit.n + rand_unit3(rng);
-  scattered.o = hit.p;
-  scattered.d = normalize(target - hit.p);
-  attenuation = sphere_colors[id];
-  return true;
+static inline float power_heuristic(float pdf, float other_pdf) {
+  return pdf*pdf / (pdf*pdf + other_pdf*other_pdf);
 }
 
-float3 render(float3 _ro, float3 _rd, thread uint32_t& rng) {
+float3 render(scene_t scene, float3 _ro, float3 _rd, thread uint32_t& rng) {
   float3 color(0);
-  float3 total_attenuation(1);
+  float3 throughput(1);
+  float3 sun = normalize(float3(2.0, 5.0, 3.0));
+  // Of the direction rd was scattered in, 0 for the camera ray.
+  float bsdf_pdf = 0;
 
   float3 ro = _ro;
   float3 rd = _rd;
 
-  for (int b=0; b < MAX_BOUNCES; b++) {
+  for (int b=0; b < MAX_DEPTH; b++) {
     hit_t hit;
-    int id = test_scene(ro, rd, hit);
-    if (id != -1) {
-      ray_t scattered;
-      float3 attenuation;
-
-      lambertian(id, hit, attenuation, scattered, rng);
-
-      // NOTE: only add to color if the surface is lit, and we don't currently have lights
-      // color += total_attenuation;
-
-      total_attenuation *= attenuation;
-
-      ro = scattered.o;
-      rd = scattered.d;
-    } else {
+    int id = test_scene(scene, ro, rd, hit);
+    if (id == -1) {
       // Skybox
       float t = 0.5*(rd.y + 1.0);
       float3 sky_color = (1.0-t)*float3(1) + t*float3(0.5, 0.7, 1.0);
-      color += total_attenuation * sky_color;
+      if (dot(rd, sun) >= SUN_COS_ANGLE) {
+        // Light sampling could have found this too, unless it's the camera ray.
+        float w = bsdf_pdf > 0 ? power_heuristic(bsdf_pdf, SUN_PDF) : 1.0;
+        sky_color += SUN_RADIANCE * w;
+      }
+      color += throughput * sky_color;
       break;
     }
+
+    float3 albedo = sphere_albedo(scene, id);
+
+    // Next event estimation, a shadow ray to a point on the sun.
+    float3 ld = sample_sun(rng);
+    float cos_l = dot(hit.n, ld);
+    if (cos_l > 0) {
+      hit_t shadow_hit;
+      if (test_scene(scene, hit.p, ld, shadow_hit) == -1) {
+        float bsdf = cos_l * M_1_PI_F;
+        // The last bounce traces no BSDF ray to share the sun with.
+        float w = b < MAX_DEPTH-1 ? power_heuristic(SUN_PDF, bsdf) : 1.0;
+        color += throughput * albedo * (bsdf * SUN_RADIANCE * w / SUN_PDF);
+      }
+    }
+
+    ro = hit.p;
+    rd = sample_cosine(hit.n, rng);
+    bsdf_pdf = max(dot(hit.n, rd), 0.0f) * M_1_PI_F;
+    throughput *= albedo;
+
+    if (b >= RR_MIN_BOUNCES) {
+      float survival = min(max(throughput.x, max(throughput.y, throughput.z)), RR_MAX_SURVIVAL);
+      if (randf(rng) >= survival) {
+        break;
+      }
+      throughput /= survival;
+    }
   }
 
   return color;
@@ -143,7 +141,14 @@ vertex screen_vert_t screen_vs_main(ushort vid [[vertex_id]]) {
   return o;
 }
 
-fragment float4 screen_fs_main(screen_vert_t i [[stage_in]], constant fs_params_t &rp [[buffer(0)]]) {
+fragment float4 screen_fs_main(screen_vert_t i [[stage_in]],
+                               constant fs_params_t &rp [[buffer(0)]],
+                               constant scene_params_t &sp [[buffer(1)]],
+                               device const scene_sphere_t* spheres [[buffer(2)]],
+                               device const uint32_t* sphere_materials [[buffer(3)]],
+                               device const float4* materials [[buffer(4)]],
+                               device const bvh_node_t* nodes [[buffer(5)]]) {
+  scene_t scene = {spheres, sphere_materials, materials, nodes, sp.node_count};
   render_camera_t camera = rp.camera;
 
   float3 color(0);
@@ -153,10 +158,6 @@ fragment float4 screen_fs_main(screen_vert_t i [[stage_in]], constant fs_params_
   uint32_t iy = (uint32_t)i.pos.y;
   uint rng = wang_hash(((ix*1973) + (iy*9277) + ((rp.frame_count)*26699))|1);
 
-#if SAMPLES_PER_PIXEL == 1
-  ray_t ray = ray_from_camera(camera, i.uv.x, i.uv.y);
-  color = render(ray.o, normalize(ray.d), rng);
-#else
   // normalized pixel size
   float psx = 1/float(rp.viewport_size.x);
   float psy = 1/float(rp.viewport_size.y);
@@ -166,10 +167,14 @@ fragment float4 screen_fs_main(screen_vert_t i [[stage_in]], constant fs_params_
     float v = (i.uv.y + (randf(rng)*psy));
 
     ray_t ray = ray_from_camera(camera, u, v);
-    color += render(ray.o, normalize(ray.d), rng);
+    color += render(scene, ray.o, normalize(ray.d), rng);
+  }
+
+  // Linear sum of this frame's samples, alpha counts them. The resolve in
+  // dynamic_resolution.metal averages and encodes to sRGB.
+  if (rp.accumulate) {
+    return float4(color, float(SAMPLES_PER_PIXEL));
   }
-  color *= SPP_MOD;
-#endif
-  return float4(linear_to_srgb(color), 1);
+  return float4(linear_to_srgb(color / float(SAMPLES_PER_PIXEL)), 1);
 }
 
@@ -19,6 +19,9 @@ constant float MIN_DIST = 1.0;
 constant float MAX_DIST = 40.0;
 constant float3 LIGHT_POSITION = float3(2.0, 5.0, 3.0);
 
+// Scenes come from the sdf_program_t bound at buffer 6. Set USE_SDF_PROGRAM
+// to 0 to use the hand written scene SCENE_INDEX instead.
+#define USE_SDF_PROGRAM 1
 #define SCENE_INDEX 4
 #define RENDER_NORMALS 0
 #define ENABLE_SHADOWS 1
@@ -116,8 +119,12 @@ float3 mod(float3 x, float y) {
   return x - y * floor(x/y);
 }
 
-float scene(float3 p) {
-#if SCENE_INDEX == 0
+#include "sdf_vm.metal"
+
+float scene(constant sdf_program_t& prog, float3 p) {
+#if USE_SDF_PROGRAM
+  return sdf_eval(prog, p);
+#elif SCENE_INDEX == 0
   float box = sd_box(p-float3(0,1,0), float3(1,1,1));
   return box;
 #elif SCENE_INDEX == 1
@@ -141,17 +148,17 @@ float scene(float3 p) {
 #endif
 }
 
-float3 calc_normal(float3 p) {
+float3 calc_normal(constant sdf_program_t& prog, float3 p) {
   float2 e = float2(1.0,-1.0)*0.5773*0.0005;
-  return normalize(e.xyy*scene(p + e.xyy) + 
-                   e.yyx*scene(p + e.yyx) + 
-                   e.yxy*scene(p + e.yxy) + 
-                   e.xxx*scene(p + e.xxx));
+  return normalize(e.xyy*scene(prog, p + e.xyy) + 
+                   e.yyx*scene(prog, p + e.yyx) + 
+                   e.yxy*scene(prog, p + e.yxy) + 
+                   e.xxx*scene(prog, p + e.xxx));
 }
 
-float calc_hard_shadow(float3 ro, float3 rd, float tmin, float tmax) {
+float calc_hard_shadow(constant sdf_program_t& prog, float3 ro, float3 rd, float tmin, float tmax) {
   for (float t=tmin; t<tmax;) {
-    float h = scene(ro + rd*t);
+    float h = scene(prog, ro + rd*t);
     if (h<0.001) {
       return 0.0;
     }
@@ -161,13 +168,13 @@ float calc_hard_shadow(float3 ro, float3 rd, float tmin, float tmax) {
 }
 
 // https://www.shadertoy.com/view/lsKcDD
-float calc_soft_shadow(float3 ro, float3 rd, float tmin, float tmax) {
+float calc_soft_shadow(constant sdf_program_t& prog, float3 ro, float3 rd, float tmin, float tmax) {
 	float r = 1.0;
   float t = tmin;
   float ph = 1e10; // big, such that y = 0 on the first iteration
 
   for (int i=0; i<32; i++) {
-    float h = scene(ro + rd*t);
+    float h = scene(prog, ro + rd*t);
 
     // Two techniques for soft shadows.
     // http://www.iquilezles.org/www/articles/rmshadows/rmshadows.htm
@@ -185,14 +192,14 @@ float calc_soft_shadow(float3 ro, float3 rd, float tmin, float tmax) {
   return clamp(r, 0.0, 1.0);
 }
 
-float cast_ray(float3 ro, float3 rd) {
+float cast_ray(constant sdf_program_t& prog, float3 ro, float3 rd) {
   float tmin = MIN_DIST;
   float tmax = MAX_DIST;
 
   float t = tmin;
   for (int i=0; i<MAX_STEPS; i++) {
     float precis = 0.0005*t;
-    float res = scene(ro+rd*t);
+    float res = scene(prog, ro+rd*t);
     if (res<precis || t>tmax) break;
     t += res;
   }
@@ -201,9 +208,9 @@ float cast_ray(float3 ro, float3 rd) {
   return t;
 }
 
-float3 render(float3 ro, float3 rd, render_camera_t camera, debug_params_t debug_params) {
+float3 render(constant sdf_program_t& prog, float3 ro, float3 rd, render_camera_t camera, debug_params_t debug_params) {
   float3 color = float3(0);
-  float t = cast_ray(ro, rd);
+  float t = cast_ray(prog, ro, rd);
   float3 p = ro + t*rd;
 
 #if ENABLE_DF_PLANE == 1
@@ -213,23 +220,23 @@ float3 render(float3 ro, float3 rd, render_camera_t camera, debug_params_t debug
     if (rd.y < 0.0) {
       ray_length = (ro.y-df_plane_y)/-rd.y;
     }
-    float dist = scene(ro+rd*ray_length);
+    float dist = scene(prog, ro+rd*ray_length);
     float3 field_color = distance_meter(dist, ray_length, rd, camera.position.y-df_plane_y);
     return field_color;
   }
 #endif
 
   if (t>-0.5) {
-    float3 n = calc_normal(p);
+    float3 n = calc_normal(prog, p);
     
     // light
     float3 light = normalize(LIGHT_POSITION);
 #if ENABLE_SHADOWS
-    float shadow = calc_hard_shadow(p, light, 0.01, 3.0);
+    float shadow = calc_hard_shadow(prog, p, light, 0.01, 3.0);
 #else
     float shadow = 1;
 #endif
-    // float shadow = calc_soft_shadow(p, light, 0.01, 3.0);
+    // float shadow = calc_soft_shadow(prog, p, light, 0.01, 3.0);
 #if RENDER_NORMALS
     color = (n * 0.5 + 0.5) * shadow;
 #else
@@ -261,11 +268,12 @@ vertex screen_vert_t screen_vs_main(ushort vid [[vertex_id]]) {
   return o;
 }
 
-fragment float4 screen_fs_main(screen_vert_t i [[stage_in]], constant fs_params_t &rp [[buffer(0)]]) {
+fragment float4 screen_fs_main(screen_vert_t i [[stage_in]], constant fs_params_t &rp [[buffer(0)]],
+                               constant sdf_program_t &prog [[buffer(6)]]) {
   render_camera_t camera = rp.camera;
   ray_t ray = ray_from_camera(camera, i.uv.x, i.uv.y);
 
-  float3 color = render(ray.o, normalize(ray.d), camera, rp.debug_params);
+  float3 color = render(prog, ray.o, normalize(ray.d), camera, rp.debug_params);
   return float4(color, 1);
 }
 
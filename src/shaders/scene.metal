@@ -0,0 +1,118 @@
+// Sphere scene shared by path_tracer.metal and ray_tracer.metal. The buffers
+// come from a sphere_scene_t on the CPU, see scene.c and bvh.c.
+
+#define BVH_STACK_SIZE 64
+
+typedef struct hit_t {
+  float3 p;
+  float3 n;
+  float t;
+} hit_t;
+
+typedef struct scene_t {
+  device const scene_sphere_t* spheres;
+  device const uint32_t* sphere_materials;
+  device const float4* materials;
+  device const bvh_node_t* nodes;
+  uint32_t node_count;
+} scene_t;
+
+float3 point_on_ray(float3 ro, float3 rd, float t) {
+  return ro + t*rd;
+}
+
+// Distance to where the ray enters the box, MAXFLOAT when it misses it or the
+// box is past max_t.
+static inline float intersect_node(device const bvh_node_t& node, float3 ro, float3 inv_rd, float max_t) {
+  float3 bmin = float3(node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]);
+  float3 bmax = float3(node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]);
+  float3 t0 = (bmin - ro) * inv_rd;
+  float3 t1 = (bmax - ro) * inv_rd;
+  float3 tsmall = min(t0, t1);
+  float3 tbig = max(t0, t1);
+  float t_near = max(max(tsmall.x, tsmall.y), tsmall.z);
+  float t_far = min(min(tbig.x, tbig.y), tbig.z);
+  if (t_far < max(t_near, 0.0f) || t_near >= max_t) {
+    return MAXFLOAT;
+  }
+  return t_near;
+}
+
+// Returns the index of the closest sphere hit, or -1.
+int test_scene(scene_t scene, float3 ro, float3 rd, thread hit_t& hit) {
+  float closest_t = MAXFLOAT;
+  float min_t = 0.001f;
+  int hit_index = -1;
+
+  if (scene.node_count == 0) {
+    return -1;
+  }
+
+  float3 inv_rd = 1.0f / rd;
+  uint32_t stack[BVH_STACK_SIZE];
+  int stack_size = 0;
+  uint32_t index = 0;
+  if (intersect_node(scene.nodes[0], ro, inv_rd, closest_t) == MAXFLOAT) {
+    return -1;
+  }
+
+  for (;;) {
+    device const bvh_node_t& node = scene.nodes[index];
+    if (node.count) {
+      for (uint32_t i=node.offset; i < node.offset + node.count; i++) {
+        device const scene_sphere_t& s = scene.spheres[i];
+        float3 rel = ro - float3(s.center[0], s.center[1], s.center[2]);
+        float b = dot(rel, rd);
+        float c = dot(rel, rel) - s.radius*s.radius;
+        float d = b*b - c;
+        if (d > 0) {
+          float sqrd = sqrt(d);
+          float t = (-b - sqrd);
+          if (t <= min_t) {
+            t = (-b + sqrd);
+          }
+          if (t > min_t && t<closest_t) {
+            hit_index = int(i);
+            closest_t = t;
+          }
+        }
+      }
+    } else {
+      // Visit the nearer child first and come back for the other one.
+      uint32_t left = index + 1;
+      uint32_t right = node.offset;
+      float t_left = intersect_node(scene.nodes[left], ro, inv_rd, closest_t);
+      float t_right = intersect_node(scene.nodes[right], ro, inv_rd, closest_t);
+      if (t_left != MAXFLOAT && t_right != MAXFLOAT) {
+        bool left_first = t_left <= t_right;
+        stack[stack_size++] = left_first ? right : left;
+        index = left_first ? left : right;
+        continue;
+      } else if (t_left != MAXFLOAT) {
+        index = left;
+        continue;
+      } else if (t_right != MAXFLOAT) {
+        index = right;
+        continue;
+      }
+    }
+    if (stack_size == 0) break;
+    index = stack[--stack_size];
+  }
+
+  if (hit_index != -1) {
+    device const scene_sphere_t& s = scene.spheres[hit_index];
+    float3 p = point_on_ray(ro, rd, closest_t);
+    float3 n = normalize(p - float3(s.center[0], s.center[1], s.center[2]));
+
+    hit.t = closest_t;
+    hit.p = p;
+    hit.n = n;
+  }
+
+  return hit_index;
+}
+
+float3 sphere_albedo(scene_t scene, int id) {
+  return scene.materials[scene.sphere_materials[id]].rgb;
+}
@@ -0,0 +1,50 @@
+// Interpreter for sdf_program_t, the GPU twin of cpu/sdf_vm.c. Included by
+// ray_marcher.metal after the primitives it calls.
+
+float3 sdf_offset(constant float* k) {
+  return float3(k[0], k[1], k[2]);
+}
+
+float sdf_eval(constant sdf_program_t& prog, float3 p) {
+  float3 pr[SDF_POINT_REGISTERS];
+  float dr[SDF_DIST_REGISTERS];
+  pr[0] = p;
+  dr[0] = INFINITY;
+
+  for (uint i=0; i < prog.instruction_count; i++) {
+    sdf_instr_t in = prog.instructions[i];
+    constant float* k = prog.constants + in.constants;
+    switch (in.op) {
+      case SDF_OP_BOX:
+        dr[in.dst] = sd_box(pr[in.a] - sdf_offset(k), float3(k[3], k[4], k[5])); break;
+      case SDF_OP_SPHERE:
+        dr[in.dst] = sd_sphere(pr[in.a] - sdf_offset(k), k[3]); break;
+      case SDF_OP_TRI_PRISM:
+        dr[in.dst] = sd_tri_prism(pr[in.a] - sdf_offset(k), float2(k[3], k[4])); break;
+      case SDF_OP_TORUS:
+        dr[in.dst] = sd_torus(pr[in.a] - sdf_offset(k), float2(k[3], k[4])); break;
+      case SDF_OP_PLANE:
+        dr[in.dst] = sd_plane(pr[in.a] - sdf_offset(k), float3(k[3], k[4], k[5]), k[6]); break;
+      case SDF_OP_JOIN:
+        dr[in.dst] = join(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SUBTRACT:
+        dr[in.dst] = subtract(dr[in.a], dr[in.b]); break;
+      case SDF_OP_INTERSECT:
+        dr[in.dst] = intersect(dr[in.a], dr[in.b]); break;
+      case SDF_OP_SMIN:
+        dr[in.dst] = smin(dr[in.a], dr[in.b], k[0]); break;
+      case SDF_OP_TRANSFORM: {
+        float3 q = pr[in.a] - sdf_offset(k);
+        pr[in.dst] = float3(
+          dot(float3(k[3], k[4], k[5]), q),
+          dot(float3(k[6], k[7], k[8]), q),
+          dot(float3(k[9], k[10], k[11]), q)
+        );
+      } break;
+      case SDF_OP_SCALE:
+        dr[in.dst] = dr[in.a] * k[0]; break;
+      default: break;
+    }
+  }
+  return dr[0];
+}
@@ -9,14 +9,18 @@ typedef struct ui_vert_t {
   float4 color;
 } ui_vert_t;
 
-vertex ui_vert_t ui_vs_main(ushort vid [[vertex_id]], 
-                            constant render_vert_t *verts [[buffer(0)]], 
+// Four vertices per instance, as a triangle strip over the rect's corners.
+vertex ui_vert_t ui_vs_main(uint vid [[vertex_id]],
+                            uint iid [[instance_id]],
+                            device const ui_rect_t *rects [[buffer(0)]],
                             constant ui_vs_params_t &vp [[buffer(1)]])
 {
   ui_vert_t o;
-  render_vert_t vert = verts[vid];
-  o.pos = vp.view_matrix * float4(vert.position, 0, 1);
-  o.color = vert.color;
+  ui_rect_t rect = rects[iid];
+  float2 corner = float2(vid & 1, vid >> 1);
+  float2 position = float2(rect.x, rect.y) + corner * float2(rect.w, rect.h);
+  o.pos = vp.view_matrix * float4(position, 0, 1);
+  o.color = unpack_unorm4x8_to_float(rect.color);
   return o;
 }
 